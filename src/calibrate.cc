@@ -0,0 +1,157 @@
+/* This file is part of onnx2c.
+ *
+ * Calibration program for quantization (the '--calibrate' option).
+ * This is the float graph, with entry() recording the value range of
+ * each float tensor it computes. A main() runs it on all inputs of
+ * a directory in the ONNX test data format, and prints the ranges.
+ * That output is then given back to onnx2c with '--quant-ranges'.
+ */
+#include "error.h"
+#include "graph.h"
+#include "options.h"
+
+#include <algorithm>
+#include <fstream>
+
+using namespace toC;
+
+/* The tensors whose ranges are recorded: graph inputs, then node outputs
+ * in the order the nodes are run */
+std::vector<Tensor*> Graph::calibration_tensors(void) const
+{
+	std::vector<Tensor*> ins, outs, rv;
+	interface_tensors(ins, outs);
+	for( auto t : ins )
+		if( t->data_type == onnx::TensorProto_DataType_FLOAT )
+			rv.push_back(t);
+	for( auto n : nodes )
+		for( auto t : n->get_outputs() )
+			if( t->data_type == onnx::TensorProto_DataType_FLOAT && t->is_used() )
+				rv.push_back(t);
+	return rv;
+}
+
+/* Escape a tensor name for a C string literal */
+static std::string c_string(const std::string &s)
+{
+	std::string rv = "\"";
+	for( char c : s ) {
+		if( c == '"' || c == '\\' )
+			rv += '\\';
+		rv += c;
+	}
+	return rv + "\"";
+}
+
+void Graph::print_calibration_recorder(std::ostream &dst)
+{
+	std::vector<Tensor*> tensors = calibration_tensors();
+	dst << "#include <stdio.h>" << std::endl;
+	dst << "static float onnx2c_range_min[" << tensors.size() << "];" << std::endl;
+	dst << "static float onnx2c_range_max[" << tensors.size() << "];" << std::endl;
+	dst << "static const char *onnx2c_range_name[" << tensors.size() << "] = {" << std::endl;
+	for( auto t : tensors )
+		dst << "\t" << c_string(t->name) << "," << std::endl;
+	dst << "};" << std::endl;
+	dst << "static void onnx2c_calibrate(int t, const float *data, uint32_t n)" << std::endl;
+	dst << "{" << std::endl;
+	dst << "\t" << "for( uint32_t i=0; i<n; i++ ) {" << std::endl;
+	dst << "\t\t" << "onnx2c_range_min[t] = MIN(onnx2c_range_min[t], data[i]);" << std::endl;
+	dst << "\t\t" << "onnx2c_range_max[t] = MAX(onnx2c_range_max[t], data[i]);" << std::endl;
+	dst << "\t" << "}" << std::endl;
+	dst << "}" << std::endl;
+	dst << std::endl;
+}
+
+void Graph::print_calibration_record(const std::vector<Tensor*> &recorded, std::ostream &dst) const
+{
+	std::vector<Tensor*> tensors = calibration_tensors();
+	for( auto t : recorded ) {
+		auto pos = std::find(tensors.begin(), tensors.end(), t);
+		if( pos == tensors.end() )
+			continue;
+		dst << "\t" << "onnx2c_calibrate(" << pos - tensors.begin() << ", ";
+		dst << "(const float*)" << t->print_tensor_callsite() << ", " << t->data_num_elem() << ");" << std::endl;
+	}
+}
+
+static bool load_tensor_file(const std::string &filename, onnx::TensorProto &result)
+{
+	std::ifstream f(filename, std::ios::binary);
+	if( !f.good() )
+		return false;
+	if( result.ParseFromIstream(&f) == false )
+		ERROR("Error parsing tensor file " << filename);
+	return true;
+}
+
+void Graph::print_calibration_main(std::ostream &dst)
+{
+	std::vector<Tensor*> ins, outs;
+	interface_tensors(ins, outs);
+
+	// The input data sets. The inputs of a set are given in the order of
+	// the graph inputs, unless the tensor files name them.
+	unsigned num_sets;
+	for( num_sets=0; ; num_sets++ ) {
+		std::string set_dir = options.calibration_dir + "/test_data_set_" + std::to_string(num_sets);
+		std::vector<Tensor*> set(ins.size(), NULL);
+		unsigned i;
+		for( i=0; ; i++ ) {
+			onnx::TensorProto tp;
+			if( load_tensor_file(set_dir + "/input_" + std::to_string(i) + ".pb", tp) == false )
+				break;
+			Tensor *t = new Tensor;
+			t->parse_onnx_tensor(tp);
+			unsigned in_no = i;
+			for( unsigned j=0; j<ins.size(); j++ )
+				if( ins[j]->name == t->name )
+					in_no = j;
+			if( in_no >= ins.size() )
+				ERROR("Calibration input " << set_dir << "/input_" << i << ".pb does not match a graph input");
+			if( t->data_dim != ins[in_no]->data_dim || t->data_type != ins[in_no]->data_type )
+				ERROR("Calibration input " << set_dir << "/input_" << i << ".pb does not match the graph input " << ins[in_no]->name);
+			set[in_no] = t;
+		}
+		if( i == 0 )
+			break;
+		if( std::find(set.begin(), set.end(), nullptr) != set.end() )
+			ERROR("Calibration data set " << set_dir << " does not have all graph inputs");
+
+		for( unsigned i=0; i<set.size(); i++ ) {
+			dst << "static ";
+			set[i]->print_tensor(dst, false, "calibration_set" + std::to_string(num_sets) + "_" + std::to_string(i), true);
+			dst << " = ";
+			set[i]->print_tensor_initializer(dst);
+			dst << ";" << std::endl;
+		}
+	}
+	if( num_sets == 0 )
+		ERROR("No calibration data in " << options.calibration_dir << "/test_data_set_0/");
+
+	for( unsigned o=0; o<outs.size(); o++ ) {
+		dst << "static ";
+		outs[o]->print_tensor(dst, false, "calibration_output_" + std::to_string(o));
+		dst << ";" << std::endl;
+	}
+
+	dst << std::endl;
+	dst << "int main(void)" << std::endl;
+	dst << "{" << std::endl;
+	dst << "\t" << "for( unsigned t=0; t<sizeof(onnx2c_range_min)/sizeof(float); t++ ) {" << std::endl;
+	dst << "\t\t" << "onnx2c_range_min[t] = FLT_MAX;" << std::endl;
+	dst << "\t\t" << "onnx2c_range_max[t] = -FLT_MAX;" << std::endl;
+	dst << "\t" << "}" << std::endl;
+	for( unsigned s=0; s<num_sets; s++ ) {
+		dst << "\t" << entry_name() << "(";
+		for( unsigned i=0; i<ins.size(); i++ )
+			dst << (i ? ", " : "") << "calibration_set" << s << "_" << i;
+		for( unsigned o=0; o<outs.size(); o++ )
+			dst << (ins.size() || o ? ", " : "") << "calibration_output_" << o;
+		dst << ");" << std::endl;
+	}
+	dst << "\t" << "for( unsigned t=0; t<sizeof(onnx2c_range_min)/sizeof(float); t++ )" << std::endl;
+	dst << "\t\t" << "printf(\"%s %.9g %.9g\\n\", onnx2c_range_name[t], onnx2c_range_min[t], onnx2c_range_max[t]);" << std::endl;
+	dst << "\t" << "return 0;" << std::endl;
+	dst << "}" << std::endl;
+}
@@ -0,0 +1,108 @@
+/* This file is part of onnx2c.
+ *
+ * Fast approximations of expf, tanhf, erff and logf.
+ * Sigmoid, Softplus, Elu etc. are built from these.
+ *
+ * Maximum errors against the double precision libm results, over
+ * all finite float inputs (exp: those with a normal result):
+ *  onnx2c_expf   relative 2.6e-7
+ *  onnx2c_tanhf  relative 1.2e-6, absolute 2.2e-7
+ *  onnx2c_erff   relative 1.6e-6, absolute 4.4e-7
+ *  onnx2c_logf   relative 1.8e-7, for positive normal inputs
+ *  1/(1+onnx2c_expf(-x)), i.e. sigmoid: absolute 1.1e-7
+ * Infinities, NaNs and denormals are not handled: exp saturates to FLT_MAX
+ * and FLT_MIN instead of overflowing, and log is exact only for positive
+ * normal inputs.
+ */
+#include "fastmath.h"
+#include "options.h"
+
+#include <map>
+
+std::string math_function(const std::string &name)
+{
+	static const std::map<std::string, std::string> approximated = {
+		{"exp", "onnx2c_expf"}, {"expf", "onnx2c_expf"},
+		{"tanh", "onnx2c_tanhf"}, {"tanhf", "onnx2c_tanhf"},
+		{"erf", "onnx2c_erff"}, {"erff", "onnx2c_erff"},
+		{"log", "onnx2c_logf"}, {"logf", "onnx2c_logf"},
+	};
+	if( options.fastmath == false || approximated.count(name) == 0 )
+		return name;
+	return approximated.at(name);
+}
+
+void print_fastmath_helpers(std::ostream &dst)
+{
+	if( options.fastmath == false )
+		return;
+
+	dst << "/* Fast approximations of libm functions ('--fastmath'). No branches, to vectorize. */" << std::endl;
+	dst << "/* exp(x) = 2^k * exp(r), with r = x - k*ln2 in [-ln2/2, ln2/2]." << std::endl;
+	dst << " * Relative error 2.6e-7. x is clamped to [log(FLT_MIN), log(FLT_MAX)]," << std::endl;
+	dst << " * so the result saturates to normal floats instead of overflowing to inf or 0." << std::endl;
+	dst << " * 2^k is applied in two halves, as 2^128 is not a float. */" << std::endl;
+	dst << "static inline float onnx2c_expf(float x)" << std::endl;
+	dst << "{" << std::endl;
+	dst << "\t" << "x = fminf(fmaxf(x, -87.33654f), 88.72283f);" << std::endl;
+	dst << "\t" << "float k = floorf(x * 1.44269504f + 0.5f);" << std::endl;
+	dst << "\t" << "/* ln2 in two parts, the first exactly multiplied by k */" << std::endl;
+	dst << "\t" << "float r = x - k * 0.693145751953125f;" << std::endl;
+	dst << "\t" << "r = r - k * 1.42860677e-6f;" << std::endl;
+	dst << "\t" << "float p = r * (1.0f/720) + (1.0f/120);" << std::endl;
+	dst << "\t" << "p = p * r + (1.0f/24);" << std::endl;
+	dst << "\t" << "p = p * r + (1.0f/6);" << std::endl;
+	dst << "\t" << "p = p * r + 0.5f;" << std::endl;
+	dst << "\t" << "p = p * r + 1;" << std::endl;
+	dst << "\t" << "p = p * r + 1;" << std::endl;
+	dst << "\t" << "int32_t k1 = (int32_t)k / 2;" << std::endl;
+	dst << "\t" << "int32_t e1 = (k1 + 127) << 23;" << std::endl;
+	dst << "\t" << "int32_t e2 = ((int32_t)k - k1 + 127) << 23;" << std::endl;
+	dst << "\t" << "float scale1, scale2;" << std::endl;
+	dst << "\t" << "memcpy(&scale1, &e1, sizeof(scale1));" << std::endl;
+	dst << "\t" << "memcpy(&scale2, &e2, sizeof(scale2));" << std::endl;
+	dst << "\t" << "return p * scale1 * scale2;" << std::endl;
+	dst << "}" << std::endl;
+	dst << "/* 1 - 2/(exp(2x)+1), with the Taylor series near zero." << std::endl;
+	dst << " * Relative error 1.2e-6. */" << std::endl;
+	dst << "static inline float onnx2c_tanhf(float x)" << std::endl;
+	dst << "{" << std::endl;
+	dst << "\t" << "float x2 = x * x;" << std::endl;
+	dst << "\t" << "float series = x * (1 + x2 * (-1.0f/3 + x2 * (2.0f/15 + x2 * (-17.0f/315))));" << std::endl;
+	dst << "\t" << "float t = 1 - 2 / (onnx2c_expf(2 * x) + 1);" << std::endl;
+	dst << "\t" << "return fabsf(x) < 0.125f ? series : t;" << std::endl;
+	dst << "}" << std::endl;
+	dst << "/* Abramowitz & Stegun 7.1.26, with the Taylor series near zero." << std::endl;
+	dst << " * Absolute error 4.4e-7, relative 1.6e-6. */" << std::endl;
+	dst << "static inline float onnx2c_erff(float x)" << std::endl;
+	dst << "{" << std::endl;
+	dst << "\t" << "float a = fabsf(x);" << std::endl;
+	dst << "\t" << "float x2 = x * x;" << std::endl;
+	dst << "\t" << "float series = x * 1.12837917f * (1 + x2 * (-1.0f/3 + x2 * (1.0f/10 + x2 * (-1.0f/42 + x2 * (1.0f/216)))));" << std::endl;
+	dst << "\t" << "float t = 1 / (1 + 0.3275911f * a);" << std::endl;
+	dst << "\t" << "float p = t * (0.254829592f + t * (-0.284496736f + t * (1.421413741f + t * (-1.453152027f + t * 1.061405429f))));" << std::endl;
+	dst << "\t" << "float y = copysignf(1 - p * onnx2c_expf(-x2), x);" << std::endl;
+	dst << "\t" << "return a < 0.25f ? series : y;" << std::endl;
+	dst << "}" << std::endl;
+	dst << "/* log(x) = e*ln2 + log(m), with m in [sqrt(1/2), sqrt(2)) and" << std::endl;
+	dst << " * log(m) = 2*atanh((m-1)/(m+1)). Relative error 1.8e-7, for positive" << std::endl;
+	dst << " * normal x. -inf for zero, NaN for negative x. */" << std::endl;
+	dst << "static inline float onnx2c_logf(float x)" << std::endl;
+	dst << "{" << std::endl;
+	dst << "\t" << "uint32_t bits;" << std::endl;
+	dst << "\t" << "memcpy(&bits, &x, sizeof(bits));" << std::endl;
+	dst << "\t" << "int32_t e = (int32_t)((bits >> 23) & 0xff) - 127;" << std::endl;
+	dst << "\t" << "bits = (bits & 0x007fffff) | 0x3f800000;" << std::endl;
+	dst << "\t" << "float m;" << std::endl;
+	dst << "\t" << "memcpy(&m, &bits, sizeof(m));" << std::endl;
+	dst << "\t" << "int32_t big = m > 1.41421356f;" << std::endl;
+	dst << "\t" << "m = big ? m * 0.5f : m;" << std::endl;
+	dst << "\t" << "e += big;" << std::endl;
+	dst << "\t" << "float f = m - 1;" << std::endl;
+	dst << "\t" << "float s = f / (2 + f);" << std::endl;
+	dst << "\t" << "float s2 = s * s;" << std::endl;
+	dst << "\t" << "float p = s2 * (1.0f/3 + s2 * (1.0f/5 + s2 * (1.0f/7 + s2 * (1.0f/9))));" << std::endl;
+	dst << "\t" << "float y = e * 0.693147181f + 2 * s + 2 * s * p;" << std::endl;
+	dst << "\t" << "return x > 0 ? y : (x == 0 ? -INFINITY : NAN);" << std::endl;
+	dst << "}" << std::endl;
+}
@@ -0,0 +1,19 @@
+/* This file is part of onnx2c.
+ *
+ * Fast approximations of the transcendental float functions
+ * (the '--fastmath' option). They are printed as static inline C
+ * functions, without branches, so compilers can vectorize the
+ * loops calling them.
+ */
+#pragma once
+#include <iostream>
+#include <string>
+
+/* Name of the C function to call for the libm function 'name'
+ * (e.g. "expf" or "tanh"). With '--fastmath', those with an
+ * approximation give the name of the approximating function.
+ * Others are returned as is. */
+std::string math_function(const std::string &name);
+
+/* Print the approximating functions, when requested. */
+void print_fastmath_helpers(std::ostream &dst);
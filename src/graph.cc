@@ -3,9 +3,12 @@
 #include "graph.h"
 #include "onnx.pb.h"
 #include "options.h"
+#include "quantization.h"
 
 #include "aixlog.hpp"
+#include <algorithm>
 #include <iostream>
+#include <set>
 
 
 using namespace toC;
@@ -15,14 +18,76 @@ int Graph::anonymous_nodes=0;
 
 Graph::Graph(
 	onnx::ModelProto &onnx_model,
-	std::vector<Tensor*> ext_inputs
+	std::vector<Tensor*> ext_inputs,
+	const std::string &variant
 	)
-	:model(onnx_model)
+	:model(onnx_model), variant(variant)
 {
 
 	processGraph(onnx_model, ext_inputs);
 }
 
+/* Prefix the names of all nodes and non-initializer tensors in the
+ * model with the variant name, so that several shape variants of the
+ * same model can be generated into one source file. Initializers keep
+ * their names, and are shared between the variants.
+ * With 'rename_initializers', for different models in one source file,
+ * the initializers are prefixed too. */
+void Graph::rename_for_variant(onnx::ModelProto &onnx_model, const std::string &variant, bool rename_initializers)
+{
+	onnx::GraphProto *g = onnx_model.mutable_graph();
+	std::set<std::string> initializers;
+	if( rename_initializers )
+		for( auto &i : *g->mutable_initializer() )
+			i.set_name(variant + "_" + i.name());
+	else
+		for( auto &i : g->initializer() )
+			initializers.insert(i.name());
+
+	auto rename = [&](std::string *name) {
+		if( *name == "" || initializers.count(*name) )
+			return;
+		*name = variant + "_" + *name;
+	};
+
+	for( auto &i : *g->mutable_input() )
+		rename(i.mutable_name());
+	for( auto &o : *g->mutable_output() )
+		rename(o.mutable_name());
+	for( auto &vi : *g->mutable_value_info() )
+		rename(vi.mutable_name());
+	for( auto &n : *g->mutable_node() ) {
+		rename(n.mutable_name());
+		for( auto &i : *n.mutable_input() )
+			rename(&i);
+		for( auto &o : *n.mutable_output() )
+			rename(&o);
+	}
+}
+
+/* The name of the tensor as in the original, un-prefixed model */
+std::string Graph::unvariant_name(const Tensor *t) const
+{
+	if( variant == "" )
+		return t->name;
+	return t->name.substr(variant.size()+1);
+}
+
+std::string Graph::entry_name(void) const
+{
+	if( variant == "" )
+		return "entry";
+	return "entry_" + variant;
+}
+
+bool Graph::is_initializer(const Tensor *t) const
+{
+	for( auto &i : model.graph().initializer() )
+		if( i.name() == t->name )
+			return true;
+	return false;
+}
+
 void Graph::processGraph(
 	onnx::ModelProto &onnx_model,
 	std::vector<Tensor*> ext_inputs
@@ -145,6 +210,8 @@ Tensor* Graph::getIoTensor(onnx::ValueInfoProto &vi)
 	// TODO: this is a bit coarse
 	if( options.quantize )
 		t->data_type = onnx::TensorProto_DataType_INT8;
+	if( quantization_calibrated() )
+		t->quant_scales = { quant_scale_from_range(t->name) };
 
 	for( onnx::TensorShapeProto_Dimension d : tsp.dim() ) {
 
@@ -154,7 +221,16 @@ Tensor* Graph::getIoTensor(onnx::ValueInfoProto &vi)
 		// is the string representation of value (i.e. "1=1").
 		// Onnx2c doesn't allow variable batch sizes, so if no value is given, use 1.
 		int dim_size;
-		if( isalpha(d.dim_param()[0]) ) {
+		if( isalpha(d.dim_param()[0]) && options.runtime_dims.count(d.dim_param()) ) {
+			// The dimension is variable at run time. Allocate for the
+			// maximum size, and let the nodes loop up to the run time value.
+			if( t->data_dim.size() != 0 )
+				ERROR("Unimplemented: run time variable dimension " << d.dim_param() << " is not the outermost dimension of tensor " << t->name);
+			dim_size = options.runtime_dims[d.dim_param()];
+			t->runtime_dim = d.dim_param();
+			LOG(DEBUG) << "Graph input tensor dimension (" << d.dim_param() << ") is variable at run time, maximum " << dim_size << std::endl;
+		}
+		else if( isalpha(d.dim_param()[0]) ) {
 			if( d.dim_value() ) {
 				dim_size=d.dim_value();
 			}
@@ -245,7 +321,8 @@ bool Graph::tryResolveNode(onnx::NodeProto &node)
 	std::string new_node = node.op_type();
 	if( options.quantize ) {
 		replaceWithQuantized(inputs);
-		if( new_node == "Conv" )
+		// With calibration, Conv handles quantized data itself, including its bias
+		if( new_node == "Conv" && quantization_calibrated() == false )
 			new_node = "ConvInteger";
 		if( new_node == "MatMul" )
 			new_node = "MatMulInteger";
@@ -300,6 +377,7 @@ bool Graph::tryResolveNode(onnx::NodeProto &node)
 
 	// Configure Node internals, and populate its outputs vector.
 	n->resolve();
+	resolveRuntimeDims(n);
 
 	// Add the output tensors the resolve() generated to the graph's list of tensors.
 	// This will now contain all of the node's outputs, also such optional ones
@@ -327,6 +405,8 @@ bool Graph::tryResolveNode(onnx::NodeProto &node)
 
 		addTensor(t);
 	}
+	if( quantization_calibrated() )
+		setQuantScales(n);
 	LOG(DEBUG) << "    outputs: " << std::endl;
 	for( auto o : n->get_outputs())
 		LOG(DEBUG) << "         " << o->name << " - "<< o->data_type_str() << " { " << o->str_dimensions() << "}" << std::endl;
@@ -337,6 +417,63 @@ bool Graph::tryResolveNode(onnx::NodeProto &node)
 }
 
 
+/* Nodes that only move or select their input's values give outputs
+ * at the input's scale. Other outputs take the calibrated scale. */
+void Graph::setQuantScales(Node *n)
+{
+	static const std::set<std::string> scale_preserving = {
+		"Dropout", "Flatten", "Identity", "MaxPool", "Relu",
+		"Reshape", "Squeeze", "Transpose", "Unsqueeze"
+	};
+
+	for( auto t : n->get_outputs() ) {
+		if( t->data_type != onnx::TensorProto_DataType_INT8 || t->is_used() == false )
+			continue;
+		if( scale_preserving.count(n->op_name) )
+			t->quant_scales = n->inputs[0]->quant_scales;
+		else
+			t->quant_scales = { quant_scale_from_range(t->name) };
+	}
+}
+
+/* Propagate the run time variable dimension from node inputs to
+ * node outputs. Only nodes that have been written to loop over
+ * a variable outermost dimension can take such inputs. */
+void Graph::resolveRuntimeDims(Node *n)
+{
+	std::string runtime_dim = "";
+	for( auto i : n->inputs ) {
+		if( i->runtime_dim == "" )
+			continue;
+		if( runtime_dim != "" && runtime_dim != i->runtime_dim )
+			ERROR("Unimplemented: node " << n->onnx_name << " has inputs with different run time variable dimensions");
+		runtime_dim = i->runtime_dim;
+	}
+	if( runtime_dim == "" )
+		return;
+
+	if( n->handles_runtime_dim() == false )
+		ERROR("Unimplemented: node " << n->onnx_name << " (" << n->op_name << ") with run time variable dimension " << runtime_dim << " as input");
+
+	for( auto o : n->get_outputs() )
+		o->runtime_dim = runtime_dim;
+}
+
+/* Names of the run time variable dimensions, in the order
+ * they are first used in the graph inputs */
+std::vector<std::string> Graph::runtime_dims(void) const
+{
+	std::vector<std::string> rv;
+	for( auto i : model.graph().input() ) {
+		Tensor *t = findTensor(i.name());
+		if( t == NULL || t->runtime_dim == "" )
+			continue;
+		if( std::find(rv.begin(), rv.end(), t->runtime_dim) == rv.end() )
+			rv.push_back(t->runtime_dim);
+	}
+	return rv;
+}
+
 bool Graph::hasUnresolvedNodes(void)
 {
 	return model.graph().node_size() > (int)nodes.size();
@@ -355,6 +492,7 @@ int64_t Graph::onnx_ir_version(void)
 	return version;
 }
 
+#include "nodes/attention.h"
 #include "nodes/averagepool.h"
 #include "nodes/batchnormalization.h"
 #include "nodes/cast.h"
@@ -365,6 +503,7 @@ int64_t Graph::onnx_ir_version(void)
 #include "nodes/conv.h"
 #include "nodes/convinteger.h"
 #include "nodes/convtranspose.h"
+#include "nodes/dequantizelinear.h"
 #include "nodes/dropout.h"
 #include "nodes/dynamicquantizelinear.h"
 #include "nodes/elementwise.h"
@@ -383,6 +522,9 @@ int64_t Graph::onnx_ir_version(void)
 #include "nodes/multithreshold.h"
 #include "nodes/maxpool.h"
 #include "nodes/pad.h"
+#include "nodes/qlinearconv.h"
+#include "nodes/qlinearmatmul.h"
+#include "nodes/quantizelinear.h"
 #include "nodes/range.h"
 #include "nodes/relu.h"
 #include "nodes/reshape.h"
@@ -425,6 +567,7 @@ Node* Graph::createNode(std::string opName)
 	if( opName == "Cosh" )return new Elementwise("Cosh");
 	if( opName == "ConvInteger" )return new ConvInteger;
 	if( opName == "ConvTranspose" )return new ConvTranspose;
+	if( opName == "DequantizeLinear" )return new DequantizeLinear;
 	if( opName == "Div" )return new Elementwise_2("Div");
 	if( opName == "Dropout" )return new Dropout;
 	if( opName == "DynamicQuantizeLinear" )return new DynamicQuantizeLinear;
@@ -463,6 +606,9 @@ Node* Graph::createNode(std::string opName)
 	if( opName == "Pad" )return new Pad;
 	if( opName == "Pow" )return new Elementwise_2("Pow");
 	if( opName == "PRelu" )return new Elementwise_2("PRelu");
+	if( opName == "QLinearConv" )return new QLinearConv;
+	if( opName == "QLinearMatMul" )return new QLinearMatMul;
+	if( opName == "QuantizeLinear" )return new QuantizeLinear;
 	if( opName == "Range" )return new Range;
 	if( opName == "Reciprocal" )return new Elementwise("Reciprocal");
 	if( opName == "Relu" )return new Relu;
@@ -493,6 +639,7 @@ Node* Graph::createNode(std::string opName)
 	if( opName == "Upsample" )return new Upsample;
 	if( opName == "Xor" )return new Elementwise_2("Xor");
 	if( opName == "MultiThreshold" )return new MultiThreshold;
+	if( opName == "FusedAttention" )return new FusedAttention;
 	if( opName == "Im2Col" )return new Im2Col;
 	if( opName == "TopK" )return new TopK;
     if( opName == "QuantAvgPool2d" )return new QuantAvgPool2d;
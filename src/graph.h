@@ -14,9 +14,21 @@ class Graph {
 public:
 	Graph(
 		onnx::ModelProto &onnx_model,
-		std::vector<Tensor*> inputs={}
+		std::vector<Tensor*> inputs={},
+		const std::string &variant=""
 	);
 
+	/* Shape specialized variants of a model. Each variant is a separate
+	 * Graph, built from a copy of the model renamed with rename_for_variant() */
+	static void rename_for_variant(onnx::ModelProto &onnx_model, const std::string &variant, bool rename_initializers=false);
+	static void print_variants_source(const std::vector<Graph*> &graphs, std::ostream &destination);
+	/* Several models into one source file. Each is renamed with rename_for_variant(),
+	 * initializers included, and has its own entry_<name>(). The initializers that
+	 * dedup_initializers() finds in more than one model are printed once. */
+	static void print_models_source(const std::vector<Graph*> &graphs, std::ostream &destination);
+	static void print_graphs_source(const std::vector<Graph*> &graphs, std::ostream &destination);
+	std::string entry_name(void) const;
+
 	/* print the entire .h and .cc file contents */
 	void print_header(std::ostream &destination);
 	void print_source(std::ostream &destination);
@@ -25,9 +37,22 @@ public:
 	void print_file_frontmatter(std::ostream &destination);
 	void print_global_tensors(std::ostream &destination);
 	void print_tensor(const Tensor *, std::ostream &dst);
+	static void print_union_variable(unsigned u, std::ostream &dst);
 	void print_functions(std::ostream &destination);
+	static void print_function(const Node *n, std::ostream &destination);
 	void print_includes(std::ostream &dst);
+	void print_packing_helpers(std::ostream &dst);
 	void print_interface_function(std::ostream &dst);
+	void print_runtime_dims(std::ostream &dst);
+	/* Streaming state (the '--stream' option) */
+	void print_state_variables(std::ostream &dst);
+	void print_state_functions(std::ostream &dst);
+	static void print_variant_dispatch(const std::vector<Graph*> &graphs, std::ostream &dst);
+	/* Calibration program (the '--calibrate' option) */
+	void print_calibration_recorder(std::ostream &dst);
+	void print_calibration_record(const std::vector<Tensor*> &recorded, std::ostream &dst) const;
+	void print_calibration_main(std::ostream &dst);
+	void print_quantized_io_scales(std::ostream &dst);
 
 	/* Create the onnx2c graph elements from the ONNX graph */
 	void processGraph(
@@ -40,6 +65,65 @@ public:
 	 * unions. This make the memory buffers time shared. */
 	void unionize_tensors(void);
 
+	/* Optimization step, run on the ONNX model before the Graph is made:
+	 * replace DequantizeLinear -> node -> QuantizeLinear sandwiches of
+	 * quantized models with integer nodes */
+	static void fuse_qdq(onnx::ModelProto &onnx_model);
+
+	/* Optimization step, run on the ONNX model before the Graph is made:
+	 * fuse MatMuls with constant weights into the MultiThreshold that
+	 * follows them */
+	static void fuse_thresholds(onnx::ModelProto &onnx_model);
+
+	/* Optimization step, run on the ONNX models before the Graphs are made:
+	 * share the initializers that are identical, within and across models */
+	static void dedup_initializers(const std::vector<onnx::ModelProto*> &models);
+
+	/* Optimization step, run on the ONNX model before the Graph is made:
+	 * replace MatMul -> Softmax -> MatMul attention blocks with a node
+	 * that does not store the whole score tensor */
+	static void fuse_attention(onnx::ModelProto &onnx_model);
+
+	/* Optimization step, run on the ONNX model before the Graph is made:
+	 * remove Softmaxes of which only the index of the largest value is used */
+	static void skip_softmax(onnx::ModelProto &onnx_model);
+
+	/* Optimization step: run MultiThresholds on integers, with integer
+	 * thresholds and outputs, where the values allow it */
+	void integer_thresholds(void);
+
+	/* Optimization step: lay out the constant weights of LSTMs for
+	 * their kernel, R with the gates interleaved and B as Wb+Rb */
+	void prepack_lstm(void);
+
+	/* Optimization step: restrict qualify node function parameters
+	 * that are proven not to overlap with other parameters */
+	void mark_restrict_params(void);
+
+	/* Optimization step: write small constant weights into the code
+	 * of the nodes using them ('--inline-weights') */
+	void inline_weights(void);
+
+	/* Optimization step: store constant weights that are mostly zeros
+	 * as only their nonzero values ('--sparse') */
+	void sparse_weights(void);
+
+	/* Optimization step: store constant weights that are 4 bit or
+	 * bipolar integers packed into bytes ('--pack-weights') */
+	void pack_weights(void);
+
+	/* Optimization step: store constant float weights as float16 or
+	 * bfloat16 ('--weights'). Calculation is still in float. */
+	void store_weights_16bit(void);
+
+	/* Optimization step: run the first layers from the graph input
+	 * depth first, over bands of rows ('--tile') */
+	void tile_layers(void);
+
+	/* Optimization step: order the nodes for the least memory alive
+	 * at a time, before unionize_tensors() */
+	void schedule_nodes(void);
+
 	void addInitializedTensor(onnx::TensorProto &tensor);
 	Tensor* getIoTensor(onnx::ValueInfoProto &vi);
 
@@ -47,6 +131,8 @@ public:
 	bool getNodeInputTensors(const onnx::NodeProto &node, std::vector<Tensor*> &inputs);
 
 	bool tryResolveNode(onnx::NodeProto &node);
+	void resolveRuntimeDims(Node *n);
+	std::vector<std::string> runtime_dims(void) const;
 	bool hasUnresolvedNodes(void);
 	Node* createNode(std::string opName);
 
@@ -62,6 +148,14 @@ private:
 	std::vector<Node*> nodes;
 	// Should onnx2c print debug info while compiling
 	bool verbose_mode;
+	// Name of the shape variant this graph is. Empty if not generating variants.
+	std::string variant;
+	std::string unvariant_name(const Tensor *t) const;
+	bool is_initializer(const Tensor *t) const;
+	void interface_tensors(std::vector<Tensor*> &ins, std::vector<Tensor*> &outs) const;
+	std::vector<Tensor*> calibration_tensors(void) const;
+	/* Set the scales of the quantized outputs of node 'n' */
+	void setQuantScales(Node *n);
 
 	/* Add new tensor to set of known tensors.
 	 * If the tensor is not already known (checked by name),
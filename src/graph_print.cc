@@ -2,11 +2,17 @@
  */
 
 #include "error.h"
+#include "fastmath.h"
 #include "graph.h"
 #include "options.h"
+#include "quantization.h"
+#include "simd.h"
 #include "util.h"
 
+#include <algorithm>
 #include <iostream>
+#include <map>
+#include <set>
 
 using namespace toC;
 
@@ -21,11 +27,22 @@ void Graph::print_source(std::ostream &dst)
 	dst << std::endl;
 	print_includes(dst);
 	dst << std::endl;
+	print_runtime_dims(dst);
 	print_global_tensors(dst);
 	dst << std::endl;
+	print_state_variables(dst);
 	print_functions(dst);
 	dst << std::endl;
+	if( options.calibration_dir != "" )
+		print_calibration_recorder(dst);
+	if( quantization_calibrated() )
+		print_quantized_io_scales(dst);
 	print_interface_function(dst);
+	print_state_functions(dst);
+	if( options.calibration_dir != "" ) {
+		dst << std::endl;
+		print_calibration_main(dst);
+	}
 }
 
 
@@ -59,10 +76,18 @@ void Graph::print_tensor(const Tensor *t, std::ostream &dst)
 		return;
 	}
 
+	if( t->pack_bits == 16 )
+		dst << "/* " << t->cname() << " stored as " << (t->pack_bfloat16 ? "bfloat16" : "float16")
+		    << ". " << t->rounding_error() << " */" << std::endl;
+	if( t->sparse_axis >= 0 )
+		dst << "/* " << t->cname() << " stored sparse: the " << t->nonzero_count() << " nonzero of "
+		    << t->data_num_elem() << " elements */" << std::endl;
 	if( t->union_no < 0 )
 		dst << "static ";
 
 	t->print_tensor(dst);
+	if( options.opt_align && t->union_no < 0 )
+		dst << " __attribute__((aligned(" << TENSOR_ALIGNMENT << ")))";
 	if( t->initialize ) {
 		if( options.target_avr && t->isConst )
 			dst << " PROGMEM";
@@ -90,23 +115,40 @@ void Graph::print_global_tensors(std::ostream &dst)
 				print_tensor(t, dst);
 		}
 		dst << "};" <<std::endl;
-		dst << "static union tensor_union_" << u << " tu" << u << ";" << std::endl <<std::endl;
+		print_union_variable(u, dst);
 	}
 }
 
-void Graph::print_functions(std::ostream &dst)
+void Graph::print_union_variable(unsigned u, std::ostream &dst)
 {
-	for( auto n : nodes ) {
-		dst << "static inline void ";
-		dst << n->c_name() << "( ";
-		n->print_function_parameters_definition(dst);
-		dst << " )";
-		dst <<  std::endl << "{" << std::endl;
+	dst << "static union tensor_union_" << u << " tu" << u;
+	if( options.opt_align )
+		dst << " __attribute__((aligned(" << TENSOR_ALIGNMENT << ")))";
+	dst << ";" << std::endl <<std::endl;
+}
 
-		n->print(dst);
+void Graph::print_function(const Node *n, std::ostream &dst)
+{
+	for( auto s : n->sub_nodes() )
+		print_function(s, dst);
 
-		dst << "}" << std::endl << std::endl;
-	}
+	dst << "static inline void ";
+	dst << n->c_name() << "( ";
+	n->print_function_parameters_definition(dst);
+	dst << " )";
+	dst <<  std::endl << "{" << std::endl;
+	if( options.opt_align )
+		n->print_assume_aligned(dst);
+
+	n->print(dst);
+
+	dst << "}" << std::endl << std::endl;
+}
+
+void Graph::print_functions(std::ostream &dst)
+{
+	for( auto n : nodes )
+		print_function(n, dst);
 }
 
 void Graph::print_includes(std::ostream &dst)
@@ -121,31 +163,210 @@ void Graph::print_includes(std::ostream &dst)
 	dst << "#define MIN(X,Y) ( X < Y ? X : Y)" << std::endl;
 	dst << "#define CLIP(X,L) ( MAX(MIN(X,L), -L) )" << std::endl;
 
+	// 16 bit floats: native types where the compiler has them, float otherwise.
+	// Calculation is in float anyway: the kernels sum in float.
+	bool float16 = false, bfloat16 = false;
+	for( auto t : tensors ) {
+		float16 |= t->data_type == onnx::TensorProto_DataType_FLOAT16;
+		bfloat16 |= t->data_type == onnx::TensorProto_DataType_BFLOAT16;
+	}
+	if( float16 ) {
+		dst << "#if defined(__FLT16_MANT_DIG__) && !defined(ONNX2C_FLOAT16_AS_FLOAT)" << std::endl;
+		dst << "typedef _Float16 onnx2c_float16;" << std::endl;
+		dst << "#else" << std::endl;
+		dst << "typedef float onnx2c_float16;" << std::endl;
+		dst << "#endif" << std::endl;
+	}
+	if( bfloat16 ) {
+		dst << "#if defined(__BFLT16_MANT_DIG__) && !defined(ONNX2C_BFLOAT16_AS_FLOAT)" << std::endl;
+		dst << "typedef __bf16 onnx2c_bfloat16;" << std::endl;
+		dst << "#else" << std::endl;
+		dst << "typedef float onnx2c_bfloat16;" << std::endl;
+		dst << "#endif" << std::endl;
+	}
+
 	if( options.target_avr ) {
 		dst << "#include <avr/pgmspace.h>" << std::endl;
 		dst << "#define RD_PROGMEM(x) pgm_read_byte(&(x));" << std::endl;
 	}
+
+	if( options.opt_restrict ) {
+		dst << "#ifdef __cplusplus" << std::endl;
+		dst << "#define RESTRICT __restrict__" << std::endl;
+		dst << "#else" << std::endl;
+		dst << "#define RESTRICT restrict" << std::endl;
+		dst << "#endif" << std::endl;
+	}
+
+	print_simd_includes(dst);
+	print_fastmath_helpers(dst);
+	// Nodes of models that come already quantized requantize with zero points
+	bool zero_point_helpers = false;
+	for( auto n : nodes )
+		if( n->op_name == "QLinearConv" || n->op_name == "QLinearMatMul" )
+			zero_point_helpers = true;
+	print_quantization_helpers(dst, zero_point_helpers);
+	print_packing_helpers(dst);
 }
 
-void Graph::print_interface_function(std::ostream &dst)
+/* Unpacking of the weights stored packed by the 'pack_weights' pass */
+void Graph::print_packing_helpers(std::ostream &dst)
+{
+	bool packed = false;
+	bool halves = false;
+	for( auto t : tensors ) {
+		if( t->pack_bits == 16 )
+			halves = true;
+		else if( t->pack_bits )
+			packed = true;
+	}
+
+	// RD_PROGMEM() brings its own semicolon
+	auto read_byte = [](const std::string &idx) -> std::string {
+		if( options.target_avr )
+			return "RD_PROGMEM(p[" + idx + "])";
+		return "p[" + idx + "];";
+	};
+	if( halves ) {
+		// Widened to float by moving the bits. Weights are finite, so
+		// only the subnormals of IEEE half need more.
+		dst << "static inline float onnx2c_fp16(const uint8_t *p, uint32_t i)" << std::endl;
+		dst << "{" << std::endl;
+		dst << "\t" << "uint8_t lo = " << read_byte("2*i") << std::endl;
+		dst << "\t" << "uint8_t hi = " << read_byte("2*i+1") << std::endl;
+		dst << "\t" << "uint32_t sign = (uint32_t)(hi & 0x80) << 24;" << std::endl;
+		dst << "\t" << "uint32_t e = (hi >> 2) & 0x1f;" << std::endl;
+		dst << "\t" << "uint32_t m = (uint32_t)(hi & 3) << 8 | lo;" << std::endl;
+		dst << "\t" << "float f;" << std::endl;
+		dst << "\t" << "if( e == 0 ) {" << std::endl;
+		dst << "\t\t" << "f = m * (1.0f / 16777216);" << std::endl;
+		dst << "\t\t" << "return sign ? -f : f;" << std::endl;
+		dst << "\t" << "}" << std::endl;
+		dst << "\t" << "uint32_t b = sign | (e + 112) << 23 | m << 13;" << std::endl;
+		dst << "\t" << "memcpy(&f, &b, 4);" << std::endl;
+		dst << "\t" << "return f;" << std::endl;
+		dst << "}" << std::endl;
+		dst << "static inline float onnx2c_bf16(const uint8_t *p, uint32_t i)" << std::endl;
+		dst << "{" << std::endl;
+		dst << "\t" << "uint8_t lo = " << read_byte("2*i") << std::endl;
+		dst << "\t" << "uint8_t hi = " << read_byte("2*i+1") << std::endl;
+		dst << "\t" << "uint32_t b = ((uint32_t)hi << 24) | ((uint32_t)lo << 16);" << std::endl;
+		dst << "\t" << "float f;" << std::endl;
+		dst << "\t" << "memcpy(&f, &b, 4);" << std::endl;
+		dst << "\t" << "return f;" << std::endl;
+		dst << "}" << std::endl;
+	}
+	if( packed == false )
+		return;
+
+	dst << "static inline int8_t onnx2c_int4(const uint8_t *p, uint32_t i)" << std::endl;
+	dst << "{" << std::endl;
+	dst << "\tuint8_t b = " << read_byte("i/2") << std::endl;
+	dst << "\tint8_t v = i%2 ? b>>4 : b&15;" << std::endl;
+	dst << "\treturn v > 7 ? v-16 : v;" << std::endl;
+	dst << "}" << std::endl;
+	dst << "static inline int8_t onnx2c_bipolar(const uint8_t *p, uint32_t i)" << std::endl;
+	dst << "{" << std::endl;
+	dst << "\tuint8_t b = " << read_byte("i/8") << std::endl;
+	dst << "\treturn (b >> (i%8)) & 1 ? 1 : -1;" << std::endl;
+	dst << "}" << std::endl;
+	dst << "static inline uint8_t onnx2c_popcount8(uint8_t x)" << std::endl;
+	dst << "{" << std::endl;
+	dst << "\tx = x - ((x >> 1) & 0x55);" << std::endl;
+	dst << "\tx = (x & 0x33) + ((x >> 2) & 0x33);" << std::endl;
+	dst << "\treturn (x + (x >> 4)) & 0x0f;" << std::endl;
+	dst << "}" << std::endl;
+}
+
+/* Run time variable dimensions are global variables, set at the start
+ * of entry(). Initialize them to the maximum size. */
+void Graph::print_runtime_dims(std::ostream &dst)
+{
+	std::vector<std::string> dims = runtime_dims();
+	for( auto d : dims )
+		dst << "static uint32_t " << runtime_dim_cname(d) << " = " << options.runtime_dims[d] << ";" << std::endl;
+	if( dims.size() )
+		dst << std::endl;
+}
+
+/* With '--stream', the variables the nodes keep between calls to entry().
+ * They start at their initial values, as after reset_state(). */
+void Graph::print_state_variables(std::ostream &dst)
+{
+	if( options.stream == false )
+		return;
+	bool first = true;
+	for( auto n : nodes )
+		for( auto &v : n->state_variables() ) {
+			if( first )
+				dst << "/* State kept between calls to " << entry_name() << "() */" << std::endl;
+			first = false;
+			dst << "static " << v.shape->print_tensor(v.name);
+			if( v.initial ) {
+				dst << " = " << std::endl;
+				v.initial->print_tensor_initializer(dst);
+			}
+			dst << ";" << std::endl;
+		}
+	if( first )
+		LOG(WARNING) << "Streaming, but the graph has no nodes that keep state" << std::endl;
+	else
+		dst << std::endl;
+}
+
+/* reset_state() sets the state to its initial values.
+ * get_state() and set_state() copy all of it to and from a buffer, to
+ * e.g. switch between streams. */
+void Graph::print_state_functions(std::ostream &dst)
+{
+	if( options.stream == false )
+		return;
+	std::vector<Node::state_variable> vars;
+	for( auto n : nodes )
+		for( auto &v : n->state_variables() )
+			vars.push_back(v);
+	if( vars.size() == 0 )
+		return;
+
+	std::vector<int> sizes;
+	int total = 0;
+	for( auto &v : vars ) {
+		sizes.push_back(v.shape->data_num_elem() * v.shape->data_elem_size());
+		total += sizes.back();
+	}
+
+	dst << std::endl << "void reset_state(void) {" << std::endl;
+	for( unsigned i=0; i<vars.size(); i++ ) {
+		if( vars[i].initial )
+			dst << "\t" << "memcpy(" << vars[i].name << ", " << vars[i].initial->cname() << ", " << sizes[i] << ");" << std::endl;
+		else
+			dst << "\t" << "memset(" << vars[i].name << ", 0, " << sizes[i] << ");" << std::endl;
+	}
+	dst << "}" << std::endl << std::endl;
+
+	dst << "/* The state is " << total << " bytes */" << std::endl;
+	dst << "void get_state(void *state) {" << std::endl;
+	for( unsigned i=0, offset=0; i<vars.size(); offset+=sizes[i], i++ )
+		dst << "\t" << "memcpy((char*)state + " << offset << ", " << vars[i].name << ", " << sizes[i] << ");" << std::endl;
+	dst << "}" << std::endl << std::endl;
+
+	dst << "void set_state(const void *state) {" << std::endl;
+	for( unsigned i=0, offset=0; i<vars.size(); offset+=sizes[i], i++ )
+		dst << "\t" << "memcpy(" << vars[i].name << ", (const char*)state + " << offset << ", " << sizes[i] << ");" << std::endl;
+	dst << "}" << std::endl;
+}
+
+/* The tensors passed as parameters to the interface function */
+void Graph::interface_tensors(std::vector<Tensor*> &ins, std::vector<Tensor*> &outs) const
 {
-	bool isfirst = true;
-	// TODO: take the interface function name from the ONNX file name
-	dst << "void entry(" ;
 	for ( auto i : model.graph().input() ) {
 		/* TODO: FIXME: separate input tensors that are initialized
 		 * or re-initializable (and therefore count as input), from
 		 * the "actual" input data */
 		Tensor *t=findTensor(i.name());
 
-		if( t && t->isIO ) {
-			if(!isfirst)
-				dst << ", ";
-			else
-				isfirst = false;
-
-			t->print_tensor_as_const(dst);
-		}
+		if( t && t->isIO )
+			ins.push_back(t);
 	}
 
 	for ( auto i : model.graph().output() ) {
@@ -153,17 +374,63 @@ void Graph::print_interface_function(std::ostream &dst)
 		 * inputs are handled */
 		Tensor *t = findTensor(i.name());
 
-		if( t ) {
-			if(!isfirst)
-				dst << ", ";
-			else
-				isfirst = false;
-			t->print_tensor(dst);
-		}
+		if( t )
+			outs.push_back(t);
+	}
+}
+
+/* The user of a graph quantized with calibration needs to know the
+ * scales to quantize the inputs and dequantize the outputs with. */
+void Graph::print_quantized_io_scales(std::ostream &dst)
+{
+	std::vector<Tensor*> ins, outs;
+	interface_tensors(ins, outs);
+	dst << "/* Quantized graph inputs and outputs. Their real values are value*scale." << std::endl;
+	for( auto t : ins )
+		dst << " * " << t->cname() << ": scale " << t->quant_scale() << std::endl;
+	for( auto t : outs )
+		dst << " * " << t->cname() << ": scale " << t->quant_scale() << std::endl;
+	dst << " */" << std::endl;
+}
+
+void Graph::print_interface_function(std::ostream &dst)
+{
+	bool isfirst = true;
+	std::vector<std::string> dims = runtime_dims();
+	std::vector<Tensor*> ins, outs;
+	interface_tensors(ins, outs);
+
+	// TODO: take the interface function name from the ONNX file name
+	dst << "void " << entry_name() << "(" ;
+	for( auto d : dims ) {
+		if(!isfirst)
+			dst << ", ";
+		else
+			isfirst = false;
+		dst << "uint32_t " << cify_name(d);
+	}
+	for( auto t : ins ) {
+		if(!isfirst)
+			dst << ", ";
+		else
+			isfirst = false;
+		t->print_tensor_as_const(dst);
+	}
+	for( auto t : outs ) {
+		if(!isfirst)
+			dst << ", ";
+		else
+			isfirst = false;
+		t->print_tensor(dst);
 	}
 
 	dst << ") {" << std::endl;
 
+	for( auto d : dims )
+		dst << "\t" << runtime_dim_cname(d) << " = " << cify_name(d) << ";" << std::endl;
+	if( options.calibration_dir != "" )
+		print_calibration_record(ins, dst);
+
 	// since nodes were resolved from graph inputs in the order there were
 	// node inputs resolved, the nodes vector is now sorted in order so that
 	// we don't need to check dependancies :)
@@ -172,7 +439,181 @@ void Graph::print_interface_function(std::ostream &dst)
 		dst << "\t" << n->c_name() << "( ";
 		n->print_function_parameters_callsite(dst);
 		dst << ");" << std::endl;
+		if( options.calibration_dir != "" )
+			print_calibration_record(n->get_outputs(), dst);
+	}
+
+	dst << "}" << std::endl;
+}
+
+/* Print all shape variants of a model into one source file.
+ * Initializers are printed once and shared. The variants never
+ * run at the same time, so they share the unionized tensor storage too. */
+void Graph::print_variants_source(const std::vector<Graph*> &graphs, std::ostream &dst)
+{
+	if( graphs.size() == 0 )
+		ERROR("No variants to print");
+	print_graphs_source(graphs, dst);
+	print_variant_dispatch(graphs, dst);
+}
+
+void Graph::print_models_source(const std::vector<Graph*> &graphs, std::ostream &dst)
+{
+	if( graphs.size() == 0 )
+		ERROR("No models to print");
+	print_graphs_source(graphs, dst);
+}
+
+/* The tensors, functions and entry functions of several graphs.
+ * Initializers of the same name are the same, and printed once. */
+void Graph::print_graphs_source(const std::vector<Graph*> &graphs, std::ostream &dst)
+{
+	graphs[0]->print_file_frontmatter(dst);
+	dst << std::endl;
+	graphs[0]->print_includes(dst);
+	dst << std::endl;
+
+	// Initializers in more than one graph first, as the common part.
+	// The weight storage passes must have made the same choices for each.
+	std::map<std::string, unsigned> uses;
+	std::map<std::string, const Tensor*> first;
+	for( auto g : graphs )
+		for( auto t : g->tensors ) {
+			if( t->union_no >= 0 || g->is_initializer(t) == false )
+				continue;
+			if( uses[t->name]++ == 0 )
+				first[t->name] = t;
+			else if( first[t->name]->print_tensor("") != t->print_tensor("") || first[t->name]->inlined != t->inlined )
+				ERROR("Initializer " << t->name << " is stored differently in the graphs that share it");
+		}
+	std::set<std::string> printed_initializers;
+	for( auto g : graphs )
+		for( auto t : g->tensors ) {
+			if( t->union_no >= 0 || g->is_initializer(t) == false )
+				continue;
+			if( uses[t->name] < 2 || printed_initializers.count(t->name) )
+				continue;
+			if( printed_initializers.size() == 0 )
+				dst << "/* Initializers shared between the graphs */" << std::endl;
+			printed_initializers.insert(t->name);
+			g->print_tensor(t, dst);
+		}
+	if( printed_initializers.size() )
+		dst << std::endl;
+
+	unsigned num_unions = 0;
+	for( auto g : graphs ) {
+		for( auto t : g->tensors ) {
+			if( t->union_no >= 0 )
+				continue;
+			if( g->is_initializer(t) ) {
+				if( printed_initializers.count(t->name) )
+					continue;
+				printed_initializers.insert(t->name);
+			}
+			g->print_tensor(t, dst);
+		}
+		num_unions = std::max(num_unions, (unsigned)g->tensor_unions.size());
 	}
 
+	for( unsigned u=0; u<num_unions; u++ )
+	{
+		dst << "union tensor_union_" << u << " {" << std::endl;
+		for( auto g : graphs )
+			for( auto t : g->tensors )
+				if( t->union_no == static_cast<int32_t>(u))
+					g->print_tensor(t, dst);
+		dst << "};" <<std::endl;
+		print_union_variable(u, dst);
+	}
+	dst << std::endl;
+
+	for( auto g : graphs ) {
+		g->print_functions(dst);
+		g->print_interface_function(dst);
+		dst << std::endl;
+	}
+}
+
+/* entry() for shape variants: pick the variant matching the given
+ * dimensions, and pass it the flat input and output buffers. */
+void Graph::print_variant_dispatch(const std::vector<Graph*> &graphs, std::ostream &dst)
+{
+	std::set<std::string> dims;
+	for( auto &v : options.dim_variants )
+		for( auto &d : v )
+			dims.insert(d.first);
+
+	std::vector<Tensor*> ins, outs;
+	graphs[0]->interface_tensors(ins, outs);
+
+	dst << "/* Returns 0 on success, -1 if no variant was generated for the given dimensions */" << std::endl;
+	dst << "int entry(";
+	bool isfirst = true;
+	for( auto &d : dims ) {
+		if(!isfirst)
+			dst << ", ";
+		else
+			isfirst = false;
+		dst << "uint32_t " << cify_name(d);
+	}
+	for( auto t : ins ) {
+		if(!isfirst)
+			dst << ", ";
+		else
+			isfirst = false;
+		dst << "const " << t->data_type_str() << " *tensor_" << cify_name(graphs[0]->unvariant_name(t));
+	}
+	for( auto t : outs ) {
+		if(!isfirst)
+			dst << ", ";
+		else
+			isfirst = false;
+		dst << t->data_type_str() << " *tensor_" << cify_name(graphs[0]->unvariant_name(t));
+	}
+	dst << ") {" << std::endl;
+
+	for( unsigned v=0; v<graphs.size(); v++ ) {
+		Graph *g = graphs[v];
+		std::string cond;
+		for( auto &d : options.dim_variants[v] ) {
+			if( cond != "" )
+				cond += " && ";
+			cond += cify_name(d.first) + "==" + std::to_string(d.second);
+		}
+		INDT_1 << "if( " << cond << " ) {" << std::endl;
+
+		std::vector<Tensor*> v_ins, v_outs;
+		g->interface_tensors(v_ins, v_outs);
+		if( v_ins.size() != ins.size() || v_outs.size() != outs.size() )
+			ERROR("Shape variants have different interfaces");
+
+		INDT_2 << g->entry_name() << "(";
+		isfirst = true;
+		for( auto t : v_ins ) {
+			if(!isfirst)
+				dst << ", ";
+			else
+				isfirst = false;
+			dst << "(const " << t->data_type_str() << "(*)";
+			for( unsigned i=1; i<t->rank(); i++ )
+				dst << "[" << t->data_dim[i] << "]";
+			dst << ")tensor_" << cify_name(g->unvariant_name(t));
+		}
+		for( auto t : v_outs ) {
+			if(!isfirst)
+				dst << ", ";
+			else
+				isfirst = false;
+			dst << "(" << t->data_type_str() << "(*)";
+			for( unsigned i=1; i<t->rank(); i++ )
+				dst << "[" << t->data_dim[i] << "]";
+			dst << ")tensor_" << cify_name(g->unvariant_name(t));
+		}
+		dst << ");" << std::endl;
+		INDT_2 << "return 0;" << std::endl;
+		INDT_1 << "}" << std::endl;
+	}
+	INDT_1 << "return -1;" << std::endl;
 	dst << "}" << std::endl;
 }
@@ -1,31 +1,131 @@
 /* This file is part of onnx2c.
  */
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <list>
 
 #include "onnx.pb.h"
 
+#include "error.h"
 #include "graph.h"
 #include "options.h"
 #include "tensor.h"
+#include "util.h"
 
-int main(int argc, const char *argv[])
+/* The optimization passes run on a resolved graph */
+static void optimize(toC::Graph *g)
+{
+	if( options.opt_lstm )
+		g->prepack_lstm();
+	if( options.opt_thresholds )
+		g->integer_thresholds();
+	if( options.inline_weights > 0 )
+		g->inline_weights();
+	if( options.sparse_weights > 0 )
+		g->sparse_weights();
+	if( options.pack_weights )
+		g->pack_weights();
+	if( options.weight_type != "" )
+		g->store_weights_16bit();
+	if( options.tile_layers > 0 )
+		g->tile_layers();
+	if( options.opt_schedule )
+		g->schedule_nodes();
+	if( options.opt_unionize )
+		g->unionize_tensors();
+	if( options.opt_restrict )
+		g->mark_restrict_params();
+}
+
+/* The entry function name for an input file: its name without the directory and extension */
+static std::string model_name(const std::string &file)
 {
-	onnx::ModelProto onnx_model;
+	std::string name = file.substr(file.find_last_of('/') + 1);
+	name = name.substr(0, name.find('.'));
+	return cify_name(name);
+}
 
+int main(int argc, const char *argv[])
+{
 	parse_cmdline_options(argc, argv);
 
-	std::ifstream input(options.input_file);
-	if (!input.good()) {
-		std::cerr << "Error opening input file: \"" << options.input_file << "\""  << std::endl;
-		exit(1); //TODO: check out error numbers for a more accurate one
+	// The graphs keep references to their model, so the models are not moved
+	std::list<onnx::ModelProto> models;
+	std::vector<onnx::ModelProto*> model_ptrs;
+	for( auto &file : options.input_files ) {
+		std::ifstream input(file);
+		if (!input.good()) {
+			std::cerr << "Error opening input file: \"" << file << "\""  << std::endl;
+			exit(1); //TODO: check out error numbers for a more accurate one
+		}
+		models.emplace_back();
+		models.back().ParseFromIstream(&input);
+		if( options.opt_qdq )
+			toC::Graph::fuse_qdq(models.back());
+		if( options.opt_thresholds )
+			toC::Graph::fuse_thresholds(models.back());
+		if( options.opt_attention )
+			toC::Graph::fuse_attention(models.back());
+		if( options.opt_argmax )
+			toC::Graph::skip_softmax(models.back());
+		model_ptrs.push_back(&models.back());
 	}
-	onnx_model.ParseFromIstream(&input);
-
 	std::cout.precision(20);
-	toC::Graph toCgraph(onnx_model);
-	if( options.opt_unionize )
-		toCgraph.unionize_tensors();
-	toCgraph.print_source(std::cout);
-}
 
+	// Several models, each with its own entry function
+	if( models.size() > 1 ) {
+		std::vector<std::string> names;
+		for( unsigned m=0; m<models.size(); m++ ) {
+			std::string name = model_name(options.input_files[m]);
+			if( std::find(names.begin(), names.end(), name) != names.end() )
+				ERROR("Two input files give the same entry function name: " << name);
+			names.push_back(name);
+			toC::Graph::rename_for_variant(*model_ptrs[m], name, true);
+		}
+		if( options.opt_dedup )
+			toC::Graph::dedup_initializers(model_ptrs);
+
+		std::vector<toC::Graph*> graphs;
+		for( unsigned m=0; m<models.size(); m++ ) {
+			toC::Graph *g = new toC::Graph(*model_ptrs[m], {}, names[m]);
+			optimize(g);
+			graphs.push_back(g);
+		}
+		toC::Graph::print_models_source(graphs, std::cout);
+		return 0;
+	}
+
+	onnx::ModelProto &onnx_model = models.front();
+	if( options.opt_dedup )
+		toC::Graph::dedup_initializers(model_ptrs);
+	if( options.dim_variants.size() == 0 ) {
+		toC::Graph toCgraph(onnx_model);
+		optimize(&toCgraph);
+		toCgraph.print_source(std::cout);
+		return 0;
+	}
+
+	// Build a fully static graph for each shape variant.
+	// The graphs keep references to their (renamed) copy of the model.
+	std::map<std::string, uint32_t> common_defines = options.dim_defines;
+	std::list<onnx::ModelProto> variant_models;
+	std::vector<toC::Graph*> variant_graphs;
+	for( auto &variant : options.dim_variants ) {
+		std::string name;
+		options.dim_defines = common_defines;
+		for( auto &d : variant ) {
+			options.dim_defines[d.first] = d.second;
+			if( name != "" )
+				name += "_";
+			name += cify_name(d.first) + "_" + std::to_string(d.second);
+		}
+
+		variant_models.push_back(onnx_model);
+		toC::Graph::rename_for_variant(variant_models.back(), name);
+		toC::Graph *g = new toC::Graph(variant_models.back(), {}, name);
+		optimize(g);
+		variant_graphs.push_back(g);
+	}
+	toC::Graph::print_variants_source(variant_graphs, std::cout);
+}
@@ -2,6 +2,11 @@
 #include "error.h"
 #include "graph.h"
 #include "node.h"
+#include "tensor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
 
 
 using namespace toC;
@@ -117,7 +122,9 @@ void Node::print_parameters(std::ostream &dst, bool not_callsite ) const
 	for( auto i : input_params ) {
 		const Tensor *t = std::get<0>(i);
 		std::string name = std::get<1>(i);
-		if( not_callsite )
+		if( not_callsite && noalias_params.count(t) && t->rank() > 0 )
+			params.push_back( t->print_tensor_as_pointer(name, true, "RESTRICT") );
+		else if( not_callsite )
 			params.push_back( t->print_tensor_as_const(name) );
 		else
 			params.push_back( t->print_tensor_callsite() );
@@ -130,7 +137,9 @@ void Node::print_parameters(std::ostream &dst, bool not_callsite ) const
 		if( t->is_used() == false )
 			continue;
 		std::string name = std::get<1>(o);
-		if( not_callsite )
+		if( not_callsite && noalias_params.count(t) && t->rank() > 0 )
+			params.push_back( t->print_tensor_as_pointer(name, false, "RESTRICT") );
+		else if( not_callsite )
 			params.push_back( t->print_tensor(name) );
 		else
 			params.push_back( t->print_tensor_callsite() );
@@ -154,6 +163,191 @@ void Node::print_function_parameters_callsite(std::ostream &destination) const
 	print_parameters(destination, false);
 }
 
+void Node::print_function_parameters_callsite(std::ostream &dst, const Node *caller) const
+{
+	std::vector<function_parameter> params = input_params;
+	for( auto o : output_params )
+		if( std::get<0>(o)->is_used() )
+			params.push_back(o);
+
+	std::vector<function_parameter> caller_params = caller->input_params;
+	caller_params.insert(caller_params.end(), caller->output_params.begin(), caller->output_params.end());
+	for( unsigned p=0; p<params.size(); p++ ) {
+		const Tensor *t = std::get<0>(params[p]);
+		auto c = std::find_if(caller_params.begin(), caller_params.end(),
+			[t](const function_parameter &f){ return std::get<0>(f) == t; });
+		if( c == caller_params.end() )
+			ERROR("Node " << caller->onnx_name << " calls " << onnx_name << " without its tensor " << t->name);
+		dst << (p ? ", " : "") << std::get<1>(*c);
+	}
+}
+
+/* Can the memory of the two tensors overlap. Graph internal tensors are either
+ * separate static arrays, or members of the tensor unions. The 'unionize' pass
+ * never places a node's output into a union still holding one of the node's
+ * inputs, so different internal tensors of a node never overlap. Graph input
+ * and output buffers are given by the caller of entry(), and might overlap
+ * each other. */
+static bool may_alias(const Tensor *a, const Tensor *b)
+{
+	if( a == b )
+		return true;
+	if( a->isIO && b->isIO )
+		return true;
+	if( a->union_no >= 0 && a->union_no == b->union_no )
+		return true;
+	return false;
+}
+
+void Node::find_noalias_params(void)
+{
+	// (tensor, is written by this node)
+	std::vector<std::tuple<const Tensor*, bool>> params;
+	for( auto i : input_params )
+		params.push_back(std::make_tuple(std::get<0>(i), false));
+	for( auto o : output_params )
+		if( std::get<0>(o)->is_used() )
+			params.push_back(std::make_tuple(std::get<0>(o), true));
+
+	noalias_params.clear();
+	for( unsigned p=0; p<params.size(); p++ ) {
+		const Tensor *t = std::get<0>(params[p]);
+		bool noalias = true;
+		for( unsigned q=0; q<params.size(); q++ ) {
+			if( p == q )
+				continue;
+			// overlapping read-only parameters are fine
+			if( std::get<1>(params[p]) == false && std::get<1>(params[q]) == false )
+				continue;
+			if( may_alias(t, std::get<0>(params[q])) )
+				noalias = false;
+		}
+		if( noalias )
+			noalias_params.insert(t);
+	}
+}
+
+void Node::print_assume_aligned(std::ostream &dst) const
+{
+	std::vector<function_parameter> params = input_params;
+	for( auto o : output_params )
+		if( std::get<0>(o)->is_used() )
+			params.push_back(o);
+
+	for( auto p : params ) {
+		const Tensor *t = std::get<0>(p);
+		std::string name = std::get<1>(p);
+		// IO buffers come from the user, with unknown alignment
+		if( t->isIO || t->rank() == 0 )
+			continue;
+
+		bool is_const = t->isConst || std::find(input_params.begin(), input_params.end(), p) != input_params.end();
+		std::string type = t->print_tensor_as_pointer("", is_const, "");
+		INDT_1 << name << " = (" << type << ")__builtin_assume_aligned(" << name << ", " << TENSOR_ALIGNMENT << ");" << std::endl;
+	}
+}
+
+std::vector<int> Node::flat_strides(const Tensor *t, unsigned loop_rank)
+{
+	std::vector<int> strides(loop_rank, 0);
+	int stride = 1;
+	// align the tensor's dimensions with the innermost loops
+	for( int r=t->rank()-1, l=loop_rank-1; r>=0 && l>=0; r--, l-- ) {
+		if( t->data_dim[r] != 1 )
+			strides[l] = stride;
+		stride *= t->data_dim[r];
+	}
+	return strides;
+}
+
+std::string Node::batch_offset(const Tensor *t, unsigned matrix_rank, unsigned batch_rank)
+{
+	std::vector<int> strides = flat_strides(t, batch_rank + matrix_rank);
+	std::string offset = "0";
+	for( unsigned b=0; b<batch_rank; b++ )
+		if( strides[b] != 0 )
+			offset += " + b" + std::to_string(b) + "*" + std::to_string(strides[b]);
+	return offset;
+}
+
+std::vector<std::string> Node::print_flat_loops_begin(
+	std::ostream &dst,
+	const std::vector<std::string> &bounds,
+	const std::vector<flat_pointer> &ptrs)
+{
+	for( auto &p : ptrs )
+		INDT_1 << p.type << " *" << p.name << "_p0 = (" << p.type << "*)" << p.name << ";" << std::endl;
+
+	for( unsigned l=0; l<bounds.size(); l++ ) {
+		std::string lv = "i" + std::to_string(l);
+		std::string pl = "_p" + std::to_string(l);
+		if( l > 0 )
+			for( auto &p : ptrs )
+				INDT_1 << p.type << " *" << p.name << pl << " = " << p.name << "_p" << l-1 << ";" << std::endl;
+		INDT_1 << "for (unsigned " << lv << "=0; " << lv << "<" << bounds[l] << "; " << lv << "++";
+		for( auto &p : ptrs )
+			if( p.strides[l] != 0 )
+				dst << ", " << p.name << pl << "+=" << p.strides[l];
+		dst << ") {" << std::endl;
+	}
+
+	std::string innermost = "_p" + std::to_string(bounds.size() ? bounds.size()-1 : 0);
+	std::vector<std::string> elements;
+	for( auto &p : ptrs )
+		// not "*p": the callers paste these next to operators, and "/*p" would start a comment
+		elements.push_back(p.name + innermost + "[0]");
+	return elements;
+}
+
+void Node::print_flat_loops_end(std::ostream &dst, unsigned num_loops)
+{
+	for( unsigned l=0; l<num_loops; l++ )
+		INDT_1 << "}" << std::endl;
+}
+
+void Node::print_index_table(std::ostream &dst, const std::string &name, const std::vector<int> &values)
+{
+	int max = 0;
+	for( int v : values )
+		max = std::max(max, v);
+	std::string type = max <= UINT8_MAX ? "uint8_t" : max <= UINT16_MAX ? "uint16_t" : "uint32_t";
+	// Not zero sized, even if there are no values
+	INDT_1 << "static const " << type << " " << name << "[" << std::max<size_t>(values.size(), 1) << "] = {";
+	for( unsigned i=0; i<values.size(); i++ ) {
+		if( i % 16 == 0 )
+			dst << std::endl << "\t\t";
+		dst << values[i];
+		if( i < values.size()-1 )
+			dst << ", ";
+	}
+	if( values.size() == 0 )
+		dst << " 0";
+	dst << std::endl;
+	INDT_1 << "};" << std::endl;
+}
+
+std::string Node::inlined_mac(const std::string &acc, const std::string &x, const Tensor *t, int i)
+{
+	bool is_float = isFloat(t->data_type);
+	double v = is_float ? t->get_data_element_float(i) : t->get_data_element(i);
+	if( v == 0 )
+		return "";
+	std::string op = v < 0 ? " -= " : " += ";
+	if( v == 1 || v == -1 )
+		return acc + op + x + ";";
+
+	// Enough digits to give back the same float
+	std::ostringstream literal;
+	literal.precision(is_float ? 9 : 20);
+	literal << std::fabs(v);
+	std::string l = literal.str();
+	if( is_float && l.find_first_of(".e") == std::string::npos )
+		l += ".0";
+	if( is_float )
+		l += "f";
+	return acc + op + x + " * " + l + ";";
+}
+
 void Node::register_input(const Tensor *t, std::string name)
 {
 	input_params.push_back(function_parameter(t, name));
@@ -163,3 +357,11 @@ void Node::register_output(Tensor *t, std::string name)
 	output_params.push_back(function_parameter(t, name));
 	outputs.push_back(t);
 }
+void Node::unregister_input(const Tensor *t)
+{
+	for( auto i = input_params.begin(); i != input_params.end(); )
+		if( std::get<0>(*i) == t )
+			i = input_params.erase(i);
+		else
+			i++;
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include <set>
 #include <string>
 #include <tuple>
 #include "error.h"
@@ -36,6 +37,8 @@ private:
 	// This might not be as long as the number of outputs in the Node operand's specification
 	// (i.e .when trailing outputs are not used)
 	std::vector<bool> output_used;
+	// Function parameters found by find_noalias_params()
+	std::set<const Tensor*> noalias_params;
 
 public:
 	void set_output_used(std::vector<bool>val){output_used = val; }
@@ -68,6 +71,23 @@ public:
 	void print_parameters(std::ostream &destination, bool decorate ) const;
 	void print_function_parameters_definition(std::ostream &destination) const;
 	void print_function_parameters_callsite(std::ostream &destination) const;
+	/* Parameters when calling this node from the function of node 'caller',
+	 * each tensor by the local name 'caller' registered it with */
+	void print_function_parameters_callsite(std::ostream &destination, const Node *caller) const;
+
+	/* Nodes whose functions this node calls, e.g. the layers run by
+	 * a Tiled node. The Graph prints their functions before this
+	 * node's, but does not call them. */
+	virtual std::vector<const Node*> sub_nodes(void) const { return {}; }
+
+	/* Aliasing analysis for the 'restrict' optimization pass.
+	 * Find the function parameters that are proven not to overlap with
+	 * any other parameter written by this node. These are then printed
+	 * RESTRICT qualified. */
+	void find_noalias_params(void);
+	/* For the 'align' optimization pass: tell the compiler the
+	 * parameters in graph internal storage are aligned. */
+	void print_assume_aligned(std::ostream &destination) const;
 
 	/* Figure out in what format the output is in.
 	 * This fills the node's list of 'outputs' tensors.
@@ -76,6 +96,46 @@ public:
 	 */
 	virtual void resolve(void) {};
 
+	/* Can this node take inputs whose outermost dimension is variable
+	 * at run time (see Tensor::runtime_dim)? The node must then loop
+	 * over Tensor::str_dim(0) instead of the static maximum, and produce
+	 * outputs with the same variable outermost dimension.
+	 * Called after resolve(). Override where implemented. */
+	virtual bool handles_runtime_dim(void) const { return false; }
+
+	/* Can this node read its constant input 't' packed to 'bits' bits
+	 * (see Tensor::pack_bits)? Set 'columns' if a 2D 't' should be packed
+	 * column by column. Called after resolve() by the 'pack_weights' and
+	 * 'store_weights_16bit' passes.
+	 * Override where implemented. */
+	virtual bool accepts_packed(const Tensor *t, int bits, bool &columns) const { return false; }
+	/* Can this node read its constant input 't' stored sparse (see
+	 * Tensor::sparse_axis)? Set 'axis' to the dimension of 't' that
+	 * indexes the output channels. Called after resolve() by the
+	 * 'sparse_weights' pass. Override where implemented. */
+	virtual bool accepts_sparse(const Tensor *t, int &axis) const { return false; }
+	/* Can this node write the values of its constant input 't' into its
+	 * code (see Tensor::inlined)? Called after resolve() by the
+	 * 'inline_weights' pass, which then drops 't' from the function
+	 * parameters with unregister_input(). Override where implemented. */
+	virtual bool accepts_inlined(const Tensor *t) const { return false; }
+	void unregister_input(const Tensor *t);
+	/* Statement adding 'x' times element 'i' of the constant 't' to 'acc',
+	 * with the value as a literal. An add or subtract for +1 or -1, and
+	 * nothing for zero. */
+	static std::string inlined_mac(const std::string &acc, const std::string &x, const Tensor *t, int i);
+	/* Streaming ('--stream'): the variables this node keeps between calls
+	 * to entry(). The Graph prints them as globals, before the node
+	 * functions, and the functions to reset, get and set them. */
+	struct state_variable {
+		std::string name;      // C name of the global
+		const Tensor *shape;   // the variable has the type and dimensions of this tensor
+		const Tensor *initial; // reset to this constant, or to zeros if nullptr
+	};
+	virtual std::vector<state_variable> state_variables(void) const { return {}; }
+	/* Are the values of output 0 known to be only -1 or +1? */
+	virtual bool bipolar_output(void) const { return false; }
+
 	/* Check if an optional output is used in the network.
 	 * N is Nth output specified in the Operator.md specification for this node.
 	 * Start counting N from 0, including the non-optional outputs. */
@@ -117,6 +177,36 @@ public:
 		std::vector<int> &result) const;
 
 protected:
+	/* Flat pointer code generation (the '--flat-pointers' option).
+	 * Instead of indexing with array syntax, e.g. X[i0][i1][i2], a loop nest
+	 * walks each tensor with a pointer. Each loop has its own copy of the
+	 * pointer, bumped by the tensor's stride for that loop, so there is no
+	 * address arithmetic left in the innermost loop. */
+	struct flat_pointer {
+		std::string name;         // local name of the tensor, as given to register_input/output()
+		std::string type;         // element type, e.g. "const float"
+		std::vector<int> strides; // elements to step per iteration of each loop
+	};
+	/* Element strides of tensor 't' when looping over the 'loop_rank' dimensions
+	 * of a result 't' is multidirectionally broadcast to.
+	 * Broadcast dimensions have stride 0. */
+	static std::vector<int> flat_strides(const Tensor *t, unsigned loop_rank);
+	/* Print loops 'i0', 'i1'... with upper bounds 'bounds', bumping the pointers 'ptrs'.
+	 * Returns the C expressions of the elements of 'ptrs' in the innermost loop. */
+	static std::vector<std::string> print_flat_loops_begin(
+		std::ostream &dst,
+		const std::vector<std::string> &bounds,
+		const std::vector<flat_pointer> &ptrs);
+	static void print_flat_loops_end(std::ostream &dst, unsigned num_loops);
+	/* C expression of the offset to the matrix of 't' at the batch indices
+	 * 'b0', 'b1'... of a result with 'batch_rank' leading dimensions, when the
+	 * last 'matrix_rank' dimensions of 't' form the matrix (e.g. MatMul).
+	 * Broadcast batch dimensions add nothing. */
+	static std::string batch_offset(const Tensor *t, unsigned matrix_rank, unsigned batch_rank);
+	/* Print a static constant table of non-negative integers, in the
+	 * narrowest unsigned type that holds them */
+	static void print_index_table(std::ostream &dst, const std::string &name, const std::vector<int> &values);
+
 	/* Record a tensor as the generated function's parameter.
 	 * - name: the name to be used locally for the tensor in the C-function
 	 */
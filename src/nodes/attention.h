@@ -0,0 +1,153 @@
+/* This file is part of onnx2c.
+ *
+ * FusedAttention
+ * Not an ONNX operator, but made by the 'attention' optimization pass
+ * of MatMul -> [Mul/Div by a constant] -> Softmax -> MatMul chains:
+ *   Y = softmax(scale * Q*K^T) * V
+ * with the softmax over the last axis.
+ *
+ * Inputs Q [..., S, D], K [..., D, T] (or [..., T, D] with attribute
+ * transposed_k, when the pass dropped a Transpose) and V [..., T, Dv].
+ * The leading dimensions broadcast as in MatMul.
+ *
+ * The [S x T] scores are not stored. For each query row, the keys are
+ * taken a tile at a time, as in "flash attention": the running max and
+ * sum of the softmax, and the output row, are rescaled when a tile
+ * raises the max. Memory use is one tile of scores and one output row.
+ */
+#include "fastmath.h"
+#include "node.h"
+
+namespace toC {
+
+class FusedAttention : public Node {
+	public:
+	FusedAttention() {
+		op_name = "FusedAttention";
+		scale = 1;
+		transposed_k = 0;
+	}
+	float scale;
+	int transposed_k;
+
+	// Number of keys in a tile of scores
+	static const int tile_size = 32;
+
+	virtual void parseAttributes( onnx::NodeProto &node ) override {
+		for( const auto& a : node.attribute() ) {
+			if( a.name() == "scale" )
+				scale = parse_attribute_float(a);
+			else if( a.name() == "transposed_k" )
+				transposed_k = parse_attribute_int(a);
+			else
+				ERROR("Unknown attribute " << a.name());
+		}
+	}
+
+	const Tensor* get_Q(void) const { return inputs[0]; }
+	const Tensor* get_K(void) const { return inputs[1]; }
+	const Tensor* get_V(void) const { return inputs[2]; }
+	int S(void) const { return get_Q()->data_dim[get_Q()->rank()-2]; }
+	int D(void) const { return get_Q()->data_dim[get_Q()->rank()-1]; }
+	int T(void) const { return get_V()->data_dim[get_V()->rank()-2]; }
+	int Dv(void) const { return get_V()->data_dim[get_V()->rank()-1]; }
+
+	virtual void print(std::ostream &dst) const override
+	{
+		const Tensor *Y = outputs[0];
+		std::string type = get_Q()->data_type_str();
+		std::string acc_type = Y->accumulator_type_str();
+		std::string expfunc = get_Q()->data_type == onnx::TensorProto_DataType_DOUBLE ? "exp" : math_function("expf");
+		int tile = std::min(T(), tile_size);
+		std::vector<int> batch(Y->data_dim.begin(), Y->data_dim.end()-2);
+
+		INDT_1 << "/* FusedAttention: softmax(scale * Q*K^T) * V" << std::endl;
+		INDT_1 << "   scale = " << scale << std::endl;
+		INDT_1 << "   " << tile << " scores at a time" << std::endl;
+		INDT_1 << "*/" << std::endl;
+		for( unsigned b=0; b<batch.size(); b++ ) {
+			std::string lv = "b" + std::to_string(b);
+			INDT_1 << "for( uint32_t " << lv << "=0; " << lv << "<" << batch[b] << "; " << lv << "++ )" << std::endl;
+		}
+		INDT_1 << "{" << std::endl;
+		INDT_2 << "const " << type << " *q = (const " << type << "*)Q + " << batch_offset(get_Q(), 2, batch.size()) << ";" << std::endl;
+		INDT_2 << "const " << type << " *k = (const " << type << "*)K + " << batch_offset(get_K(), 2, batch.size()) << ";" << std::endl;
+		INDT_2 << "const " << type << " *v = (const " << type << "*)V + " << batch_offset(get_V(), 2, batch.size()) << ";" << std::endl;
+		INDT_2 << type << " *y = (" << type << "*)Y + " << batch_offset(Y, 2, batch.size()) << ";" << std::endl;
+
+		std::string k_el = transposed_k ? "k[(t0+t)*" + std::to_string(D()) + "+i]"
+		                                 : "k[i*" + std::to_string(T()) + "+t0+t]";
+		INDT_2 << "for( uint32_t s=0; s<" << S() << "; s++, q+=" << D() << ", y+=" << Dv() << " ) {" << std::endl;
+		INDT_3 << acc_type << " max = -INFINITY;" << std::endl;
+		INDT_3 << acc_type << " sum = 0;" << std::endl;
+		INDT_3 << acc_type << " acc[" << Dv() << "];" << std::endl;
+		INDT_3 << "for( uint32_t j=0; j<" << Dv() << "; j++ )" << std::endl;
+		INDT_4 << "acc[j] = 0;" << std::endl;
+		INDT_3 << "for( uint32_t t0=0; t0<" << T() << "; t0+=" << tile << " ) {" << std::endl;
+		INDT_4 << "uint32_t n = MIN(" << T() << "-t0, " << tile << ");" << std::endl;
+		INDT_4 << acc_type << " score[" << tile << "];" << std::endl;
+		INDT_4 << acc_type << " tile_max = -INFINITY;" << std::endl;
+		INDT_4 << "for( uint32_t t=0; t<n; t++ ) {" << std::endl;
+		INDT_5 << acc_type << " dot = 0;" << std::endl;
+		INDT_5 << "for( uint32_t i=0; i<" << D() << "; i++ )" << std::endl;
+		INDT_5 << "\tdot += q[i] * " << k_el << ";" << std::endl;
+		INDT_5 << "score[t] = dot * " << scale << ";" << std::endl;
+		INDT_5 << "tile_max = MAX(tile_max, score[t]);" << std::endl;
+		INDT_4 << "}" << std::endl;
+		INDT_4 << "if( tile_max > max ) {" << std::endl;
+		INDT_5 << acc_type << " rescale = " << expfunc << "(max - tile_max);" << std::endl;
+		INDT_5 << "sum *= rescale;" << std::endl;
+		INDT_5 << "for( uint32_t j=0; j<" << Dv() << "; j++ )" << std::endl;
+		INDT_5 << "\tacc[j] *= rescale;" << std::endl;
+		INDT_5 << "max = tile_max;" << std::endl;
+		INDT_4 << "}" << std::endl;
+		INDT_4 << "for( uint32_t t=0; t<n; t++ ) {" << std::endl;
+		INDT_5 << acc_type << " p = " << expfunc << "(score[t] - max);" << std::endl;
+		INDT_5 << "sum += p;" << std::endl;
+		INDT_5 << "for( uint32_t j=0; j<" << Dv() << "; j++ )" << std::endl;
+		INDT_5 << "\tacc[j] += p * v[(t0+t)*" << Dv() << "+j];" << std::endl;
+		INDT_4 << "}" << std::endl;
+		INDT_3 << "}" << std::endl;
+		INDT_3 << acc_type << " rsum = 1 / sum;" << std::endl;
+		INDT_3 << "for( uint32_t j=0; j<" << Dv() << "; j++ )" << std::endl;
+		INDT_4 << "y[j] = acc[j] * rsum;" << std::endl;
+		INDT_2 << "}" << std::endl;
+		INDT_1 << "}" << std::endl;
+	}
+
+	virtual void resolve(void) override
+	{
+		const Tensor *Q = get_Q();
+		const Tensor *K = get_K();
+		const Tensor *V = get_V();
+		register_input(Q, "Q");
+		register_input(K, "K");
+		register_input(V, "V");
+		if( Q->rank() < 2 || K->rank() < 2 || V->rank() < 2 )
+			ERROR("Unimplemented: FusedAttention with vector inputs");
+		if( Q->data_type != K->data_type || Q->data_type != V->data_type
+		 || typeConstraint_plainFloatingPoints(Q) == false )
+			ERROR("Unimplemented: FusedAttention of data type " << Q->data_type_str());
+		int kd = K->data_dim[K->rank() - (transposed_k ? 1 : 2)];
+		int kt = K->data_dim[K->rank() - (transposed_k ? 2 : 1)];
+		if( kd != D() || kt != T() )
+			ERROR("FusedAttention: mismatching dimensions of Q, K and V");
+
+		// The leading dimensions broadcast, as in MatMul
+		std::vector<int> batch;
+		for( const Tensor *t : { Q, K, V } ) {
+			std::vector<int> lead(t->data_dim.begin(), t->data_dim.end()-2);
+			std::vector<int> result;
+			multidirectional_broadcast_size(batch, lead, result);
+			batch = result;
+		}
+
+		Tensor *rv = new Tensor;
+		rv->data_dim = batch;
+		rv->data_dim.push_back(S());
+		rv->data_dim.push_back(Dv());
+		rv->data_type = Q->data_type;
+		register_output(rv, "Y");
+	}
+};
+}
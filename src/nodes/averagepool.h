@@ -22,13 +22,13 @@ class AveragePool : public Pooling {
 	}
 	virtual void print_output_cell_calc(
 		std::ostream &dst,
-		const std::string &x_idx,
-		const std::string &w_idx,
+		const std::string &x_el,
+		const std::string &w_el,
 		const std::string &y_idx) const override
 	{
 		// Sum up the cells
 		INDT_4 << "numavg += 1;" <<std::endl;
-		INDT_4 << "curavg += x" << x_idx << ";" <<std::endl;
+		INDT_4 << "curavg += " << x_el << ";" <<std::endl;
 	}
 	virtual void print_output_cell_finalize(std::ostream &dst, const std::string &y_idx) const override
 	{
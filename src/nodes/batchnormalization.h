@@ -138,13 +138,21 @@ class BatchNormalization : public Node {
 	}
 
 	// Updates variance tensor in-place to contain the entire denominator
-	// of the BatchNormalization formula.
+	// of the BatchNormalization formula. Only once for each tensor, as
+	// it is resolved again for the stages of a Tiled node, and might
+	// be shared by BatchNormalizations of the same epsilon.
 	// TODO: This breaks if var is used anywere else.
 	void calculateSqrtVarOffline(Tensor *var)
 	{
+		if( var->sqrt_var_epsilon >= 0 ) {
+			if( var->sqrt_var_epsilon != epsilon )
+				ERROR("Unimplemented: BatchNormalizations with different epsilons share the variance " << var->name);
+			return;
+		}
 		float *v = (float*)var->data_buffer;
 		for( int i=0; i<var->data_num_elem(); i++)
 			v[i] = sqrt(v[i] + epsilon);
+		var->sqrt_var_epsilon = epsilon;
 	}
 
 	virtual void resolve(void) override
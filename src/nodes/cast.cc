@@ -30,6 +30,12 @@ void Cast::resolve(void)
 		case onnx::TensorProto_DataType_DOUBLE:
 			output_type = "double";
 			break;
+		case onnx::TensorProto_DataType_FLOAT16:
+			output_type = "onnx2c_float16";
+			break;
+		case onnx::TensorProto_DataType_BFLOAT16:
+			output_type = "onnx2c_bfloat16";
+			break;
 		default:
 			ERROR("Unimplemented casting to requested type");
 	}
@@ -4,6 +4,7 @@
  * Calculates an "industry standard" convolution filter.
  */
 
+#include "quantization.h"
 #include "spatialfilter.h"
 namespace toC {
 
@@ -18,7 +19,12 @@ class Conv : public SpatialFilter {
 		std::string outidx="";
 		for(unsigned i=0; i<get_numDataDim(); i++)
 			outidx += "[o" + std::to_string(i) + "]";
-		INDT_3 << "y[b][m]" << outidx << " = ";
+		if( quantization_calibrated() )
+			INDT_3 << "int32_t cell = ";
+		else if( wide_cell() )
+			INDT_3 << get_Y()->accumulator_type_str() << " cell = ";
+		else
+			INDT_3 << "y[b][m]" << outidx << " = ";
 		if( inputs.size() < 3 ) // bias is the 3rd input, optional
 			dst << "0;" << std::endl;
 		else
@@ -26,31 +32,143 @@ class Conv : public SpatialFilter {
 	};
 	virtual void print_output_cell_calc(
 		std::ostream &dst,
-		const std::string &x_idx,
-		const std::string &w_idx,
+		const std::string &x_el,
+		const std::string &w_el,
 		const std::string &y_idx) const override
 	{
 		std::string outidx="";
-		std::string iididx="";
-		std::string kidx="";
-		for(unsigned i=0; i<get_numDataDim(); i++){
+		for(unsigned i=0; i<get_numDataDim(); i++)
 			outidx += "[o" + std::to_string(i) + "]";
-			iididx+= "[ii" + std::to_string(i) + "]";
-			kidx+= "[k" + std::to_string(i) + "]";
-		}
-		INDT_4 << "y[b][m]"<<outidx<<" += x[b][c]"<<iididx<<" *";
-		if( group == 1 )
-		   dst << "w[m][c]"<<kidx<<";" << std::endl;
+		if( quantization_calibrated() )
+			INDT_4 << "cell += " << x_el << " * " << w_el << ";" << std::endl;
+		else if( wide_cell() )
+			INDT_4 << "cell += (" << get_Y()->accumulator_type_str() << ")" << x_el << " * " << w_el << ";" << std::endl;
 		else
-		   dst << "w[m][c-(gi*g)]"<<kidx<<";" << std::endl;
+			INDT_4 << "y[b][m]"<<outidx<<" += " << x_el << " * " << w_el << ";" << std::endl;
 	}
 	virtual void print_output_cell_finalize(std::ostream &dst, const std::string &y_idx) const override
 	{
+		if( quantization_calibrated() )
+			INDT_3 << "y" << y_idx << " = " << requantize("cell", "mult[m]", "shift[m]") << ";" << std::endl;
+		else if( wide_cell() )
+			INDT_3 << "y" << y_idx << " = cell;" << std::endl;
+	}
+	/* Sum in a local variable of a wider type than the output */
+	bool wide_cell(void) const
+	{
+		return get_Y()->accumulator_type_str() != get_Y()->data_type_str();
 	}
 	virtual void print(std::ostream &dst) const override
 	{
 		print_header_info_comment(dst);
-		print_loop_with_padding_checks(dst);
+		if( quantization_calibrated() ) {
+			std::vector<double> reals;
+			for( int m=0; m<get_W()->data_dim[0]; m++ )
+				reals.push_back( get_X()->quant_scale() * get_W()->quant_scale(m) / get_Y()->quant_scale() );
+			print_requantize_tables(dst, reals);
+		}
+		if( get_W()->inlined )
+			print_inlined_loops(dst);
+		else
+			print_loop_with_padding_checks(dst);
+	}
+
+	/* Inlined weights: the kernel of each output channel as straight-line
+	 * code, with the weights as literals. A kernel position is checked for
+	 * hitting the padding only where it can. */
+	void print_inlined_loops(std::ostream &dst) const
+	{
+		const Tensor *w = get_W();
+		const Tensor *x = get_X();
+		unsigned n_data_dims = get_numDataDim();
+		int maps = w->data_dim[0];
+		int group_channels = w->data_dim[1];
+		int kernel_size = w->data_num_elem() / maps / group_channels;
+		std::string y_idx = "[b][m]";
+		for( unsigned i=0; i<n_data_dims; i++ )
+			y_idx += "[o" + std::to_string(i) + "]";
+		std::string cell = quantization_calibrated() || wide_cell() ? "cell" : "y" + y_idx;
+		std::string widen = wide_cell() ? "(" + get_Y()->accumulator_type_str() + ")" : "";
+
+		INDT_1 << "for( uint32_t b=0; b<" << x->str_dim(0) << "; b++ ) {" << std::endl;
+		for( int m=0; m<maps; m++ ) {
+			INDT_1 << "{" << std::endl;
+			INDT_2 << "const uint32_t m = " << m << ";" << std::endl;
+			for( unsigned i=0; i<n_data_dims; i++ ) {
+				std::string i_str = std::to_string(i);
+				INDT_2 << "for( int32_t o" << i_str << "=0, i" << i_str << "=" << -pads[i] << "; ";
+				   dst <<       "o" << i_str << "<" << get_Y()->data_dim[2+i] << "; ";
+				   dst <<       "o" << i_str << "++, i" << i_str << "+=" << strides[i] << ") {" << std::endl;
+			}
+			print_output_cell_init(dst, y_idx);
+
+			int first_channel = m / (maps/group) * group_channels;
+			for( int e=0; e<kernel_size*group_channels; e++ ) {
+				std::vector<int> offsets(n_data_dims);
+				for( int i=n_data_dims-1, k_flat=e%kernel_size; i>=0; i-- ) {
+					offsets[i] = k_flat % kernel_shape[i] * dilations[i];
+					k_flat /= kernel_shape[i];
+				}
+				std::string x_el = "x[b][" + std::to_string(first_channel + e/kernel_size) + "]";
+				std::string checks;
+				for( unsigned i=0; i<n_data_dims; i++ ) {
+					std::string ii = "i" + std::to_string(i) + (offsets[i] ? "+" + std::to_string(offsets[i]) : "");
+					int lowest = -pads[i] + offsets[i];
+					int highest = -pads[i] + (get_Y()->data_dim[2+i]-1) * strides[i] + offsets[i];
+					if( lowest < 0 )
+						checks += (checks != "" ? " && " : "") + ii + ">=0";
+					if( highest >= x->data_dim[2+i] )
+						checks += (checks != "" ? " && " : "") + ii + "<" + std::to_string(x->data_dim[2+i]);
+					x_el += "[" + ii + "]";
+				}
+				std::string mac = inlined_mac(cell, widen + x_el, w, m*group_channels*kernel_size + e);
+				if( mac == "" )
+					continue;
+				if( checks != "" )
+					INDT_3 << "if( " << checks << " ) " << mac << std::endl;
+				else
+					INDT_3 << mac << std::endl;
+			}
+
+			print_output_cell_finalize(dst, y_idx);
+			for( unsigned i=0; i<n_data_dims; i++ )
+				INDT_2 << "} /* o */" << std::endl;
+			INDT_1 << "}" << std::endl;
+		}
+		INDT_1 << "} /* b */" << std::endl;
+	}
+
+	virtual bool accepts_packed(const Tensor *t, int bits, bool &columns) const override
+	{
+		return t == get_W() && t != get_X();
+	}
+
+	virtual bool accepts_sparse(const Tensor *t, int &axis) const override
+	{
+		axis = 0;
+		return t == get_W() && t != get_X();
+	}
+
+	virtual bool accepts_inlined(const Tensor *t) const override
+	{
+		return t == get_W() && t != get_X();
+	}
+
+	/* Calibrated quantization: weights per output channel, the bias
+	 * to int32 at the scale of the accumulator */
+	void quantize_weights(void)
+	{
+		Tensor *w = inputs[1];
+		Tensor *bias = inputs.size() > 2 ? inputs[2] : nullptr;
+		if( w->quantizedFrom == NULL || (bias && bias->quantizedFrom == NULL) )
+			ERROR("Unimplemented: calibrated quantization of Conv with non-constant weights or bias");
+		w->quantize_per_channel(0);
+		if( bias == nullptr )
+			return;
+		std::vector<float> scales;
+		for( int m=0; m<w->data_dim[0]; m++ )
+			scales.push_back( get_X()->quant_scale() * w->quant_scale(m) );
+		bias->quantize_with_scales(0, scales, onnx::TensorProto_DataType_INT32);
 	}
  
 	virtual void resolve(void) override
@@ -65,6 +183,8 @@ class Conv : public SpatialFilter {
 		resolve_dilations();
 		resolve_pads();
 		resolve_kernel_shape();
+		if( quantization_calibrated() )
+			quantize_weights();
 
 		Tensor *rv = new Tensor;
 		rv->data_dim = resolve_output_size();
@@ -8,7 +8,19 @@
  * this is to give better dynamic range for variables not centered
  * around zero.
  * These zero-point offsets are given as optional input tensors.
+ *
+ * The sum over (x-zx)*(w-zw) is expanded into
+ *   sum(x*w) - zw*sum(x) + zx*(K*zw - sum(w))
+ * With constant weights, (K*zw - sum(w)) is precomputed for each
+ * output channel, so the innermost loop is a plain integer dot
+ * product. The weight zero point multiplies a running sum of the inputs.
+ * With padding, the kernel window is not always full, so the
+ * input zero point is subtracted in the loop instead.
+ *
+ * QLinearConv shares this, with its own inputs and output.
  */
+#pragma once
+#include "quantization.h"
 #include "spatialfilter.h"
 namespace toC {
 
@@ -18,84 +30,181 @@ class ConvInteger : public SpatialFilter {
 		op_name = "ConvInteger";
 		auto_pad = "NOTSET";
 		group = 1;
+		fold = false;
+		padded = false;
+	}
+
+	// Zero point folding, resolved in resolve_zero_points()
+	bool fold;                  // weights and their zero points are constants
+	bool padded;                // kernel can hit the padding
+	std::vector<int32_t> w_zero;
+
+	virtual const Tensor* get_x_zero(void) const {
+		if( inputs.size() > 2 && inputs[2]->is_used() )
+			return inputs[2];
+		return nullptr;
+	}
+	virtual const Tensor* get_w_zero(void) const {
+		if( inputs.size() > 3 && inputs[3]->is_used() )
+			return inputs[3];
+		return nullptr;
+	}
+	virtual const Tensor* get_bias(void) const { return nullptr; }
+	virtual std::string x_zero_name(void) const { return "x_zero_point"; }
+	virtual std::string w_zero_name(void) const { return "w_zero_point"; }
+
+	/* The input zero point, as a C expression */
+	std::string x_zero_c(void) const
+	{
+		const Tensor *x_zero = get_x_zero();
+		if( x_zero == nullptr )
+			return "0";
+		if( x_zero->data_buffer )
+			return std::to_string(constant_ints(x_zero, "x_zero_point")[0]);
+		return x_zero_name() + "[0]";
+	}
+	bool has_x_zero(void) const
+	{
+		return x_zero_c() != "0";
+	}
+	/* The weight zero point of output channel m, as a C expression */
+	std::string w_zero_c(void) const
+	{
+		if( fold == false )
+			return get_w_zero() ? w_zero_name() + "[" + (get_w_zero()->data_num_elem() > 1 ? "m" : "0") + "]" : "0";
+		for( int32_t zw : w_zero )
+			if( zw != w_zero[0] )
+				return "w_zero[m]";
+		return std::to_string(w_zero[0]);
+	}
+	// The input element, minus its zero point when that is not precomputed
+	std::string x_term(const std::string &x_el) const
+	{
+		if( (padded || fold == false) && has_x_zero() )
+			return "(" + x_el + " - " + x_zero_c() + ")";
+		return x_el;
+	}
+	std::string w_term(const std::string &w_el) const
+	{
+		if( fold == false && w_zero_c() != "0" )
+			return "(" + constant_acces_code(w_el) + " - " + w_zero_c() + ")";
+		return constant_acces_code(w_el);
 	}
 
 	virtual void print_output_cell_init(std::ostream &dst, const std::string &y_idx) const override
 	{
-		if( options.quantize )
-			INDT_3 << "int32_t cell = 0;" << std::endl;
+		INDT_3 << "int32_t cell = ";
+		if( get_bias() )
+			dst << "bias[m]";
 		else
-			INDT_3 << "y[b][m][o0][o1] = 0;" << std::endl;
+			dst << "0";
+		if( fold && padded == false && has_x_zero() )
+			dst << " + " << x_zero_c() << " * w_term[m]";
+		dst << ";" << std::endl;
+		if( fold && w_zero_c() != "0" )
+			INDT_3 << "int32_t x_sum = 0;" << std::endl;
 	}
 
 	virtual void print_output_cell_calc(
 		std::ostream &dst,
-		const std::string &x_idx,
-		const std::string &w_idx,
+		const std::string &x_el,
+		const std::string &w_el,
 		const std::string &y_idx) const override
 	{
-		std::string x_zero;
-		if( inputs.size() >= 3 ) // x_zero_point is optional, 3rd input
-			x_zero = constant_acces_code( "x_zero_point[0]");
-		else
-			x_zero = "0";
-
-		INDT_4 << get_W()->data_type_str() << " w_ = " << constant_acces_code("w[m][c][k0][k1]") << ";" << std::endl;
-		std::string dest;
-		if( options.quantize )
-			dest = "cell";
-		else
-			dest = "y[b][m][o0][o1]";
-
-		INDT_4 << dest << "+= (x[b][c][i0+k0][i1+k1] - " << x_zero << ") * w_;" << std::endl;
+		INDT_4 << "cell += " << x_term(x_el) << " * " << w_term(w_el) << ";" << std::endl;
+		if( fold && w_zero_c() != "0" )
+			INDT_4 << "x_sum += " << x_term(x_el) << ";" << std::endl;
 	}
 
 	virtual void print_output_cell_finalize(std::ostream &dst, const std::string &y_idx) const override
 	{
+		if( fold && w_zero_c() != "0" )
+			INDT_3 << "cell -= " << w_zero_c() << " * x_sum;" << std::endl;
+		print_output_cell_store(dst, y_idx);
+	}
+
+	virtual void print_output_cell_store(std::ostream &dst, const std::string &y_idx) const
+	{
+		// NB: this is the experimental onnx2c quantization, with a non conformant int8 output
 		if( options.quantize ) {
-			// TODO: this assumes 2D filter
-			int divisor = kernel_shape[0]*kernel_shape[1]*16;
+			int divisor = 16;
+			for( auto k : kernel_shape )
+				divisor *= k;
 			INDT_3 << "int32_t tmp = cell/" << divisor << ";" << std::endl;
 			INDT_3 << "tmp = tmp > 127?127:tmp;" << std::endl;
 			INDT_3 << "tmp = tmp < -127?-127:tmp;" << std::endl;
-			INDT_3 << "y[b][m][o0][o1] = tmp;" << std::endl;
+			INDT_3 << "y" << y_idx << " = tmp;" << std::endl;
 		}
+		else
+			INDT_3 << "y" << y_idx << " = cell;" << std::endl;
 	}
 
+	/* Print the precomputed tables of the zero point folding */
+	void print_zero_point_tables(std::ostream &dst) const
+	{
+		const Tensor *w = get_W();
+		int maps = w->data_dim[0];
+		int kernel_size = w->data_num_elem() / maps;
+		if( fold && padded == false && has_x_zero() ) {
+			// K*zw - sum(w) for each output channel
+			INDT_1 << "static const int32_t w_term[" << maps << "] = {";
+			for( int m=0; m<maps; m++ ) {
+				int32_t sum = 0;
+				for( int i=0; i<kernel_size; i++ )
+					sum += w->get_data_element(m*kernel_size+i);
+				dst << (m ? ", " : " ") << kernel_size*w_zero[w_zero.size() > 1 ? m : 0] - sum;
+			}
+			dst << " };" << std::endl;
+		}
+		if( fold && w_zero_c() == "w_zero[m]" ) {
+			INDT_1 << "static const int32_t w_zero[" << maps << "] = {";
+			for( int m=0; m<maps; m++ )
+				dst << (m ? ", " : " ") << w_zero[m];
+			dst << " };" << std::endl;
+		}
+	}
 
 	virtual void print(std::ostream &dst) const override
 	{
 		print_header_info_comment(dst);
+		print_zero_point_tables(dst);
 		print_loop_with_padding_checks(dst);
 	}
 
-	virtual void resolve(void) override
+	/* Resolve the attributes, and what can be folded. Call after registering inputs. */
+	void resolve_zero_points(void)
 	{
-		register_input(inputs[0], "x");
-		register_input(inputs[1], "w");
-
-		if( inputs.size() > 2 )
-			register_input(inputs[2], "x_zero_point");
-		if( inputs.size() > 3 ){
-			register_input(inputs[3], "w_zero_point");
-			ERROR("unimplemented: weight zero points");
-		}
-
-		if( get_X()->data_dim.size() != 4 )
-			ERROR("Unimplemented: ConvInteger for non 2D images");
-
-
 		resolve_strides();
 		resolve_dilations();
 		resolve_pads();
 		resolve_kernel_shape();
+		for( auto p : pads )
+			if( p != 0 )
+				padded = true;
+
+		const Tensor *w = get_W();
+		const Tensor *wz = get_w_zero();
+		int maps = w->data_dim[0];
+		if( wz && wz->data_num_elem() != 1 && wz->data_num_elem() != maps )
+			ERROR(op_name << " weight zero point must be a scalar or per output channel");
+		fold = w->data_buffer && (wz == nullptr || wz->data_buffer);
+		if( fold == false )
+			LOG(INFO) << op_name << " " << onnx_name << " has non-constant weights. Zero points are subtracted in the innermost loop." << std::endl;
+		else if( wz )
+			w_zero = constant_ints(wz, "w_zero_point");
+		else
+			w_zero = { 0 };
+	}
 
-		if( group != 1 )
-			ERROR("Unimplemented: ConvInteger: setting group to anything but 1");
-
-		for( int d : dilations )
-			if( d != 1 )
-				ERROR("Unimplemented: ConvInteger: dilations other than 1");
+	virtual void resolve(void) override
+	{
+		register_input(inputs[0], "x");
+		register_input(inputs[1], "w");
+		if( get_x_zero() )
+			register_input(inputs[2], x_zero_name());
+		if( get_w_zero() )
+			register_input(inputs[3], w_zero_name());
+		resolve_zero_points();
 
 		Tensor *rv = new Tensor;
 		rv->data_dim = resolve_output_size();
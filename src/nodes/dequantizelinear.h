@@ -0,0 +1,99 @@
+/* This file is part of onnx2c.
+ *
+ * DequantizeLinear node.
+ * Converts a quantized integer tensor to float:
+ * y = (x - x_zero_point) * x_scale
+ * The scale and zero point are either one for the whole
+ * tensor, or one for each index of dimension 'axis'.
+ */
+#include "quantizelinear.h"
+namespace toC {
+
+class DequantizeLinear : public Node {
+	public:
+	DequantizeLinear() {
+		op_name = "DequantizeLinear";
+		axis = 1;
+		block_size = 0;
+	}
+	int axis;
+	int block_size;
+
+	virtual void parseAttributes( onnx::NodeProto &node ) override {
+		for( const auto& a : node.attribute() ) {
+			LOG(TRACE) << "Parsing attribute " << a.name() << std::endl;
+			if( a.name() == "axis" )
+				axis = parse_attribute_int(a);
+			else if( a.name() == "block_size" )
+				block_size = parse_attribute_int(a);
+			else if( a.name() == "output_dtype" )
+				; // the output type is checked to be the type of the scale
+			else
+				ERROR("unknown attribute: " << a.name());
+		}
+	}
+
+	virtual void print(std::ostream &dst) const override
+	{
+		const Tensor *x = inputs[0];
+		const Tensor *scale = inputs[1];
+		const Tensor *zero_point = inputs.size() > 2 ? inputs[2] : nullptr;
+
+		INDT_1 << "/* DequantizeLinear */" << std::endl;
+		INDT_1 << "const " << x->data_type_str() << " *X = (const " << x->data_type_str() << "*)x;" << std::endl;
+		INDT_1 << "float *Y = (float*)y;" << std::endl;
+		INDT_1 << "for( uint32_t i=0; i<" << x->data_num_elem() << "; i++ ) {" << std::endl;
+		INDT_2 << "uint32_t a = " << axis_index(scale) << ";" << std::endl;
+		INDT_2 << "int32_t q = X[i]";
+		if( zero_point )
+			dst << " - " << QuantizeLinear::element(zero_point, "x_zero_point");
+		dst << ";" << std::endl;
+		INDT_2 << "Y[i] = q * " << QuantizeLinear::element(scale, "x_scale") << ";" << std::endl;
+		INDT_1 << "}" << std::endl;
+	}
+
+	/* C expression of the index into the scale and zero point of element 'i' of x */
+	std::string axis_index(const Tensor *scale) const
+	{
+		const Tensor *x = inputs[0];
+		if( scale->data_num_elem() == 1 )
+			return "0";
+		int inner = 1;
+		for( unsigned d=axis+1; d<x->rank(); d++ )
+			inner *= x->data_dim[d];
+		return "i / " + std::to_string(inner) + " % " + std::to_string(x->data_dim[axis]);
+	}
+
+	virtual void resolve(void) override
+	{
+		const Tensor *x = inputs[0];
+		const Tensor *scale = inputs[1];
+		register_input(x, "x");
+		register_input(scale, "x_scale");
+		if( inputs.size() > 2 && inputs[2]->is_used() )
+			register_input(inputs[2], "x_zero_point");
+		else
+			inputs.resize(2);
+
+		if( x->data_type != onnx::TensorProto_DataType_INT8
+		 && x->data_type != onnx::TensorProto_DataType_UINT8
+		 && x->data_type != onnx::TensorProto_DataType_INT16
+		 && x->data_type != onnx::TensorProto_DataType_UINT16
+		 && x->data_type != onnx::TensorProto_DataType_INT32 )
+			ERROR("Unimplemented: DequantizeLinear input of type " << x->data_type_str());
+		if( scale->data_type != onnx::TensorProto_DataType_FLOAT )
+			ERROR("Unimplemented: DequantizeLinear scale of type " << scale->data_type_str());
+		if( block_size != 0 )
+			ERROR("Unimplemented: blocked DequantizeLinear");
+		if( axis < 0 )
+			axis += x->rank();
+		if( scale->data_num_elem() != 1 && (axis < 0 || axis >= (int)x->rank() || scale->data_num_elem() != x->data_dim[axis]) )
+			ERROR("DequantizeLinear scale does not match the input on axis " << axis);
+
+		Tensor *t = new Tensor;
+		t->data_dim = x->data_dim;
+		t->data_type = onnx::TensorProto_DataType_FLOAT;
+		register_output(t, "y");
+	}
+};
+}
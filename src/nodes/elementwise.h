@@ -4,11 +4,25 @@
  * Some nodes are identical in description, differeing only in
  * the function applied
  * Calculates elementwise Y = func ( A )
+ *
+ * On 8 and 16 bit quantized inputs, func is evaluated at generation
+ * time for each possible input value, and the node is a table lookup.
+ * The quantization parameters come either from the calibration, or
+ * from the 'qdq' optimization pass, which gives them as constant
+ * inputs: x_scale, x_zero_point, y_scale, y_zero_point.
  */
+#include "fastmath.h"
+#include "quantization.h"
+#include <cmath>
+
 namespace toC {
 
 class Elementwise : public Node {
 	float alpha, beta, bias, gamma, lambd;
+	// The quantization parameters, with the output range, of a lookup table
+	bool lookup = false;
+	float x_scale, y_scale;
+	int32_t x_zero, y_zero, y_min, y_max;
 
 	public:
 	Elementwise(std::string op) {
@@ -38,7 +52,7 @@ class Elementwise : public Node {
 			alpha=1.0;
 			operation = [this](const std::string& x){
 				std::string a = std::to_string(alpha);
-				return  "fmax(0,"+x+") + fmin(0,"+a+"*(exp("+x+"/"+a+")-1));"; };
+				return  "fmax(0,"+x+") + fmin(0,"+a+"*("+math_function("exp")+"("+x+"/"+a+")-1));"; };
 		}
 		else if( op == "Cos" )
 			operation = [](const std::string& x){ return  "cosf("+x+");"; };
@@ -50,12 +64,12 @@ class Elementwise : public Node {
 			alpha=1.0;
 			operation = [this](const std::string& x){
 				std::string a = std::to_string(alpha);
-				return x+">0 ? "+x+": "+a+"*(exp("+x+")-1);"; };
+				return x+">0 ? "+x+": "+a+"*("+math_function("exp")+"("+x+")-1);"; };
 		}
 		else if( op == "Erf" )
-			operation = [](const std::string& x){ return  "erff("+x+");"; };
+			operation = [](const std::string& x){ return  math_function("erff")+"("+x+");"; };
 		else if( op == "Exp" )
-			operation = [](const std::string& x){ return  "expf("+x+");"; };
+			operation = [](const std::string& x){ return  math_function("expf")+"("+x+");"; };
 		else if( op == "HardSigmoid" ) {
 			alpha=0.2;
 			beta=0.5;
@@ -82,7 +96,7 @@ class Elementwise : public Node {
 				return x+">0 ? "+x+" : " +x+ "*" +a+ ";"; };
 		}
 		else if( op == "Log" )
-			operation = [](const std::string& x){ return  "logf("+x+");"; };
+			operation = [](const std::string& x){ return  math_function("logf")+"("+x+");"; };
 		else if( op == "Neg" )
 			operation = [](const std::string& x){ return  " -"+x+";"; };
 		else if( op == "Not" )
@@ -107,7 +121,7 @@ class Elementwise : public Node {
 				std::string a = std::to_string(alpha);
 				std::string c = std::to_string(gamma);
 				//`y = gamma * (alpha * e^x - alpha) for x <= 0`, `y = gamma * x for x > 0`,
-				return x+">0 ? "+c+"*"+x+": "+c+"*("+a+"*exp("+x+")-"+a+");"; };
+				return x+">0 ? "+c+"*"+x+": "+c+"*("+a+"*"+math_function("exp")+"("+x+")-"+a+");"; };
 		}
 		else if( op == "Shrink" ) {
 			operation = [this](const std::string& x){
@@ -123,7 +137,7 @@ class Elementwise : public Node {
 			};
 		}
 		else if( op == "Sigmoid" )
-			operation = [](const std::string& x){ return  "1/(1+exp(-"+x+"));"; };
+			operation = [](const std::string& x){ return  "1/(1+"+math_function("exp")+"(-"+x+"));"; };
 		else if( op == "Sign" )
 			operation = [](const std::string& x){ return  ""+x+"<0?-1:"+x+">0?1:0;"; };
 		else if( op == "Sin" )
@@ -131,7 +145,7 @@ class Elementwise : public Node {
 		else if( op == "Sinh" )
 			operation = [](const std::string& x){ return  "sinhf("+x+");"; };
 		else if( op == "Softplus" )
-			operation = [](const std::string& x){ return  "logf(exp("+x+")+1);"; };
+			operation = [](const std::string& x){ return  math_function("logf")+"("+math_function("exp")+"("+x+")+1);"; };
 		else if( op == "Softsign" )
 			operation = [](const std::string& x){ return  ""+x+"/(1+fabsf("+x+"));"; };
 		else if( op == "Sqrt" )
@@ -139,7 +153,7 @@ class Elementwise : public Node {
 		else if( op == "Tan" )
 			operation = [](const std::string& x){ return  "tanf("+x+");"; };
 		else if( op == "Tanh" )
-			operation = [](const std::string& x){ return  "tanhf("+x+");"; };
+			operation = [](const std::string& x){ return  math_function("tanhf")+"("+x+");"; };
 		else if( op == "ThresholdedRelu" ) {
 			alpha=1.0f;
 			operation = [this](const std::string& x){
@@ -155,6 +169,108 @@ class Elementwise : public Node {
 		[](const std::string& x){ ERROR("onnx2c internal error"); return ""; };
 
 
+	/* The operation evaluated at generation time, for the lookup tables.
+	 * Returns false for operations without one. */
+	bool host_operation(double x, double &y) const
+	{
+		if( op_name == "Celu" )
+			y = std::max(0.0, x) + std::min(0.0, alpha*(std::exp(x/alpha)-1));
+		else if( op_name == "Elu" )
+			y = x > 0 ? x : alpha*(std::exp(x)-1);
+		else if( op_name == "Erf" )
+			y = std::erf(x);
+		else if( op_name == "Exp" )
+			y = std::exp(x);
+		else if( op_name == "HardSigmoid" )
+			y = std::max(0.0, std::min(1.0, alpha*x+beta));
+		else if( op_name == "HardSwish" )
+			y = x * std::max(0.0, std::min(1.0, alpha*x+beta));
+		else if( op_name == "LeakyRelu" )
+			y = x > 0 ? x : x*alpha;
+		else if( op_name == "Log" )
+			y = std::log(x);
+		else if( op_name == "Selu" )
+			y = x > 0 ? gamma*x : gamma*(alpha*std::exp(x)-alpha);
+		else if( op_name == "Sigmoid" )
+			y = 1/(1+std::exp(-x));
+		else if( op_name == "Softplus" )
+			y = std::log(std::exp(x)+1);
+		else if( op_name == "Softsign" )
+			y = x/(1+std::fabs(x));
+		else if( op_name == "Sqrt" )
+			y = std::sqrt(x);
+		else if( op_name == "Tanh" )
+			y = std::tanh(x);
+		else
+			return false;
+		return true;
+	}
+
+	/* Print the table of the quantized results for each input value,
+	 * and the loop looking them up */
+	void print_lookup(std::ostream &dst) const
+	{
+		const Tensor *X = inputs[0];
+		const Tensor *Y = outputs[0];
+		float xs = x_scale, ys = y_scale;
+		if( inputs.size() == 1 ) {
+			// calibrated: symmetric, scales known once all nodes are resolved
+			xs = X->quant_scale();
+			ys = Y->quant_scale();
+		}
+		int32_t x_min, x_max;
+		quantized_range(X->data_type, x_min, x_max);
+
+		std::vector<int32_t> table;
+		for( int32_t q=x_min; q<=x_max; q++ ) {
+			double y;
+			host_operation((double)(q - x_zero) * xs, y);
+			// Saturating as QuantizeLinear. NaNs (e.g. log of negative values) to the zero point.
+			double v = std::isnan(y) ? y_zero : std::nearbyint(y / ys) + y_zero;
+			table.push_back( std::max<double>(y_min, std::min<double>(y_max, v)) );
+		}
+
+		INDT_1 << "/* " << op_name << " of each input value, quantized" << std::endl;
+		INDT_1 << "   x_scale = " << xs << ", x_zero_point = " << x_zero << std::endl;
+		INDT_1 << "   y_scale = " << ys << ", y_zero_point = " << y_zero << std::endl;
+		INDT_1 << "*/" << std::endl;
+		INDT_1 << "static const " << Y->data_type_str() << " lut[" << table.size() << "]";
+		if( options.target_avr )
+			dst << " PROGMEM";
+		dst << " = {";
+		for( unsigned i=0; i<table.size(); i++ ) {
+			if( i % 16 == 0 )
+				dst << std::endl << "\t\t";
+			dst << table[i];
+			if( i < table.size()-1 )
+				dst << ", ";
+		}
+		dst << std::endl;
+		INDT_1 << "};" << std::endl;
+
+		std::string Xidx = "X";
+		std::string Yidx = "Y";
+		for( unsigned r=0; r< Y->rank(); r++) {
+			std::string lv = "i" + std::to_string(r);
+			INDT_1 << "for (unsigned " << lv << "=0; " << lv << "<" << Y->str_dim(r) << "; " << lv << "++) {" << std::endl;
+			Xidx += "[" + lv + "]";
+			Yidx += "[" + lv + "]";
+		}
+		std::string entry = "lut[" + Xidx + (x_min ? " + " + std::to_string(-x_min) : "") + "]";
+		// The read is as wide as an entry of the table, i.e. of Y. Not of X:
+		// e.g. int8 -> int16 tables have 256 entries of two bytes.
+		if( options.target_avr && Y->data_elem_size() == 2 )
+			INDT_2 << Yidx << " = pgm_read_word(&" << entry << ");" << std::endl;
+		else if( options.target_avr )
+			// RD_PROGMEM() brings its own semicolon
+			INDT_2 << Yidx << " = " << constant_acces_code(entry) << std::endl;
+		else
+			INDT_2 << Yidx << " = " << entry << ";" << std::endl;
+		for( unsigned r=0; r<Y->rank(); r++) {
+			INDT_1 << "}" << std::endl;
+		}
+	}
+
 	// NB: not all ONNX operators implemented with Elementwise have attributes.
 	// This gets the attributes over an union of all implemented operators
 	virtual void parseAttributes( onnx::NodeProto &node ) override {
@@ -180,18 +296,36 @@ class Elementwise : public Node {
 	virtual void print(std::ostream &dst) const override
 	{
 		const Tensor *Y = outputs[0];
+		if( lookup ) {
+			print_lookup(dst);
+			return;
+		}
 		INDT_1 << "/* " << op_name << std::endl;
 		INDT_1 << "   alpha = " << alpha << std::endl;
 		INDT_1 << "   beta = " << beta << std::endl;
 		INDT_1 << "*/" << std::endl;
 
+		if( options.flat_pointers && Y->rank() > 0 ) {
+			std::vector<std::string> bounds;
+			for( unsigned r=0; r< Y->rank(); r++)
+				bounds.push_back(Y->str_dim(r));
+			std::vector<flat_pointer> ptrs = {
+				{"X", "const " + inputs[0]->data_type_str(), flat_strides(inputs[0], Y->rank())},
+				{"Y", Y->data_type_str(), flat_strides(Y, Y->rank())}
+			};
+			std::vector<std::string> el = print_flat_loops_begin(dst, bounds, ptrs);
+			INDT_2 << el[1] << " = " << operation(el[0]) << std::endl;
+			print_flat_loops_end(dst, Y->rank());
+			return;
+		}
+
 		// print out the loops over all C dimensions.
 		// at the same time, create the indexing strings into X and Y
 		std::string Xidx = "X";
 		std::string Yidx = "Y";
 		for( unsigned r=0; r< Y->rank(); r++) {
 			std::string lv = "i" + std::to_string(r);
-			INDT_1 << "for (unsigned " << lv << "=0; " << lv << "<" << Y->data_dim[r] << "; " << lv << "++) {" << std::endl;
+			INDT_1 << "for (unsigned " << lv << "=0; " << lv << "<" << Y->str_dim(r) << "; " << lv << "++) {" << std::endl;
 
 			Xidx += "[" + lv + "]";
 			Yidx += "[" + lv + "]";
@@ -205,6 +339,11 @@ class Elementwise : public Node {
 	}
 
 
+	virtual bool handles_runtime_dim(void) const override
+	{
+		return true;
+	}
+
 	virtual void resolve(void) override
 	{
 		const Tensor *X = inputs[0];
@@ -213,6 +352,29 @@ class Elementwise : public Node {
 		Tensor *t = new Tensor;
 		t->data_dim = X->data_dim;
 		t->data_type = X->data_type;
+
+		double y;
+		if( inputs.size() == 5 ) {
+			if( host_operation(0, y) == false )
+				ERROR("onnx2c internal error: no lookup table for " << op_name);
+			register_input(inputs[1], "x_scale");
+			register_input(inputs[2], "x_zero_point");
+			register_input(inputs[3], "y_scale");
+			register_input(inputs[4], "y_zero_point");
+			x_scale = constant_floats(inputs[1], op_name + " x_scale")[0];
+			x_zero = constant_ints(inputs[2], op_name + " x_zero_point")[0];
+			y_scale = constant_floats(inputs[3], op_name + " y_scale")[0];
+			y_zero = constant_ints(inputs[4], op_name + " y_zero_point")[0];
+			t->data_type = inputs[4]->data_type;
+			quantized_range(t->data_type, y_min, y_max);
+			lookup = true;
+		}
+		else if( quantization_calibrated() && X->data_type == onnx::TensorProto_DataType_INT8 && host_operation(0, y) ) {
+			x_zero = y_zero = 0;
+			y_min = -127;
+			y_max = 127;
+			lookup = true;
+		}
 		register_output(t, "Y");
 	}
 };
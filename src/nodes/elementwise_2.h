@@ -3,6 +3,9 @@
  * Generic node for two input tensors.
  * Calculates elementvise C = A <op> B
  */
+#include "quantization.h"
+#include "simd.h"
+
 namespace toC {
 
 class Elementwise_2 : public Node {
@@ -124,11 +127,21 @@ class Elementwise_2 : public Node {
 		INDT_1 << "   fmod: " << fmod << std::endl;
 		INDT_1 << " */" << std::endl;
 
+		if( simd_op() ) {
+			print_simd(dst);
+			return;
+		}
+
 		// C = A ? B
 		Tensor *A = inputs[0];
 		Tensor *B = inputs[1];
 		Tensor *C = outputs[0];
 
+		if( options.flat_pointers && C->rank() > 0 ) {
+			print_flat(dst);
+			return;
+		}
+
 		// if either A or B does not have enough dimensions, prepend
 		// dimensions of 1 to match rank of C
 		std::vector<int> padA = A->data_dim;
@@ -145,7 +158,7 @@ class Elementwise_2 : public Node {
 		std::string Cidx = "C";
 		for( unsigned r=0; r<C->rank(); r++) {
 			std::string lv = "i" + std::to_string(r);
-			INDT_1 << "for (unsigned " << lv << "=0; " << lv << "<" << C->data_dim[r] << "; " << lv << "++) {" << std::endl;
+			INDT_1 << "for (unsigned " << lv << "=0; " << lv << "<" << C->str_dim(r) << "; " << lv << "++) {" << std::endl;
 
 			if (padA[r]==1)
 				Aidx += "[0]";
@@ -159,22 +172,177 @@ class Elementwise_2 : public Node {
 		}
 
 
-		if( options.quantize ) {
-			INDT_2 << "int32_t tmp = " << operation(Aidx, Bidx) << ";" << std::endl;
+		if( options.quantize )
+			print_quantized_element(dst, Aidx, Bidx, Cidx);
+		else
+			INDT_2 << Cidx << " = " << operation(Aidx, Bidx) << ";" << std::endl;
+
+		for( unsigned r=0; r<C->rank(); r++) {
+			INDT_1 << "}" << std::endl;
+		}
+	}
+
+
+	/* Calculate one element c = a ? b of quantized tensors.
+	 * With calibration, Add and Sub bring a and b to the output scale
+	 * with 16 bit fractional multipliers. Mul requantizes the product. */
+	void print_quantized_element(std::ostream &dst, const std::string &a, const std::string &b, const std::string &c) const
+	{
+		if( quantization_calibrated() == false ) {
+			INDT_2 << "int32_t tmp = " << operation(a, b) << ";" << std::endl;
 			// TODO: division amount here depends on operand
 			INDT_2 << "tmp = tmp/2;" << std::endl;
 			INDT_2 << "tmp = tmp > 127?127:tmp;" << std::endl;
 			INDT_2 << "tmp = tmp < -127?-127:tmp;" << std::endl;
-			INDT_2 << Cidx << "= tmp;" << std::endl;
+			INDT_2 << c << "= tmp;" << std::endl;
+			return;
+		}
+
+		float sa = inputs[0]->quant_scale();
+		float sb = inputs[1]->quant_scale();
+		float sc = outputs[0]->quant_scale();
+		if( op_name == "Add" || op_name == "Sub" ) {
+			int64_t ka = std::llround(sa / sc * 65536);
+			int64_t kb = std::llround(sb / sc * 65536);
+			char op = op_name == "Add" ? '+' : '-';
+			INDT_2 << "int64_t acc = (int64_t)" << a << "*" << ka << " " << op << " (int64_t)" << b << "*" << kb << ";" << std::endl;
+			INDT_2 << c << " = " << requantize("acc", "1", "16") << ";" << std::endl;
+		}
+		else if( op_name == "Mul" ) {
+			int32_t mult, shift;
+			quantize_multiplier(sa * sb / sc, mult, shift);
+			INDT_2 << "int32_t acc = (int32_t)" << a << "*" << b << ";" << std::endl;
+			INDT_2 << c << " = " << requantize("acc", std::to_string(mult), std::to_string(shift)) << ";" << std::endl;
 		}
 		else
-			INDT_2 << Cidx << " = " << operation(Aidx, Bidx) << ";" << std::endl;
+			ERROR("Unimplemented: calibrated quantization of " << op_name);
+	}
 
-		for( unsigned r=0; r<C->rank(); r++) {
+	/* As print(), but walking the tensors with flat pointers. A broadcast
+	 * operand's pointer stays put in the loops it is broadcast over. */
+	void print_flat(std::ostream &dst) const
+	{
+		const Tensor *A = inputs[0];
+		const Tensor *B = inputs[1];
+		const Tensor *C = outputs[0];
+
+		std::vector<std::string> bounds;
+		for( unsigned r=0; r<C->rank(); r++)
+			bounds.push_back(C->str_dim(r));
+		std::vector<flat_pointer> ptrs = {
+			{"A", "const " + A->data_type_str(), flat_strides(A, C->rank())},
+			{"B", "const " + B->data_type_str(), flat_strides(B, C->rank())},
+			{"C", C->data_type_str(), flat_strides(C, C->rank())}
+		};
+		std::vector<std::string> el = print_flat_loops_begin(dst, bounds, ptrs);
+
+		if( options.quantize )
+			print_quantized_element(dst, el[0], el[1], el[2]);
+		else
+			INDT_2 << el[2] << " = " << operation(el[0], el[1]) << ";" << std::endl;
+
+		print_flat_loops_end(dst, C->rank());
+	}
+
+	/* The arithmetic operator to use in explicit SIMD code,
+	 * or 0 if this node is printed as scalar code */
+	char simd_op(void) const
+	{
+		const Tensor *A = inputs[0];
+		const Tensor *B = inputs[1];
+		const Tensor *C = outputs[0];
+		if( simd_enabled() == false || options.quantize )
+			return 0;
+		if( A->data_type != onnx::TensorProto_DataType_FLOAT
+		  ||B->data_type != onnx::TensorProto_DataType_FLOAT )
+			return 0;
+		// the innermost dimension must be static for the remainder to be known
+		if( A->rank() == 0 || B->rank() == 0 || (C->rank() == 1 && C->runtime_dim != "") )
+			return 0;
+
+		if( op_name == "Add" ) return '+';
+		if( op_name == "Sub" ) return '-';
+		if( op_name == "Mul" ) return '*';
+		if( op_name == "Div" ) return '/';
+		return 0;
+	}
+
+	/* As print(), but the innermost dimension is calculated in full vectors,
+	 * and the remainder with scalar code. An operand that is broadcast
+	 * along the innermost dimension is splat to all vector lanes. */
+	void print_simd(std::ostream &dst) const
+	{
+		const Tensor *A = inputs[0];
+		const Tensor *B = inputs[1];
+		const Tensor *C = outputs[0];
+		unsigned last = C->rank()-1;
+
+		std::vector<int> padA = A->data_dim;
+		std::vector<int> padB = B->data_dim;
+		for( unsigned i=0; i< (C->rank() - A->rank()); i++)
+			padA.insert(padA.begin(), 0);
+		for( unsigned i=0; i< (C->rank() - B->rank()); i++)
+			padB.insert(padB.begin(), 0);
+
+		std::string Aidx = "A";
+		std::string Bidx = "B";
+		std::string Cidx = "C";
+		for( unsigned r=0; r<last; r++) {
+			std::string lv = "i" + std::to_string(r);
+			INDT_1 << "for (unsigned " << lv << "=0; " << lv << "<" << C->str_dim(r) << "; " << lv << "++) {" << std::endl;
+
+			if (padA[r]==1)
+				Aidx += "[0]";
+			else if(padA[r]!=0)
+				Aidx += "[" + lv + "]";
+			if (padB[r]==1)
+				Bidx += "[0]";
+			else if(padB[r]!=0)
+				Bidx += "[" + lv + "]";
+			Cidx +="[" + lv + "]";
+		}
+
+		std::string lv = "i" + std::to_string(last);
+		unsigned width = simd_width();
+		unsigned n = C->data_dim[last];
+		unsigned n_vec = n / width * width;
+		std::string Avec = padA[last]==1 ? simd_set1(Aidx+"[0]") : simd_load("&"+Aidx+"["+lv+"]");
+		std::string Bvec = padB[last]==1 ? simd_set1(Bidx+"[0]") : simd_load("&"+Bidx+"["+lv+"]");
+		std::string Asc = padA[last]==1 ? Aidx+"[0]" : Aidx+"["+lv+"]";
+		std::string Bsc = padB[last]==1 ? Bidx+"[0]" : Bidx+"["+lv+"]";
+
+		if( n_vec > 0 ) {
+			INDT_1 << "for (unsigned " << lv << "=0; " << lv << "<" << n_vec << "; " << lv << "+=" << width << ")" << std::endl;
+			INDT_2 << simd_store("&"+Cidx+"["+lv+"]", simd_arith(simd_op(), Avec, Bvec)) << ";" << std::endl;
+		}
+		if( n_vec < n ) {
+			INDT_1 << "for (unsigned " << lv << "=" << n_vec << "; " << lv << "<" << n << "; " << lv << "++)" << std::endl;
+			INDT_2 << Cidx << "[" << lv << "] = " << operation(Asc, Bsc) << std::endl;
+		}
+
+		for( unsigned r=0; r<last; r++) {
 			INDT_1 << "}" << std::endl;
 		}
 	}
 
+	/* The run time variable input must span the outermost dimension of C,
+	 * and the other input must either vary along it, or be broadcast over it. */
+	virtual bool handles_runtime_dim(void) const override
+	{
+		const Tensor *C = outputs[0];
+		for( const Tensor *t : {inputs[0], inputs[1]} ) {
+			if( t->rank() < C->rank() )
+				continue;
+			if( t->runtime_dim != "" )
+				continue;
+			if( t->data_dim[0] != 1 )
+				return false;
+		}
+		for( const Tensor *t : {inputs[0], inputs[1]} )
+			if( t->runtime_dim != "" && t->rank() != C->rank() )
+				return false;
+		return true;
+	}
 
 	virtual void resolve(void) override
 	{
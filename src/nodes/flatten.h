@@ -34,12 +34,17 @@ class Flatten : public Node {
 		dst << "\t" << type << " *input_ = (" << type << "*)input;" << std::endl;
 		dst << "\t" << type << " *output_ = (" << type << "*)output;" << std::endl;
 
-		dst << "\t" << "for( uint32_t i=0; i<" << input->data_num_elem() << "; i++ )" << std::endl;
+		dst << "\t" << "for( uint32_t i=0; i<" << input->str_num_elem() << "; i++ )" << std::endl;
 		dst << "\t\toutput_[i] = input_[i];" << std::endl;
 		dst << std::endl;
 	}
 
-
+	/* Only when the outermost input dimension maps
+	 * directly to the outer dimension of the output */
+	virtual bool handles_runtime_dim(void) const override
+	{
+		return axis == 1 || axis == -(int)inputs[0]->rank() + 1;
+	}
 
 	virtual void resolve(void) override
 	{
@@ -7,6 +7,9 @@
  * C need not be of size A*B, but must be
  * 'unidirectionally broadcastable' to A*B.
  */
+#include "quantization.h"
+#include "simd.h"
+
 namespace toC {
 
 class Gemm : public Node {
@@ -61,7 +64,7 @@ class Gemm : public Node {
 		int M = transA ? A->data_dim[1] : A->data_dim[0]; // row
 		int K = transA ? A->data_dim[0] : A->data_dim[1]; // inner
 		int N = transB ? B->data_dim[0] : B->data_dim[1]; // column
-		std::string type = A->data_type_str();
+		std::string acc_type = A->accumulator_type_str();
 
 		// Documentation if someone is reading the code
 		dst << "\t/* Gemm */" << std::endl;
@@ -72,11 +75,34 @@ class Gemm : public Node {
 		dst << "\t */" << std::endl;
 
 		// Helper variables to make the code (both this and generated) cleaner
-		dst << "\t" << "const int M = " << M << ";" << std::endl;
-		dst << "\t" << "const int K = " << K << ";" << std::endl;
-		dst << "\t" << "const int N = " << N << ";" << std::endl;
-		dst << "\t" << "float alpha = " << alpha << ";" << std::endl;
-		dst << "\t" << "float beta = " << beta << ";" << std::endl;
+		if( transA )
+			dst << "\t" << "const int M = " << M << ";" << std::endl;
+		else
+			dst << "\t" << "const int M = " << A->str_dim(0) << ";" << std::endl;
+		// Sparse B: the nonzeros of each column c, and their rows i
+		bool sparse = B->sparse_axis >= 0;
+		if( (sparse == false && B->inlined == false) || options.quantize )
+			dst << "\t" << "const int K = " << K << ";" << std::endl;
+		if( B->inlined == false )
+			dst << "\t" << "const int N = " << N << ";" << std::endl;
+		if( quantization_calibrated() ) {
+			// Y[r][c] = alpha*scale(A)*scale(B[c])*(AB[r][c] + C_[r][c]) / scale(Y)
+			std::vector<double> reals;
+			for( int c=0; c<(B->quant_axis < 0 ? 1 : N); c++ )
+				reals.push_back( alpha * A->quant_scale() * B->quant_scale(c) / outputs[0]->quant_scale() );
+			print_requantize_tables(dst, reals);
+		}
+		else {
+			dst << "\t" << "float alpha = " << alpha << ";" << std::endl;
+			dst << "\t" << "float beta = " << beta << ";" << std::endl;
+		}
+
+		if( sparse ) {
+			std::vector<int> starts, rows;
+			B->sparse_layout(starts, rows);
+			print_index_table(dst, "B_start", starts);
+			print_index_table(dst, "B_row", rows);
+		}
 
 		std::string A_el = transA ? "A[i][r]" : "A[r][i]";
 		std::string B_idx = transB ? "[c][i]" : "[i][c]";
@@ -94,14 +120,15 @@ class Gemm : public Node {
 					break;
 				case 1:
 					dim = C->data_dim[0];
-					if( dim == M ){
-						C0=M;
-						C1=1;
-					}
-					else if ( dim == N ) {
+					// unidirectional broadcast: a vector is a row, check that first
+					if ( dim == N ) {
 						C0=1;
 						C1=N;
 					}
+					else if( dim == M ){
+						C0=M;
+						C1=1;
+					}
 					else if ( dim == 1 ) {
 						C0=1;
 						C1=1;
@@ -125,34 +152,80 @@ class Gemm : public Node {
 				C_idx += "[0]";
 			else
 				C_idx += "[c]";
-			INDT_1 << type << " (*C_)["<<C1<<"]  = (" << type << "(*)["<<C1<<"])C;" << std::endl;
+			std::string C_type = C->data_type_str();
+			INDT_1 << C_type << " (*C_)["<<C1<<"]  = (" << C_type << "(*)["<<C1<<"])C;" << std::endl;
 		}
 
 
 		// Now genereate the calculation source code
+		if( B->inlined ) {
+			print_inlined_columns(dst, C_idx);
+			return;
+		}
 
-		// Loop output rows, columns
-		INDT_1 << "for( uint32_t r=0; r<M; r++ )" << std::endl;
-		INDT_2 << "for( uint32_t c=0; c<N; c++ ) {" << std::endl;
+		// Loop output rows, columns.
+		// With explicit SIMD, full vectors of output columns first, and the remaining columns
+		// with the scalar code
+		int N_vec = 0;
+		INDT_1 << "for( uint32_t r=0; r<M; r++ ) {" << std::endl;
+		if( use_simd() ) {
+			N_vec = N / simd_width() * simd_width();
+			print_simd_columns(dst, N_vec, A_el, C_idx);
+		}
+		if( N_vec == N ) {
+			INDT_1 << "}" << std::endl;
+			return;
+		}
+		INDT_2 << "for( uint32_t c=" << N_vec << "; c<N; c++ ) {" << std::endl;
 
 		/* Calculate the matrix muliplication dot inner dot product */
 		if( options.quantize ) {
 			INDT_3 << "int32_t ABrc = 0;" << std::endl;
 		}
 		else {
-			INDT_3 << type <<" ABrc = 0;" << std::endl;
+			INDT_3 << acc_type <<" ABrc = 0;" << std::endl;
 		}
-		INDT_3 << "for( uint32_t i=0; i<K; i++ ) {" << std::endl;
-		INDT_4 <<   B->data_type_str() << " B_el = " << constant_acces_code( "B" + B_idx ) << ";" << std::endl;
+		if( sparse ) {
+			INDT_3 << "for( uint32_t j=B_start[c]; j<B_start[c+1]; j++ ) {" << std::endl;
+			INDT_4 << "uint32_t i = B_row[j];" << std::endl;
+		}
+		else
+			INDT_3 << "for( uint32_t i=0; i<K; i++ ) {" << std::endl;
+		// B_el is widened, so that 16 bit floats are multiplied in float
+		if( sparse )
+			INDT_4 << B->accumulator_type_str() << " B_el = " << constant_acces_code( "B[j]" ) << ";" << std::endl;
+		else if( B->pack_bits )
+			INDT_4 << B->accumulator_type_str() << " B_el = " << B->packed_element("B", transB ? "c*K+i" : "i*N+c") << ";" << std::endl;
+		else
+			INDT_4 << B->accumulator_type_str() << " B_el = " << constant_acces_code( "B" + B_idx ) << ";" << std::endl;
 		INDT_4 <<   "ABrc += " << A_el << " * B_el;" << std::endl;
 		INDT_3 << "}" << std::endl;
 
+		print_column_store(dst, C_idx);
+		INDT_2 << "}" << std::endl;
+		INDT_1 << "}" << std::endl;
+	}
+
+	/* Scale the dot product ABrc of row r and column c, add the bias and store it */
+	void print_column_store(std::ostream &dst, const std::string &C_idx) const
+	{
+		const Tensor *B  = inputs[1];
+		const Tensor *C  = inputs.size() > 2 ? inputs[2]:nullptr;
+		std::string acc_type = inputs[0]->accumulator_type_str();
+		if( quantization_calibrated() ) {
+			INDT_3 << "int32_t tmp = ABrc;" << std::endl;
+			if( C && beta != 0 )
+				INDT_3 << "tmp += C_" << C_idx << ";" << std::endl;
+			std::string ch = B->quant_axis < 0 ? "[0]" : "[c]";
+			INDT_3 << "Y[r][c] = " << requantize("tmp", "mult" + ch, "shift" + ch) << ";" << std::endl;
+			return;
+		}
 
 		/* Add scale & bias, store result in output */
 		if( options.quantize )
 			INDT_3 << "int32_t tmp = ABrc * alpha;" << std::endl;
 		else
-			INDT_3 << type <<" tmp = ABrc * alpha;" << std::endl;
+			INDT_3 << acc_type <<" tmp = ABrc * alpha;" << std::endl;
 
 		if( C ) {
 			INDT_3 << "tmp += C_" << C_idx << " * beta;" << std::endl;
@@ -165,10 +238,131 @@ class Gemm : public Node {
 		}
 
 		INDT_3 << "Y[r][c] = tmp;" << std::endl;
+	}
 
+	/* Inlined B: each column as straight-line code, with the values of B as literals */
+	void print_inlined_columns(std::ostream &dst, const std::string &C_idx) const
+	{
+		const Tensor *A  = inputs[0];
+		const Tensor *B  = inputs[1];
+		int K = transA ? A->data_dim[0] : A->data_dim[1];
+		int N = transB ? B->data_dim[0] : B->data_dim[1];
+		std::string acc_type = options.quantize ? "int32_t" : A->accumulator_type_str();
+		INDT_1 << "for( uint32_t r=0; r<M; r++ ) {" << std::endl;
+		for( int c=0; c<N; c++ ) {
+			INDT_2 << "{" << std::endl;
+			INDT_3 << "const uint32_t c = " << c << ";" << std::endl;
+			INDT_3 << acc_type << " ABrc = 0;" << std::endl;
+			for( int i=0; i<K; i++ ) {
+				std::string A_el = transA ? "A[" + std::to_string(i) + "][r]" : "A[r][" + std::to_string(i) + "]";
+				std::string mac = inlined_mac("ABrc", A_el, B, transB ? c*K+i : i*N+c);
+				if( mac != "" )
+					INDT_3 << mac << std::endl;
+			}
+			print_column_store(dst, C_idx);
+			INDT_2 << "}" << std::endl;
+		}
 		INDT_1 << "}" << std::endl;
 	}
 
+	virtual bool accepts_packed(const Tensor *t, int bits, bool &columns) const override
+	{
+		return t == inputs[1] && t != inputs[0];
+	}
+
+	virtual bool accepts_sparse(const Tensor *t, int &axis) const override
+	{
+		axis = transB ? 0 : 1;
+		return t == inputs[1] && t != inputs[0];
+	}
+
+	virtual bool accepts_inlined(const Tensor *t) const override
+	{
+		return t == inputs[1] && t != inputs[0];
+	}
+
+	bool use_simd(void) const
+	{
+		return simd_enabled()
+		    && options.quantize == false
+		    && transB == 0
+		    && inputs[1]->pack_bits == 0
+		    && inputs[1]->sparse_axis < 0
+		    && inputs[1]->inlined == false
+		    && inputs[0]->data_type == onnx::TensorProto_DataType_FLOAT
+		    && inputs[1]->data_type == onnx::TensorProto_DataType_FLOAT;
+	}
+
+	/* Print the loop over the first N_vec output columns of row 'r', a vector
+	 * of columns at a time. Each vector is accumulated from A[r][i] splat
+	 * times a vector of row i of B. */
+	void print_simd_columns(std::ostream &dst, int N_vec, const std::string &A_el, const std::string &C_idx) const
+	{
+		const Tensor *C  = inputs.size() > 2 ? inputs[2]:nullptr;
+		std::string vtype = simd_type();
+
+		INDT_2 << "for( uint32_t c=0; c<" << N_vec << "; c+=" << simd_width() << " ) {" << std::endl;
+		INDT_3 << vtype << " ABrc = " << simd_set1("0.0f") << ";" << std::endl;
+		INDT_3 << "for( uint32_t i=0; i<K; i++ )" << std::endl;
+		INDT_4 << "ABrc = " << simd_fmadd(simd_set1(A_el), simd_load("&B[i][c]"), "ABrc") << ";" << std::endl;
+		INDT_3 << vtype << " tmp = " << simd_arith('*', "ABrc", simd_set1("alpha")) << ";" << std::endl;
+		if( C ) {
+			// C_idx is either [..][c] for a row of C, or [..][0] when C is broadcast over the columns
+			std::string C_vec;
+			if( C_idx.substr(C_idx.size()-3) == "[c]" )
+				C_vec = simd_load("&C_" + C_idx);
+			else
+				C_vec = simd_set1("C_" + C_idx);
+			INDT_3 << "tmp = " << simd_fmadd(C_vec, simd_set1("beta"), "tmp") << ";" << std::endl;
+		}
+		INDT_3 << simd_store("&Y[r][c]", "tmp") << ";" << std::endl;
+		INDT_2 << "}" << std::endl;
+	}
+
+
+	/* Run time variable number of rows in A. C must then be broadcast over the rows. */
+	virtual bool handles_runtime_dim(void) const override
+	{
+		const Tensor *A = inputs[0];
+		const Tensor *B = inputs[1];
+		if( transA || A->runtime_dim == "" || B->runtime_dim != "" )
+			return false;
+		if( inputs.size() < 3 )
+			return true;
+		const Tensor *C = inputs[2];
+		int N = transB ? B->data_dim[0] : B->data_dim[1];
+		if( C->runtime_dim != "" )
+			return false;
+		if( C->rank() == 1 )
+			return C->data_dim[0] == N || C->data_dim[0] == 1;
+		if( C->rank() == 2 )
+			return C->data_dim[0] == 1;
+		return false;
+	}
+
+	/* Calibrated quantization: B per column, unless a bias C is broadcast
+	 * over the columns. C to int32 at the scale of the accumulator. */
+	void quantize_weights(void)
+	{
+		Tensor *A = inputs[0];
+		Tensor *B = inputs[1];
+		Tensor *C = inputs.size() > 2 ? inputs[2] : nullptr;
+		int N = transB ? B->data_dim[0] : B->data_dim[1];
+		if( B->quantizedFrom == NULL || (C && C->quantizedFrom == NULL) )
+			ERROR("Unimplemented: calibrated quantization of Gemm with non-constant B or C");
+		if( alpha <= 0 )
+			ERROR("Unimplemented: calibrated quantization of Gemm with alpha <= 0");
+
+		bool per_column = C == nullptr || C->data_dim.back() == N;
+		B->quantize_per_channel(per_column ? (transB ? 0 : 1) : -1);
+		if( C == nullptr || beta == 0 )
+			return;
+
+		std::vector<float> scales;
+		for( int c=0; c<(per_column ? N : 1); c++ )
+			scales.push_back( alpha * A->quant_scale() * B->quant_scale(c) / beta );
+		C->quantize_with_scales(per_column ? C->rank()-1 : -1, scales, onnx::TensorProto_DataType_INT32);
+	}
 
 	/* Assign input tensors, resolve output tensor shapes, allocate output tensors */
 	virtual void resolve(void) override
@@ -189,6 +383,9 @@ class Gemm : public Node {
 		int M = transA ? A->data_dim[1] : A->data_dim[0];
 		int N = transB ? B->data_dim[0] : B->data_dim[1];
 
+		if( quantization_calibrated() )
+			quantize_weights();
+
 		/* Create output tensors.
 		 * Set data dimensions and data type for the created tensors. */
 		Tensor *t = new Tensor;
@@ -1,4 +1,6 @@
+#include "fastmath.h"
 #include "lstm.h"
+#include "options.h"
 /* This file is part of onnx2c.
  *
  * LSTM.
@@ -38,9 +40,6 @@ void LSTM::parseAttributes( onnx::NodeProto &node ) {
 			        &&direction != "reverse"
 			        &&direction != "bidirectional")
 				ERROR("Bad value ("<<direction<<") for direction attribute");
-			// The specification is not quite clear - need test case
-			if( direction == "reverse" )
-				LOG(WARNING) << "Reverse LSTM might be buggy"<< std::flush;
 		}
 		else if( a.name() == "hidden_size" )
 			hidden_size = parse_attribute_int(a);
@@ -87,10 +86,10 @@ void LSTM::print_activation(std::ostream &dst, const std::string &activation, co
 		variable="CLIP(" + var + ", " + std::to_string(clip) + ")";
 
 	if( activation == "Sigmoid" )
-		dst << "1.0f/(1+expf(-" << variable << "));" << std::endl;
+		dst << "1.0f/(1+" << math_function("expf") << "(-" << variable << "));" << std::endl;
 	else if (activation == "Tanh" )
 		// TODO: optimize to tanhf? If someone uses tanh, do they care about execution speed? :)
-		dst << "tanh(" << variable << ");" << std::endl;
+		dst << math_function("tanh") << "(" << variable << ");" << std::endl;
 	else if (activation == "Relu" )
 		dst << "MAX(" << variable << ", 0);" << std::endl;
 	else
@@ -98,137 +97,162 @@ void LSTM::print_activation(std::ostream &dst, const std::string &activation, co
 }
 
 
-/* Print the C code for the core LSTM kernel, inside of the "sequences" loop.
- * The code is almost identical for forward and backwards nodes */
-void LSTM::print_lstm_kernel(std::ostream &dst, bool forward) const
+/* Print the C code for the input projection X*W of all time steps and
+ * directions, with the biases. It does not depend on the hidden state, so
+ * it is calculated before the "sequences" loop, as one matrix multiplication. */
+void LSTM::print_input_projection(std::ostream &dst) const
 {
 	const Tensor* B = get_B();
-	const Tensor* P = get_P();
+	const std::string data_type = get_X()->data_type_str();
+	std::string X_sbi = layout == 0 ? "X[s][b][i]" : "X[b][s][i]";
+	std::string bias;
+	if( B == nullptr )
+		bias = "0";
+	else if( folded_B )
+		bias = "B[d][j]";
+	else
+		bias = "B[d][j] + B[d][Rb+j]";
+
+	INDT_1<<  "/* Input projection of all time steps */" << std::endl;
+	INDT_1<<  "for( int s=0; s<sequence_lenght; s++)" << std::endl;
+	INDT_1<<  "for( int d=0; d<" << num_directions << "; d++)" << std::endl;
+	INDT_1<<  "for( int b=0; b<bs; b++)" << std::endl;
+	if( get_sequence_lens() )
+		INDT_1<<  "if( s < lens[b] )" << std::endl;
+	INDT_1<<  "for( int j=0; j<4*hs; j++) {" << std::endl;
+	INDT_2<<  data_type << " x = " << bias << ";" << std::endl;
+	INDT_2<<  "for( int i=0; i<ds; i++)" << std::endl;
+	INDT_3<<  "x += " << X_sbi << "*W[d][j][i];" << std::endl;
+	INDT_2<<  "xw[s][d][b][j] = x;" << std::endl;
+	INDT_1<<  "}" << std::endl;
+	dst << std::endl;
+}
 
-	int dir;    // direction index into tensors that separate forward and backward (W,B,Y,...)
-	int f_act;  // indexes for the activation functions in activations[]
-	int g_act;
-	int h_act;
-	std::string di;
-	std::string X_sbi;  // input data, indexed with s(equence), b(atch), i(input)
-	std::string Yh_dbh; // Y_h, indexed with direction, batch, hidden
-	std::string Yh_dbk; // Same, but use k for indexing hidden size (used in inner matmul loops)
-	std::string Yc_dbh; // Y_h, indexed with direction, batch, hidden
-	std::string Y_snbh; // Y, indexed with sequence, numdir, batch, hidden
-	if( forward ) {
-		dir=0;
-		f_act=0;
-		g_act=1;
-		h_act=2;
-		di="i";
+/* Loops over the batch and the hidden size, in the LSTM kernel. With
+ * sequence_lens, the batch entries whose sequences have ended are
+ * skipped, and their state is left as it is. */
+void LSTM::print_batch_loop(std::ostream &dst) const
+{
+	if( get_sequence_lens() ) {
+		INDT_2<<  "for( int l=0; l<num_lanes; l++)" << std::endl;
+		INDT_2<<  "for( int h=0; h<hs; h++) {" << std::endl;
+		INDT_3<<  "int b = lanes[l];" << std::endl;
 	}
 	else {
-		dir=1;
-		f_act=3;
-		g_act=4;
-		h_act=5;
-		di="ds-1-i";
+		INDT_2<<  "for( int b=0; b<bs; b++)" << std::endl;
+		INDT_2<<  "for( int h=0; h<hs; h++) {" << std::endl;
 	}
+}
 
+/* Print the C code for the core LSTM kernel, inside of the "sequences" loop.
+ * The code is almost identical for forward and backwards nodes.
+ * A reverse lane walks the sequence from its end. */
+void LSTM::print_lstm_kernel(std::ostream &dst, int dir, bool reverse) const
+{
+	const Tensor* P = get_P();
+	const std::string data_type = get_X()->data_type_str();
+
+	// indexes for the activation functions in activations[]
+	int f_act = 3*dir;
+	int g_act = 3*dir+1;
+	int h_act = 3*dir+2;
+	std::string d = std::to_string(dir);
+	// time step. A reverse lane starts from the end of each sequence
+	std::string t = reverse ? (get_sequence_lens() ? "lens[b]-1-s" : "sequence_lenght-1-s") : "s";
+	std::string Yh_dbh; // Y_h, indexed with direction, batch, hidden
+	std::string Yh_dbk; // Same, but use k for indexing hidden size (used in inner matmul loops)
+	std::string Yc_dbh; // Y_c, indexed with direction, batch, hidden
+	std::string Y_tnbh; // Y, indexed with time step, numdir, batch, hidden
 	if( layout == 0 ) {
-		X_sbi = "X[s][b]["+di+"]";
-		Y_snbh = "Y[s][" + std::to_string(dir) + "][b][h]";
-		Yh_dbh = "Y_h[" + std::to_string(dir) + "][b][h]";
-		Yh_dbk = "Y_h[" + std::to_string(dir) + "][b][k]";
-		Yc_dbh = "Y_c[" + std::to_string(dir) + "][b][h]";
+		Y_tnbh = "Y[" + t + "][" + d + "][b][h]";
+		Yh_dbh = "Y_h[" + d + "][b][h]";
+		Yh_dbk = "Y_h[" + d + "][b][k]";
+		Yc_dbh = "Y_c[" + d + "][b][h]";
 	}
 	else { //layout==1
-		X_sbi = "X[b][s]["+di+"]";
-		Y_snbh = "Y[b][s][" + std::to_string(dir) + "][h]";
-		Yh_dbh = "Y_h[b][" + std::to_string(dir) + "][h]";
-		Yh_dbk = "Y_h[b][" + std::to_string(dir) + "][k]";
-		Yc_dbh = "Y_c[b][" + std::to_string(dir) + "][h]";
+		Y_tnbh = "Y[b][" + t + "][" + d + "][h]";
+		Yh_dbh = "Y_h[b][" + d + "][h]";
+		Yh_dbk = "Y_h[b][" + d + "][k]";
+		Yc_dbh = "Y_c[b][" + d + "][h]";
 	}
-
-
+	// The gates, in the order they are in W, R and B
+	const char *gates[] = {"i", "o", "f", "c"};
+	const char *gate_idx[] = {"iidx", "oidx", "fidx", "cidx"};
 
 	/* With all the helper strings above, print out the kernel.
 	 * indexes:
 	 * - b: batch size
 	 * - h: hidden size
-	 * - i: data size
 	 * - k: hidden size, when it disappears as the inner dimension in a multiplication
+	 * - l: the batch entries whose sequence is not over yet, with sequence_lens
 	 */
-	INDT_2<<  "for( int b=0; b<bs; b++)" << std::endl;
-	INDT_2<<  "for( int h=0; h<hs; h++) {" << std::endl;
-	INDT_3<<  "ft[b][h]=0;" << std::endl;
-	INDT_3<<  "it[b][h]=0;" << std::endl;
-	INDT_3<<  "ct[b][h]=0;" << std::endl;
-
-	// Xt*W
-	INDT_3<<  "for( int i=0; i<ds; i++) {" << std::endl;
-	INDT_4<<  "ft[b][h] += " << X_sbi << "*W["<<dir<<"][fidx+h][i];" << std::endl;
-	INDT_4<<  "it[b][h] += " << X_sbi << "*W["<<dir<<"][iidx+h][i];" << std::endl;
-	INDT_4<<  "ct[b][h] += " << X_sbi << "*W["<<dir<<"][cidx+h][i];" << std::endl;
-	INDT_3<<  "}" << std::endl;
+	print_batch_loop(dst);
+	if( hoisted_XW ) {
+		for( int g=0; g<4; g++ )
+			INDT_3<<  data_type << " " << gates[g] << " = xw[" << t << "][" << d << "][b][" << gate_idx[g] << "+h];" << std::endl;
+	}
+	else {
+		// Xt*W, and the biases
+		const Tensor* B = get_B();
+		std::string X_tbj = layout == 0 ? "X[" + t + "][b][j]" : "X[b][" + t + "][j]";
+		for( int g=0; g<4; g++ ) {
+			INDT_3<<  data_type << " " << gates[g] << " = ";
+			if( B == nullptr )
+				dst << "0;" << std::endl;
+			else if( folded_B )
+				dst << "B[" << d << "][" << gate_idx[g] << "+h];" << std::endl;
+			else
+				dst << "B[" << d << "][" << gate_idx[g] << "+h] + B[" << d << "][Rb+" << gate_idx[g] << "+h];" << std::endl;
+		}
+		// not 'i', that is the input gate
+		INDT_3<<  "for( int j=0; j<ds; j++) {" << std::endl;
+		INDT_4<<  data_type << " x = " << X_tbj << ";" << std::endl;
+		for( int g=0; g<4; g++ )
+			INDT_4<<  gates[g] << " += x*W[" << d << "][" << gate_idx[g] << "+h][j];" << std::endl;
+		INDT_3<<  "}" << std::endl;
+	}
 
-	// Ht-1*R
+	// Ht-1*R, for all gates at once
 	INDT_3<<  "for( int k=0; k<hs; k++) {" << std::endl;
-	INDT_4<<  "ft[b][h] += " << Yh_dbk << "*R["<<dir<<"][fidx+h][k];" << std::endl;
-	INDT_4<<  "ct[b][h] += " << Yh_dbk << "*R["<<dir<<"][cidx+h][k];" << std::endl;
-	INDT_4<<  "it[b][h] += " << Yh_dbk << "*R["<<dir<<"][iidx+h][k];" << std::endl;
+	INDT_4<<  data_type << " y = " << Yh_dbk << ";" << std::endl;
+	for( int g=0; g<4; g++ ) {
+		if( packed_R )
+			INDT_4<<  gates[g] << " += y*R[" << d << "][h][k][" << g << "];" << std::endl;
+		else
+			INDT_4<<  gates[g] << " += y*R[" << d << "][" << gate_idx[g] << "+h][k];" << std::endl;
+	}
 	INDT_3<<  "}" << std::endl;
 
-	if( B ) { // Bias
-	INDT_3<<  "ft[b][h] += B["<<dir<<"][fidx+h];" << std::endl;
-	INDT_3<<  "ft[b][h] += B["<<dir<<"][Rb+fidx+h];" << std::endl;
-	INDT_3<<  "it[b][h] += B["<<dir<<"][iidx+h];" << std::endl;
-	INDT_3<<  "it[b][h] += B["<<dir<<"][Rb+iidx+h];" << std::endl;
-	INDT_3<<  "ct[b][h] += B["<<dir<<"][cidx+h];" << std::endl;
-	INDT_3<<  "ct[b][h] += B["<<dir<<"][Rb+cidx+h];" << std::endl;
-	}
 	if( P ) { // Peephole
-	INDT_3<<  "ft[b][h] += P["<<dir<<"][fidx+h]*" << Yc_dbh << ";" << std::endl;
-	INDT_3<<  "it[b][h] += P["<<dir<<"][iidx+h]*" << Yc_dbh << ";" << std::endl;
+	INDT_3<<  "f += P[" << d << "][fidx+h]*" << Yc_dbh << ";" << std::endl;
+	INDT_3<<  "i += P[" << d << "][iidx+h]*" << Yc_dbh << ";" << std::endl;
 	// Cell gate does not have a peephole
 	}
 
 	// Activations
-	INDT_3<<  "ft[b][h] =";
-	print_activation( dst, activations[f_act], "ft[b][h]");
-	INDT_3<<  "it[b][h] =";
-	print_activation( dst, activations[f_act], "it[b][h]");
-	INDT_3<<  "ct[b][h] =";
-	print_activation( dst, activations[g_act], "ct[b][h]");
+	INDT_3<<  "ft[b][h] = ";
+	print_activation( dst, activations[f_act], "f");
+	INDT_3<<  "it[b][h] = ";
+	print_activation( dst, activations[f_act], "i");
+	INDT_3<<  "ct[b][h] = ";
+	print_activation( dst, activations[g_act], "c");
+	INDT_3<<  "ot[b][h] = o;" << std::endl;
 	INDT_2<< "}" << std::endl;
 
-	// Cell state, Output gate
-	INDT_2<<  "for( int b=0; b<bs; b++)" << std::endl;
-	INDT_2<<  "for( int h=0; h<hs; h++) {" << std::endl;
+	// Cell state, Output gate, Hidden state
+	print_batch_loop(dst);
 	INDT_3<<  "/* Cell state */" << std::endl;
 	INDT_3<<  Yc_dbh << " = " << Yc_dbh << "*ft[b][h] + it[b][h]*ct[b][h];" << std::endl;
 	INDT_3<<  "/* Output gate */" << std::endl;
-	INDT_3<<  "ot[b][h]=0;" << std::endl;
-	// X*W
-	INDT_3<<  "for( int i=0; i<ds; i++)" << std::endl;
-	INDT_4<<  "ot[b][h] += " << X_sbi << "*W["<<dir<<"][oidx+h][i];" << std::endl;
-	// Ht-1*R
-	INDT_3<<  "for( int k=0; k<hs; k++)" << std::endl;
-	INDT_4<<  "ot[b][h] += " << Yh_dbk << "*R["<<dir<<"][oidx+h][k];" << std::endl;
-	if( B ) {// Bias
-	INDT_3<<  "ot[b][h] += B["<<dir<<"][oidx+h];" << std::endl;
-	INDT_3<<  "ot[b][h] += B["<<dir<<"][Rb+oidx+h];" << std::endl;
-	}
 	if( P ) // Peephole
-	INDT_3<<  "ot[b][h] += P["<<dir<<"][oidx+h]*" << Yc_dbh << ";" << std::endl;
-	INDT_3<<  "ot[b][h] =";
+	INDT_3<<  "ot[b][h] += P[" << d << "][oidx+h]*" << Yc_dbh << ";" << std::endl;
+	INDT_3<<  "ot[b][h] = ";
 	print_activation( dst, activations[f_act], "ot[b][h]");
-	INDT_2<<  "}" << std::endl;
-
-	// Hidden state
-	INDT_2<<  "/* Hidden state */" << std::endl;
-	INDT_2<<  "for( int b=0; b<bs; b++)" << std::endl;
-	INDT_2<<  "for( int h=0; h<hs; h++) {" << std::endl;
-		INDT_3<< Yh_dbh << " = ot[b][h] * ";
-			print_activation( dst, activations[h_act], Yc_dbh );
-		if( get_Y()->is_used() ) {
-			INDT_3<< Y_snbh << "= " << Yh_dbh <<";" << std::endl;
-		}
+	INDT_3<<  "/* Hidden state */" << std::endl;
+	INDT_3<< Yh_dbh << " = ot[b][h] * ";
+	print_activation( dst, activations[h_act], Yc_dbh );
+	if( get_Y()->is_used() )
+		INDT_3<< Y_tnbh << " = " << Yh_dbh <<";" << std::endl;
 	INDT_2<<  "}" << std::endl << std::endl;
 }
 
@@ -282,49 +306,124 @@ void LSTM::print(std::ostream &dst) const
 	INDT_1<<  "int fidx = 2*hs;" << std::endl;
 	INDT_1<<  "int cidx = 3*hs;" << std::endl;
 	// index into B, to get Rb. Wb is B at offset 0
-	INDT_1<<  "int Rb = 4*hs;" << std::endl;
-	// TODO: variable lenght sequences not yet implemented
-	INDT_1<<  "int sequence_lenght = " << seq_length << ";" << std::endl;
+	if( B && folded_B == false )
+		INDT_1<<  "int Rb = 4*hs;" << std::endl;
+	if( sequence_lens ) {
+		// Lengths past the input data are cut to it
+		INDT_1<<  "int lens[" << bs << "];" << std::endl;
+		INDT_1<<  "int sequence_lenght = 0;" << std::endl;
+		INDT_1<<  "for( int b=0; b<bs; b++) {" << std::endl;
+		INDT_2<<  "lens[b] = MIN(MAX(sequence_lens[b], 0), " << seq_length << ");" << std::endl;
+		INDT_2<<  "sequence_lenght = MAX(sequence_lenght, lens[b]);" << std::endl;
+		INDT_1<<  "}" << std::endl;
+		INDT_1<<  "int lanes[" << bs << "];" << std::endl;
+	}
+	else
+		INDT_1<<  "int sequence_lenght = " << seq_length << ";" << std::endl;
 
-	// TODO: these temporary variables are BIG. Make them global to minimize
-	// stack usage? Probably needs to be an onnx2c flag for user to select
+	// The temporary variables are static, not to need large stacks on small targets
+	std::string gate_dims = "[" + std::to_string(bs) + "][" + std::to_string(hs) + "]";
 	INDT_1<<  "/* Forget gate */" << std::endl;
-	INDT_1<<  data_type << " ft[bs][hs];" << std::endl;
+	INDT_1<<  "static " << data_type << " ft" << gate_dims << ";" << std::endl;
 	INDT_1<<  "/* Input gate */" << std::endl;
-	INDT_1<<  data_type << " it[bs][hs];" << std::endl;
+	INDT_1<<  "static " << data_type << " it" << gate_dims << ";" << std::endl;
 	INDT_1<<  "/* Cell gate */" << std::endl;
-	INDT_1<<  data_type << " ct[bs][hs];" << std::endl;
+	INDT_1<<  "static " << data_type << " ct" << gate_dims << ";" << std::endl;
 	INDT_1<<  "/* Output gate */" << std::endl;
-	INDT_1<<  data_type << " ot[bs][hs];" << std::endl;
+	INDT_1<<  "static " << data_type << " ot" << gate_dims << ";" << std::endl;
+	if( hoisted_XW )
+		INDT_1<<  "static " << data_type << " xw[" << seq_length << "][" << num_directions << "][" << bs << "][" << 4*hs << "];" << std::endl;
 	dst << std::endl;
 
 	/* Initialize cell and hidden state at the start of a run.
-	 * TODO: should these not be reset at the start of each sequence run?
-	 *       The documentation doesn't say, but this passes backend tests...
+	 * When streaming, continue from where the previous run left off.
 	 */
-	if( initial_h && initial_h->is_used() )
-		INDT_1 << "memcpy(Y_h, initial_h, sizeof(*initial_h));" << std::endl;
-	else
-		INDT_1 << "memset(Y_h, 0, sizeof(*Y_h));" << std::endl;
-	if( initial_c && initial_c->is_used() )
-		INDT_1 << "memcpy(Y_c, initial_c, sizeof(*initial_c));" << std::endl;
-	else
-		INDT_1 << "memset(Y_c, 0, sizeof(*Y_c));" << std::endl;
+	// Not sizeof(*Y_h): that is only the first direction (or batch) of the state
+	int state_size = get_Y_h()->data_num_elem() * get_Y_h()->data_elem_size();
+	if( options.stream ) {
+		INDT_1 << "memcpy(Y_h, " << c_name() << "_h, " << state_size << ");" << std::endl;
+		INDT_1 << "memcpy(Y_c, " << c_name() << "_c, " << state_size << ");" << std::endl;
+	}
+	else {
+		if( initial_h && initial_h->is_used() )
+			INDT_1 << "memcpy(Y_h, initial_h, " << state_size << ");" << std::endl;
+		else
+			INDT_1 << "memset(Y_h, 0, " << state_size << ");" << std::endl;
+		if( initial_c && initial_c->is_used() )
+			INDT_1 << "memcpy(Y_c, initial_c, " << state_size << ");" << std::endl;
+		else
+			INDT_1 << "memset(Y_c, 0, " << state_size << ");" << std::endl;
+	}
+	// Y past the end of a sequence is zeros
+	if( sequence_lens && get_Y()->is_used() )
+		INDT_1 << "memset(Y, 0, " << get_Y()->data_num_elem() * get_Y()->data_elem_size() << ");" << std::endl;
 	dst << std::endl;
 
+	if( hoisted_XW )
+		print_input_projection(dst);
+
 	/* Loop over sequences */
 	INDT_1<<  "for( int s=0; s<sequence_lenght; s++) {" << std::endl;
+	if( sequence_lens ) {
+		INDT_2<<  "/* The batch entries still in their sequence */" << std::endl;
+		INDT_2<<  "int num_lanes = 0;" << std::endl;
+		INDT_2<<  "for( int b=0; b<bs; b++)" << std::endl;
+		INDT_3<<  "if( s < lens[b] )" << std::endl;
+		INDT_4<<  "lanes[num_lanes++] = b;" << std::endl;
+	}
 	dst << std::endl;
-	INDT_2<<  "/* Forward lane */" << std::endl;
-	print_lstm_kernel(dst, /* forward= */ true);
+	if( direction == "reverse" ) {
+		INDT_2<<  "/* Backward lane */" << std::endl;
+		print_lstm_kernel(dst, 0, /* reverse= */ true);
+	}
+	else {
+		INDT_2<<  "/* Forward lane */" << std::endl;
+		print_lstm_kernel(dst, 0, /* reverse= */ false);
+	}
 
 	if( direction == "bidirectional" ) {
 		dst << std::endl;
 		INDT_2<<  "/* Backward lane */" << std::endl;
-		print_lstm_kernel(dst, /* forward= */ false);
+		print_lstm_kernel(dst, 1, /* reverse= */ true);
 	}
 	INDT_1<<  "} /* sequences */" << std::endl;
 
+	// As onnxruntime: the state of an empty sequence is zeros, not the initial state
+	if( sequence_lens && options.stream == false ) {
+		std::string Yh_db = layout == 0 ? "Y_h[d][b]" : "Y_h[b][d]";
+		std::string Yc_db = layout == 0 ? "Y_c[d][b]" : "Y_c[b][d]";
+		INDT_1<<  "for( int b=0; b<bs; b++)" << std::endl;
+		INDT_1<<  "if( lens[b] == 0 )" << std::endl;
+		INDT_1<<  "for( int d=0; d<" << num_directions << "; d++)" << std::endl;
+		INDT_1<<  "for( int h=0; h<hs; h++)" << std::endl;
+		INDT_2<<  Yh_db << "[h] = " << Yc_db << "[h] = 0;" << std::endl;
+	}
+
+	if( options.stream ) {
+		INDT_1 << "memcpy(" << c_name() << "_h, Y_h, " << state_size << ");" << std::endl;
+		INDT_1 << "memcpy(" << c_name() << "_c, Y_c, " << state_size << ");" << std::endl;
+	}
+
+}
+
+// The initial state, if it is a compile time constant
+static const Tensor* constant_state(const Tensor *initial)
+{
+	if( initial && initial->isConst && initial->isIO == false )
+		return initial;
+	return nullptr;
+}
+
+/* The hidden and cell state, between the calls of a stream. Reset to the
+ * constant initial state, if there is one. */
+std::vector<Node::state_variable> LSTM::state_variables(void) const
+{
+	if( options.stream == false )
+		return {};
+	return {
+		{ c_name() + "_h", get_Y_h(), constant_state(get_initial_h()) },
+		{ c_name() + "_c", get_Y_c(), constant_state(get_initial_c()) }
+	};
 }
 
 
@@ -411,6 +510,14 @@ void LSTM::resolve(void)
 
 	calculate_data_dimensions();
 
+	if( options.stream && num_directions != 1 )
+		ERROR("Unimplemented: streaming a bidirectional LSTM. The backward lane needs the whole sequence");
+	if( options.stream && direction == "reverse" )
+		ERROR("Unimplemented: streaming a reverse LSTM. It needs the whole sequence");
+	if( options.stream && ((get_initial_h() && constant_state(get_initial_h()) == nullptr)
+	                    || (get_initial_c() && constant_state(get_initial_c()) == nullptr)) )
+		LOG(WARNING) << "Streaming LSTM " << onnx_name << " ignores its initial state inputs. It starts from zeros after reset_state()" << std::endl;
+
 	if( get_sequence_lens() ) {
 		const Tensor* sequence_lens = get_sequence_lens();
 
@@ -418,10 +525,11 @@ void LSTM::resolve(void)
 			ERROR("If providing sequence lengths, it must be a 1D tensor");
 		if( static_cast<int>(sequence_lens->data_dim[0]) != batch_size )
 			ERROR("If providing sequence lengths, there must be 'batch_size' of them");
-		for( auto sl : sequence_lens->data_dim )
-			if( sl < seq_length )
-				// Not quite sure if I understand the documentation correctly here.
-				ERROR("Error: requested sequence lenght is longer than input data");
+		if( sequence_lens->data_type != onnx::TensorProto_DataType_INT32 )
+			ERROR("LSTM sequence_lens must be int32");
+		for( int b=0; sequence_lens->isConst && b<batch_size; b++ )
+			if( sequence_lens->get_data_element(b) > seq_length )
+				ERROR("LSTM sequence_lens is longer than the input data");
 	}
 
 
@@ -14,6 +14,21 @@
  * If the initializers initial_h or initial_c are given, the Y_[h,c]
  * tensors are aliased to the respectie one, and the LSTM hidden/cell
  * state is saved & updated in the initial_[h,c] tensor.
+ *
+ * Each time step does one pass over R for all four gates.
+ * Graph::prepack_lstm() (optimization pass 'lstm') has the input projection
+ * X*W of all time steps calculated before the sequence loop, into a static
+ * buffer. It also stores a constant R with the gates interleaved, and adds
+ * the two halves of a constant B together. Without it, each time step
+ * calculates its own X*W.
+ *
+ * With '--stream', the hidden and cell state are kept in globals between
+ * calls, so a long sequence can be fed a few time steps at a time.
+ * Only forward LSTMs can stream.
+ *
+ * With sequence_lens, each time step runs only the batch entries whose
+ * sequence is not over. Their Y is zeros past the end, and Y_h and Y_c
+ * are from their last time step, or zeros for an empty sequence.
  */
 
 #include "node.h"
@@ -27,6 +42,9 @@ class LSTM : public Node {
 		hidden_size = -1;
 		input_forget = 0;
 		layout=0;
+		packed_R = false;
+		folded_B = false;
+		hoisted_XW = false;
 	}
 
 	// Attributes
@@ -45,10 +63,15 @@ class LSTM : public Node {
 	int num_directions;
 	int input_size;
 
+	// Set by Graph::prepack_lstm()
+	bool packed_R; // R is [num_directions][hidden_size][hidden_size][4]: the gates i,o,f,c of a weight together
+	bool folded_B; // B is [num_directions][4*hidden_size]: Wb+Rb
+	bool hoisted_XW; // X*W+B of all time steps is in xw, before the sequence loop
 
 	virtual void parseAttributes( onnx::NodeProto &node ) override;
 	virtual void resolve(void) override;
 	virtual void print(std::ostream &dst) const override;
+	virtual std::vector<state_variable> state_variables(void) const override;
 
 	float get_activation_alpha( const std::string &a);
 	float get_activation_beta( const std::string &a);
@@ -77,7 +100,9 @@ class LSTM : public Node {
 	const Tensor* get_P(void) const {return get_optional(7); }
 
 	void print_activation(std::ostream &dst, const std::string &activation, const std::string &var) const;
-	void print_lstm_kernel(std::ostream &dst, bool forward) const;
+	void print_input_projection(std::ostream &dst) const;
+	void print_batch_loop(std::ostream &dst) const;
+	void print_lstm_kernel(std::ostream &dst, int dir, bool reverse) const;
 	void calculate_data_dimensions();
 };
 }
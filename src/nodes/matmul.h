@@ -11,12 +11,13 @@ class MatMul : public Node {
 	{
 		Tensor *A = inputs[0];
 		Tensor *B = inputs[1];
-		std::string type = A->data_type_str();
+		std::string acc_type = outputs[0]->accumulator_type_str();
+		// 16 bit floats are multiplied in float
+		std::string widen = acc_type != A->data_type_str() ? "(" + acc_type + ")" : "";
 
-		if( A->data_dim.size() == 2 )
+		if( A->rank() == 2 && B->rank() == 2 )
 		{
 
-			int32_t rows = A->data_dim[0];
 			int32_t cols = B->data_dim[1];
 			int32_t inner = A->data_dim[1];
 			int32_t inner2 = B->data_dim[0];
@@ -28,44 +29,175 @@ class MatMul : public Node {
 			if( inner != inner2 )
 				ERROR("MatMul input's inner dimensions don't match");
 
+			if( B->pack_columns ) {
+				print_xnor_popcount(dst);
+				return;
+			}
+			std::string B_el = B->pack_bits ? B->packed_element("B", "i*" + std::to_string(cols) + "+c") : "B[i][c]";
 			INDT_1 << "/* MatMul */" << std::endl;
-			INDT_1 << "for( uint32_t r=0; r<" << rows << "; r++ )" << std::endl;
+			print_sparse_tables(dst);
+			INDT_1 << "for( uint32_t r=0; r<" << A->str_dim(0) << "; r++ )" << std::endl;
 			INDT_2 <<   "for( uint32_t c=0; c<" << cols << "; c++ ) {" << std::endl;
-			INDT_3 <<     "Y[r][c] = 0;" << std::endl;
-			INDT_3 <<     "for( uint32_t i=0; i<" << inner << "; i++ )" << std::endl;
-			INDT_4 <<        "Y[r][c] += A[r][i] * B[i][c];" << std::endl;
-			INDT_2 <<   "}" << std::endl;
-		} 
-		else if (A->data_dim.size() == 4)
-		{
-			INDT_1 << "/* MatMul 3D*/" << std::endl;
-			INDT_1 << "/* 1 extra dim for batch 3D*/" << std::endl;
-			// int32_t batch = A->data_dim[0];
-			int32_t channels = A->data_dim[1];
-			int32_t rows = A->data_dim[2];
-			int32_t cols = B->data_dim[1];
-			int32_t inner = A->data_dim[3];
-			int32_t inner2 = B->data_dim[0];
-			if( inner == 0 ) inner=1;
-				if( inner != inner2 )
-					ERROR("MatMul input's inner dimensions don't match");
-			INDT_1 << "for( uint32_t chan=0; chan<" << channels << "; chan++ ) {" << std::endl;
-			INDT_2 << "for( uint32_t r=0; r<" << rows << "; r++ )" << std::endl;
-			INDT_3 <<   "for( uint32_t c=0; c<" << cols << "; c++ ) {" << std::endl;
-			INDT_4 <<     "Y[0][chan][r][c] = 0;" << std::endl;
-			INDT_4 <<     "for( uint32_t i=0; i<" << inner << "; i++ )" << std::endl;
-			INDT_5 <<        "Y[0][chan][r][c] += A[0][chan][r][i] * B[i][c];" << std::endl;
+			INDT_3 <<     acc_type << " sum = 0;" << std::endl;
+			if( B->sparse_axis >= 0 ) {
+				INDT_3 <<     "for( uint32_t j=B_start[c]; j<B_start[c+1]; j++ )" << std::endl;
+				INDT_4 <<        "sum += " << widen << "A[r][B_row[j]] * " << "B[j]" << ";" << std::endl;
+			}
+			else {
+				INDT_3 <<     "for( uint32_t i=0; i<" << inner << "; i++ )" << std::endl;
+				INDT_4 <<        "sum += " << widen << "A[r][i] * " << B_el << ";" << std::endl;
+			}
+			INDT_3 <<     "Y[r][c] = sum;" << std::endl;
 			INDT_2 <<   "}" << std::endl;
-			INDT_1 <<   "}" << std::endl;
 		} 
 		else
-		{
-			LOG(DEBUG) << "mine inputs[0]->data_dim[0]"  << inputs[0]->data_dim[0] <<std::endl;
-			ERROR("Uninimplemented for higher than 3 dimensions");
+			print_batched(dst);
+	}
+
+	/* Any other ranks. The leading (batch) dimensions broadcast as in numpy.
+	 * A 1D A is a row vector and a 1D B a column vector.
+	 * A B shared by the whole batch is used as one [K x N] matrix for all
+	 * rows of A, and can be packed or sparse as in the 2D case. */
+	void print_batched(std::ostream &dst) const
+	{
+		const Tensor *A = inputs[0];
+		const Tensor *B = inputs[1];
+		const Tensor *Y = outputs[0];
+		std::string acc_type = Y->accumulator_type_str();
+		std::string widen = acc_type != A->data_type_str() ? "(" + acc_type + ")" : "";
+		int a_matrix = std::min((int)A->rank(), 2);
+		int b_matrix = std::min((int)B->rank(), 2);
+		int rows = a_matrix == 2 ? A->data_dim[A->rank()-2] : 1;
+		int inner = A->data_dim[A->rank()-1];
+		int cols = b_matrix == 2 ? B->data_dim[B->rank()-1] : 1;
+		std::vector<int> batch(Y->data_dim.begin(), Y->data_dim.end() - (a_matrix-1) - (b_matrix-1));
+		if( Y->rank() == 1 && a_matrix == 1 && b_matrix == 1 )
+			batch.clear();
+
+		if( shared_B() ) {
+			for( int b : batch )
+				rows *= b;
+			batch.clear();
+		}
 
+		INDT_1 << "/* MatMul, batched */" << std::endl;
+		print_sparse_tables(dst);
+		for( unsigned b=0; b<batch.size(); b++ ) {
+			std::string lv = "b" + std::to_string(b);
+			INDT_1 << "for( uint32_t " << lv << "=0; " << lv << "<" << batch[b] << "; " << lv << "++ )" << std::endl;
+		}
+		INDT_1 << "{" << std::endl;
+		INDT_2 << "const " << A->data_type_str() << " *a = (const " << A->data_type_str() << "*)A + "
+		       << batch_offset(A, a_matrix, batch.size()) << ";" << std::endl;
+		std::string B_el;
+		if( B->sparse_axis < 0 && B->pack_bits == 0 ) {
+			INDT_2 << "const " << B->data_type_str() << " *b = (const " << B->data_type_str() << "*)B + "
+			       << batch_offset(B, b_matrix, batch.size()) << ";" << std::endl;
+			B_el = "b[i*" + std::to_string(cols) + "+c]";
+		}
+		else if( B->pack_bits )
+			B_el = B->packed_element("B", "i*" + std::to_string(cols) + "+c");
+		INDT_2 << Y->data_type_str() << " *y = (" << Y->data_type_str() << "*)Y + "
+		       << batch_offset(Y, a_matrix + b_matrix - 2, batch.size()) << ";" << std::endl;
+		// A has a run time number of rows only if it is 2D, see handles_runtime_dim()
+		std::string rows_str = A->runtime_dim != "" ? A->str_dim(0) : std::to_string(rows);
+		INDT_2 << "for( uint32_t r=0; r<" << rows_str << "; r++, a+=" << inner << ", y+=" << cols << " )" << std::endl;
+		INDT_3 <<   "for( uint32_t c=0; c<" << cols << "; c++ ) {" << std::endl;
+		INDT_4 <<     acc_type << " sum = 0;" << std::endl;
+		if( B->sparse_axis >= 0 ) {
+			INDT_4 <<     "for( uint32_t j=B_start[c]; j<B_start[c+1]; j++ )" << std::endl;
+			INDT_5 <<        "sum += " << widen << "a[B_row[j]] * B[j];" << std::endl;
+		}
+		else {
+			INDT_4 <<     "for( uint32_t i=0; i<" << inner << "; i++ )" << std::endl;
+			INDT_5 <<        "sum += " << widen << "a[i] * " << B_el << ";" << std::endl;
 		}
+		INDT_4 <<     "y[c] = sum;" << std::endl;
+		INDT_3 <<   "}" << std::endl;
+		INDT_1 << "}" << std::endl;
+	}
+
+	/* B is the same matrix for every batch index */
+	bool shared_B(void) const
+	{
+		const Tensor *B = inputs[1];
+		for( int d=0; d<(int)B->rank()-2; d++ )
+			if( B->data_dim[d] != 1 )
+				return false;
+		return true;
+	}
+
+	/* Bipolar A and B, with B packed by columns: the dot product of a row of A
+	 * and a column of B is the number of equal bits, times two, minus the length.
+	 * A row is packed to bits first, and the bits are compared with XNOR. */
+	void print_xnor_popcount(std::ostream &dst) const
+	{
+		const Tensor *A = inputs[0];
+		const Tensor *B = inputs[1];
+		int cols = B->data_dim[1];
+		int inner = B->data_dim[0];
+		int bytes = (inner+7)/8;
+		// The padding bits of both are 0, so they always match
+		int padding = bytes*8 - inner;
+
+		INDT_1 << "/* MatMul of bipolar values, as XNOR and popcount of bits */" << std::endl;
+		INDT_1 << "for( uint32_t r=0; r<" << A->str_dim(0) << "; r++ ) {" << std::endl;
+		INDT_2 <<   "uint8_t a_bits[" << bytes << "] = {0};" << std::endl;
+		INDT_2 <<   "for( uint32_t i=0; i<" << inner << "; i++ )" << std::endl;
+		INDT_3 <<     "if( A[r][i] > 0 )" << std::endl;
+		INDT_4 <<       "a_bits[i/8] |= 1 << (i%8);" << std::endl;
+		INDT_2 <<   "for( uint32_t c=0; c<" << cols << "; c++ ) {" << std::endl;
+		INDT_3 <<     "int32_t matches = " << -padding << ";" << std::endl;
+		INDT_3 <<     "for( uint32_t j=0; j<" << bytes << "; j++ ) {" << std::endl;
+		INDT_4 <<       "uint8_t w = " << constant_acces_code("B[c*" + std::to_string(bytes) + "+j]") << ";" << std::endl;
+		INDT_4 <<       "matches += onnx2c_popcount8(~(a_bits[j] ^ w));" << std::endl;
+		INDT_3 <<     "}" << std::endl;
+		INDT_3 <<     "Y[r][c] = 2*matches - " << inner << ";" << std::endl;
+		INDT_2 <<   "}" << std::endl;
+		INDT_1 << "}" << std::endl;
+	}
+
+	/* Weights B can be packed. Bipolar B multiplying bipolar A
+	 * is packed by columns, for print_xnor_popcount() */
+	virtual bool accepts_packed(const Tensor *t, int bits, bool &columns) const override
+	{
+		const Tensor *A = inputs[0];
+		if( t != inputs[1] || t == A || t->rank() != 2 )
+			return false;
+		columns = bits == 1 && A->bipolar && A->rank() == 2;
+		return true;
+	}
+
+	/* Sparse B by columns, for a 2D B with A of any rank */
+	virtual bool accepts_sparse(const Tensor *t, int &axis) const override
+	{
+		axis = 1;
+		return t == inputs[1] && t != inputs[0] && t->rank() == 2;
+	}
+
+	/* The nonzeros of each column c of a sparse B start at B_start[c],
+	 * and B_row has their rows */
+	void print_sparse_tables(std::ostream &dst) const
+	{
+		const Tensor *B = inputs[1];
+		if( B->sparse_axis < 0 )
+			return;
+		std::vector<int> starts, rows;
+		B->sparse_layout(starts, rows);
+		print_index_table(dst, "B_start", starts);
+		print_index_table(dst, "B_row", rows);
+	}
+
+	/* Only a 2D A, with a run time variable number of rows, times a 2D
+	 * B or a 1D B (that goes through print_batched()). A B of more
+	 * dimensions would make its batch the first dimension of Y. */
+	virtual bool handles_runtime_dim(void) const override
+	{
+		return inputs[0]->rank() == 2
+		    && inputs[1]->rank() <= 2
+		    && inputs[1]->runtime_dim == "";
+	}
 
-	} 
 	virtual void resolve(void) override
 	{
 		Tensor *A = inputs[0];
@@ -76,79 +208,31 @@ class MatMul : public Node {
 			ERROR("Incorrect input for MatMul"); 
 		if(  typeConstraint_highPrecisionNumeric(B) == false )
 			ERROR("Incorrect input for MatMul"); 
+		if( A->rank() == 0 || B->rank() == 0 )
+			ERROR("MatMul of a scalar");
 
-		int32_t channels, rows, cols;
-		channels = 0;
-		result_dim(inputs, channels, rows, cols);
-		
-		if (channels == 0)
-		{
-			Tensor *rv = new Tensor;
-			rv->data_dim.push_back(rows);
-			rv->data_dim.push_back(cols);
-			rv->data_type = A->data_type;
-			register_output(rv, "Y");
-		} else
-		{
-			Tensor *rv = new Tensor;
+		int inner = A->data_dim[A->rank()-1];
+		int inner2 = B->data_dim[B->rank() < 2 ? 0 : B->rank()-2];
+		if( inner != inner2 )
+			ERROR("MatMul input's inner dimensions don't match");
 
-			// batch
+		// The leading dimensions broadcast. A 1D operand's dimension is
+		// dropped from the result, so two vectors make a 1 element tensor.
+		std::vector<int> batch_A, batch_B;
+		if( A->rank() > 2 )
+			batch_A.assign(A->data_dim.begin(), A->data_dim.end()-2);
+		if( B->rank() > 2 )
+			batch_B.assign(B->data_dim.begin(), B->data_dim.end()-2);
+		Tensor *rv = new Tensor;
+		multidirectional_broadcast_size(batch_A, batch_B, rv->data_dim);
+		if( A->rank() >= 2 )
+			rv->data_dim.push_back(A->data_dim[A->rank()-2]);
+		if( B->rank() >= 2 )
+			rv->data_dim.push_back(B->data_dim[B->rank()-1]);
+		if( rv->data_dim.size() == 0 )
 			rv->data_dim.push_back(1);
-			rv->data_dim.push_back(channels);
-			rv->data_dim.push_back(rows);
-			rv->data_dim.push_back(cols);
-
-			rv->data_type = A->data_type;
-			register_output(rv, "Y");
-		}
-		
-		
-		
-	}
-
-	void result_dim( const std::vector< Tensor*> &inputs, int32_t &channels, int32_t &rows, int32_t &cols) const
-	{
-		// TODO: this is the check for vectors. Check equivalent for N-dimensons: N>2
-		if( inputs[0]->data_dim[1] != 0 && inputs[1]->data_dim[1] != 0 )
-		{
-			// for size of input for with batch
-			if( inputs[0]->data_dim.size() == 4 )
-			{
-				channels =  inputs[0]-> data_dim[1];
-				rows = inputs[0]->data_dim[2];
-				cols = inputs[1]->data_dim[1];
-				LOG(DEBUG) << "channels->"  << channels << " rows " << rows << " cols "<< cols <<std::endl;
-
-			}
-			else
-			{
-				channels = 0;
-				rows = inputs[0]->data_dim[0];
-				cols = inputs[1]->data_dim[1];
-			}
-			
-
-		}
-		else if( inputs[0]->data_dim[1] == 0 && inputs[1]->data_dim[1] == 0 )
-		{
-			ERROR("Bad input/unhandled: 2 vectors to MatMul");
-		}
-		else if( inputs[0]->data_dim[1] == 0 )
-		{
-			cols = inputs[1]->data_dim[1];
-			if( inputs[0]->data_dim[0] == inputs[1]->data_dim[0] )
-				rows = 1;
-			else
-				rows = inputs[0]->data_dim[0];
-		}
-		else
-		{
-			rows = inputs[0]->data_dim[0];
-			if( inputs[0]->data_dim[1] == inputs[1]->data_dim[0] )
-				cols = 1;
-			else
-				cols = inputs[1]->data_dim[0];
-		}
+		rv->data_type = A->data_type;
+		register_output(rv, "Y");
 	}
 };
 }
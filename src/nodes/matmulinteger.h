@@ -6,8 +6,17 @@
  * MatMulInteger takes a input zero-point bias term
  * which is useful for quantized networks.
  *
+ * The sum over (a-za)*(b-zb) is expanded into
+ *   sum(a*b) - zb*sum(a) + za*(K*zb - sum(b))
+ * With a constant B, (K*zb - sum(b)) is precomputed for each column,
+ * and the innermost loop is a plain integer multiply-accumulate.
+ * Each row of A is run against the rows of B into a row of accumulators,
+ * so the innermost loop reads B and writes the accumulators contiguously,
+ * which compilers vectorize.
+ *
  * TODO: share code with MatMul
  */
+#include "quantization.h"
 
 namespace toC {
 
@@ -17,6 +26,27 @@ class MatMulInteger : public Node {
 		op_name = "MatMulInteger";
 	}
 
+	const Tensor* get_a_zero(void) const {
+		if( inputs.size() > 2 && inputs[2]->is_used() )
+			return inputs[2];
+		return nullptr;
+	}
+	const Tensor* get_b_zero(void) const {
+		if( inputs.size() > 3 && inputs[3]->is_used() )
+			return inputs[3];
+		return nullptr;
+	}
+
+	/* Zero point as a C expression, indexed with 'idx' when not a scalar */
+	static std::string zero_point_c(const Tensor *zp, const std::string &name, const std::string &idx)
+	{
+		if( zp == nullptr )
+			return "0";
+		if( zp->data_buffer && zp->data_num_elem() == 1 )
+			return std::to_string(zp->get_data_element(0));
+		return name + "[" + (zp->data_num_elem() > 1 ? idx : "0") + "]";
+	}
+
 	virtual void print(std::ostream &dst) const override
 	{
 		Tensor *A = inputs[0];
@@ -25,8 +55,6 @@ class MatMulInteger : public Node {
 		std::string intype = A->data_type_str();
 		std::string outtype = Y->data_type_str();
 		std::string weighttype = B->data_type_str();
-		std::string a_zero;
-		std::string b_zero;
 
 		if( A->data_dim.size() != 2 )
 			ERROR("Unimplemented: higher than 2D MatMulInteger");
@@ -43,47 +71,77 @@ class MatMulInteger : public Node {
 		if( inner != inner2 )
 			ERROR("MatMulInteger input's inner dimensions don't match");
 
-		if( inputs.size() > 2)
-			a_zero = "a_zero_point[0]";
-		else
-			a_zero = "0";
-		if( inputs.size() > 3)
-			b_zero = "b_zero_point[0]";
-		else
-			b_zero = "0";
+		const Tensor *a_zp = get_a_zero();
+		const Tensor *b_zp = get_b_zero();
+		std::string a_zero = zero_point_c(a_zp, "a_zero_point", "r");
+		std::string b_zero = zero_point_c(b_zp, "b_zero_point", "c");
+		// Fold the zero points when B and its zero point are constants
+		bool fold = B->data_buffer && (b_zp == nullptr || b_zp->data_buffer);
 
 		INDT_1 "/*MatMulInteger*/" << std::endl;
+		if( quantization_calibrated() ) {
+			std::vector<double> reals;
+			for( int c=0; c<cols; c++ )
+				reals.push_back( A->quant_scale() * B->quant_scale(c) / Y->quant_scale() );
+			print_requantize_tables(dst, reals);
+		}
+		bool has_b_term = fold && a_zero != "0";
+		if( has_b_term ) {
+			// K*zb - sum(b) for each column
+			INDT_1 << "static const int32_t b_term[" << cols << "] = {";
+			for( int c=0; c<cols; c++ ) {
+				int32_t zb = b_zp ? b_zp->get_data_element(b_zp->data_num_elem() > 1 ? c : 0) : 0;
+				int32_t sum = 0;
+				for( int i=0; i<inner; i++ )
+					sum += B->get_data_element(i*cols+c);
+				dst << (c ? ", " : " ") << inner*zb - sum;
+			}
+			dst << " };" << std::endl;
+		}
 		INDT_1 << intype << " *A = (" << intype << "*)input_A;" << std::endl;
 		INDT_1 << weighttype << " *B = (" << weighttype << "*)input_B;" << std::endl;
 		INDT_1 << outtype << " *Y = (" << outtype << "*)output_Y;" << std::endl;
 
-		INDT_1 << "for( uint32_t r=0; r<" << rows << "; r++ )" << std::endl;
-		INDT_2 << "for( uint32_t c=0; c<" << cols << "; c++ ) {" << std::endl;
-
+		INDT_1 << "for( uint32_t r=0; r<" << rows << "; r++ ) {" << std::endl;
+		INDT_2 << "int32_t acc[" << cols << "];" << std::endl;
+		INDT_2 << "for( uint32_t c=0; c<" << cols << "; c++ )" << std::endl;
+		INDT_3 << "acc[c] = " << (has_b_term ? a_zero + " * b_term[c]" : "0") << ";" << std::endl;
+		bool has_a_sum = fold && b_zero != "0";
+		if( has_a_sum )
+			INDT_2 << "int32_t a_sum = 0;" << std::endl;
+
+		INDT_2 << "for( uint32_t i=0; i<" << inner << "; i++ ) {" << std::endl;
+		if( fold )
+			INDT_3 << "int32_t a = A[r*" << inner << "+i];" << std::endl;
+		else
+			INDT_3 << "int32_t a = A[r*" << inner << "+i] - " << a_zero << ";" << std::endl;
+		if( has_a_sum )
+			INDT_3 << "a_sum += a;" << std::endl;
+		INDT_3 << "for( uint32_t c=0; c<" << cols << "; c++ )" << std::endl;
+		if( fold || b_zero == "0" )
+			INDT_4 << "acc[c] += a * B[i*" << cols << "+c];" << std::endl;
+		else
+			INDT_4 << "acc[c] += a * (B[i*" << cols << "+c] - " << b_zero << ");" << std::endl;
+		INDT_2 << "}" << std::endl;
 
+		INDT_2 << "for( uint32_t c=0; c<" << cols << "; c++ ) {" << std::endl;
+		if( has_a_sum )
+			INDT_3 << "acc[c] -= " << b_zero << " * a_sum;" << std::endl;
 		// NB: quantization here is the experimental ONNXC quantization
 		// that is not only integers, but also scales the output to 8bits.
 		// This quantization terribly kludgy, and really should be removed
-		if( options.quantize )
-			INDT_3 << "int32_t sum = 0;" << std::endl;
-		else
-			INDT_3 << "Y[r*"<<cols<<" + c] = 0;" << std::endl;
-		INDT_3 << "for( uint32_t i=0; i<" << inner << "; i++ )" << std::endl;
-		if( options.quantize )
-			INDT_4 << "sum";
-		else
-			INDT_4 << "Y[r*"<<cols<<"+c]";
-		dst <<         "+= (A[r*"<<inner<< "+i] - " << a_zero << ")";
-		dst <<           " * (B[i*"<<cols<<"+c] - " << b_zero << ");" << std::endl;
-
-		if( options.quantize ) {
-			INDT_3 << "int32_t tmp = sum/64;" << std::endl;
+		if( quantization_calibrated() )
+			INDT_3 << "Y[r*"<<cols<<"+c] = " << requantize("acc[c]", "mult[c]", "shift[c]") << ";" << std::endl;
+		else if( options.quantize ) {
+			INDT_3 << "int32_t tmp = acc[c]/64;" << std::endl;
 			INDT_3 << "tmp = tmp > 127?127:tmp;" << std::endl;
 			INDT_3 << "tmp = tmp < -127?-127:tmp;" << std::endl;
 			INDT_3 << "Y[r*"<<cols<<"+c] = tmp;" << std::endl;
 		}
-
-		INDT_2 "}" << std::endl;
+		else
+			INDT_3 << "Y[r*"<<cols<<"+c] = acc[c];" << std::endl;
+		INDT_2 << "}" << std::endl;
+		INDT_1 << "}" << std::endl;
 	}
 
 	virtual void resolve(void) override
@@ -91,20 +149,27 @@ class MatMulInteger : public Node {
 		register_input(inputs[0], "input_A");
 		register_input(inputs[1], "input_B");
 
-		if( inputs.size() > 2 ) {
+		int32_t rows, cols;
+		result_dim(inputs, rows, cols);
+
+		// Zero points are per tensor, per row of A or per column of B
+		if( get_a_zero() ) {
 			register_input(inputs[2], "a_zero_point");
-			/* There is no backend reference test for this case */
-			if( inputs[2]->data_dim[0] != 1 )
-				ERROR("Unimplemented: 1D zero_point input");
+			if( inputs[2]->data_num_elem() != 1 && inputs[2]->data_num_elem() != rows )
+				ERROR("MatMulInteger a_zero_point must be a scalar or per row");
 		}
-		if( inputs.size() > 3 ) {
+		if( get_b_zero() ) {
 			register_input(inputs[3], "b_zero_point");
-			if( inputs[3]->data_dim[0] != 1 )
-				ERROR("Unimplemented: 1D zero_point input");
+			if( inputs[3]->data_num_elem() != 1 && inputs[3]->data_num_elem() != cols )
+				ERROR("MatMulInteger b_zero_point must be a scalar or per column");
 		}
 
-		int32_t rows, cols;
-		result_dim(inputs, rows, cols);
+		// Calibrated quantization: B per column
+		if( quantization_calibrated() ) {
+			if( inputs[1]->quantizedFrom == NULL || inputs[1]->rank() != 2 )
+				ERROR("Unimplemented: calibrated quantization of MatMul with non-constant or 1D B");
+			inputs[1]->quantize_per_channel(1);
+		}
 
 		Tensor *rv = new Tensor;
 		rv->data_dim.push_back(rows);
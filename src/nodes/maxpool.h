@@ -32,6 +32,8 @@ class MaxPool : public Pooling {
 		std::string type_min_value;
 		if( type == "float" )
 			type_min_value = "-FLT_MAX";
+		else if( type == "onnx2c_float16" || type == "onnx2c_bfloat16" )
+			type_min_value = "-INFINITY";
 		else if( type == "int8_t" )
 			type_min_value = "INT8_MIN";
 		else if( type == "uint8_t" )
@@ -49,8 +51,8 @@ class MaxPool : public Pooling {
 	}
 	virtual void print_output_cell_calc(
 		std::ostream &dst,
-		const std::string &x_idx,
-		const std::string &w_idx,
+		const std::string &x_el,
+		const std::string &w_el,
 		const std::string &y_idx) const override
 	{
 		unsigned n_data_dims = get_numDataDim();
@@ -67,8 +69,8 @@ class MaxPool : public Pooling {
 			indices_value += "+(ii" + std::to_string(i) + "*" + std::to_string(size_of_dim[i+2]) + ")";
 
 		// Update the max and index value
-		INDT_4 << "if( curmax < x" << x_idx << ") {" <<std::endl;
-		INDT_4 << "curmax = MAX( curmax, x" << x_idx << ");" <<std::endl;
+		INDT_4 << "if( curmax < " << x_el << ") {" <<std::endl;
+		INDT_4 << "curmax = MAX( curmax, " << x_el << ");" <<std::endl;
 		if( get_Indices() )
 			INDT_4  << "curmaxind = " << indices_value << ";" <<std::endl;
 		INDT_4 << "}" << std::endl;
@@ -0,0 +1,220 @@
+/* This file is part of onnx2c.
+ *
+ * MultiThreshold node.
+ */
+#include "multithreshold.h"
+#include <cmath>
+namespace toC {
+
+
+/* Parse attributes, if this node has them. */
+void MultiThreshold::parseAttributes( onnx::NodeProto &node )
+{
+	for( const auto& a : node.attribute() ) {
+		LOG(TRACE) << "Parsing attribute " << a.name() << std::endl;
+		if( a.name() == "out_bias" )
+			out_bias = parse_attribute_float(a);
+		else if( a.name() == "out_dtype" )
+			out_dtype = parse_attribute_string(a);
+		else if( a.name() == "data_layout" )
+			data_layout = parse_attribute_string(a);
+		else if( a.name() == "out_scale" )
+			out_scale = parse_attribute_float(a);
+		else
+			LOG(ERROR) << "Ignoring attribute " << a.name() << " for node MultiThreshold/" << onnx_name << std::endl;
+	}
+}
+
+
+/* Assign input tensors, resolve output tensor shapes, allocate output tensors */
+void MultiThreshold::resolve(void)
+{
+	Tensor *input_1  = inputs[0];
+	Tensor *B = inputs[1];
+	// Remember the parameters to the generated function,
+	// along with a descriptive name that is used locally in the generated source.
+	// The most "descriptive name" usually is the one this tensor has in the ONNX documentation.
+	register_input(input_1, "A");
+	register_input(B, "B");
+
+	/* Create output tensors.
+	 * Set data dimensions and data type for the created tensors. */
+	Tensor *t = new Tensor;
+	// Same data dimensions for input and output
+	t->data_dim = inputs[0]->data_dim;
+	if( fused_matmul() ) {
+		// ... but the inner dimension from the weights
+		const Tensor *W = inputs[2];
+		register_input(W, "W");
+		if( W->rank() != 2 || input_1->data_dim.back() != W->data_dim[0] )
+			ERROR("MultiThreshold fused MatMul input's inner dimensions don't match");
+		t->data_dim.back() = W->data_dim[1];
+	}
+	if( t->rank() != 2 && t->rank() != 4 )
+		ERROR("Not implemented for anything different than 2 or 4 dimensions");
+	int channels = t->data_dim[channel_axis(t->rank())];
+	if( B->rank() != 2 || (B->data_dim[0] != channels && B->data_dim[0] != 1) )
+		ERROR("Channels of input and threshold are different");
+
+	// Multithreshold should turn this to an integer,
+	// but for simulation purposes this is now a float.
+	// The 'thresholds' optimization pass can change this later.
+	t->data_type = onnx::TensorProto_DataType_FLOAT;
+	register_output(t, "Y");
+}
+
+unsigned MultiThreshold::channel_axis(unsigned rank) const
+{
+	if( rank == 4 && data_layout == "NHWC" )
+		return 3;
+	return 1;
+}
+
+onnx::TensorProto_DataType MultiThreshold::integer_type(void) const
+{
+	double scale = out_scale == 0 ? 1 : out_scale;
+	if( scale != std::floor(scale) || out_bias != std::floor(out_bias) )
+		return onnx::TensorProto_DataType_UNDEFINED;
+	double thresholds = inputs[1]->data_dim[1];
+	double lo = std::min<double>(out_bias, out_bias + scale*thresholds);
+	double hi = std::max<double>(out_bias, out_bias + scale*thresholds);
+	if( lo >= 0 && hi <= UINT8_MAX )
+		return onnx::TensorProto_DataType_UINT8;
+	if( lo >= INT8_MIN && hi <= INT8_MAX )
+		return onnx::TensorProto_DataType_INT8;
+	if( lo >= 0 && hi <= UINT16_MAX )
+		return onnx::TensorProto_DataType_UINT16;
+	if( lo >= INT16_MIN && hi <= INT16_MAX )
+		return onnx::TensorProto_DataType_INT16;
+	if( lo >= INT32_MIN && hi <= INT32_MAX )
+		return onnx::TensorProto_DataType_INT32;
+	return onnx::TensorProto_DataType_UNDEFINED;
+}
+
+/* Constant thresholds, in ascending order for each channel */
+bool MultiThreshold::sorted_thresholds(void) const
+{
+	const Tensor *B = inputs[1];
+	if( B->data_buffer == NULL )
+		return false;
+	bool is_float = B->data_type == onnx::TensorProto_DataType_FLOAT;
+	int thresholds = B->data_dim[1];
+	for( int c=0; c<B->data_dim[0]; c++ )
+		for( int t=1; t<thresholds; t++ ) {
+			int i = c*thresholds + t;
+			if( is_float && B->get_data_element_float(i-1) > B->get_data_element_float(i) )
+				return false;
+			if( is_float == false && B->get_data_element(i-1) > B->get_data_element(i) )
+				return false;
+		}
+	return true;
+}
+
+/* Print the counting of the thresholds of 'channel' that 'x' is at or above.
+ * Sorted thresholds are searched for the first one above 'x'. */
+void MultiThreshold::print_count(std::ostream &dst, const std::string &x, const std::string &channel) const
+{
+	const Tensor *B = inputs[1];
+	int thresholds = B->data_dim[1];
+	// First threshold of the channel
+	std::string thr = "b";
+	if( B->data_dim[0] > 1 )
+		thr = "(b+" + channel + "*" + std::to_string(thresholds) + ")";
+
+	INDT_2 << "uint32_t count = 0;" << std::endl;
+	if( thresholds >= 4 && sorted_thresholds() ) {
+		INDT_2 << "uint32_t above = " << thresholds << ";" << std::endl;
+		INDT_2 << "while( count < above ) {" << std::endl;
+		INDT_3 <<   "uint32_t mid = (count + above) / 2;" << std::endl;
+		INDT_3 <<   "if( " << x << " >= " << thr << "[mid] )" << std::endl;
+		INDT_4 <<     "count = mid + 1;" << std::endl;
+		INDT_3 <<   "else" << std::endl;
+		INDT_4 <<     "above = mid;" << std::endl;
+		INDT_2 << "}" << std::endl;
+	}
+	else {
+		INDT_2 << "for( uint32_t t=0; t<" << thresholds << "; t++ )" << std::endl;
+		INDT_3 <<   "count += " << x << " >= " << thr << "[t];" << std::endl;
+	}
+}
+
+/* Print the scaling and biasing of 'count' to the output element 'y' */
+void MultiThreshold::print_output(std::ostream &dst, const std::string &y) const
+{
+	if( outputs[0]->data_type != onnx::TensorProto_DataType_FLOAT ) {
+		int64_t scale = out_scale == 0 ? 1 : std::lround(out_scale);
+		int64_t bias = std::lround(out_bias);
+		INDT_2 << y << " = (int32_t)count";
+		if( scale != 1 )
+			dst << " * " << scale;
+		if( bias != 0 )
+			dst << " + (" << bias << ")";
+		dst << ";" << std::endl;
+	}
+	else if( out_scale != 0 )
+		INDT_2 << y << " = " << out_scale << " * (float)count + (" << out_bias << ");" << std::endl;
+	else
+		INDT_2 << y << " = (float)count + (" << out_bias << ");" << std::endl;
+}
+
+/* Body of the node implementing function */
+void MultiThreshold::print(std::ostream &dst) const
+{
+	const Tensor *A = inputs[0];
+	const Tensor *Y = outputs[0];
+	unsigned axis = channel_axis(Y->rank());
+	int channels = Y->data_dim[axis];
+	int outer = 1;
+	int inner = 1;
+	for( unsigned d=0; d<axis; d++ )
+		outer *= Y->data_dim[d];
+	for( unsigned d=axis+1; d<Y->rank(); d++ )
+		inner *= Y->data_dim[d];
+
+	INDT_1 << "/* MultiThreshold */" << std::endl;
+	INDT_1 << "const " << A->data_type_str() << " *a = (const " << A->data_type_str() << "*)A;" << std::endl;
+	INDT_1 << Y->data_type_str() << " *y = (" << Y->data_type_str() << "*)Y;" << std::endl;
+	INDT_1 << "const " << inputs[1]->data_type_str() << " *b = (const " << inputs[1]->data_type_str() << "*)B;" << std::endl;
+
+	if( fused_matmul() == false ) {
+		INDT_1 << "for( uint32_t o=0; o<" << outer << "; o++ )" << std::endl;
+		INDT_1 << "for( uint32_t c=0; c<" << channels << "; c++ )" << std::endl;
+		INDT_1 << "for( uint32_t i=0; i<" << inner << "; i++ ) {" << std::endl;
+		INDT_2 <<   "uint32_t idx = (o*" << channels << "+c)*" << inner << "+i;" << std::endl;
+		INDT_2 <<   A->data_type_str() << " x = a[idx];" << std::endl;
+		print_count(dst, "x", "c");
+		print_output(dst, "y[idx]");
+		INDT_1 << "}" << std::endl;
+		return;
+	}
+
+	// MatMul fused: each output element is thresholded as soon as its sum is ready.
+	// The sum is in integers if both the input and the weights are.
+	const Tensor *W = inputs[2];
+	int K = W->data_dim[0];
+	int N = W->data_dim[1];
+	int rows = A->data_num_elem() / K;
+	bool integer_sum = A->data_type != onnx::TensorProto_DataType_FLOAT
+	                && W->data_type != onnx::TensorProto_DataType_FLOAT;
+	std::string W_idx = "i*" + std::to_string(N) + "+c";
+	std::string W_el = W->pack_bits ? W->packed_element("W", W_idx) : "w[" + W_idx + "]";
+	// Channel of the output element at (r, c)
+	std::string channel = "c";
+	if( axis != Y->rank()-1 )
+		channel = "(r*" + std::to_string(N) + "+c)/" + std::to_string(inner) + "%" + std::to_string(channels);
+
+	INDT_1 << "/* with fused MatMul */" << std::endl;
+	if( W->pack_bits == 0 )
+		INDT_1 << "const " << W->data_type_str() << " *w = (const " << W->data_type_str() << "*)W;" << std::endl;
+	INDT_1 << "for( uint32_t r=0; r<" << rows << "; r++ )" << std::endl;
+	INDT_1 << "for( uint32_t c=0; c<" << N << "; c++ ) {" << std::endl;
+	INDT_2 <<   (integer_sum ? "int32_t" : "float") << " sum = 0;" << std::endl;
+	INDT_2 <<   "for( uint32_t i=0; i<" << K << "; i++ )" << std::endl;
+	INDT_3 <<     "sum += a[r*" << K << "+i] * " << W_el << ";" << std::endl;
+	print_count(dst, "sum", channel);
+	print_output(dst, "y[r*" + std::to_string(N) + "+c]");
+	INDT_1 << "}" << std::endl;
+}
+
+
+} // namespace
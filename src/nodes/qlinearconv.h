@@ -0,0 +1,85 @@
+/* This file is part of onnx2c.
+ *
+ * QLinearConv
+ * Convolution of quantized tensors, with a quantized result.
+ * Each tensor has a scale and a zero point: real = (q - zero_point) * scale.
+ * The optional bias is int32 at the scale x_scale*w_scale.
+ *
+ * The scales and zero points must be compile time constants.
+ * The zero points are handled as in ConvInteger, and the int32 sum
+ * is requantized to the output scale with fixed point multipliers.
+ */
+#include "convinteger.h"
+namespace toC {
+
+class QLinearConv : public ConvInteger {
+	public:
+	QLinearConv() {
+		op_name = "QLinearConv";
+		y_zero = 0;
+	}
+
+	// Compile time constants, from the inputs
+	int32_t y_zero;
+	std::vector<double> reals; // requantization multipliers, per output channel or one
+
+	virtual const Tensor* get_W(void) const override { return inputs[3]; }
+	virtual const Tensor* get_x_zero(void) const override { return inputs[2]; }
+	virtual const Tensor* get_w_zero(void) const override { return inputs[5]; }
+	virtual const Tensor* get_bias(void) const override {
+		return inputs.size() > 8 ? inputs[8] : nullptr;
+	}
+
+	virtual void print_output_cell_store(std::ostream &dst, const std::string &y_idx) const override
+	{
+		std::string ch = reals.size() > 1 ? "[m]" : "[0]";
+		INDT_3 << "y" << y_idx << " = " << requantize_zp("cell", "mult" + ch, "shift" + ch, y_zero, get_Y()->data_type) << ";" << std::endl;
+	}
+
+	virtual void print(std::ostream &dst) const override
+	{
+		print_header_info_comment(dst);
+		print_requantize_tables(dst, reals);
+		print_zero_point_tables(dst);
+		print_loop_with_padding_checks(dst);
+	}
+
+	virtual void resolve(void) override
+	{
+		if( inputs.size() < 8 )
+			ERROR("QLinearConv needs at least 8 inputs");
+		register_input(inputs[0], "x");
+		register_input(inputs[1], "x_scale");
+		register_input(inputs[2], "x_zero_point");
+		register_input(inputs[3], "w");
+		register_input(inputs[4], "w_scale");
+		register_input(inputs[5], "w_zero_point");
+		register_input(inputs[6], "y_scale");
+		register_input(inputs[7], "y_zero_point");
+		if( inputs.size() > 8 && inputs[8]->is_used() )
+			register_input(inputs[8], "bias");
+		else
+			inputs.resize(8);
+
+		// Zero points are always constants here, so x_zero_c() and w_zero_c() give literals
+		constant_ints(inputs[2], "QLinearConv x_zero_point");
+		constant_ints(inputs[5], "QLinearConv w_zero_point");
+		resolve_zero_points();
+
+		int maps = get_W()->data_dim[0];
+		float x_scale = constant_floats(inputs[1], "QLinearConv x_scale")[0];
+		std::vector<float> w_scale = constant_floats(inputs[4], "QLinearConv w_scale");
+		float y_scale = constant_floats(inputs[6], "QLinearConv y_scale")[0];
+		y_zero = constant_ints(inputs[7], "QLinearConv y_zero_point")[0];
+		if( w_scale.size() != 1 && (int)w_scale.size() != maps )
+			ERROR("QLinearConv w_scale must be a scalar or per output channel");
+		for( float ws : w_scale )
+			reals.push_back( (double)x_scale * ws / y_scale );
+
+		Tensor *rv = new Tensor;
+		rv->data_dim = resolve_output_size();
+		rv->data_type = inputs[7]->data_type;
+		register_output(rv, "y");
+	}
+};
+}
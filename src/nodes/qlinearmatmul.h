@@ -0,0 +1,143 @@
+/* This file is part of onnx2c.
+ *
+ * QLinearMatMul
+ * Matrix multiplication of quantized tensors, with a quantized result.
+ * Each tensor has a scale and a zero point: real = (q - zero_point) * scale.
+ *
+ * The scales and zero points must be compile time constants.
+ * The sum over (a-za)*(b-zb) is expanded into
+ *   sum(a*b) - zb*sum(a) - za*sum(b) + K*za*zb
+ * With a constant B, the last two terms are precomputed for each column,
+ * and the innermost loop is a plain integer dot product.
+ * The int32 sum is requantized to the output scale with fixed point
+ * multipliers.
+ */
+#include "quantization.h"
+
+namespace toC {
+
+class QLinearMatMul : public Node {
+	public:
+	QLinearMatMul() {
+		op_name = "QLinearMatMul";
+	}
+
+	virtual void print(std::ostream &dst) const override
+	{
+		const Tensor *A = inputs[0];
+		const Tensor *B = inputs[3];
+		const Tensor *Y = outputs[0];
+		int K = B->data_dim[0];
+		int N = B->data_dim[1];
+		int rows = A->data_num_elem() / K;
+
+		float a_scale = constant_floats(inputs[1], "QLinearMatMul a_scale")[0];
+		int32_t a_zero = constant_ints(inputs[2], "QLinearMatMul a_zero_point")[0];
+		std::vector<float> b_scale = constant_floats(inputs[4], "QLinearMatMul b_scale");
+		std::vector<int32_t> b_zero = constant_ints(inputs[5], "QLinearMatMul b_zero_point");
+		float y_scale = constant_floats(inputs[6], "QLinearMatMul y_scale")[0];
+		int32_t y_zero = constant_ints(inputs[7], "QLinearMatMul y_zero_point")[0];
+		bool fold_b = B->data_buffer != NULL;
+
+		INDT_1 << "/* QLinearMatMul */" << std::endl;
+
+		// Requantization multipliers, per column if B has per column scales
+		std::vector<double> reals;
+		for( float bs : b_scale )
+			reals.push_back( (double)a_scale * bs / y_scale );
+		print_requantize_tables(dst, reals);
+		std::string ch = b_scale.size() > 1 ? "[c]" : "[0]";
+
+		// The zero point terms that depend only on B
+		bool has_b_term = false;
+		if( fold_b && a_zero != 0 ) {
+			INDT_1 << "static const int32_t b_term[" << N << "] = {";
+			for( int c=0; c<N; c++ ) {
+				int32_t zb = b_zero[b_zero.size() > 1 ? c : 0];
+				int32_t sum = 0;
+				for( int i=0; i<K; i++ )
+					sum += B->get_data_element(i*N+c);
+				dst << (c ? ", " : " ") << -a_zero*sum + K*a_zero*zb;
+			}
+			dst << " };" << std::endl;
+			has_b_term = true;
+		}
+		// The zero point of B multiplies the row sums of A
+		bool has_b_zero = false;
+		for( int32_t zb : b_zero )
+			if( zb != 0 )
+				has_b_zero = true;
+		std::string b_zero_c = std::to_string(b_zero[0]);
+		if( has_b_zero && b_zero.size() > 1 ) {
+			INDT_1 << "static const int32_t b_zero[" << N << "] = {";
+			for( int c=0; c<N; c++ )
+				dst << (c ? ", " : " ") << b_zero[c];
+			dst << " };" << std::endl;
+			b_zero_c = "b_zero[c]";
+		}
+
+		std::string atype = A->data_type_str();
+		std::string btype = B->data_type_str();
+		std::string ytype = Y->data_type_str();
+		INDT_1 << "const " << atype << " *A = (const " << atype << "*)a;" << std::endl;
+		INDT_1 << "const " << btype << " *B = (const " << btype << "*)b;" << std::endl;
+		INDT_1 << ytype << " *Y = (" << ytype << "*)y;" << std::endl;
+
+		INDT_1 << "for( uint32_t r=0; r<" << rows << "; r++ ) {" << std::endl;
+		if( fold_b && has_b_zero ) {
+			INDT_2 << "int32_t a_sum = 0;" << std::endl;
+			INDT_2 << "for( uint32_t i=0; i<" << K << "; i++ )" << std::endl;
+			INDT_3 << "a_sum += A[r*" << K << "+i];" << std::endl;
+		}
+		INDT_2 << "for( uint32_t c=0; c<" << N << "; c++ ) {" << std::endl;
+		INDT_3 << "int32_t acc = " << (has_b_term ? "b_term[c]" : "0") << ";" << std::endl;
+		INDT_3 << "for( uint32_t i=0; i<" << K << "; i++ )" << std::endl;
+		if( fold_b )
+			INDT_4 << "acc += A[r*" << K << "+i] * B[i*" << N << "+c];" << std::endl;
+		else {
+			// Run time B: no precomputation possible
+			INDT_4 << "acc += (A[r*" << K << "+i] - " << a_zero << ") * (B[i*" << N << "+c] - " << b_zero_c << ");" << std::endl;
+		}
+		if( fold_b && has_b_zero )
+			INDT_3 << "acc -= " << b_zero_c << " * a_sum;" << std::endl;
+		INDT_3 << "Y[r*" << N << "+c] = " << requantize_zp("acc", "mult" + ch, "shift" + ch, y_zero, Y->data_type) << ";" << std::endl;
+		INDT_2 << "}" << std::endl;
+		INDT_1 << "}" << std::endl;
+	}
+
+	virtual void resolve(void) override
+	{
+		if( inputs.size() != 8 )
+			ERROR("QLinearMatMul needs 8 inputs");
+		const Tensor *A = inputs[0];
+		const Tensor *B = inputs[3];
+		register_input(A, "a");
+		register_input(inputs[1], "a_scale");
+		register_input(inputs[2], "a_zero_point");
+		register_input(B, "b");
+		register_input(inputs[4], "b_scale");
+		register_input(inputs[5], "b_zero_point");
+		register_input(inputs[6], "y_scale");
+		register_input(inputs[7], "y_zero_point");
+
+		if( B->rank() != 2 )
+			ERROR("Unimplemented: QLinearMatMul with B of other than 2 dimensions");
+		if( A->rank() < 1 || A->data_dim.back() != B->data_dim[0] )
+			ERROR("QLinearMatMul input's inner dimensions don't match");
+		int N = B->data_dim[1];
+		if( inputs[1]->data_num_elem() != 1 || inputs[2]->data_num_elem() != 1 )
+			ERROR("QLinearMatMul a_scale and a_zero_point must be scalars");
+		if( inputs[6]->data_num_elem() != 1 || inputs[7]->data_num_elem() != 1 )
+			ERROR("QLinearMatMul y_scale and y_zero_point must be scalars");
+		if( (inputs[4]->data_num_elem() != 1 && inputs[4]->data_num_elem() != N)
+		 || (inputs[5]->data_num_elem() != 1 && inputs[5]->data_num_elem() != N) )
+			ERROR("QLinearMatMul b_scale and b_zero_point must be scalars or per column");
+
+		Tensor *rv = new Tensor;
+		rv->data_dim = A->data_dim;
+		rv->data_dim.back() = N;
+		rv->data_type = inputs[7]->data_type;
+		register_output(rv, "y");
+	}
+};
+}
@@ -0,0 +1,125 @@
+/* This file is part of onnx2c.
+ *
+ * QuantizeLinear node.
+ * Quantizes a float tensor to 8 or 16 bit integers:
+ * y = saturate(round(x / y_scale) + y_zero_point)
+ * The scale and zero point are either one for the whole
+ * tensor, or one for each index of dimension 'axis'.
+ */
+#pragma once
+namespace toC {
+
+class QuantizeLinear : public Node {
+	public:
+	QuantizeLinear() {
+		op_name = "QuantizeLinear";
+		axis = 1;
+		block_size = 0;
+		output_dtype = 0;
+	}
+	int axis;
+	int block_size;
+	int output_dtype;
+
+	virtual void parseAttributes( onnx::NodeProto &node ) override {
+		for( const auto& a : node.attribute() ) {
+			LOG(TRACE) << "Parsing attribute " << a.name() << std::endl;
+			if( a.name() == "axis" )
+				axis = parse_attribute_int(a);
+			else if( a.name() == "block_size" )
+				block_size = parse_attribute_int(a);
+			else if( a.name() == "output_dtype" )
+				output_dtype = parse_attribute_int(a);
+			else if( a.name() == "saturate" || a.name() == "precision" )
+				; // only affect float8 outputs, and computation in other than float
+			else
+				ERROR("unknown attribute: " << a.name());
+		}
+	}
+
+	virtual void print(std::ostream &dst) const override
+	{
+		const Tensor *x = inputs[0];
+		const Tensor *scale = inputs[1];
+		const Tensor *zero_point = inputs.size() > 2 ? inputs[2] : nullptr;
+		const Tensor *y = outputs[0];
+		std::string ytype = y->data_type_str();
+		int32_t lo, hi;
+		switch( y->data_type ) {
+			case onnx::TensorProto_DataType_INT8:   lo = INT8_MIN;  hi = INT8_MAX;   break;
+			case onnx::TensorProto_DataType_UINT8:  lo = 0;         hi = UINT8_MAX;  break;
+			case onnx::TensorProto_DataType_INT16:  lo = INT16_MIN; hi = INT16_MAX;  break;
+			default:                                lo = 0;         hi = UINT16_MAX; break;
+		}
+
+		INDT_1 << "/* QuantizeLinear */" << std::endl;
+		INDT_1 << "const " << x->data_type_str() << " *X = (const " << x->data_type_str() << "*)x;" << std::endl;
+		INDT_1 << ytype << " *Y = (" << ytype << "*)y;" << std::endl;
+		INDT_1 << "for( uint32_t i=0; i<" << x->data_num_elem() << "; i++ ) {" << std::endl;
+		INDT_2 << "uint32_t a = " << axis_index(scale) << ";" << std::endl;
+		INDT_2 << "float q = rintf(X[i] / " << element(scale, "y_scale") << ")";
+		if( zero_point )
+			dst << " + " << element(zero_point, "y_zero_point");
+		dst << ";" << std::endl;
+		INDT_2 << "Y[i] = q < " << lo << " ? " << lo << " : q > " << hi << " ? " << hi << " : q;" << std::endl;
+		INDT_1 << "}" << std::endl;
+	}
+
+	/* C expression of the index into the scale and zero point of element 'i' of x */
+	std::string axis_index(const Tensor *scale) const
+	{
+		const Tensor *x = inputs[0];
+		if( scale->data_num_elem() == 1 )
+			return "0";
+		int inner = 1;
+		for( unsigned d=axis+1; d<x->rank(); d++ )
+			inner *= x->data_dim[d];
+		return "i / " + std::to_string(inner) + " % " + std::to_string(x->data_dim[axis]);
+	}
+
+	/* Element 'a' of a scale or zero point tensor. Scalars are passed by value. */
+	static std::string element(const Tensor *t, const std::string &name)
+	{
+		if( t->rank() == 0 )
+			return name;
+		return "((const " + t->data_type_str() + "*)" + name + ")[a]";
+	}
+
+	virtual void resolve(void) override
+	{
+		const Tensor *x = inputs[0];
+		const Tensor *scale = inputs[1];
+		register_input(x, "x");
+		register_input(scale, "y_scale");
+		if( inputs.size() > 2 && inputs[2]->is_used() )
+			register_input(inputs[2], "y_zero_point");
+		else
+			inputs.resize(2);
+
+		if( x->data_type != onnx::TensorProto_DataType_FLOAT
+		 && x->data_type != onnx::TensorProto_DataType_INT32 )
+			ERROR("Unimplemented: QuantizeLinear input of type " << x->data_type_str());
+		if( block_size != 0 )
+			ERROR("Unimplemented: blocked QuantizeLinear");
+		if( axis < 0 )
+			axis += x->rank();
+		if( scale->data_num_elem() != 1 && (axis < 0 || axis >= (int)x->rank() || scale->data_num_elem() != x->data_dim[axis]) )
+			ERROR("QuantizeLinear scale does not match the input on axis " << axis);
+
+		Tensor *t = new Tensor;
+		t->data_dim = x->data_dim;
+		if( inputs.size() > 2 )
+			t->data_type = inputs[2]->data_type;
+		else if( output_dtype )
+			t->data_type = static_cast<onnx::TensorProto_DataType>(output_dtype);
+		else
+			t->data_type = onnx::TensorProto_DataType_UINT8;
+		if( t->data_type != onnx::TensorProto_DataType_INT8
+		 && t->data_type != onnx::TensorProto_DataType_UINT8
+		 && t->data_type != onnx::TensorProto_DataType_INT16
+		 && t->data_type != onnx::TensorProto_DataType_UINT16 )
+			ERROR("Unimplemented: QuantizeLinear to type " << t->data_type_str());
+		register_output(t, "y");
+	}
+};
+}
@@ -1,4 +1,5 @@
 #include "error.h"
+#include "simd.h"
 
 namespace toC {
 
@@ -18,11 +19,24 @@ class Relu : public Node {
 		dst << "\t" << type << " *X_ptr = (" << type << "*)X;" << std::endl;
 		dst << "\t" << type << " *Y_ptr = (" << type << "*)Y;" << std::endl;
 
-		dst << "\t" << "for( uint32_t i=0; i<" << X->data_num_elem() << "; i++ )" << std::endl;
+		std::string start = "0";
+		if( simd_enabled() && X->data_type == onnx::TensorProto_DataType_FLOAT && X->runtime_dim == "" ) {
+			unsigned n_vec = X->data_num_elem() / simd_width() * simd_width();
+			dst << "\t" << "for( uint32_t i=0; i<" << n_vec << "; i+=" << simd_width() << " )" << std::endl;
+			dst << "\t\t" << simd_store("&Y_ptr[i]", simd_max(simd_load("&X_ptr[i]"), simd_set1("0.0f"))) << ";" << std::endl;
+			start = std::to_string(n_vec);
+		}
+
+		dst << "\t" << "for( uint32_t i=" << start << "; i<" << X->str_num_elem() << "; i++ )" << std::endl;
 		dst << "\t\tY_ptr[i] = X_ptr[i] > 0 ? X_ptr[i] : 0;" << std::endl;
 		dst << std::endl;
 	} 
 
+	virtual bool handles_runtime_dim(void) const override
+	{
+		return true;
+	}
+
 	virtual void resolve(void) override
 	{
 		const Tensor *X = inputs[0];
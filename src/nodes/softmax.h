@@ -21,6 +21,8 @@
  * The trick with (x-max) is to accomodate big values of x (where exp(x)->inf).
  * subtracting max doesn't change the result.
  */
+#include "fastmath.h"
+
 namespace toC {
 
 class Softmax : public Node {
@@ -58,16 +60,62 @@ class Softmax : public Node {
 			print11(dst);
 	}
 
-	void print11(std::ostream &dst) const
+	std::string exp_function(void) const
+	{
+		if( inputs[0]->data_type == onnx::TensorProto_DataType_DOUBLE )
+			return "exp";
+		return math_function("expf");
+	}
+
+	/* Print the online softmax of the elements 'x' into 'y', over 'loop'.
+	 * The max and the sum of the exponentials are found in one pass:
+	 * the sum so far is rescaled whenever a new max is found. The second
+	 * pass writes the outputs, multiplied by the reciprocal of the sum. */
+	void print_online(std::ostream &dst, const std::string &loop, const std::string &x, const std::string &y) const
+	{
+		std::string acc_type = inputs[0]->accumulator_type_str();
+		std::string expfunc = exp_function();
+		INDT_2 << acc_type << " max = -INFINITY;" << std::endl;
+		INDT_2 << acc_type << " sum = 0;" << std::endl;
+		INDT_2 << loop << " {" << std::endl;
+		INDT_3 << "if( " << x << " > max ) {" << std::endl;
+		INDT_4 << "sum *= " << expfunc << "(max - " << x << ");" << std::endl;
+		INDT_4 << "max = " << x << ";" << std::endl;
+		INDT_3 << "}" << std::endl;
+		INDT_3 << "sum += " << expfunc << "(" << x << " - max);" << std::endl;
+		INDT_2 << "}" << std::endl;
+		INDT_2 << acc_type << " rsum = 1 / sum;" << std::endl;
+		INDT_2 << loop << std::endl;
+		INDT_3 << y << " = " << expfunc << "(" << x << " - max) * rsum;" << std::endl;
+	}
+
+	/* Softmax over each contiguous row of 'n' elements, i.e. over the
+	 * innermost dimensions starting from dimension 'first' */
+	void print_rows(std::ostream &dst, unsigned first) const
 	{
 		const Tensor *input=inputs[0];
 		std::string type = input->data_type_str();
-		unsigned n_dim = input->data_dim.size();
-		std::string expfunc = "expf";
-		if( type == "double" )
-			expfunc = "exp";
-		//TODO fp16?
+		int n = 1;
+		for( unsigned i = first; i<input->rank(); i++ )
+			n *= input->data_dim[i];
+		int rows = 1;
+		for( unsigned i = 0; i<first; i++ )
+			rows *= input->data_dim[i];
+		std::string num_rows = std::to_string(rows);
+		// The run time variable dimension is the outermost one
+		if( input->runtime_dim != "" && first > 0 )
+			num_rows = input->str_dim(0) + "*" + std::to_string(rows / input->data_dim[0]);
+
+		INDT_1 << "const " << type << " *x = (const " << type << "*)input;" << std::endl;
+		INDT_1 << type << " *y = (" << type << "*)output;" << std::endl;
+		INDT_1 << "for( uint32_t r=0; r<" << num_rows << "; r++, x+=" << n << ", y+=" << n << " ) {" << std::endl;
+		print_online(dst, "for( uint32_t i=0; i<" + std::to_string(n) + "; i++ )", "x[i]", "y[i]");
+		INDT_1 << "}" << std::endl;
+	}
 
+	void print11(std::ostream &dst) const
+	{
+		const Tensor *input=inputs[0];
 		unsigned flatten_axis;
 		if( axis < 0 ) 
 			flatten_axis = input->data_dim.size() + axis;
@@ -77,68 +125,13 @@ class Softmax : public Node {
 		dst << "\t/* Softmax 11 (caffe2-style)" << std::endl;
 		dst << "\t * axis = " << axis << std::endl;
 		dst << "\t */" << std::endl; 
-		dst << "\t" << type << " sum = 0.0;" << std::endl;
-		dst << "\t" << type << " max = -INFINITY;" << std::endl;
-		dst << std::endl;
-
-		std::string idxs;
-		for( unsigned i = 0; i<n_dim; i++)
-			idxs += "[i" + std::to_string(i) + "]";
-
-		for( unsigned i = 0; i<n_dim; i++) {
-			std::string idx = "i" + std::to_string(i);
-			dst << "\t" << "for( uint32_t " << idx << "=0; ";
-			dst <<               idx << "<" << input->data_dim[i] << "; ";
-			dst <<               idx <<"++ ) {" << std::endl;
-		}
-
-		// Calculate max of the flattened inner dimensions, and close those loops
-		dst << "\t\t" << "max = max>input" << idxs << " ? max : input" << idxs << ";" << std::endl;
-		for( unsigned i = flatten_axis; i<n_dim; i++)
-			dst << "\t}" << std::endl;
-
-		// Calculate exp() and running sum of innermost flattened dimensions
-		for( unsigned i = flatten_axis; i<n_dim; i++) {
-			std::string idx = "i" + std::to_string(i);
-			dst << "\t" << "for( uint32_t " << idx << "=0; ";
-			dst <<               idx << "<" << input->data_dim[i] << "; ";
-			dst <<               idx <<"++ ) {" << std::endl;
-		}
-		INDT_2 << "output"<< idxs << " = ";
-		dst           << expfunc << "(input" << idxs << "-max);" << std::endl;
-		INDT_2 << "sum += output" << idxs << ";" << std::endl;
-		for( unsigned i = flatten_axis; i<n_dim; i++)
-			dst << "\t}" << std::endl;
-			
-		// loop again over inner dimensions to do the division
-		for( unsigned i = flatten_axis; i<n_dim; i++) {
-			std::string idx = "i" + std::to_string(i);
-			dst << "\t" << "for( uint32_t " << idx << "=0; ";
-			dst <<               idx << "<" << input->data_dim[i] << "; ";
-			dst <<               idx <<"++ ) {" << std::endl;
-		}
-		INDT_2 << "output" << idxs <<" /= sum;" << std::endl;
-		for( unsigned i = flatten_axis; i<n_dim; i++)
-			dst << "\t}" << std::endl;
-
-		dst << "\t" << "sum = 0.0;" << std::endl; 
-		dst << "\t" << "max = -INFINITY;" << std::endl; 
-
-		
-		for( unsigned i = 0; i<flatten_axis; i++ )
-			dst << "\t}" << std::endl;
+		print_rows(dst, flatten_axis);
 	}
 
 	void print13(std::ostream &dst) const
 	{
 		const Tensor *input=inputs[0];
-
-		std::string type = input->data_type_str();
 		unsigned num_dim = input->rank();
-		std::string expfunc = "expf";
-		if( type == "double" )
-			expfunc = "exp";
-		//TODO fp16?
 
 		unsigned reduce_axis;
 		if( axis < 0 )
@@ -153,6 +146,12 @@ class Softmax : public Node {
 		INDT_1 << " * axis = " << axis << std::endl;
 		INDT_1 << " */" << std::endl;
 
+		// The common case: softmax over the last axis, i.e. contiguous rows
+		if( reduce_axis == num_dim-1 ) {
+			print_rows(dst, reduce_axis);
+			return;
+		}
+
 		// Loop over all tensor elements, leaving the axis along which to calculate
 		// softmax as the innermost loop.
 		std::string idxs;
@@ -162,40 +161,26 @@ class Softmax : public Node {
 				continue;
 			std::string idx = "i" + std::to_string(i);
 			INDT_1 << "for( uint32_t " << idx << "=0; ";
-			dst <<               idx << "<" << input->data_dim[i] << "; ";
+			dst <<               idx << "<" << input->str_dim(i) << "; ";
 			dst <<               idx <<"++ ) {" << std::endl;
 		}
 
-		// Loop over the reduction axis three times, first calculate the max, then sum, then the elements
 		std::string ridx = "i" + std::to_string(reduce_axis);
-		INDT_2 << type << " max = -INFINITY;" << std::endl;
-		INDT_2 << "for( uint32_t " << ridx << "=0; ";
-		   dst <<       ridx << "<" << reduce_axis_size << "; ";
-		   dst <<       ridx <<"++ ) {" << std::endl;
-		INDT_3 << "max = max>input" << idxs << " ? max :input" << idxs << ";" << std::endl;
-		INDT_2 << "};" << std::endl;
-
-		// Now loop to calculate sum
-		INDT_2 << type << " sum = 0.0;" << std::endl;
-		INDT_2 << "for( uint32_t " << ridx << "=0; ";
-		   dst <<       ridx << "<" << reduce_axis_size << "; ";
-		   dst <<       ridx <<"++ ) {" << std::endl;
-		INDT_3 << "sum += " << expfunc << "(input" << idxs << " - max);" << std::endl;
-		INDT_2 << "};" << std::endl;
-
-		// And last the elementwise softmax
-		INDT_2 << "for( uint32_t " << ridx << "=0; ";
-		   dst <<       ridx << "<" << reduce_axis_size << "; ";
-		   dst <<       ridx <<"++ ) {" << std::endl;
-		INDT_3 << "output" << idxs << " = ";
-		   dst << expfunc << "(input" << idxs << " - max)/sum;" << std::endl;
-		INDT_2 << "};" << std::endl;
+		std::string loop = "for( uint32_t " + ridx + "=0; " + ridx + "<" + std::to_string(reduce_axis_size) + "; " + ridx + "++ )";
+		print_online(dst, loop, "input" + idxs, "output" + idxs);
 
 		for( unsigned i = 0; i<num_dim-1; i++ )
 			INDT_1 <<"}" << std::endl;
 	}
 
 
+	/* The softmax must not be calculated across the run time variable dimension */
+	virtual bool handles_runtime_dim(void) const override
+	{
+		int a = axis < 0 ? inputs[0]->rank() + axis : axis;
+		return a != 0;
+	}
+
 	virtual void resolve(void) override
 	{
 		if( inputs.size() != 1 )
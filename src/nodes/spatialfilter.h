@@ -29,7 +29,8 @@ class SpatialFilter : public Node {
 	std::vector<int64_t> strides;
 
 	const Tensor* get_X(void) const { return inputs[0]; }
-	const Tensor* get_W(void) const {
+	// The weights input. Not always the second input, e.g. in QLinearConv
+	virtual const Tensor* get_W(void) const {
 		if( inputs.size() > 1 )
 			return inputs[1];
 		else
@@ -138,6 +139,16 @@ class SpatialFilter : public Node {
 		return rv;
 	}
 
+	/* The batch loop in print_loop_with_padding_checks() runs to the
+	 * run time batch size. Weights, bias etc. must be static. */
+	virtual bool handles_runtime_dim(void) const override
+	{
+		for( unsigned i=1; i<inputs.size(); i++ )
+			if( inputs[i]->runtime_dim != "" )
+				return false;
+		return true;
+	}
+
 	// Does output channels map one-to-one to input channels.
 	// This is only true for pooling filters.
 	virtual bool direct_channel_map(void) const
@@ -180,16 +191,102 @@ class SpatialFilter : public Node {
 	 *
 	 * Three callbacks to pure virtual functions are used:
 	 * - to initialize output cell
-	 * - to calculate input cell / kernel cell (this is the calculation in the innermost loop)
+	 * - to calculate input cell / kernel cell (this is the calculation in the innermost loop).
+	 *   x_el and w_el are the C expressions of the input and kernel cells.
 	 * - to finalize the output cell
+	 *
+	 * With '--flat-pointers', the input and kernel are read through pointers to the
+	 * current channel, with offsets that the kernel loops bump by precomputed strides.
+	 * The padding checks are then done in each kernel loop, not the innermost.
 	 */
 	virtual void print_output_cell_init(std::ostream &dst, const std::string &y_idx="") const = 0;
-	virtual void print_output_cell_calc(std::ostream &dst, const std::string &x_idx="", const std::string &w_idx="", const std::string &y_idx="") const = 0;
+	virtual void print_output_cell_calc(std::ostream &dst, const std::string &x_el="", const std::string &w_el="", const std::string &y_idx="") const = 0;
 	virtual void print_output_cell_finalize(std::ostream &dst, const std::string &y_idx="") const = 0;
+	/* The element strides of each dimension of t, in C order. Not
+	 * Node::flat_strides(), which are zero for dimensions of size 1 to
+	 * broadcast them: e.g. the channel stride of a depthwise W [M][1][k][k]
+	 * is still k*k. */
+	static std::vector<int> dense_strides(const Tensor *t)
+	{
+		std::vector<int> strides(t->rank());
+		int stride = 1;
+		for( int r=t->rank()-1; r>=0; r-- ) {
+			strides[r] = stride;
+			stride *= t->data_dim[r];
+		}
+		return strides;
+	}
+
+	/* The kernel loops of print_loop_with_padding_checks() in flat pointer mode.
+	 * For each spatial dimension i, the loop over k<i> keeps the input index ii<i>,
+	 * and the offsets xo<i> and wo<i> into the current channel of x and w.
+	 * The offset of the output loop, io<i>, is where the kernel window starts. */
+	void print_flat_kernel_loops(std::ostream &dst, const std::vector<int> &x_strides, const std::vector<int> &w_strides) const
+	{
+		unsigned n_data_dims = get_numDataDim();
+		const Tensor *x = get_X();
+		const Tensor *w = get_W();
+		int channel_size = x_strides[1];
+		INDT_3 << "const " << x->data_type_str() << " *x_c = (const " << x->data_type_str() << "*)x + ";
+		   dst <<      "(b*" << x->data_dim[1] << "+c)*" << channel_size << ";" << std::endl;
+		if( w ) {
+			std::string wc = group > 1 ? "(c-(gi*g))" : "c";
+			// Packed weights can't be pointed to, so w_c is an element offset
+			if( w->pack_bits )
+				INDT_3 << "uint32_t w_c = ";
+			else
+				INDT_3 << "const " << w->data_type_str() << " *w_c = (const " << w->data_type_str() << "*)w + ";
+			dst << "(m*" << w->data_dim[1] << "+" << wc << ")*" << w_strides[1] << ";" << std::endl;
+		}
+
+		for( unsigned i = 0; i<n_data_dims; i++) {
+			std::string i_str = std::to_string(i);
+			std::string xo_prev = i ? "xo" + std::to_string(i-1) + "+" : "";
+			std::string wo_prev = i ? "wo" + std::to_string(i-1) : "0";
+			std::string wo_init = w ? ", wo" + i_str + "=" + wo_prev : "";
+			std::string wo_bump = w ? ", wo" + i_str + "+=" + std::to_string(w_strides[2+i]) : "";
+			INDT_3 << "for( int32_t k" << i_str << "=0";
+			   dst <<       ", ii" << i_str << "=i" << i_str;
+			   dst <<       ", xo" << i_str << "=" << xo_prev << "io" << i_str;
+			   dst <<       wo_init << "; ";
+			   dst <<       "k" << i_str << "<" << kernel_shape[i] << "; ";
+			   dst <<       "k" << i_str << "++";
+			   dst <<       ", ii" << i_str << "+=" << dilations[i];
+			   dst <<       ", xo" << i_str << "+=" << dilations[i]*x_strides[2+i];
+			   dst <<       wo_bump << " ) {" << std::endl;
+			// check for out-of-input reading (i.e. read a pad)
+			INDT_4 <<  "if( ii" << i_str << "<0) continue;" << std::endl;
+			INDT_4 <<  "if( ii" << i_str << ">=" << x->data_dim[2+i] << ") continue;" << std::endl;
+		}
+	}
+
+	/* Index tables of sparse weights: the nonzeros of output channel m start at
+	 * w_start[m]. For each, the input channel (within the group) and the kernel
+	 * position in each spatial dimension i are in w_channel and w_k<i>. */
+	void print_sparse_tables(std::ostream &dst) const
+	{
+		const Tensor *w = get_W();
+		unsigned n_data_dims = get_numDataDim();
+		std::vector<int> starts, indices;
+		w->sparse_layout(starts, indices);
+		std::vector<std::vector<int>> positions(n_data_dims+1);
+		for( int idx : indices ) {
+			for( int i=n_data_dims-1; i>=0; i-- ) {
+				positions[i+1].push_back(idx % kernel_shape[i]);
+				idx /= kernel_shape[i];
+			}
+			positions[0].push_back(idx);
+		}
+		print_index_table(dst, "w_start", starts);
+		print_index_table(dst, "w_channel", positions[0]);
+		for( unsigned i=0; i<n_data_dims; i++ )
+			print_index_table(dst, "w_k" + std::to_string(i), positions[i+1]);
+	}
+
 	void print_loop_with_padding_checks(std::ostream &dst) const
 	{
 		unsigned n_data_dims = get_numDataDim();
-		unsigned batch_size = get_X()->data_dim[0];
+		std::string batch_size = get_X()->str_dim(0);
 		unsigned channels = get_X()->data_dim[1];
 		unsigned maps=get_Y()->data_dim[1];
 
@@ -198,11 +295,44 @@ class SpatialFilter : public Node {
 		std::string x_idx = "[b][c]";
 		std::string in_kern_idxs = "[b][c]";
 		std::string y_idx = "[b][m]";
+		std::string kern_idxs = group > 1 ? "[m][c-(gi*g)]" : "[m][c]";
 		for( unsigned i = 0; i<n_data_dims; i++) {
 			std::string i_str = std::to_string(i);
 			x_idx += "[i" + i_str + "]";
 			y_idx += "[o" + i_str + "]";
 			in_kern_idxs += "[ii" + i_str + "]";
+			kern_idxs += "[k" + i_str + "]";
+		}
+		std::string x_el = "x" + in_kern_idxs;
+		std::string w_el = get_W() ? "w" + kern_idxs : "";
+		// Sparse weights: loop over the nonzero weights of the output channel instead
+		bool sparse = get_W() && get_W()->sparse_axis >= 0;
+		if( sparse ) {
+			print_sparse_tables(dst);
+			w_el = "w[j]";
+		}
+		// Packed weights are unpacked from their index in C order
+		const Tensor *packed_w = get_W() && get_W()->pack_bits ? get_W() : nullptr;
+		if( packed_w ) {
+			std::string w_idx = std::string("(m*") + std::to_string(packed_w->data_dim[1]) + "+" + (group > 1 ? "c-(gi*g)" : "c") + ")";
+			for( unsigned i = 0; i<n_data_dims; i++)
+				w_idx = "(" + w_idx + "*" + std::to_string(kernel_shape[i]) + "+k" + std::to_string(i) + ")";
+			w_el = packed_w->packed_element("w", w_idx);
+		}
+
+		// Flat pointer mode: element strides of each dimension in x and w
+		bool flat = options.flat_pointers && sparse == false;
+		std::vector<int> x_strides = dense_strides(get_X());
+		std::vector<int> w_strides;
+		if( get_W() )
+			w_strides = dense_strides(get_W());
+		if( flat ) {
+			std::string last = std::to_string(n_data_dims-1);
+			x_el = "x_c[xo" + last + "]";
+			if( packed_w )
+				w_el = packed_w->packed_element("w", "w_c+wo" + last);
+			else if( get_W() )
+				w_el = "w_c[wo" + last + "]";
 		}
 
 		/* Create the loops over batches and channels.
@@ -230,46 +360,65 @@ class SpatialFilter : public Node {
 		for( unsigned i = 0; i<n_data_dims; i++) {
 			std::string o_idx = "o" + std::to_string(i);
 			std::string i_idx = "i" + std::to_string(i);
+			std::string io_idx = "io" + std::to_string(i);
+			std::string io_init = flat ? ", " + io_idx + "=" + std::to_string(-pads[i]*x_strides[2+i]) : "";
+			std::string io_bump = flat ? ", " + io_idx + "+=" + std::to_string(strides[i]*x_strides[2+i]) : "";
 			INDT_2 << "for( int32_t " << o_idx << "=0, ";
-			   dst <<       i_idx << "=" << -pads[i] << "; ";
+			   dst <<       i_idx << "=" << -pads[i] << io_init << "; ";
 			   dst <<       o_idx << "<" << get_Y()->data_dim[2+i] << "; ";
-			   dst <<       o_idx <<"++, "<< i_idx << "+=" << strides[i] << ") {" << std::endl;
+			   dst <<       o_idx <<"++, "<< i_idx << "+=" << strides[i] << io_bump << ") {" << std::endl;
 		}
 
 		print_output_cell_init(dst, y_idx);
 
 		if (direct_channel_map())
 			;
+		else if( sparse ) {
+			INDT_3 << "for( uint32_t j=w_start[m]; j<w_start[m+1]; j++ ) {" << std::endl;
+			INDT_4 << "int32_t c = " << (group > 1 ? "gi*g + " : "") << "w_channel[j];" << std::endl;
+		}
 		else if( get_W() && group > 1 )
 			INDT_3 <<   "for( int32_t c=gi*g; c<gi*(g+1); c++ ) {" << std::endl;
 		else    // same as above, just cleaner to read :)
 			INDT_3 <<   "for( int32_t c=0; c<" << channels << "; c++ ) {" << std::endl;
 
 
-		for( unsigned i = 0; i<n_data_dims; i++) {
-			std::string idx = "k" + std::to_string(i);
-			INDT_3 << "for( uint32_t " << idx << "=0; ";
-			   dst <<       idx << "<" << kernel_shape[i] << "; ";
-			   dst <<       idx <<"++ ) {" << std::endl;
+		if( flat )
+			print_flat_kernel_loops(dst, x_strides, w_strides);
+		else if( sparse ) {
+			for( unsigned i = 0; i<n_data_dims; i++) {
+				std::string i_str = std::to_string(i);
+				INDT_4 <<  "int ii" << i_str << " = i" << i_str << "+w_k" << i_str << "[j] * " << dilations[i] <<";" << std::endl;
+				INDT_4 <<  "if( ii" << i_str << "<0) continue;" << std::endl;
+				INDT_4 <<  "if( ii" << i_str << ">=" << get_X()->data_dim[2+i] << ") continue;" << std::endl;
+			}
 		}
+		else {
+			for( unsigned i = 0; i<n_data_dims; i++) {
+				std::string idx = "k" + std::to_string(i);
+				INDT_3 << "for( uint32_t " << idx << "=0; ";
+				   dst <<       idx << "<" << kernel_shape[i] << "; ";
+				   dst <<       idx <<"++ ) {" << std::endl;
+			}
 
-		// check for out-of-input reading (i.e. read a pad)
-		for( unsigned i = 0; i<n_data_dims; i++) {
-			std::string i_str = std::to_string(i);
-			INDT_4 <<  "int ii" << i_str << " = i" << i_str << "+k" << i_str <<" * " << dilations[i] <<";" << std::endl;
-			INDT_4 <<  "if( ii" << i_str << "<0) continue;" << std::endl;
-			INDT_4 <<  "if( ii" << i_str << ">=" << get_X()->data_dim[2+i] << ") continue;" << std::endl;
+			// check for out-of-input reading (i.e. read a pad)
+			for( unsigned i = 0; i<n_data_dims; i++) {
+				std::string i_str = std::to_string(i);
+				INDT_4 <<  "int ii" << i_str << " = i" << i_str << "+k" << i_str <<" * " << dilations[i] <<";" << std::endl;
+				INDT_4 <<  "if( ii" << i_str << "<0) continue;" << std::endl;
+				INDT_4 <<  "if( ii" << i_str << ">=" << get_X()->data_dim[2+i] << ") continue;" << std::endl;
+			}
 		}
 
-		print_output_cell_calc(dst, in_kern_idxs, "", y_idx);
+		print_output_cell_calc(dst, x_el, w_el, y_idx);
 
 		// close kernel loop
-		for( unsigned i = 0; i<n_data_dims; i++)
+		for( unsigned i = 0; sparse == false && i<n_data_dims; i++)
 			INDT_3 << "} /* k */" << std::endl;
 
 		// close input channels loop when it is separate from output channels
 		if( direct_channel_map() == false )
-			INDT_3 << "} /* c */" << std::endl;
+			INDT_3 << (sparse ? "} /* j */" : "} /* c */") << std::endl;
 		print_output_cell_finalize(dst, y_idx);
 
 		// close output loop
@@ -0,0 +1,141 @@
+/* This file is part of onnx2c.
+ *
+ * Tiled
+ * Not an ONNX operator, but made by the 'tile_layers' pass ('--tile')
+ * of a chain of layers at the graph input, e.g. Conv -> Relu -> MaxPool.
+ * The layers run depth first, over bands of rows: for each band of
+ * the output, each layer calculates only the rows of its output that
+ * the next layer needs for the band. These include the halo rows that
+ * the kernel of the next layer overlaps with the neighbouring bands,
+ * and which are calculated again for each band.
+ * The full size intermediate tensors of the chain never exist. Only one
+ * band of each is stored, as the outputs band0, band1... of this node.
+ *
+ * The layers are run by stage nodes: copies of the original nodes,
+ * resolved for a band of their input. They have no padding at the top
+ * and bottom. The rows of a band that are outside the image are
+ * filled with the padding value of the stage instead.
+ */
+#pragma once
+#include "node.h"
+
+namespace toC {
+
+class Tiled : public Node {
+	public:
+	Tiled() {
+		op_name = "Tiled";
+		result = nullptr;
+		tile_rows = 0;
+	}
+
+	/* A layer of the chain */
+	struct stage {
+		Node *node;        // resolved for bands[i] as input, bands[i+1] as output
+		int first_row;     // row of the full input of the layer at row 0 of band i, for band 0
+		int row_step;      // rows the input band moves from one band to the next
+		int height;        // rows of the full input of the layer
+	};
+	std::vector<stage> stages;
+	// The input band of each stage, and the output band of the last stage
+	std::vector<Tensor*> bands;
+	// Output of the last layer of the chain
+	Tensor *result;
+	int tile_rows;
+
+	int num_tiles(void) const
+	{
+		int rows = result->data_dim[2];
+		return (rows + tile_rows - 1) / tile_rows;
+	}
+
+	virtual std::vector<const Node*> sub_nodes(void) const override
+	{
+		std::vector<const Node*> rv;
+		for( auto &s : stages )
+			rv.push_back(s.node);
+		return rv;
+	}
+
+	/* The value of the rows outside the image of the input of stage 's'.
+	 * Empty if that does not matter. */
+	static std::string padding_value(const stage &s)
+	{
+		if( s.node->op_name == "Conv" )
+			return "0";
+		if( s.node->op_name == "MaxPool" )
+			return "-FLT_MAX";
+		return "";
+	}
+
+	/* Can some band of the input of stage 's' have rows outside the image */
+	bool outside_rows(const stage &s, const Tensor *band) const
+	{
+		int rows = band->data_dim[2];
+		int last = (num_tiles()-1) * s.row_step + s.first_row + rows;
+		return s.first_row < 0 || last > s.height;
+	}
+
+	/* Loops over the batch, channels and columns of a band,
+	 * with the row r and its row ir in the full tensor. */
+	void print_band_loops_begin(std::ostream &dst, const Tensor *band, const stage &s) const
+	{
+		INDT_2 << "for( uint32_t b=0; b<" << band->data_dim[0] << "; b++ )" << std::endl;
+		INDT_2 << "for( uint32_t c=0; c<" << band->data_dim[1] << "; c++ )" << std::endl;
+		INDT_2 << "for( int32_t r=0, ir=t*" << s.row_step << "+(" << s.first_row << "); r<" << band->data_dim[2] << "; r++, ir++ )" << std::endl;
+		INDT_2 << "for( uint32_t w=0; w<" << band->data_dim[3] << "; w++ )" << std::endl;
+	}
+
+	virtual void print(std::ostream &dst) const override
+	{
+		INDT_1 << "/* Tiled: " << stages.size() << " layers depth first, in " << num_tiles();
+		dst << " bands of " << tile_rows << " rows of the output" << std::endl;
+		for( auto &s : stages )
+			INDT_1 << " * " << s.node->op_name << " " << s.node->onnx_name << std::endl;
+		INDT_1 << " */" << std::endl;
+		INDT_1 << "for( int32_t t=0; t<" << num_tiles() << "; t++ ) {" << std::endl;
+
+		for( unsigned i=0; i<stages.size(); i++ ) {
+			const stage &s = stages[i];
+			const Tensor *band = bands[i];
+			std::string name = "band" + std::to_string(i);
+			std::string pad = padding_value(s);
+			if( i == 0 ) {
+				INDT_2 << "/* rows of the input */" << std::endl;
+				print_band_loops_begin(dst, band, s);
+				INDT_3 << name << "[b][c][r][w] = ir>=0 && ir<" << s.height << " ? x[b][c][ir][w] : " << (pad == "" ? "0" : pad) << ";" << std::endl;
+			}
+			else if( pad != "" && outside_rows(s, band) ) {
+				INDT_2 << "/* padding rows */" << std::endl;
+				print_band_loops_begin(dst, band, s);
+				INDT_3 << "if( ir<0 || ir>=" << s.height << " ) " << name << "[b][c][r][w] = " << pad << ";" << std::endl;
+			}
+			INDT_2 << s.node->c_name() << "( ";
+			s.node->print_function_parameters_callsite(dst, this);
+			dst << " );" << std::endl;
+		}
+
+		const Tensor *band = bands.back();
+		std::string name = "band" + std::to_string(bands.size()-1);
+		INDT_2 << "/* rows of the output */" << std::endl;
+		INDT_2 << "for( uint32_t b=0; b<" << band->data_dim[0] << "; b++ )" << std::endl;
+		INDT_2 << "for( uint32_t c=0; c<" << band->data_dim[1] << "; c++ )" << std::endl;
+		INDT_2 << "for( int32_t r=0, ir=t*" << tile_rows << "; r<" << tile_rows << " && ir<" << result->data_dim[2] << "; r++, ir++ )" << std::endl;
+		INDT_2 << "for( uint32_t w=0; w<" << band->data_dim[3] << "; w++ )" << std::endl;
+		INDT_3 << "y[b][c][ir][w] = " << name << "[b][c][r][w];" << std::endl;
+		INDT_1 << "}" << std::endl;
+	}
+
+	/* inputs[0] is the graph input, the rest are the constant
+	 * inputs of the stages */
+	virtual void resolve(void) override
+	{
+		register_input(inputs[0], "x");
+		for( unsigned i=1; i<inputs.size(); i++ )
+			register_input(inputs[i], "c" + std::to_string(i));
+		register_output(result, "y");
+		for( unsigned i=0; i<bands.size(); i++ )
+			register_output(bands[i], "band" + std::to_string(i));
+	}
+};
+}
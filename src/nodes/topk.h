@@ -22,6 +22,9 @@ class TopK : public Node {
 	public:
 	TopK() {
 		op_name = "TopK";
+		axis = -1;
+		largest = 1;
+		sorted = 1;
 	}
 	/* Examples of ONNX Operand attributes */
 	std::vector<float> a_floatarray_attribute;
@@ -110,7 +113,9 @@ void TopK::print(std::ostream &dst) const
 	INDT_3 << "max = A[0][r];" << std::endl; 
 	INDT_3 << "indice = r;" << std::endl; 
 	INDT_2 << "}" << std::endl;
-	INDT_1 << "values[0][0] = max;" << std::endl;
+	// Only the index is used e.g. when the 'argmax' pass skipped a Softmax before
+	if( outputs[0]->is_used() )
+		INDT_1 << "values[0][0] = max;" << std::endl;
 	INDT_1 << "indices[0][0] = indice;" << std::endl;
 }
 
@@ -0,0 +1,133 @@
+#include "graph.h"
+#include "options.h"
+#include "quantization.h"
+
+#include <functional>
+#include <map>
+#include <set>
+
+using namespace toC;
+
+/* Share initializers that are the same in type, shape and values, e.g.
+ * tied embeddings or repeated biases. The nodes using a duplicate are
+ * made to use the first one instead. Within a model the duplicate is
+ * removed. With several models, each renamed with rename_for_variant()
+ * in main.cc, the duplicate in the later model is renamed to the first,
+ * so that both models' Graphs have the tensor, and it is printed once.
+ * This is done on the ONNX models, before they are resolved.
+ * With calibrated quantization, the weights and biases of Conv and Gemm
+ * are not shared: each node quantizes them in place, at its own scales.
+ */
+
+namespace {
+
+/* The initializer without its name, for comparing */
+std::string contents(const onnx::TensorProto &t)
+{
+	onnx::TensorProto c = t;
+	c.clear_name();
+	c.clear_doc_string();
+	return c.SerializeAsString();
+}
+
+/* Initializers can be used by name from subgraphs, which are not renamed here */
+bool has_subgraphs(const onnx::GraphProto &g)
+{
+	for( auto &n : g.node() )
+		for( auto &a : n.attribute() )
+			if( a.has_g() || a.graphs_size() )
+				return true;
+	return false;
+}
+
+/* The initializers that calibrated quantization rewrites in place, at the
+ * scales of the node using them (see Conv and Gemm quantize_weights()) */
+std::set<std::string> quantized_in_place(const onnx::GraphProto &g)
+{
+	std::set<std::string> rv;
+	if( quantization_calibrated() == false )
+		return rv;
+	for( auto &n : g.node() )
+		if( n.op_type() == "Conv" || n.op_type() == "Gemm" )
+			for( int i=1; i<n.input_size(); i++ )
+				rv.insert(n.input(i));
+	return rv;
+}
+}
+
+void Graph::dedup_initializers(const std::vector<onnx::ModelProto*> &models)
+{
+	// hash of contents -> (model, initializer index)
+	std::multimap<size_t, std::pair<unsigned, int>> seen;
+	std::vector<std::set<std::string>> dropped(models.size());
+	unsigned num_shared = 0;
+
+	for( unsigned m=0; m<models.size(); m++ ) {
+		onnx::GraphProto *g = models[m]->mutable_graph();
+		if( has_subgraphs(*g) ) {
+			LOG(INFO) << "Not sharing the initializers of a model with subgraphs" << std::endl;
+			continue;
+		}
+		// Older models list initializers as graph inputs, which can override them
+		std::set<std::string> io;
+		for( auto &i : g->input() )
+			io.insert(i.name());
+		for( auto &o : g->output() )
+			io.insert(o.name());
+		std::set<std::string> quantized = quantized_in_place(*g);
+		std::set<std::string> names;
+		for( auto &i : g->initializer() )
+			names.insert(i.name());
+
+		std::map<std::string, std::string> renames;
+		for( int i=0; i<g->initializer_size(); i++ ) {
+			onnx::TensorProto *t = g->mutable_initializer(i);
+			if( io.count(t->name()) || quantized.count(t->name()) )
+				continue;
+			std::string c = contents(*t);
+			size_t hash = std::hash<std::string>()(c);
+			const onnx::TensorProto *first = nullptr;
+			unsigned first_model = 0;
+			auto range = seen.equal_range(hash);
+			for( auto s = range.first; s != range.second; s++ ) {
+				const onnx::TensorProto &candidate = models[s->second.first]->graph().initializer(s->second.second);
+				if( contents(candidate) == c ) {
+					first = &candidate;
+					first_model = s->second.first;
+					break;
+				}
+			}
+			if( first == nullptr ) {
+				seen.insert(std::make_pair(hash, std::make_pair(m, i)));
+				continue;
+			}
+
+			LOG(DEBUG) << "Initializer " << t->name() << " is the same as " << first->name() << std::endl;
+			renames[t->name()] = first->name();
+			num_shared++;
+			if( first_model == m || names.count(first->name()) )
+				dropped[m].insert(t->name());
+			else {
+				names.insert(first->name());
+				t->set_name(first->name());
+			}
+		}
+
+		for( auto &n : *g->mutable_node() )
+			for( auto &in : *n.mutable_input() )
+				if( renames.count(in) )
+					in = renames[in];
+	}
+
+	for( unsigned m=0; m<models.size(); m++ ) {
+		if( dropped[m].size() == 0 )
+			continue;
+		google::protobuf::RepeatedPtrField<onnx::TensorProto> initializers;
+		initializers.Swap(models[m]->mutable_graph()->mutable_initializer());
+		for( auto &i : initializers )
+			if( dropped[m].count(i.name()) == 0 )
+				*models[m]->mutable_graph()->add_initializer() = i;
+	}
+	if( num_shared )
+		LOG(INFO) << num_shared << " initializers are shared with an identical one" << std::endl;
+}
@@ -0,0 +1,185 @@
+#include "graph.h"
+#include "options.h"
+#include "util.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+using namespace toC;
+
+/* Transformer exports calculate attention as
+ *   MatMul(Q, K^T) -> [Mul or Div by a constant] -> Softmax -> MatMul(., V)
+ * with K^T often from a Transpose of K. Replace such chains with a
+ * FusedAttention node, which does not keep the whole [S x T] score
+ * tensor, but one tile of it at a time (see nodes/attention.h).
+ * The intermediate tensors must not be used elsewhere.
+ * This is done on the ONNX model, before it is resolved.
+ */
+
+namespace {
+
+struct attention_model {
+	onnx::GraphProto *g;
+	std::map<std::string, int> producer;   // tensor name -> index of node
+	std::map<std::string, int> consumers;  // tensor name -> number of uses
+	std::set<int> fused;                   // indices of nodes already in a fused chain
+
+	attention_model(onnx::GraphProto *g) : g(g)
+	{
+		for( int n=0; n<g->node_size(); n++ ) {
+			for( auto &o : g->node(n).output() )
+				producer[o] = n;
+			for( auto &i : g->node(n).input() )
+				consumers[i]++;
+		}
+		for( auto &o : g->output() )
+			consumers[o.name()]++;
+	}
+
+	/* Index of the node of type 'op' giving 'name', when that is its only use. -1 if none. */
+	int only_use_from(const std::string &name, const std::string &op) const
+	{
+		auto p = producer.find(name);
+		if( p == producer.end() || consumers.at(name) != 1 || fused.count(p->second) )
+			return -1;
+		const onnx::NodeProto &n = g->node(p->second);
+		if( n.op_type() != op || n.output_size() != 1 )
+			return -1;
+		return p->second;
+	}
+
+	/* Value of the constant scalar 'name', from an initializer or a Constant node */
+	bool constant_scalar(const std::string &name, float &value) const
+	{
+		Tensor t;
+		bool found = false;
+		for( auto &i : g->initializer() )
+			if( i.name() == name ) {
+				t.parse_onnx_tensor(i);
+				found = true;
+			}
+		auto p = producer.find(name);
+		if( p != producer.end() && g->node(p->second).op_type() == "Constant" )
+			for( auto &a : g->node(p->second).attribute() )
+				if( a.name() == "value" ) {
+					t.parse_onnx_tensor(a.t());
+					found = true;
+				}
+		if( found == false || t.data_num_elem() != 1 || isFloat(t.data_type) == false )
+			return false;
+		value = t.get_data_element_float(0);
+		return true;
+	}
+};
+}
+
+void Graph::fuse_attention(onnx::ModelProto &onnx_model)
+{
+	onnx::GraphProto *g = onnx_model.mutable_graph();
+	int64_t opset = model_opset(onnx_model);
+	attention_model m(g);
+	std::map<int, onnx::NodeProto> replaced; // index of the second MatMul -> fused node
+
+	for( int i=0; i<g->node_size(); i++ ) {
+		const onnx::NodeProto &pv = g->node(i);
+		if( pv.op_type() != "MatMul" || m.fused.count(i) )
+			continue;
+		std::vector<int> chain = { i };
+
+		int sm = m.only_use_from(pv.input(0), "Softmax");
+		if( sm < 0 )
+			continue;
+		const onnx::NodeProto &softmax = g->node(sm);
+		chain.push_back(sm);
+
+		float scale = 1;
+		std::string scores = softmax.input(0);
+		int sc = m.only_use_from(scores, "Mul");
+		if( sc < 0 )
+			sc = m.only_use_from(scores, "Div");
+		if( sc >= 0 ) {
+			const onnx::NodeProto &n = g->node(sc);
+			float c;
+			int constant;
+			if( m.constant_scalar(n.input(1), c) )
+				constant = 1;
+			else if( n.op_type() == "Mul" && m.constant_scalar(n.input(0), c) )
+				constant = 0;
+			else
+				continue;
+			scores = n.input(1-constant);
+			scale = n.op_type() == "Mul" ? c : 1/c;
+			chain.push_back(sc);
+			int cn = m.only_use_from(n.input(constant), "Constant");
+			if( cn >= 0 )
+				chain.push_back(cn);
+		}
+
+		int qk = m.only_use_from(scores, "MatMul");
+		if( qk < 0 )
+			continue;
+		chain.push_back(qk);
+		std::string K = g->node(qk).input(1);
+		int transposed_k = 0;
+		int tr = m.only_use_from(K, "Transpose");
+		if( tr >= 0 ) {
+			// Only a swap of the last two axes
+			bool swap = false;
+			for( auto &a : g->node(tr).attribute() )
+				if( a.name() == "perm" && a.ints_size() >= 2 ) {
+					swap = true;
+					int r = a.ints_size();
+					for( int d=0; d<r-2; d++ )
+						swap &= a.ints(d) == d;
+					swap &= a.ints(r-2) == r-1 && a.ints(r-1) == r-2;
+				}
+			if( swap ) {
+				K = g->node(tr).input(0);
+				transposed_k = 1;
+				chain.push_back(tr);
+			}
+		}
+
+		// Softmax must be over the last axis. Without shape information
+		// on the scores, their rank is that of Q or K.
+		int rank = listed_rank(*g, softmax.input(0));
+		if( rank < 0 )
+			rank = std::max(listed_rank(*g, g->node(qk).input(0)), listed_rank(*g, K));
+		int axis = node_attribute_int(softmax, "axis", opset < 13 ? 1 : -1);
+		if( axis != -1 && axis != rank-1 )
+			continue;
+
+		onnx::NodeProto fused;
+		fused.set_op_type("FusedAttention");
+		fused.set_name(pv.name() != "" ? pv.name() : g->node(qk).name());
+		fused.add_input(g->node(qk).input(0));
+		fused.add_input(K);
+		fused.add_input(pv.input(1));
+		fused.add_output(pv.output(0));
+		onnx::AttributeProto *a = fused.add_attribute();
+		a->set_name("scale");
+		a->set_type(onnx::AttributeProto_AttributeType_FLOAT);
+		a->set_f(scale);
+		a = fused.add_attribute();
+		a->set_name("transposed_k");
+		a->set_type(onnx::AttributeProto_AttributeType_INT);
+		a->set_i(transposed_k);
+		LOG(DEBUG) << "Fusing attention from MatMul " << g->node(qk).name() << " to MatMul " << pv.name() << std::endl;
+
+		m.fused.insert(chain.begin(), chain.end());
+		replaced[i] = fused;
+	}
+	if( replaced.size() == 0 )
+		return;
+
+	google::protobuf::RepeatedPtrField<onnx::NodeProto> nodes;
+	nodes.Swap(g->mutable_node());
+	for( int i=0; i<nodes.size(); i++ ) {
+		if( replaced.count(i) )
+			*g->add_node() = replaced[i];
+		else if( m.fused.count(i) == 0 )
+			*g->add_node() = nodes.Get(i);
+	}
+	LOG(INFO) << replaced.size() << " attention blocks fused" << std::endl;
+}
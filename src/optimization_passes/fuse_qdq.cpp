@@ -0,0 +1,324 @@
+#include "graph.h"
+#include "options.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+
+using namespace toC;
+
+/* Quantized models in the "QDQ" format keep float nodes, with
+ * DequantizeLinear on their inputs and QuantizeLinear on their output.
+ * Replace such sandwiches with integer nodes:
+ *  - Conv and MatMul with constant weights become QLinearConv and QLinearMatMul.
+ *    A float or int32 bias is requantized to int32 at the scale x_scale*w_scale.
+ *  - Nodes that only move data are run on the quantized data directly,
+ *    when the input and output are quantized the same.
+ *  - Elementwise nonlinearities (Sigmoid, Tanh...) get the scales and zero
+ *    points as extra inputs, and become lookup tables (see Elementwise).
+ * The DequantizeLinear nodes that are left without consumers are removed.
+ * This is done on the ONNX model, before it is resolved.
+ */
+
+namespace {
+
+struct qdq_model {
+	onnx::GraphProto *g;
+	std::map<std::string, int> producer;   // tensor name -> index of node
+	std::map<std::string, int> consumers;  // tensor name -> number of uses
+	std::map<std::string, int> initializer;// tensor name -> index of initializer
+
+	qdq_model(onnx::GraphProto *g) : g(g)
+	{
+		for( int n=0; n<g->node_size(); n++ ) {
+			for( auto &o : g->node(n).output() )
+				producer[o] = n;
+			for( auto &i : g->node(n).input() )
+				consumers[i]++;
+		}
+		for( auto &o : g->output() )
+			consumers[o.name()]++;
+		for( int i=0; i<g->initializer_size(); i++ )
+			initializer[g->initializer(i).name()] = i;
+	}
+
+	const onnx::NodeProto* produced_by(const std::string &name, const std::string &op) const
+	{
+		auto p = producer.find(name);
+		if( p == producer.end() || g->node(p->second).op_type() != op )
+			return nullptr;
+		return &g->node(p->second);
+	}
+	const onnx::NodeProto* only_consumer(const std::string &name, const std::string &op) const
+	{
+		auto c = consumers.find(name);
+		if( c == consumers.end() || c->second != 1 )
+			return nullptr;
+		for( auto &n : g->node() )
+			for( auto &i : n.input() )
+				if( i == name )
+					return n.op_type() == op ? &n : nullptr;
+		return nullptr;
+	}
+	Tensor* constant(const std::string &name) const
+	{
+		auto i = initializer.find(name);
+		if( i == initializer.end() )
+			return nullptr;
+		Tensor *t = new Tensor;
+		t->parse_onnx_tensor(g->initializer(i->second));
+		return t;
+	}
+	/* A Quantize- or DequantizeLinear with constant scale and zero point */
+	bool constant_qparams(const onnx::NodeProto *n) const
+	{
+		return n && n->input_size() == 3
+		    && initializer.count(n->input(1)) && initializer.count(n->input(2));
+	}
+	int axis(const onnx::NodeProto *n, unsigned rank) const
+	{
+		int axis = 1;
+		for( auto &a : n->attribute() )
+			if( a.name() == "axis" )
+				axis = a.i();
+			else
+				return -1; // e.g. blocked quantization
+		return axis < 0 ? axis + rank : axis;
+	}
+};
+
+bool same_values(const Tensor *a, const Tensor *b)
+{
+	if( a->data_type != b->data_type || a->data_num_elem() != b->data_num_elem() )
+		return false;
+	for( int i=0; i<a->data_num_elem(); i++ ) {
+		if( a->data_type == onnx::TensorProto_DataType_FLOAT ) {
+			if( a->get_data_element_float(i) != b->get_data_element_float(i) )
+				return false;
+		}
+		else if( a->get_data_element(i) != b->get_data_element(i) )
+			return false;
+	}
+	return true;
+}
+
+/* Try to make the integer version of Conv or MatMul node 'n' */
+bool fuse_qlinear(qdq_model &m, const onnx::NodeProto &n, const onnx::NodeProto *q, onnx::NodeProto &fused)
+{
+	const onnx::NodeProto *dq_x = m.produced_by(n.input(0), "DequantizeLinear");
+	const onnx::NodeProto *dq_w = m.produced_by(n.input(1), "DequantizeLinear");
+	if( m.constant_qparams(dq_x) == false || m.constant_qparams(dq_w) == false )
+		return false;
+	Tensor *x_scale = m.constant(dq_x->input(1));
+	Tensor *w = m.constant(dq_w->input(0));
+	Tensor *w_scale = m.constant(dq_w->input(1));
+	if( w == nullptr || x_scale->data_num_elem() != 1 )
+		return false;
+	bool conv = n.op_type() == "Conv";
+	if( conv == false && w->rank() != 2 )
+		return false;
+	// Weight scales per output channel must be on the output channel axis
+	int channel_axis = conv ? 0 : 1;
+	int num_channels = w->data_dim[channel_axis];
+	if( w_scale->data_num_elem() != 1
+	 && (m.axis(dq_w, w->rank()) != channel_axis || w_scale->data_num_elem() != num_channels) )
+		return false;
+
+	std::string bias;
+	if( conv && n.input_size() > 2 && n.input(2) != "" ) {
+		// Bias as a plain float constant, or dequantized from int32
+		const onnx::NodeProto *dq_b = m.produced_by(n.input(2), "DequantizeLinear");
+		Tensor *b = m.constant(dq_b ? dq_b->input(0) : n.input(2));
+		if( b == nullptr || b->data_num_elem() != num_channels )
+			return false;
+		std::vector<float> b_scale(1, 1.0f);
+		std::vector<int64_t> b_zero(1, 0);
+		if( dq_b ) {
+			if( dq_b->input_size() < 2 || m.initializer.count(dq_b->input(1)) == 0 )
+				return false;
+			Tensor *s = m.constant(dq_b->input(1));
+			for( int i=0; i<s->data_num_elem(); i++ )
+				b_scale.push_back(s->get_data_element_float(i));
+			b_scale.erase(b_scale.begin());
+			if( dq_b->input_size() > 2 ) {
+				if( m.initializer.count(dq_b->input(2)) == 0 )
+					return false;
+				Tensor *z = m.constant(dq_b->input(2));
+				b_zero.clear();
+				for( int i=0; i<z->data_num_elem(); i++ )
+					b_zero.push_back(z->get_data_element(i));
+			}
+		}
+		else if( b->data_type != onnx::TensorProto_DataType_FLOAT )
+			return false;
+
+		onnx::TensorProto *qb = m.g->add_initializer();
+		bias = n.output(0) + "_qlinear_bias";
+		qb->set_name(bias);
+		qb->set_data_type(onnx::TensorProto_DataType_INT32);
+		qb->add_dims(num_channels);
+		for( int c=0; c<num_channels; c++ ) {
+			float real;
+			if( dq_b ) {
+				int64_t zero = b_zero[b_zero.size() > 1 ? c : 0];
+				real = (b->get_data_element(c) - zero) * b_scale[b_scale.size() > 1 ? c : 0];
+			}
+			else
+				real = b->get_data_element_float(c);
+			float acc_scale = x_scale->get_data_element_float(0) * w_scale->get_data_element_float(w_scale->data_num_elem() > 1 ? c : 0);
+			qb->add_int32_data(std::lrint(real / acc_scale));
+		}
+	}
+
+	fused.set_op_type(conv ? "QLinearConv" : "QLinearMatMul");
+	fused.set_name(n.name());
+	fused.clear_input();
+	for( int i=0; i<3; i++ )
+		fused.add_input(dq_x->input(i));
+	for( int i=0; i<3; i++ )
+		fused.add_input(dq_w->input(i));
+	fused.add_input(q->input(1));
+	fused.add_input(q->input(2));
+	if( bias != "" )
+		fused.add_input(bias);
+	fused.clear_output();
+	fused.add_output(q->output(0));
+	if( conv )
+		*fused.mutable_attribute() = n.attribute();
+	return true;
+}
+
+/* Try to run node 'n', that only moves data, on the quantized data */
+bool fuse_data_movement(qdq_model &m, const onnx::NodeProto &n, const onnx::NodeProto *q, onnx::NodeProto &fused)
+{
+	const onnx::NodeProto *dq = m.produced_by(n.input(0), "DequantizeLinear");
+	if( m.constant_qparams(dq) == false )
+		return false;
+	if( same_values(m.constant(dq->input(1)), m.constant(q->input(1))) == false
+	 || same_values(m.constant(dq->input(2)), m.constant(q->input(2))) == false
+	 || m.constant(q->input(1))->data_num_elem() != 1 )
+		return false;
+
+	fused = n;
+	fused.set_input(0, dq->input(0));
+	fused.set_output(0, q->output(0));
+	return true;
+}
+
+/* Try to make the lookup table version of the elementwise node 'n' */
+bool fuse_lookup(qdq_model &m, const onnx::NodeProto &n, const onnx::NodeProto *q, onnx::NodeProto &fused)
+{
+	const onnx::NodeProto *dq = m.produced_by(n.input(0), "DequantizeLinear");
+	if( m.constant_qparams(dq) == false || m.constant(dq->input(1))->data_num_elem() != 1 )
+		return false;
+	// One table entry for each input value
+	for( auto zero : { m.constant(dq->input(2)), m.constant(q->input(2)) } )
+		switch( zero->data_type ) {
+			case onnx::TensorProto_DataType_INT8:
+			case onnx::TensorProto_DataType_UINT8:
+			case onnx::TensorProto_DataType_INT16:
+			case onnx::TensorProto_DataType_UINT16:
+				break;
+			default:
+				return false;
+		}
+
+	fused = n;
+	fused.set_input(0, dq->input(0));
+	fused.add_input(dq->input(1));
+	fused.add_input(dq->input(2));
+	fused.add_input(q->input(1));
+	fused.add_input(q->input(2));
+	fused.set_output(0, q->output(0));
+	return true;
+}
+
+void remove_unused_initializers(onnx::GraphProto *g, std::set<std::string> names)
+{
+	for( auto &n : g->node() )
+		for( auto &i : n.input() )
+			names.erase(i);
+	// Older models list initializers as graph inputs too
+	for( auto &i : g->input() )
+		names.erase(i.name());
+	for( auto &o : g->output() )
+		names.erase(o.name());
+
+	google::protobuf::RepeatedPtrField<onnx::TensorProto> initializers;
+	initializers.Swap(g->mutable_initializer());
+	for( auto &i : initializers )
+		if( names.count(i.name()) == 0 )
+			*g->add_initializer() = i;
+}
+
+/* Find and fuse one sandwich. Returns false when there are no more. */
+bool fuse_one(onnx::GraphProto *g)
+{
+	static const std::set<std::string> data_movement = {
+		"Flatten", "MaxPool", "Reshape", "Squeeze", "Transpose", "Unsqueeze"
+	};
+	// Those with Elementwise::host_operation()
+	static const std::set<std::string> lookup = {
+		"Celu", "Elu", "Erf", "Exp", "HardSigmoid", "HardSwish", "LeakyRelu",
+		"Log", "Selu", "Sigmoid", "Softplus", "Softsign", "Sqrt", "Tanh"
+	};
+	qdq_model m(g);
+
+	for( int i=0; i<g->node_size(); i++ ) {
+		const onnx::NodeProto &n = g->node(i);
+		bool qlinear = n.op_type() == "Conv" || n.op_type() == "MatMul";
+		if( qlinear == false && data_movement.count(n.op_type()) == 0 && lookup.count(n.op_type()) == 0 )
+			continue;
+		if( n.input_size() == 0 || n.output_size() == 0 )
+			continue;
+		// MaxPool's optional indices output can't be used
+		if( n.output_size() > 1 && n.output(1) != "" )
+			continue;
+		const onnx::NodeProto *q = m.only_consumer(n.output(0), "QuantizeLinear");
+		if( m.constant_qparams(q) == false || m.constant(q->input(1))->data_num_elem() != 1 )
+			continue;
+
+		onnx::NodeProto fused;
+		if( qlinear && fuse_qlinear(m, n, q, fused) == false )
+			continue;
+		if( lookup.count(n.op_type()) && fuse_lookup(m, n, q, fused) == false )
+			continue;
+		if( data_movement.count(n.op_type()) && fuse_data_movement(m, n, q, fused) == false )
+			continue;
+		LOG(DEBUG) << "Fusing " << n.op_type() << " node " << n.name() << " with its DequantizeLinear and QuantizeLinear into " << fused.op_type() << std::endl;
+
+		// Replace the node with the fused one, and drop the QuantizeLinear
+		// and the DequantizeLinears that are no longer used, along with
+		// their constants (e.g. the bias that was requantized)
+		std::vector<std::string> dq_outputs;
+		for( auto &in : n.input() )
+			if( m.produced_by(in, "DequantizeLinear") )
+				dq_outputs.push_back(in);
+		std::string q_output = q->output(0);
+		std::set<std::string> dropped_inputs;
+		google::protobuf::RepeatedPtrField<onnx::NodeProto> nodes;
+		nodes.Swap(g->mutable_node());
+		for( auto &o : nodes ) {
+			if( &o == &nodes.Get(i) )
+				*g->add_node() = fused;
+			else if( o.op_type() == "QuantizeLinear" && o.output(0) == q_output )
+				continue;
+			else if( o.op_type() == "DequantizeLinear" && m.consumers[o.output(0)] == 1
+			      && std::find(dq_outputs.begin(), dq_outputs.end(), o.output(0)) != dq_outputs.end() )
+				dropped_inputs.insert(o.input().begin(), o.input().end());
+			else
+				*g->add_node() = o;
+		}
+		remove_unused_initializers(g, dropped_inputs);
+		return true;
+	}
+	return false;
+}
+}
+
+void Graph::fuse_qdq(onnx::ModelProto &onnx_model)
+{
+	while( fuse_one(onnx_model.mutable_graph()) )
+		;
+}
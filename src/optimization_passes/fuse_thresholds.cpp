@@ -0,0 +1,169 @@
+#include "graph.h"
+#include "options.h"
+#include "nodes/multithreshold.h"
+
+#include <cmath>
+#include <map>
+
+using namespace toC;
+
+/* Low-bit (e.g. QONNX/FINN) models quantize activations with MultiThreshold
+ * nodes that follow a MatMul. The MatMul result is only ever compared to
+ * the thresholds, so the MultiThreshold can do the MatMul itself, and
+ * the intermediate tensor is not needed.
+ * Convolutions in these models are lowered to Im2Col and MatMul, so they
+ * are covered as well.
+ */
+void Graph::fuse_thresholds(onnx::ModelProto &onnx_model)
+{
+	onnx::GraphProto *g = onnx_model.mutable_graph();
+	std::map<std::string, int> consumers;  // tensor name -> number of uses
+	std::map<std::string, int> rank;       // initializer name -> rank
+	for( auto &n : g->node() )
+		for( auto &i : n.input() )
+			consumers[i]++;
+	for( auto &o : g->output() )
+		consumers[o.name()]++;
+	for( auto &i : g->initializer() )
+		rank[i.name()] = i.dims_size();
+
+	std::map<std::string, const onnx::NodeProto*> matmuls; // output name -> MatMul
+	for( auto &n : g->node() )
+		if( n.op_type() == "MatMul" && n.input_size() == 2 && rank.count(n.input(1)) && rank[n.input(1)] == 2 )
+			matmuls[n.output(0)] = &n;
+
+	std::map<std::string, std::string> fused; // output of the removed MatMul -> MultiThreshold
+	for( auto &n : *g->mutable_node() ) {
+		if( n.op_type() != "MultiThreshold" || n.input_size() != 2 )
+			continue;
+		auto mm = matmuls.find(n.input(0));
+		if( mm == matmuls.end() || consumers[n.input(0)] != 1 )
+			continue;
+		LOG(DEBUG) << "Fusing MatMul node " << mm->second->name() << " into MultiThreshold " << n.name() << std::endl;
+		fused[n.input(0)] = n.name();
+		n.set_input(0, mm->second->input(0));
+		n.add_input(mm->second->input(1));
+	}
+	if( fused.size() == 0 )
+		return;
+
+	google::protobuf::RepeatedPtrField<onnx::NodeProto> nodes;
+	nodes.Swap(g->mutable_node());
+	for( auto &n : nodes )
+		if( n.op_type() != "MatMul" || fused.count(n.output(0)) == 0 )
+			*g->add_node() = n;
+}
+
+/* Smallest signed integer type that holds all values of 't'.
+ * UNDEFINED if some value is not an integer. */
+static onnx::TensorProto_DataType integer_values(const Tensor *t)
+{
+	double lo = 0, hi = 0;
+	for( int i=0; i<t->data_num_elem(); i++ ) {
+		double v;
+		if( t->data_type == onnx::TensorProto_DataType_FLOAT )
+			v = t->get_data_element_float(i);
+		else
+			v = t->get_data_element(i);
+		if( v != std::floor(v) )
+			return onnx::TensorProto_DataType_UNDEFINED;
+		lo = std::min(lo, v);
+		hi = std::max(hi, v);
+	}
+	if( lo >= INT8_MIN && hi <= INT8_MAX )
+		return onnx::TensorProto_DataType_INT8;
+	if( lo >= INT16_MIN && hi <= INT16_MAX )
+		return onnx::TensorProto_DataType_INT16;
+	if( lo >= INT32_MIN && hi <= INT32_MAX )
+		return onnx::TensorProto_DataType_INT32;
+	return onnx::TensorProto_DataType_UNDEFINED;
+}
+
+/* Replace the values of constant 't' with 'type' integers. The values are
+ * rounded up, which keeps 'x >= t' the same for integer x. */
+static void convert_constant(Tensor *t, onnx::TensorProto_DataType type)
+{
+	std::vector<double> values;
+	for( int i=0; i<t->data_num_elem(); i++ ) {
+		if( t->data_type == onnx::TensorProto_DataType_FLOAT )
+			values.push_back(std::ceil(t->get_data_element_float(i)));
+		else
+			values.push_back(t->get_data_element(i));
+	}
+	LOG(DEBUG) << "Converting constant " << t->name << " from " << t->data_type_str() << " to integers" << std::endl;
+	free(t->data_buffer);
+	t->data_type = type;
+	t->data_buffer = calloc(t->data_num_elem(), t->data_elem_size());
+	for( unsigned i=0; i<values.size(); i++ ) {
+		double v = std::min<double>(std::max<double>(values[i], INT32_MIN), INT32_MAX);
+		switch( type ) {
+			case onnx::TensorProto_DataType_INT8:  ((int8_t*)t->data_buffer)[i] = v; break;
+			case onnx::TensorProto_DataType_INT16: ((int16_t*)t->data_buffer)[i] = v; break;
+			default:                               ((int32_t*)t->data_buffer)[i] = v; break;
+		}
+	}
+}
+
+static bool is_float(const Tensor *t)
+{
+	return t->data_type == onnx::TensorProto_DataType_FLOAT;
+}
+static bool is_integer(const Tensor *t)
+{
+	switch( t->data_type ) {
+		case onnx::TensorProto_DataType_INT8:
+		case onnx::TensorProto_DataType_UINT8:
+		case onnx::TensorProto_DataType_INT16:
+		case onnx::TensorProto_DataType_UINT16:
+		case onnx::TensorProto_DataType_INT32:
+			return true;
+		default:
+			return false;
+	}
+}
+/* A constant that only 'n' uses, and can be changed */
+static bool own_constant(const Tensor *t, const Node *n)
+{
+	return t->isConst && t->isIO == false && t->data_buffer
+	    && t->consumers.size() == 1 && t->consumers[0] == n;
+}
+
+/* MultiThresholds that count thresholds of integer inputs can compare
+ * integers, and output their counts as integers to the next ones.
+ * The nodes are in order, so the inputs are already converted when a node is handled. */
+void Graph::integer_thresholds(void)
+{
+	for( auto n : nodes ) {
+		MultiThreshold *mt = dynamic_cast<MultiThreshold*>(n);
+		if( mt == nullptr )
+			continue;
+		Tensor *A = mt->inputs[0];
+		Tensor *T = mt->inputs[1];
+		Tensor *Y = mt->outputs[0];
+		bool integer_input = is_integer(A);
+
+		// The fused MatMul sums integers when the weights are integers too
+		if( mt->fused_matmul() && integer_input ) {
+			Tensor *W = mt->inputs[2];
+			onnx::TensorProto_DataType type = integer_values(W);
+			if( is_float(W) && own_constant(W, mt) && type != onnx::TensorProto_DataType_UNDEFINED )
+				convert_constant(W, type);
+			integer_input = is_integer(W);
+		}
+
+		if( integer_input && is_float(T) && own_constant(T, mt) )
+			convert_constant(T, onnx::TensorProto_DataType_INT32);
+
+		onnx::TensorProto_DataType out_type = mt->integer_type();
+		if( out_type == onnx::TensorProto_DataType_UNDEFINED || Y->isIO || Y->consumers.size() == 0 )
+			continue;
+		bool thresholded = true;
+		for( auto c : Y->consumers )
+			if( dynamic_cast<MultiThreshold*>(c) == nullptr || c->inputs[0] != Y )
+				thresholded = false;
+		if( thresholded == false )
+			continue;
+		LOG(DEBUG) << "MultiThreshold " << mt->onnx_name << " outputs " << onnx::TensorProto_DataType_Name(out_type) << std::endl;
+		Y->data_type = out_type;
+	}
+}
@@ -0,0 +1,52 @@
+#include "graph.h"
+#include "options.h"
+
+#include <cmath>
+
+using namespace toC;
+
+/* Write the values of small constant weights into the code of the nodes
+ * using them, as straight-line multiply-adds with literals (see
+ * Node::inlined_mac()). This saves the loads and the loop overhead of
+ * tiny kernels on small cores. The code grows with each nonzero weight,
+ * so only tensors of at most options.inline_weights nonzero values are
+ * inlined.
+ */
+void Graph::inline_weights(void)
+{
+	for( auto t : tensors ) {
+		if( t->isConst == false || t->isIO || t->data_buffer == NULL || t->consumers.size() == 0 )
+			continue;
+		switch( t->data_type ) {
+			case onnx::TensorProto_DataType_FLOAT:
+			case onnx::TensorProto_DataType_INT8:
+			case onnx::TensorProto_DataType_UINT8:
+			case onnx::TensorProto_DataType_INT16:
+			case onnx::TensorProto_DataType_UINT16:
+			case onnx::TensorProto_DataType_INT32:
+				break;
+			default:
+				continue;
+		}
+		if( t->nonzero_count() > options.inline_weights )
+			continue;
+		bool finite = true;
+		for( int i=0; t->data_type == onnx::TensorProto_DataType_FLOAT && i<t->data_num_elem(); i++ )
+			if( std::isfinite(t->get_data_element_float(i)) == false )
+				finite = false;
+		if( finite == false )
+			continue;
+
+		bool accepted = true;
+		for( auto n : t->consumers )
+			if( n->accepts_inlined(t) == false )
+				accepted = false;
+		if( accepted == false )
+			continue;
+		for( auto n : t->consumers )
+			n->unregister_input(t);
+		t->inlined = true;
+		t->generate = false;
+		LOG(DEBUG) << "Writing the " << t->nonzero_count() << " nonzero values of tensor " << t->name << " into the code" << std::endl;
+	}
+}
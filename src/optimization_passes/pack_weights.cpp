@@ -0,0 +1,123 @@
+#include "graph.h"
+#include "options.h"
+#include "util.h"
+
+#include <cmath>
+#include <set>
+
+using namespace toC;
+
+/* Store constant weights of low-bit (e.g. QONNX/FINN) models packed:
+ * tensors of small integers as 4 bit nibbles, and tensors of -1 and +1
+ * as bits. The values are still of the original type in the onnx2c
+ * Tensor, only the generated code changes. Each node using the tensor
+ * must know how to unpack it (see Node::accepts_packed()).
+ */
+
+/* Number of bits 't' can be packed to: 1 if all values are -1 or +1,
+ * 4 if they are integers in [-8, 7]. 0 if it can't be packed. */
+static int bits_needed(const Tensor *t)
+{
+	bool bipolar = true;
+	bool int4 = true;
+	for( int i=0; i<t->data_num_elem(); i++ ) {
+		double v;
+		switch( t->data_type ) {
+			case onnx::TensorProto_DataType_FLOAT:
+				v = t->get_data_element_float(i); break;
+			case onnx::TensorProto_DataType_INT8:
+			case onnx::TensorProto_DataType_UINT8:
+			case onnx::TensorProto_DataType_INT16:
+			case onnx::TensorProto_DataType_UINT16:
+			case onnx::TensorProto_DataType_INT32:
+			case onnx::TensorProto_DataType_INT64:
+				v = t->get_data_element(i); break;
+			default:
+				return 0;
+		}
+		if( v != 1 && v != -1 )
+			bipolar = false;
+		if( v != std::floor(v) || v < -8 || v > 7 )
+			int4 = false;
+	}
+	return bipolar ? 1 : int4 ? 4 : 0;
+}
+
+/* Try packing 't' to 'bits'. All nodes using it must accept the same layout. */
+static bool try_pack(Tensor *t, int bits)
+{
+	bool first = true;
+	bool columns = false;
+	for( auto n : t->consumers ) {
+		bool c = false;
+		if( n->accepts_packed(t, bits, c) == false )
+			return false;
+		if( first == false && c != columns )
+			return false;
+		columns = c;
+		first = false;
+	}
+	if( first )
+		return false;
+	t->pack_bits = bits;
+	t->pack_columns = columns;
+	return true;
+}
+
+void Graph::pack_weights(void)
+{
+	// Find the activations that are -1 or +1, to multiply with
+	// bipolar weights as bits
+	static const std::set<std::string> data_movement = {
+		"Flatten", "Identity", "MaxPool", "Reshape", "Squeeze", "Transpose", "Unsqueeze"
+	};
+	for( auto n : nodes ) {
+		if( n->outputs.size() == 0 )
+			continue;
+		if( n->bipolar_output() )
+			n->outputs[0]->bipolar = true;
+		else if( data_movement.count(n->op_name) && n->inputs.size() && n->inputs[0]->bipolar )
+			n->outputs[0]->bipolar = true;
+	}
+
+	for( auto t : tensors ) {
+		if( t->isConst == false || t->isIO || t->data_buffer == NULL || t->sparse_axis >= 0 || t->inlined )
+			continue;
+		int bits = bits_needed(t);
+		if( bits == 0 )
+			continue;
+		// Bipolar values fit in 4 bits as well
+		if( try_pack(t, bits) == false && (bits != 1 || try_pack(t, 4) == false) )
+			continue;
+		LOG(DEBUG) << "Packing tensor " << t->name << " to " << t->pack_bits << " bits" << (t->pack_columns ? " by columns" : "") << std::endl;
+	}
+}
+
+/* Store the constant float weights as 16 bit floats ('--weights'),
+ * where all nodes using them can widen them back to float.
+ * Tensors already packed to fewer bits, or sparse, are left as they are. */
+void Graph::store_weights_16bit(void)
+{
+	bool bfloat16 = options.weight_type == "bf16";
+	for( auto t : tensors ) {
+		if( t->isConst == false || t->isIO || t->data_buffer == NULL || t->pack_bits || t->sparse_axis >= 0 || t->inlined )
+			continue;
+		if( t->data_type != onnx::TensorProto_DataType_FLOAT )
+			continue;
+		// float16 tops out at 65504
+		bool fits = true;
+		for( int i=0; i<t->data_num_elem(); i++ ) {
+			float f = t->get_data_element_float(i);
+			if( std::isfinite(float_from_16bit(float_to_16bit(f, bfloat16), bfloat16)) == false )
+				fits = false;
+		}
+		if( fits == false ) {
+			LOG(WARNING) << "Tensor " << t->name << " does not fit " << options.weight_type << ". Keeping it as float" << std::endl;
+			continue;
+		}
+		if( try_pack(t, 16) == false )
+			continue;
+		t->pack_bfloat16 = bfloat16;
+		LOG(INFO) << "Storing tensor " << t->name << " as " << options.weight_type << ". " << t->rounding_error() << std::endl;
+	}
+}
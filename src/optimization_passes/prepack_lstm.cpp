@@ -0,0 +1,78 @@
+#include "graph.h"
+#include "options.h"
+#include "nodes/lstm.h"
+
+#include <cstring>
+
+using namespace toC;
+
+/* The LSTM kernel does one pass over R per time step, for all four
+ * gates (see LSTM::print_lstm_kernel()). A constant R, that only the LSTM
+ * uses, is stored so that the weights of the four gates for the same
+ * hidden and input index are next to each other. The two halves of a
+ * constant B are always added together, so that is done here, once.
+ * The input projection X*W of all time steps does not depend on the
+ * hidden state, so it is calculated before the sequence loop
+ * (see LSTM::print_input_projection()).
+ */
+
+static bool own_float_constant(const Tensor *t, const Node *n)
+{
+	return t->isConst && t->isIO == false && t->data_buffer
+	    && t->data_type == onnx::TensorProto_DataType_FLOAT
+	    && t->consumers.size() == 1 && t->consumers[0] == n;
+}
+
+/* [dirs][4*hs][hs] -> [dirs][hs][hs][4] */
+static void interleave_gates(Tensor *R, int dirs, int hs)
+{
+	float *data = (float*)R->data_buffer;
+	std::vector<float> packed(R->data_num_elem());
+	for( int d=0; d<dirs; d++ )
+	for( int g=0; g<4; g++ )
+	for( int h=0; h<hs; h++ )
+	for( int k=0; k<hs; k++ )
+		packed[((d*hs + h)*hs + k)*4 + g] = data[(d*4*hs + g*hs + h)*hs + k];
+	memcpy(data, packed.data(), packed.size() * sizeof(float));
+	R->data_dim = {dirs, hs, hs, 4};
+}
+
+/* [dirs][8*hs] -> [dirs][4*hs] */
+static void fold_bias(Tensor *B, int dirs, int hs)
+{
+	float *data = (float*)B->data_buffer;
+	std::vector<float> folded(dirs*4*hs);
+	for( int d=0; d<dirs; d++ )
+	for( int j=0; j<4*hs; j++ )
+		folded[d*4*hs + j] = data[d*8*hs + j] + data[d*8*hs + 4*hs + j];
+	memcpy(data, folded.data(), folded.size() * sizeof(float));
+	B->data_dim = {dirs, 4*hs};
+}
+
+void Graph::prepack_lstm(void)
+{
+	for( auto n : nodes ) {
+		LSTM *lstm = dynamic_cast<LSTM*>(n);
+		if( lstm == nullptr )
+			continue;
+		int dirs = lstm->num_directions;
+		int hs = lstm->hidden_size;
+		lstm->hoisted_XW = true;
+
+		Tensor *R = lstm->inputs[2];
+		if( own_float_constant(R, lstm) ) {
+			interleave_gates(R, dirs, hs);
+			lstm->packed_R = true;
+			LOG(DEBUG) << "LSTM " << lstm->onnx_name << ": R stored with the gates interleaved" << std::endl;
+		}
+
+		if( lstm->get_B() == nullptr )
+			continue;
+		Tensor *B = lstm->inputs[3];
+		if( own_float_constant(B, lstm) ) {
+			fold_bias(B, dirs, hs);
+			lstm->folded_B = true;
+			LOG(DEBUG) << "LSTM " << lstm->onnx_name << ": Wb and Rb added together" << std::endl;
+		}
+	}
+}
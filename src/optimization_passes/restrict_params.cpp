@@ -0,0 +1,12 @@
+#include "graph.h"
+
+using namespace toC;
+
+// Find the node function parameters that can be
+// restrict qualified. Run after unionize_tensors(),
+// since sharing union memory changes what can overlap.
+void Graph::mark_restrict_params(void)
+{
+	for( auto n : nodes )
+		n->find_noalias_params();
+}
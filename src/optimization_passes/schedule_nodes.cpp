@@ -0,0 +1,283 @@
+#include "graph.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+
+using namespace toC;
+
+/* Order the nodes to need the least memory for the intermediate tensors.
+ * The nodes are in the order they resolved in, which is about the order
+ * of the ONNX file. Where the graph branches, running one branch to
+ * its end before starting the next can keep much less alive at a time.
+ *
+ * A tensor is alive from the start of the node that calculates it to
+ * the end of the last node that uses it, like in unionize_tensors().
+ * Only the tensors that unionize_tensors() places count.
+ * The cost of an order is the largest sum of the sizes of the tensors
+ * alive at the same time. Small graphs are searched for the order of
+ * the least cost, step by step over the sets of nodes run so far.
+ * Larger graphs are ordered greedily: the next node is the one that
+ * leaves the least memory alive. The order changes only if it costs less.
+ */
+
+namespace {
+
+// The exact search is over bitmasks of nodes, and gives up
+// after this many sets of nodes run so far
+const unsigned max_search_nodes = 64;
+const size_t max_search_states = 100000;
+
+struct schedule {
+	struct tensor {
+		uint64_t bytes;
+		unsigned producer;
+		std::vector<unsigned> consumers;
+		bool freed;  // false if it is used by something that is not a node of the graph
+	};
+	std::vector<tensor> tensors;
+	// tensors each node calculates and uses
+	std::vector<std::vector<unsigned>> outs, ins;
+	// nodes each node uses the outputs of
+	std::vector<std::vector<unsigned>> preds;
+
+	/* Memory alive after running the nodes in mask */
+	uint64_t alive(uint64_t mask) const
+	{
+		uint64_t rv=0;
+		for( auto &t : tensors ) {
+			if( (mask & (1ULL << t.producer)) == 0 )
+				continue;
+			bool done = t.freed;
+			for( auto c : t.consumers )
+				done &= (mask & (1ULL << c)) != 0;
+			if( !done )
+				rv += t.bytes;
+		}
+		return rv;
+	}
+
+	bool is_ready(unsigned n, const std::vector<bool> &run) const
+	{
+		if( run[n] )
+			return false;
+		for( auto p : preds[n] )
+			if( run[p] == false )
+				return false;
+		return true;
+	}
+
+	uint64_t output_bytes(unsigned n) const
+	{
+		uint64_t rv=0;
+		for( auto t : outs[n] )
+			rv += tensors[t].bytes;
+		return rv;
+	}
+
+	/* Memory that running node n frees, when 'uses' is the
+	 * number of the nodes still to use each tensor */
+	uint64_t freed_bytes(unsigned n, const std::vector<unsigned> &uses) const
+	{
+		uint64_t rv=0;
+		for( auto t : ins[n] )
+			if( uses[t] == 1 && tensors[t].freed )
+				rv += tensors[t].bytes;
+		for( auto t : outs[n] )
+			if( uses[t] == 0 && tensors[t].freed )
+				rv += tensors[t].bytes;
+		return rv;
+	}
+
+	std::vector<unsigned> initial_uses(void) const
+	{
+		std::vector<unsigned> uses;
+		for( auto &t : tensors )
+			uses.push_back(t.consumers.size());
+		return uses;
+	}
+
+	/* Largest memory alive while running the nodes in 'order' */
+	uint64_t peak(const std::vector<unsigned> &order) const
+	{
+		std::vector<unsigned> uses = initial_uses();
+		uint64_t now=0, rv=0;
+		for( auto n : order ) {
+			now += output_bytes(n);
+			rv = std::max(rv, now);
+			now -= freed_bytes(n, uses);
+			for( auto t : ins[n] )
+				uses[t]--;
+		}
+		return rv;
+	}
+
+	std::vector<unsigned> greedy(void) const
+	{
+		unsigned num_nodes = outs.size();
+		std::vector<unsigned> order;
+		std::vector<bool> run(num_nodes, false);
+		std::vector<unsigned> uses = initial_uses();
+
+		while( order.size() < num_nodes ) {
+			unsigned best = num_nodes;
+			int64_t best_change = 0;
+			for( unsigned n=0; n<num_nodes; n++ ) {
+				if( is_ready(n, run) == false )
+					continue;
+				int64_t change = (int64_t)output_bytes(n) - (int64_t)freed_bytes(n, uses);
+				if( best == num_nodes || change < best_change ) {
+					best = n;
+					best_change = change;
+				}
+			}
+			if( best == num_nodes )
+				ERROR("Scheduling: the graph has a cycle");
+			run[best] = true;
+			order.push_back(best);
+			for( auto t : ins[best] )
+				uses[t]--;
+		}
+		return order;
+	}
+
+	/* The order of the least peak. Empty if there are too many orders to search. */
+	std::vector<unsigned> search(void) const
+	{
+		unsigned num_nodes = outs.size();
+		if( num_nodes > max_search_nodes )
+			return {};
+		struct state {
+			uint64_t peak;
+			uint64_t alive;
+			uint64_t prev;
+			unsigned node;
+		};
+		// The sets of n nodes run, for each n
+		std::vector<std::map<uint64_t, state>> steps(num_nodes+1);
+		steps[0][0] = {0, 0, 0, 0};
+		size_t num_states = 1;
+		for( unsigned s=0; s<num_nodes; s++ ) {
+			for( auto &it : steps[s] ) {
+				uint64_t mask = it.first;
+				std::vector<bool> run(num_nodes);
+				for( unsigned n=0; n<num_nodes; n++ )
+					run[n] = mask & (1ULL << n);
+				for( unsigned n=0; n<num_nodes; n++ ) {
+					if( is_ready(n, run) == false )
+						continue;
+					uint64_t next = mask | (1ULL << n);
+					uint64_t peak = std::max(it.second.peak, it.second.alive + output_bytes(n));
+					auto found = steps[s+1].find(next);
+					if( found != steps[s+1].end() ) {
+						if( peak < found->second.peak ) {
+							found->second.peak = peak;
+							found->second.prev = mask;
+							found->second.node = n;
+						}
+						continue;
+					}
+					steps[s+1][next] = {peak, alive(next), mask, n};
+					if( ++num_states > max_search_states )
+						return {};
+				}
+			}
+		}
+		if( steps[num_nodes].size() != 1 )
+			ERROR("Scheduling: the graph has a cycle");
+
+		std::vector<unsigned> order(num_nodes);
+		uint64_t mask = steps[num_nodes].begin()->first;
+		for( unsigned s=num_nodes; s>0; s-- ) {
+			const state &st = steps[s][mask];
+			order[s-1] = st.node;
+			mask = st.prev;
+		}
+		return order;
+	}
+};
+
+bool is_union_tensor(const Tensor *t)
+{
+	return t->is_used() && t->isIO == false && t->isConst == false && t->initialize == false;
+}
+}
+
+void Graph::schedule_nodes(void)
+{
+	schedule sch;
+	unsigned num_nodes = nodes.size();
+	std::map<const Node*, unsigned> node_index;
+	for( unsigned n=0; n<num_nodes; n++ )
+		node_index[nodes[n]] = n;
+	sch.outs.resize(num_nodes);
+	sch.ins.resize(num_nodes);
+	sch.preds.resize(num_nodes);
+
+	// Who calculates each tensor
+	std::map<const Tensor*, unsigned> producer;
+	for( unsigned n=0; n<num_nodes; n++ )
+		for( auto o : nodes[n]->outputs )
+			if( o->is_used() )
+				producer[o] = n;
+
+	for( unsigned n=0; n<num_nodes; n++ ) {
+		for( auto o : nodes[n]->outputs ) {
+			if( is_union_tensor(o) == false )
+				continue;
+			schedule::tensor t = {(uint64_t)o->data_num_elem() * o->data_elem_size(), n, {}, true};
+			for( auto c : o->consumers ) {
+				if( node_index.count(c) == 0 )
+					t.freed = false;
+				else if( std::count(t.consumers.begin(), t.consumers.end(), node_index[c]) == 0 )
+					t.consumers.push_back(node_index[c]);
+			}
+			sch.outs[n].push_back(sch.tensors.size());
+			sch.tensors.push_back(t);
+		}
+	}
+	for( unsigned n=0; n<num_nodes; n++ ) {
+		for( auto i : nodes[n]->inputs ) {
+			auto p = producer.find(i);
+			if( p != producer.end() && p->second != n
+			 && std::find(sch.preds[n].begin(), sch.preds[n].end(), p->second) == sch.preds[n].end() )
+				sch.preds[n].push_back(p->second);
+		}
+	}
+	for( unsigned t=0; t<sch.tensors.size(); t++ ) {
+		unsigned p = sch.tensors[t].producer;
+		for( auto c : sch.tensors[t].consumers ) {
+			sch.ins[c].push_back(t);
+			if( c != p && std::find(sch.preds[c].begin(), sch.preds[c].end(), p) == sch.preds[c].end() )
+				sch.preds[c].push_back(p);
+		}
+	}
+
+	std::vector<unsigned> original(num_nodes);
+	for( unsigned n=0; n<num_nodes; n++ )
+		original[n] = n;
+	std::vector<unsigned> order = sch.search();
+	if( order.size() == 0 ) {
+		LOG(DEBUG) << "Scheduling: too many orders to search, ordering greedily" << std::endl;
+		order = sch.greedy();
+	}
+	uint64_t before = sch.peak(original);
+	uint64_t after = sch.peak(order);
+	if( after >= before ) {
+		LOG(DEBUG) << "Scheduling: the order of the nodes is kept, at " << before << " bytes alive at most" << std::endl;
+		return;
+	}
+
+	std::vector<Node*> scheduled;
+	for( auto n : order )
+		scheduled.push_back(nodes[n]);
+	std::string order_before, order_after;
+	for( auto n : nodes )
+		order_before += " " + n->onnx_name;
+	for( auto n : scheduled )
+		order_after += " " + n->onnx_name;
+	LOG(INFO) << "Scheduling: nodes reordered, from " << before << " to " << after << " bytes alive at most" << std::endl;
+	LOG(INFO) << "  order before:" << order_before << std::endl;
+	LOG(INFO) << "  order after:" << order_after << std::endl;
+	nodes = scheduled;
+}
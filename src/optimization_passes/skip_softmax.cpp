@@ -0,0 +1,87 @@
+#include "graph.h"
+#include "options.h"
+#include "util.h"
+
+#include <map>
+#include <set>
+
+using namespace toC;
+
+/* Classifiers often end with a Softmax, of which only the index of the
+ * largest value is used (TopK with k=1). Softmax does not change the
+ * order of the values, so the index can be found from its input, and
+ * the exponentials are not calculated at all.
+ * This is done on the ONNX model, before it is resolved.
+ */
+
+namespace {
+
+/* Is the constant 'name' a single 1 */
+bool is_one(const onnx::GraphProto &g, const std::string &name)
+{
+	for( auto &i : g.initializer() ) {
+		if( i.name() != name )
+			continue;
+		Tensor t;
+		t.parse_onnx_tensor(i);
+		return t.data_num_elem() == 1 && t.get_data_element(0) == 1;
+	}
+	return false;
+}
+}
+
+void Graph::skip_softmax(onnx::ModelProto &onnx_model)
+{
+	onnx::GraphProto *g = onnx_model.mutable_graph();
+	int64_t opset = model_opset(onnx_model);
+
+	std::map<std::string, std::vector<onnx::NodeProto*>> consumers;
+	for( auto &n : *g->mutable_node() )
+		for( auto &i : n.input() )
+			consumers[i].push_back(&n);
+	std::set<std::string> outputs;
+	for( auto &o : g->output() )
+		outputs.insert(o.name());
+
+	std::set<std::string> skipped;
+	for( auto &n : g->node() ) {
+		if( n.op_type() != "Softmax" || n.input_size() != 1 || outputs.count(n.output(0)) )
+			continue;
+		const std::string &x = n.input(0);
+		const std::string &y = n.output(0);
+		int r = listed_rank(*g, x);
+		int axis = node_attribute_int(n, "axis", opset < 13 ? 1 : -1);
+		if( axis < 0 && r > 0 )
+			axis += r;
+		// Before opset 13, the softmax is over all dimensions from the axis on
+		bool last_axis = axis == -1 || axis == r-1;
+		if( opset < 13 && last_axis == false )
+			continue;
+
+		bool only_index = consumers[y].size() > 0;
+		for( auto c : consumers[y] ) {
+			int topk_axis = node_attribute_int(*c, "axis", -1);
+			if( topk_axis < 0 && r > 0 )
+				topk_axis += r;
+			if( c->op_type() != "TopK" || c->input(0) != y || c->input_size() < 2 || is_one(*g, c->input(1)) == false
+			 || node_attribute_int(*c, "largest", 1) != 1 || topk_axis != axis
+			 || (c->output(0) != "" && (consumers[c->output(0)].size() || outputs.count(c->output(0)))) )
+				only_index = false;
+		}
+		if( only_index == false )
+			continue;
+
+		LOG(DEBUG) << "Skipping Softmax node " << n.name() << ": only the index of its largest value is used" << std::endl;
+		for( auto c : consumers[y] )
+			c->set_input(0, x);
+		skipped.insert(y);
+	}
+	if( skipped.size() == 0 )
+		return;
+
+	google::protobuf::RepeatedPtrField<onnx::NodeProto> nodes;
+	nodes.Swap(g->mutable_node());
+	for( auto &n : nodes )
+		if( n.op_type() != "Softmax" || skipped.count(n.output(0)) == 0 )
+			*g->add_node() = n;
+}
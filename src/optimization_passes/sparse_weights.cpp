@@ -0,0 +1,57 @@
+#include "graph.h"
+#include "options.h"
+
+using namespace toC;
+
+/* Store the constant weights of pruned models sparse: only the nonzero
+ * values, grouped by output channel, with index tables to find their
+ * place (see Tensor::sparse_axis). Output channels with only zero weights
+ * take no storage and no multiplications. Each node using the tensor must
+ * know how to calculate with it (see Node::accepts_sparse()).
+ * The values are still dense in the onnx2c Tensor.
+ */
+
+/* All nodes using 't' must take it sparse on the same axis */
+static bool try_sparse(Tensor *t)
+{
+	int axis = -1;
+	for( auto n : t->consumers ) {
+		int a = -1;
+		if( n->accepts_sparse(t, a) == false )
+			return false;
+		if( axis >= 0 && a != axis )
+			return false;
+		axis = a;
+	}
+	if( axis < 0 )
+		return false;
+	t->sparse_axis = axis;
+	return true;
+}
+
+void Graph::sparse_weights(void)
+{
+	for( auto t : tensors ) {
+		if( t->isConst == false || t->isIO || t->data_buffer == NULL || t->pack_bits || t->inlined )
+			continue;
+		switch( t->data_type ) {
+			case onnx::TensorProto_DataType_FLOAT:
+			case onnx::TensorProto_DataType_FLOAT16:
+			case onnx::TensorProto_DataType_BFLOAT16:
+			case onnx::TensorProto_DataType_INT8:
+			case onnx::TensorProto_DataType_UINT8:
+			case onnx::TensorProto_DataType_INT16:
+			case onnx::TensorProto_DataType_INT32:
+				break;
+			default:
+				continue;
+		}
+		int elements = t->data_num_elem();
+		int nonzeros = t->nonzero_count();
+		if( elements == 0 || elements - nonzeros < options.sparse_weights * elements )
+			continue;
+		if( try_sparse(t) == false )
+			continue;
+		LOG(INFO) << "Storing tensor " << t->name << " sparse: " << nonzeros << " of " << elements << " elements are nonzero" << std::endl;
+	}
+}
@@ -0,0 +1,174 @@
+#include "graph.h"
+#include "options.h"
+#include "nodes/spatialfilter.h"
+#include "nodes/tiled.h"
+
+#include <algorithm>
+#include <set>
+
+using namespace toC;
+
+/* Depth first execution of the first layers of a CNN ('--tile').
+ * The largest tensors of a vision model are usually right after its
+ * input layers, and the unions can share only whole tensors. So run
+ * the chain of layers from the graph input a band of rows at a time
+ * instead, in a Tiled node (see nodes/tiled.h).
+ * The chain is options.tile_layers layers long, or shorter where it
+ * meets a layer that can't be tiled, a tensor used by more than one
+ * layer, or a graph output. Bands are options.tile_rows rows of the
+ * output of the last layer.
+ */
+
+namespace {
+
+/* Layers that calculate a row of output from a window of input rows */
+const std::set<std::string> spatial = { "Conv", "MaxPool" };
+/* Layers that calculate a row of output from the same row of input */
+const std::set<std::string> rowwise = {
+	"BatchNormalization", "Celu", "Clip", "Elu", "HardSigmoid", "HardSwish",
+	"LeakyRelu", "Relu", "Selu", "Sigmoid", "Softplus", "Softsign", "Tanh"
+};
+
+bool can_tile(const Node *n, const Tensor *x)
+{
+	if( spatial.count(n->op_name) == 0 && rowwise.count(n->op_name) == 0 )
+		return false;
+	if( n->inputs[0] != x || x->rank() != 4 || x->runtime_dim != "" )
+		return false;
+	if( x->data_type != onnx::TensorProto_DataType_FLOAT )
+		return false;
+	for( unsigned i=1; i<n->inputs.size(); i++ )
+		if( n->inputs[i]->isConst == false && n->inputs[i]->initialize == false )
+			return false;
+	// Only the first output, e.g. not the Indices of MaxPool
+	for( unsigned o=1; o<n->outputs.size(); o++ )
+		if( n->outputs[o]->is_used() )
+			return false;
+	return n->outputs[0]->rank() == 4;
+}
+}
+
+void Graph::tile_layers(void)
+{
+	std::vector<Tensor*> ins, outs;
+	interface_tensors(ins, outs);
+	if( ins.size() != 1 ) {
+		LOG(WARNING) << "Layers not tiled: the graph has more than one input" << std::endl;
+		return;
+	}
+
+	// The chain of layers from the graph input
+	std::vector<Node*> chain;
+	Tensor *x = ins[0];
+	while( (int)chain.size() < options.tile_layers ) {
+		if( x->consumers.size() != 1 || can_tile(x->consumers[0], x) == false )
+			break;
+		chain.push_back(x->consumers[0]);
+		x = chain.back()->outputs[0];
+		if( x->isIO )
+			break;
+	}
+	if( chain.size() < 2 ) {
+		LOG(WARNING) << "Layers not tiled: no chain of layers to tile at the graph input" << std::endl;
+		return;
+	}
+
+	Tiled *tiled = new Tiled;
+	tiled->onnx_name = chain[0]->onnx_name + "_tiled";
+	tiled->result = chain.back()->outputs[0];
+	tiled->tile_rows = std::min(options.tile_rows, tiled->result->data_dim[2]);
+
+	// Rows of the input band of each layer, and where the band of the
+	// first tile starts, from the last layer back to the first
+	std::vector<int> rows(chain.size()+1), first(chain.size()+1), step(chain.size()+1);
+	rows.back() = tiled->tile_rows;
+	first.back() = 0;
+	step.back() = tiled->tile_rows;
+	for( int i=chain.size()-1; i>=0; i-- ) {
+		const SpatialFilter *f = dynamic_cast<const SpatialFilter*>(chain[i]);
+		if( f == nullptr ) {
+			rows[i] = rows[i+1];
+			first[i] = first[i+1];
+			step[i] = step[i+1];
+			continue;
+		}
+		int filter_size = (f->kernel_shape[0]-1) * f->dilations[0] + 1;
+		rows[i] = (rows[i+1]-1) * f->strides[0] + filter_size;
+		first[i] = first[i+1] * f->strides[0] - f->pads[0];
+		step[i] = step[i+1] * f->strides[0];
+	}
+
+	// The stages: the layers resolved for bands of their input
+	tiled->inputs.push_back(ins[0]);
+	for( unsigned i=0; i<chain.size(); i++ ) {
+		const Node *n = chain[i];
+		const Tensor *in = n->inputs[0];
+		Tensor *band = i ? tiled->bands.back() : new Tensor;
+		if( i == 0 ) {
+			band->data_type = in->data_type;
+			band->data_dim = in->data_dim;
+			band->data_dim[2] = rows[0];
+			band->name = tiled->onnx_name + "_band0";
+			tiled->bands.push_back(band);
+		}
+
+		Node *s = createNode(n->op_name);
+		s->op_name = n->op_name;
+		s->onnx_name = n->onnx_name + "_tile";
+		for( auto &proto : *model.mutable_graph()->mutable_node() )
+			if( proto.output_size() && proto.output(0) == n->outputs[0]->name && proto.attribute_size() )
+				s->parseAttributes(proto);
+		SpatialFilter *f = dynamic_cast<SpatialFilter*>(s);
+		if( f ) {
+			// The padding of the rows is in the bands
+			f->pads = dynamic_cast<const SpatialFilter*>(n)->pads;
+			f->pads[0] = 0;
+			f->pads[f->pads.size()/2] = 0;
+			f->auto_pad = "NOTSET";
+		}
+		s->inputs = n->inputs;
+		s->inputs[0] = band;
+		s->set_output_used({true});
+		s->resolve();
+		s->isResolved = true;
+
+		Tensor *out = s->outputs[0];
+		std::vector<int> expected = n->outputs[0]->data_dim;
+		expected[2] = rows[i+1];
+		if( out->data_dim != expected )
+			ERROR("Tiling: the band of layer " << n->onnx_name << " is not of the expected size");
+		out->name = tiled->onnx_name + "_band" + std::to_string(i+1);
+		tiled->bands.push_back(out);
+
+		for( unsigned j=1; j<n->inputs.size(); j++ ) {
+			Tensor *t = n->inputs[j];
+			if( t->inlined ) {
+				s->unregister_input(t);
+				continue;
+			}
+			if( std::find(tiled->inputs.begin(), tiled->inputs.end(), t) == tiled->inputs.end() )
+				tiled->inputs.push_back(t);
+		}
+		tiled->stages.push_back({s, first[i], step[i], in->data_dim[2]});
+	}
+	tiled->resolve();
+	tiled->isResolved = true;
+	LOG(INFO) << "Tiled " << chain.size() << " layers into " << tiled->num_tiles() << " bands" << std::endl;
+
+	// Replace the chain with the Tiled node. Its intermediate tensors are gone.
+	for( auto t : tiled->inputs ) {
+		for( auto n : chain )
+			t->consumers.erase(std::remove(t->consumers.begin(), t->consumers.end(), n), t->consumers.end());
+		t->consumers.push_back(tiled);
+	}
+	for( unsigned i=0; i<chain.size(); i++ )
+		for( auto t : chain[i]->outputs )
+			if( t != tiled->result )
+				tensors.erase(std::remove(tensors.begin(), tensors.end(), t), tensors.end());
+	auto pos = std::find(nodes.begin(), nodes.end(), chain[0]);
+	*pos = tiled;
+	for( unsigned i=1; i<chain.size(); i++ )
+		nodes.erase(std::remove(nodes.begin(), nodes.end(), chain[i]), nodes.end());
+	for( auto t : tiled->bands )
+		tensors.push_back(t);
+}
@@ -4,6 +4,8 @@
 #include "options.h"
 #include "args.hxx"
 #include "error.h"
+#include "quantization.h"
+#include "tensor.h"
 #include "timestamp.h"
 
 #include <iostream>
@@ -39,35 +41,88 @@ void initialize_logging(void)
 	AixLog::Log::init<AixLog::SinkCerr>(s);
 }
 
-void store_define_option(const std::string &opt)
+/* Parse a "name:value" dimension definition as given to the
+ * option 'flag' */
+void parse_dim_option(const std::string &opt, char flag, std::string &name, uint32_t &val_num)
 {
 	auto delim_pos = opt.find(':', 0 );
 	if( delim_pos == std::string::npos )
-		ERROR("bad command line argument for the '-d' option");
+		ERROR("bad command line argument for the '-" << flag << "' option");
 
-	std::string name = opt.substr(0, delim_pos);
+	name = opt.substr(0, delim_pos);
 	if( name.size() < 1 )
-		ERROR("bad command line argument for the '-d' option");
+		ERROR("bad command line argument for the '-" << flag << "' option");
 
 	std::string val = opt.substr(delim_pos+1, std::string::npos);
 	if( val.size() < 1 )
-		ERROR("bad command line argument for the '-d' option");
+		ERROR("bad command line argument for the '-" << flag << "' option");
 
-	uint32_t val_num;
 	try {
 		val_num = std::stoul(val);
 	}
 	catch( std::exception& e ) {
-		ERROR("bad command line argument for the '-d' option");
+		ERROR("bad command line argument for the '-" << flag << "' option");
 	}
+}
 
+void store_define_option(const std::string &opt)
+{
+	std::string name;
+	uint32_t val_num;
+	parse_dim_option(opt, 'd', name, val_num);
 	options.dim_defines[name] = val_num;
 }
 
+void store_runtime_dim_option(const std::string &opt)
+{
+	std::string name;
+	uint32_t val_num;
+	parse_dim_option(opt, 'r', name, val_num);
+	if( val_num == 0 )
+		ERROR("bad command line argument for the '-r' option: maximum size must be given");
+
+	options.runtime_dims[name] = val_num;
+}
+
+/* A shape variant is a comma separated list of dimension definitions */
+void store_variant_option(const std::string &opt)
+{
+	std::map<std::string, uint32_t> variant;
+	size_t start = 0;
+	while( start <= opt.size() ) {
+		size_t end = opt.find(',', start);
+		if( end == std::string::npos )
+			end = opt.size();
+
+		std::string name;
+		uint32_t val_num;
+		parse_dim_option(opt.substr(start, end-start), 'V', name, val_num);
+		if( val_num == 0 )
+			ERROR("bad command line argument for the '-V' option: dimension " << name << " is 0");
+		variant[name] = val_num;
+
+		start = end+1;
+	}
+
+	for( auto &v : options.dim_variants )
+		if( v == variant )
+			ERROR("shape variant '" << opt << "' given twice");
+	options.dim_variants.push_back(variant);
+}
+
 void print_optimization_passes(void)
 {
 	std::cout << "Available optimization passes:" << std::endl;
 	std::cout << " - 'unionize' (defaut:on)" << std::endl;
+	std::cout << " - 'restrict' (defaut:on) - restrict qualify node parameters that never overlap" << std::endl;
+	std::cout << " - 'align' (defaut:off) - align internal tensors to " << toC::TENSOR_ALIGNMENT << " bytes, and tell the compiler" << std::endl;
+	std::cout << " - 'qdq' (defaut:on) - run DequantizeLinear->node->QuantizeLinear sequences of quantized models as integer nodes" << std::endl;
+	std::cout << " - 'thresholds' (defaut:on) - fuse MatMuls into the following MultiThresholds, and threshold integers as integers" << std::endl;
+	std::cout << " - 'dedup' (defaut:on) - store identical initializers once, also across several input models" << std::endl;
+	std::cout << " - 'attention' (defaut:on) - calculate MatMul->Softmax->MatMul attention blocks a tile of scores at a time" << std::endl;
+	std::cout << " - 'argmax' (defaut:on) - skip Softmaxes of which only the index of the largest value is used (TopK with k=1)" << std::endl;
+	std::cout << " - 'schedule' (defaut:on) - order the nodes for the least memory in use at a time" << std::endl;
+	std::cout << " - 'lstm' (defaut:on) - calculate the input projection of LSTMs before the sequence loop, and store their constant weights for the kernel" << std::endl;
 	std::cout << " - 'none' (disable all optimization passes)" << std::endl;
 }
 
@@ -78,6 +133,15 @@ void store_optimization_passes(const std::string &opt)
 	// disable all optimizations (i.e. override the default settings)
 	// then enable those that were requested
 	options.opt_unionize=false;
+	options.opt_restrict=false;
+	options.opt_align=false;
+	options.opt_qdq=false;
+	options.opt_thresholds=false;
+	options.opt_dedup=false;
+	options.opt_argmax=false;
+	options.opt_attention=false;
+	options.opt_schedule=false;
+	options.opt_lstm=false;
 	if( opt == "none" )
 	{
 		LOG(TRACE) << "Disabling all optimizations: " << opt << std::endl;
@@ -98,6 +162,51 @@ void store_optimization_passes(const std::string &opt)
 			LOG(DEBUG) << "Enabling 'Unionize tensors' optimization pass" << std::endl;
 			options.opt_unionize=true;
 		}
+		else if( item == "restrict" )
+		{
+			LOG(DEBUG) << "Enabling 'Restrict parameters' optimization pass" << std::endl;
+			options.opt_restrict=true;
+		}
+		else if( item == "align" )
+		{
+			LOG(DEBUG) << "Enabling 'Align tensors' optimization pass" << std::endl;
+			options.opt_align=true;
+		}
+		else if( item == "qdq" )
+		{
+			LOG(DEBUG) << "Enabling 'Fuse QDQ' optimization pass" << std::endl;
+			options.opt_qdq=true;
+		}
+		else if( item == "thresholds" )
+		{
+			LOG(DEBUG) << "Enabling 'Integer thresholds' optimization pass" << std::endl;
+			options.opt_thresholds=true;
+		}
+		else if( item == "dedup" )
+		{
+			LOG(DEBUG) << "Enabling 'Deduplicate initializers' optimization pass" << std::endl;
+			options.opt_dedup=true;
+		}
+		else if( item == "attention" )
+		{
+			LOG(DEBUG) << "Enabling 'Fuse attention' optimization pass" << std::endl;
+			options.opt_attention=true;
+		}
+		else if( item == "argmax" )
+		{
+			LOG(DEBUG) << "Enabling 'Skip Softmax before argmax' optimization pass" << std::endl;
+			options.opt_argmax=true;
+		}
+		else if( item == "schedule" )
+		{
+			LOG(DEBUG) << "Enabling 'Schedule nodes' optimization pass" << std::endl;
+			options.opt_schedule=true;
+		}
+		else if( item == "lstm" )
+		{
+			LOG(DEBUG) << "Enabling 'Prepack LSTM' optimization pass" << std::endl;
+			options.opt_lstm=true;
+		}
 		else {
 			LOG(WARNING) << "Optimization pass " << item << " does not exist" << std::endl;
 		}
@@ -110,12 +219,25 @@ void parse_cmdline_options(int argc, const char *argv[])
 	args::ArgumentParser parser("Generate C code from an ONNX graph file.");
 	args::Flag avr(parser, "avr", "Target AVR-GCC", {'a', "avr"});
 	args::ValueFlagList<std::string> define(parser, "dim:size", "Define graph input dimension. Can be given multiple times", {'d', "define"});
+	args::ValueFlagList<std::string> runtime_dim(parser, "dim:max", "Declare graph input dimension variable at run time, with the given maximum size. Can be given multiple times", {'r', "runtime-dim"});
+	args::ValueFlagList<std::string> variant(parser, "dim:size[,dim:size]...", "Generate a shape specialized variant of the graph for the given input dimensions. Can be given multiple times", {'V', "variant"});
 	args::ValueFlag<int> loglevel(parser, "level", "Logging verbosity. 0(none)-4(all)", {'l',"log"});
 	args::ValueFlag<std::string> optimizations(parser, "opt[,opt]...", "Specify optimization passes to run. ('help' to list available)", {'p', "optimizations"});
 	args::Flag help(parser, "help", "Print this help text.", {'h',"help"});
 	args::Flag quantize(parser, "quantize", "Quantize network (EXPERIMENTAL!)", {'q', "quantize"});
+	args::ValueFlag<std::string> calibrate(parser, "dir", "Print a calibration program instead: it runs the graph on the inputs in dir/test_data_set_*/ and prints the value range of each tensor", {'c', "calibrate"});
+	args::ValueFlag<std::string> quant_ranges(parser, "file", "Quantize with the value ranges printed by a calibration program. Use with -q", {"quant-ranges"});
+	args::ValueFlag<std::string> simd(parser, "isa", "Print explicit SIMD code for float kernels. One of: generic, sse4.1, avx2. The C compiler must then be given the matching flags (e.g. -mavx2 -mfma)", {"simd"});
+	args::Flag flat_pointers(parser, "flat-pointers", "Walk tensors in kernel loops with flat pointers bumped by precomputed strides, instead of indexing with array syntax", {"flat-pointers"});
+	args::Flag pack_weights(parser, "pack-weights", "Store constant MatMul, Gemm and Conv weights that are 4 bit or bipolar (-1/+1) integers packed into bytes, and multiply bipolar weights and activations with XNOR and popcount", {"pack-weights"});
+	args::ValueFlag<std::string> weights(parser, "type", "Store constant float MatMul, Gemm and Conv weights as 16 bit floats. One of: fp16, bf16. Calculation stays in float. The rounding error of each tensor is noted in the generated code", {"weights"});
+	args::ValueFlag<float> sparse(parser, "fraction", "Store constant MatMul, Gemm and Conv weights of which at least the given fraction (e.g. 0.7) is zero as compressed sparse columns or filters, and skip the zeros in the calculation", {"sparse"});
+	args::ValueFlag<int> inline_weights(parser, "count", "Write constant Gemm and Conv weights of at most the given number of nonzero values into the code as literals, as straight-line multiply-adds that skip the zeros and add or subtract the ones", {"inline-weights"});
+	args::Flag stream(parser, "stream", "Keep the state of LSTMs between calls to entry(), to run a sequence a frame at a time. Adds reset_state(), get_state() and set_state()", {"stream"});
+	args::Flag fastmath(parser, "fastmath", "Calculate exp, tanh, sigmoid, erf and log with inline approximations the C compiler can vectorize, instead of calling libm. The maximum errors are noted in the generated code", {"fastmath"});
+	args::ValueFlag<std::string> tile(parser, "layers[:rows]", "Run the given number of layers from the graph input (Conv, MaxPool, BatchNormalization and activations) depth first, a band of rows (default 8) of their output at a time, so that their full size intermediate tensors are never stored. The rows where the kernels of neighbouring bands overlap are calculated again for each band", {"tile"});
 	args::Flag version(parser, "version", "Print onnx2c version", {'v', "version"});
-	args::Positional<std::string> input(parser, "input", "ONNX file to process");
+	args::PositionalList<std::string> input(parser, "input", "ONNX file to process. With several files, each model gets its own entry_<file name>(), and the identical initializers are shared");
 	try
 	{
 		parser.ParseCLI(argc, argv);
@@ -151,8 +273,87 @@ void parse_cmdline_options(int argc, const char *argv[])
 			store_define_option(d);
 		}
 	}
+	if (runtime_dim) {
+		for (const auto &d: args::get(runtime_dim)) {
+			store_runtime_dim_option(d);
+		}
+	}
+	if (variant) {
+		for (const auto &v: args::get(variant)) {
+			store_variant_option(v);
+		}
+	}
+	if (options.dim_variants.size() && options.runtime_dims.size())
+		ERROR("Unimplemented: shape variants with run time variable dimensions");
+	if (simd) {
+		options.simd = args::get(simd);
+		if( options.simd != "generic" && options.simd != "sse4.1" && options.simd != "avx2" ) {
+			std::cerr << "Unknown SIMD instruction set '" << options.simd << "'";
+			hint_at_help_and_exit();
+		}
+		if( options.target_avr )
+			ERROR("SIMD code cannot be generated for AVR");
+	}
+	if (flat_pointers) { options.flat_pointers = true; }
+	if (pack_weights) { options.pack_weights = true; }
+	if (weights) {
+		options.weight_type = args::get(weights);
+		if( options.weight_type != "fp16" && options.weight_type != "bf16" ) {
+			std::cerr << "Unknown weight type '" << options.weight_type << "'";
+			hint_at_help_and_exit();
+		}
+	}
+	if (sparse) {
+		options.sparse_weights = args::get(sparse);
+		if( options.sparse_weights <= 0 || options.sparse_weights > 1 ) {
+			std::cerr << "Sparse weight fraction must be in (0, 1]";
+			hint_at_help_and_exit();
+		}
+	}
+	if (inline_weights) {
+		options.inline_weights = args::get(inline_weights);
+		if( options.inline_weights < 0 ) {
+			std::cerr << "Inlined weight count must not be negative";
+			hint_at_help_and_exit();
+		}
+	}
+	if (stream) {
+		options.stream = true;
+		if( options.dim_variants.size() )
+			ERROR("Unimplemented: streaming with shape variants");
+	}
+	if (fastmath)
+		options.fastmath = true;
+	if (tile) {
+		std::string opt = args::get(tile);
+		try {
+			size_t delim_pos = opt.find(':');
+			options.tile_layers = std::stoi(opt.substr(0, delim_pos));
+			if( delim_pos != std::string::npos )
+				options.tile_rows = std::stoi(opt.substr(delim_pos+1));
+		}
+		catch( std::exception& e ) {
+			ERROR("bad command line argument for the '--tile' option");
+		}
+		if( options.tile_layers < 2 || options.tile_rows < 1 )
+			ERROR("bad command line argument for the '--tile' option: at least 2 layers and 1 row");
+	}
+	if (calibrate) {
+		options.calibration_dir = args::get(calibrate);
+		if( options.quantize || options.dim_variants.size() || options.runtime_dims.size() )
+			ERROR("A calibration program can be printed only for a float graph with fixed dimensions");
+		if( options.tile_layers )
+			ERROR("Unimplemented: calibration program with tiled layers");
+	}
+	if (quant_ranges) {
+		if( options.quantize == false )
+			ERROR("Option '--quant-ranges' needs '-q'");
+		load_quant_ranges( args::get(quant_ranges) );
+	}
 	if (optimizations) { store_optimization_passes( args::get(optimizations) ); }
-	if (input) { options.input_file = args::get(input); }
-	if (options.input_file == "" ) { std::cerr << "No input file given"; hint_at_help_and_exit(); }
+	if (input) { options.input_files = args::get(input); }
+	if (options.input_files.size() == 0 ) { std::cerr << "No input file given"; hint_at_help_and_exit(); }
+	if (options.input_files.size() > 1 && (options.dim_variants.size() || options.runtime_dims.size() || options.calibration_dir != "" || options.stream))
+		ERROR("Unimplemented: several input models with shape variants, run time dimensions, calibration or streaming");
 }
 
@@ -6,12 +6,45 @@
 #pragma once
 #include <map>
 #include <string>
+#include <vector>
 
 struct onnx2c_opts
 {
 	bool quantize=false;
 	bool target_avr=false;
 	bool opt_unionize=true;
+	bool opt_restrict=true;
+	bool opt_align=false;
+	bool opt_qdq=true;
+	bool opt_thresholds=true;
+	bool opt_dedup=true;
+	bool opt_argmax=true;
+	bool opt_attention=true;
+	bool opt_schedule=true;
+	bool opt_lstm=true;
+	// Instruction set to print explicit SIMD code for. Empty for plain scalar C.
+	std::string simd;
+	// Index tensors in kernel loops through flat pointers and precomputed
+	// strides, instead of multidimensional array syntax.
+	bool flat_pointers=false;
+	// Store constant weights that are 4 bit or bipolar integers packed into bytes.
+	bool pack_weights=false;
+	std::string weight_type="";  // "fp16" or "bf16" for 16 bit float weights
+	// Store constant weights with at least this fraction of zeros in a compressed
+	// sparse form. 0 keeps all weights dense.
+	float sparse_weights=0;
+	// Write constant weights of at most this many nonzero values into the
+	// code as literals. 0 to never do so.
+	int inline_weights=0;
+	// Keep the state of recurrent nodes between calls to entry(), for
+	// feeding a sequence a few time steps at a time.
+	bool stream=false;
+	// Call inline approximations of exp, tanh, erf and log instead of libm.
+	bool fastmath=false;
+	// Run this many layers from the graph input depth first, over bands of
+	// tile_rows rows of their output. 0 to run all layers on whole tensors.
+	int tile_layers=0;
+	int tile_rows=8;
 	/*
 	 * logging levels are
 	 * cmd line     aixlog     Use
@@ -27,8 +60,19 @@ struct onnx2c_opts
 	#define DEFAULT_LOG_LEVEL 2
 	#endif
 	int logging_level=DEFAULT_LOG_LEVEL;  // Default level set by CMake. 1 in release, 4 in debug builds
-	std::string input_file;
+	std::vector<std::string> input_files;
 	std::map<std::string, uint32_t> dim_defines;
+	// Graph input dimensions that are variable at run time,
+	// mapped to the maximum size they can take.
+	std::map<std::string, uint32_t> runtime_dims;
+	// Sets of graph input dimensions, one for each shape specialized
+	// variant of the graph to generate.
+	std::vector<std::map<std::string, uint32_t>> dim_variants;
+	// Directory of test_data_set_* inputs to print a calibration program for.
+	std::string calibration_dir;
+	// Calibrated value ranges (min, max) of graph tensors, by ONNX name,
+	// for quantization. Empty for the uncalibrated quantization.
+	std::map<std::string, std::pair<float, float>> quant_ranges;
 };
 
 extern struct onnx2c_opts options;
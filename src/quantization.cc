@@ -0,0 +1,168 @@
+/* This file is part of onnx2c.
+ *
+ * Calibrated int8 quantization helpers.
+ */
+#include "error.h"
+#include "options.h"
+#include "quantization.h"
+#include "tensor.h"
+
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+
+bool quantization_calibrated(void)
+{
+	return options.quantize && options.quant_ranges.size() > 0;
+}
+
+/* Each line is "<tensor name> <min> <max>". Tensor names can contain spaces. */
+void load_quant_ranges(const std::string &filename)
+{
+	std::ifstream f(filename);
+	if( !f.good() )
+		ERROR("Error opening quantization range file: \"" << filename << "\"");
+
+	std::string line;
+	while( std::getline(f, line) ) {
+		if( line == "" )
+			continue;
+		size_t max_pos = line.rfind(' ');
+		size_t min_pos = max_pos == std::string::npos ? max_pos : line.rfind(' ', max_pos-1);
+		if( min_pos == std::string::npos || min_pos == 0 )
+			ERROR("Bad line in quantization range file: \"" << line << "\"");
+		std::string name = line.substr(0, min_pos);
+		try {
+			float min = std::stof(line.substr(min_pos+1, max_pos-min_pos-1));
+			float max = std::stof(line.substr(max_pos+1));
+			options.quant_ranges[name] = std::make_pair(min, max);
+		}
+		catch( std::exception& e ) {
+			ERROR("Bad line in quantization range file: \"" << line << "\"");
+		}
+	}
+}
+
+float quant_scale_from_range(const std::string &name)
+{
+	auto r = options.quant_ranges.find(name);
+	if( r == options.quant_ranges.end() )
+		ERROR("No calibrated value range for tensor " << name);
+	float absmax = std::max(std::fabs(r->second.first), std::fabs(r->second.second));
+	return absmax > 0 ? absmax/127 : 1;
+}
+
+void quantize_multiplier(double real, int32_t &mult, int32_t &shift)
+{
+	if( real <= 0 )
+		ERROR("Non-positive quantization multiplier " << real);
+	int exp;
+	double q = std::frexp(real, &exp); // real = q * 2^exp, q in [0.5, 1)
+	int64_t q31 = std::llround(q * (1ll << 31));
+	if( q31 == (1ll << 31) ) {
+		q31 /= 2;
+		exp++;
+	}
+	mult = q31;
+	shift = 31 - exp;
+	// Multipliers this small flush to zero
+	if( shift > 62 ) {
+		mult = 0;
+		shift = 62;
+	}
+	if( shift < 1 )
+		ERROR("Quantization multiplier " << real << " is too large");
+}
+
+std::string requantize(const std::string &acc, const std::string &mult, const std::string &shift)
+{
+	return "onnx2c_requantize(" + acc + ", " + mult + ", " + shift + ")";
+}
+
+void print_requantize_tables(std::ostream &dst, const std::vector<double> &reals)
+{
+	std::vector<int32_t> mults, shifts;
+	for( double r : reals ) {
+		int32_t m, s;
+		quantize_multiplier(r, m, s);
+		mults.push_back(m);
+		shifts.push_back(s);
+	}
+
+	dst << "\t" << "static const int32_t mult[" << reals.size() << "] = {";
+	for( unsigned i=0; i<mults.size(); i++ )
+		dst << (i ? ", " : " ") << mults[i];
+	dst << " };" << std::endl;
+	dst << "\t" << "static const int8_t shift[" << reals.size() << "] = {";
+	for( unsigned i=0; i<shifts.size(); i++ )
+		dst << (i ? ", " : " ") << shifts[i];
+	dst << " };" << std::endl;
+}
+
+std::vector<int32_t> constant_ints(const toC::Tensor *t, const std::string &what)
+{
+	if( t->data_buffer == NULL )
+		ERROR("Unimplemented: " << what << " (" << t->name << ") is not a compile time constant");
+	std::vector<int32_t> rv;
+	for( int i=0; i<t->data_num_elem(); i++ )
+		rv.push_back(t->get_data_element(i));
+	return rv;
+}
+
+std::vector<float> constant_floats(const toC::Tensor *t, const std::string &what)
+{
+	if( t->data_buffer == NULL )
+		ERROR("Unimplemented: " << what << " (" << t->name << ") is not a compile time constant");
+	std::vector<float> rv;
+	for( int i=0; i<t->data_num_elem(); i++ )
+		rv.push_back(t->get_data_element_float(i));
+	return rv;
+}
+
+void quantized_range(onnx::TensorProto_DataType type, int32_t &lo, int32_t &hi)
+{
+	switch( type ) {
+		case onnx::TensorProto_DataType_INT8:   lo = INT8_MIN;  hi = INT8_MAX;   break;
+		case onnx::TensorProto_DataType_UINT8:  lo = 0;         hi = UINT8_MAX;  break;
+		case onnx::TensorProto_DataType_INT16:  lo = INT16_MIN; hi = INT16_MAX;  break;
+		case onnx::TensorProto_DataType_UINT16: lo = 0;         hi = UINT16_MAX; break;
+		default:
+			ERROR("Unimplemented: quantized data type " << type);
+	}
+}
+
+std::string requantize_zp(const std::string &acc, const std::string &mult, const std::string &shift, int32_t zero_point, onnx::TensorProto_DataType type)
+{
+	int32_t lo, hi;
+	quantized_range(type, lo, hi);
+	return "onnx2c_requantize_zp(" + acc + ", " + mult + ", " + shift + ", "
+	     + std::to_string(zero_point) + ", " + std::to_string(lo) + ", " + std::to_string(hi) + ")";
+}
+
+void print_quantization_helpers(std::ostream &dst, bool zero_point_helpers)
+{
+	if( zero_point_helpers ) {
+		dst << "static inline int32_t onnx2c_requantize_zp(int64_t acc, int32_t mult, int8_t shift, int32_t zero_point, int32_t lo, int32_t hi)" << std::endl;
+		dst << "{" << std::endl;
+		dst << "\t" << "int64_t v = acc * mult;" << std::endl;
+		dst << "\t" << "int64_t half = (int64_t)1 << (shift-1);" << std::endl;
+		dst << "\t" << "int64_t rem = v & ((half<<1)-1);" << std::endl;
+		dst << "\t" << "v >>= shift;" << std::endl;
+		dst << "\t" << "if( rem > half || (rem == half && (v & 1)) )" << std::endl;
+		dst << "\t\t" << "v++;" << std::endl;
+		dst << "\t" << "v += zero_point;" << std::endl;
+		dst << "\t" << "return v > hi ? hi : v < lo ? lo : v;" << std::endl;
+		dst << "}" << std::endl;
+	}
+
+	if( quantization_calibrated() == false )
+		return;
+
+	dst << "static inline int8_t onnx2c_requantize(int64_t acc, int32_t mult, int8_t shift)" << std::endl;
+	dst << "{" << std::endl;
+	dst << "\t" << "int64_t v = acc * mult;" << std::endl;
+	dst << "\t" << "v = (v + ((int64_t)1 << (shift-1))) >> shift;" << std::endl;
+	dst << "\t" << "return v > 127 ? 127 : v < -127 ? -127 : v;" << std::endl;
+	dst << "}" << std::endl;
+}
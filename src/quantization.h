@@ -0,0 +1,60 @@
+/* This file is part of onnx2c.
+ *
+ * Helpers for calibrated int8 quantization ('-q' with '--quant-ranges').
+ *
+ * Activations are quantized symmetrically per tensor, with the scale given
+ * by the value range recorded with a '--calibrate' program. Weights are
+ * quantized per output channel, and biases to int32 at the scale of the
+ * accumulator they are added to.
+ * Nodes accumulate in int32, and requantize the accumulator to the output
+ * scale with a fixed point multiplier and shift. No floats are left in
+ * the generated code.
+ */
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include "onnx.pb.h"
+
+namespace toC { class Tensor; }
+
+/* Is quantization calibrated (as opposed to the plain '-q' quantization) */
+bool quantization_calibrated(void);
+
+/* Read a value range file printed by a calibration program into options.quant_ranges */
+void load_quant_ranges(const std::string &filename);
+/* int8 scale of the graph tensor 'name' from its calibrated value range */
+float quant_scale_from_range(const std::string &name);
+
+/* Represent a positive real multiplier as mult * 2^-shift, with
+ * mult a Q31 fixed point value in [0.5, 1) */
+void quantize_multiplier(double real, int32_t &mult, int32_t &shift);
+
+/* C expression requantizing the int32/int64 'acc' to int8 with the given
+ * multiplier and shift, rounding to nearest and saturating */
+std::string requantize(const std::string &acc, const std::string &mult, const std::string &shift);
+
+/* Print, in a node function, constant tables 'mult' and 'shift' with
+ * the fixed point representations of 'reals' */
+void print_requantize_tables(std::ostream &dst, const std::vector<double> &reals);
+
+/* Models that come already quantized (QLinearConv, QLinearMatMul...) have
+ * asymmetric int8 or uint8 tensors, i.e. real = (q - zero_point) * scale.
+ * Scales and zero points must be compile time constants, so that the nodes
+ * can fold the zero points into precomputed terms and print the requantization
+ * multipliers as tables.
+ * Values of the constant tensor 't', named 'what' in error messages. */
+std::vector<int32_t> constant_ints(const toC::Tensor *t, const std::string &what);
+std::vector<float> constant_floats(const toC::Tensor *t, const std::string &what);
+
+/* Range of the quantized integer 'type': int8, uint8, int16 or uint16 */
+void quantized_range(onnx::TensorProto_DataType type, int32_t &lo, int32_t &hi);
+
+/* C expression requantizing the accumulator 'acc' to a tensor of 'type'
+ * with the given zero point, rounding to nearest even and saturating to
+ * the range of 'type' */
+std::string requantize_zp(const std::string &acc, const std::string &mult, const std::string &shift, int32_t zero_point, onnx::TensorProto_DataType type);
+
+/* Print helper definitions needed by the above.
+ * The zero point variant only when 'zero_point_helpers' is set. */
+void print_quantization_helpers(std::ostream &dst, bool zero_point_helpers);
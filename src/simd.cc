@@ -0,0 +1,114 @@
+/* This file is part of onnx2c.
+ *
+ * Explicit SIMD code generation helpers.
+ * The ISA is selected with options.simd:
+ *  "generic" - GCC vector extensions, 4 floats wide
+ *  "sse4.1"  - SSE intrinsics, 4 floats wide
+ *  "avx2"    - AVX2 + FMA intrinsics, 8 floats wide
+ */
+#include "error.h"
+#include "options.h"
+#include "simd.h"
+
+bool simd_enabled(void)
+{
+	return options.simd != "";
+}
+
+unsigned simd_width(void)
+{
+	if( options.simd == "avx2" )
+		return 8;
+	else
+		return 4;
+}
+
+std::string simd_type(void)
+{
+	if( options.simd == "generic" )
+		return "onnx2c_vf";
+	else if( options.simd == "sse4.1" )
+		return "__m128";
+	else if( options.simd == "avx2" )
+		return "__m256";
+	ERROR("Unknown SIMD instruction set " << options.simd);
+}
+
+/* Prefix of the intrinsics function names, or of the helpers for
+ * the generic vectors */
+static std::string fn_prefix(void)
+{
+	if( options.simd == "generic" )
+		return "onnx2c_vf_";
+	else if( options.simd == "sse4.1" )
+		return "_mm_";
+	else if( options.simd == "avx2" )
+		return "_mm256_";
+	ERROR("Unknown SIMD instruction set " << options.simd);
+}
+
+std::string simd_load(const std::string &ptr)
+{
+	if( options.simd == "generic" )
+		return "onnx2c_vf_load(" + ptr + ")";
+	return fn_prefix() + "loadu_ps(" + ptr + ")";
+}
+
+std::string simd_store(const std::string &ptr, const std::string &v)
+{
+	if( options.simd == "generic" )
+		return "onnx2c_vf_store(" + ptr + ", " + v + ")";
+	return fn_prefix() + "storeu_ps(" + ptr + ", " + v + ")";
+}
+
+std::string simd_set1(const std::string &scalar)
+{
+	return fn_prefix() + "set1_ps(" + scalar + ")";
+}
+
+std::string simd_arith(char op, const std::string &a, const std::string &b)
+{
+	if( options.simd == "generic" )
+		return "(" + a + " " + op + " " + b + ")";
+
+	std::string fn;
+	switch( op ) {
+		case '+': fn = "add_ps"; break;
+		case '-': fn = "sub_ps"; break;
+		case '*': fn = "mul_ps"; break;
+		case '/': fn = "div_ps"; break;
+		default:
+			ERROR("Unknown SIMD operation " << op);
+	}
+	return fn_prefix() + fn + "(" + a + ", " + b + ")";
+}
+
+std::string simd_max(const std::string &a, const std::string &b)
+{
+	return fn_prefix() + "max_ps(" + a + ", " + b + ")";
+}
+
+std::string simd_fmadd(const std::string &a, const std::string &b, const std::string &c)
+{
+	if( options.simd == "avx2" )
+		return "_mm256_fmadd_ps(" + a + ", " + b + ", " + c + ")";
+	return simd_arith('+', simd_arith('*', a, b), c);
+}
+
+void print_simd_includes(std::ostream &dst)
+{
+	if( simd_enabled() == false )
+		return;
+
+	if( options.simd != "generic" ) {
+		dst << "#include <immintrin.h>" << std::endl;
+		return;
+	}
+
+	// memcpy() for unaligned access. Compilers turn these into plain vector loads & stores.
+	dst << "typedef float onnx2c_vf __attribute__((vector_size(16)));" << std::endl;
+	dst << "static inline onnx2c_vf onnx2c_vf_load(const float *p) { onnx2c_vf v; memcpy(&v, p, sizeof(v)); return v; }" << std::endl;
+	dst << "static inline void onnx2c_vf_store(float *p, onnx2c_vf v) { memcpy(p, &v, sizeof(v)); }" << std::endl;
+	dst << "static inline onnx2c_vf onnx2c_vf_set1_ps(float x) { onnx2c_vf v = {x, x, x, x}; return v; }" << std::endl;
+	dst << "static inline onnx2c_vf onnx2c_vf_max_ps(onnx2c_vf a, onnx2c_vf b) { for( int i=0; i<4; i++) a[i] = a[i] > b[i] ? a[i] : b[i]; return a; }" << std::endl;
+}
@@ -0,0 +1,33 @@
+/* This file is part of onnx2c.
+ *
+ * Helpers for nodes printing explicit SIMD code (the '--simd' option).
+ * Only single precision float vectors are supported.
+ * The returned strings are C expressions, without the terminating ';'.
+ *
+ * All shapes are known at generation time, so nodes should loop
+ * over full vectors only, and print the remainder with the scalar code.
+ */
+#pragma once
+#include <iostream>
+#include <string>
+
+/* Is explicit SIMD code generation requested */
+bool simd_enabled(void);
+/* Number of floats in a vector */
+unsigned simd_width(void);
+/* C type of a float vector variable */
+std::string simd_type(void);
+
+/* Unaligned load/store of a vector from a float pointer */
+std::string simd_load(const std::string &ptr);
+std::string simd_store(const std::string &ptr, const std::string &v);
+/* Vector with all elements set to the scalar */
+std::string simd_set1(const std::string &scalar);
+/* Arithmetic. 'op' is one of + - * / */
+std::string simd_arith(char op, const std::string &a, const std::string &b);
+std::string simd_max(const std::string &a, const std::string &b);
+/* a*b+c. Fused where the ISA has it. */
+std::string simd_fmadd(const std::string &a, const std::string &b, const std::string &c);
+
+/* Print headers and helper definitions needed by the above. */
+void print_simd_includes(std::ostream &dst);
@@ -1,6 +1,9 @@
 #include "tensor.h"
 #include "util.h"
+#include <algorithm>
+#include <cmath>
 #include <limits>
+#include <sstream>
 
 using namespace toC;
 void Tensor::parse_onnx_tensor(const onnx::TensorProto &tensor)
@@ -43,6 +46,9 @@ void Tensor::parse_onnx_tensor(const onnx::TensorProto &tensor)
 			data_num_elements = tensor.int32_data_size(); break;
 		case onnx::TensorProto_DataType_UINT16:
 			data_num_elements = tensor.int32_data_size(); break;
+		case onnx::TensorProto_DataType_FLOAT16:
+		case onnx::TensorProto_DataType_BFLOAT16:
+			data_num_elements = tensor.int32_data_size(); break;
 		case onnx::TensorProto_DataType_INT32:
 			data_num_elements = tensor.int32_data_size(); break;
 		case onnx::TensorProto_DataType_UINT32:
@@ -104,6 +110,9 @@ void Tensor::parse_onnx_tensor(const onnx::TensorProto &tensor)
 					((int16_t*)data_buffer)[i] = tensor.int32_data(i);
 				break;
 			case onnx::TensorProto_DataType_UINT16:
+			// 16 bit floats are kept as their bits
+			case onnx::TensorProto_DataType_FLOAT16:
+			case onnx::TensorProto_DataType_BFLOAT16:
 				for( int i=0; i<data_num_elem(); i++  )
 					((uint16_t*)data_buffer)[i] = tensor.int32_data(i);
 				break;
@@ -143,6 +152,13 @@ std::string Tensor::cname(void) const
 	return "tensor_" + cify_name(name);
 }
 
+std::string Tensor::accumulator_type_str(void) const
+{
+	if( data_type == onnx::TensorProto_DataType_FLOAT16
+	 || data_type == onnx::TensorProto_DataType_BFLOAT16 )
+		return "float";
+	return data_type_str();
+}
 int Tensor::data_elem_size(void)const
 {
 	switch( data_type )
@@ -151,6 +167,9 @@ int Tensor::data_elem_size(void)const
 			return sizeof(float); break;
 		case onnx::TensorProto_DataType_DOUBLE:
 			return sizeof(double); break;
+		case onnx::TensorProto_DataType_FLOAT16:
+		case onnx::TensorProto_DataType_BFLOAT16:
+			return sizeof(uint16_t); break;
 		case onnx::TensorProto_DataType_INT8:
 			return sizeof(int8_t); break;
 		case onnx::TensorProto_DataType_UINT8:
@@ -183,6 +202,10 @@ std::string Tensor::data_type_str(void) const
 			return "float"; break;
 		case onnx::TensorProto_DataType_DOUBLE:
 			return "double"; break;
+		case onnx::TensorProto_DataType_FLOAT16:
+			return "onnx2c_float16"; break;
+		case onnx::TensorProto_DataType_BFLOAT16:
+			return "onnx2c_bfloat16"; break;
 		case onnx::TensorProto_DataType_INT8:
 			return "int8_t"; break;
 		case onnx::TensorProto_DataType_UINT8:
@@ -226,6 +249,12 @@ void Tensor::print_element(std::ostream &dst, uint64_t element) const
 			dst << std::showpoint << f[element]<< "f";
 			break;
 		}
+		case onnx::TensorProto_DataType_FLOAT16:
+		case onnx::TensorProto_DataType_BFLOAT16:
+		{
+			dst << std::showpoint << get_data_element_float(element) << "f";
+			break;
+		}
 		case onnx::TensorProto_DataType_INT8:
 		{
 			int8_t *f = static_cast<int8_t*>(data_buffer);
@@ -297,6 +326,14 @@ void Tensor::print_element(std::ostream &dst, uint64_t element) const
  */
 void Tensor::print_tensor_initializer(std::ostream &dst, int dim, int offs) const
 {
+	if( pack_bits ) {
+		print_packed_initializer(dst);
+		return;
+	}
+	if( sparse_axis >= 0 ) {
+		print_sparse_initializer(dst);
+		return;
+	}
 	if( data_dim[dim] == 0 )
 		return;
 
@@ -339,21 +376,7 @@ void Tensor::print_tensor_initializer(std::ostream &dst, int dim, int offs) cons
 
 void Tensor::print_tensor(std::ostream &dst, bool is_callsite, std::string alternate_name, bool as_const) const
 {
-	if( is_callsite == false ) {
-		if( isConst || as_const )
-			dst << "const ";
-		dst << data_type_str() << " ";
-	}
-	else if( union_no >= 0 ) {
-		dst << "tu" << union_no << ".";
-	}
-	if( alternate_name == "" )
-		dst << cname();
-	else
-		dst << alternate_name;
-	if( is_callsite == false )
-		for( unsigned i : data_dim )
-			dst << "[" << i << "]";
+	dst << print_tensor(alternate_name, is_callsite, as_const);
 }
 
 std::string Tensor::print_tensor(std::string alternate_name, bool is_callsite, bool as_const) const
@@ -362,7 +385,7 @@ std::string Tensor::print_tensor(std::string alternate_name, bool is_callsite, b
 	if( is_callsite == false ) {
 		if( isConst || as_const )
 			rv += "const ";
-		rv += data_type_str() + " ";
+		rv += (pack_bits ? "uint8_t" : data_type_str()) + " ";
 	}
 	else if( union_no >= 0 ) {
 		rv += "tu" + std::to_string(union_no) + ".";
@@ -372,13 +395,167 @@ std::string Tensor::print_tensor(std::string alternate_name, bool is_callsite, b
 	else
 		rv += alternate_name;
 
-	if( is_callsite == false )
+	if( is_callsite == false && pack_bits )
+		rv += "[" + std::to_string(packed_size()) + "]";
+	else if( is_callsite == false && sparse_axis >= 0 )
+		rv += "[" + std::to_string(std::max(nonzero_count(), 1)) + "]";
+	else if( is_callsite == false )
 		for( unsigned i : data_dim )
 			rv += "[" + std::to_string(i) + "]";
 
 	return rv;
 }
 
+std::string Tensor::print_tensor_as_pointer(std::string name, bool as_const, const std::string &qualifier) const
+{
+	std::string rv = "";
+	if( isConst || as_const )
+		rv += "const ";
+	rv += (pack_bits ? "uint8_t" : data_type_str()) + " ";
+
+	std::string ptr = "*";
+	if( qualifier != "" )
+		ptr += " " + qualifier;
+	if( name != "" )
+		ptr += " " + name;
+
+	if( rank() == 1 || pack_bits || sparse_axis >= 0 )
+		return rv + ptr;
+
+	rv += "(" + ptr + ")";
+	for( unsigned i=1; i<rank(); i++ )
+		rv += "[" + std::to_string(data_dim[i]) + "]";
+	return rv;
+}
+
+int Tensor::packed_size(void) const
+{
+	if( pack_columns ) {
+		int column_bytes = (data_dim[0]*pack_bits + 7) / 8;
+		return data_dim[1] * column_bytes;
+	}
+	return (data_num_elem()*pack_bits + 7) / 8;
+}
+
+std::string Tensor::packed_element(const std::string &name, const std::string &index) const
+{
+	if( pack_columns )
+		ERROR("Tensor " << name << " is packed by columns");
+	if( pack_bits == 16 )
+		return std::string(pack_bfloat16 ? "onnx2c_bf16(" : "onnx2c_fp16(") + name + ", " + index + ")";
+	if( pack_bits == 4 )
+		return "onnx2c_int4(" + name + ", " + index + ")";
+	return "onnx2c_bipolar(" + name + ", " + index + ")";
+}
+
+std::string Tensor::rounding_error(void) const
+{
+	double max_error = 0;
+	double square_error = 0;
+	double square_sum = 0;
+	for( int e=0; e<data_num_elem(); e++ ) {
+		float f = get_data_element_float(e);
+		double error = f - float_from_16bit(float_to_16bit(f, pack_bfloat16), pack_bfloat16);
+		max_error = std::max(max_error, std::fabs(error));
+		square_error += error*error;
+		square_sum += (double)f*f;
+	}
+	std::ostringstream rv;
+	rv.precision(3);
+	rv << "Max abs error " << max_error << ", relative RMS error ";
+	rv << (square_sum > 0 ? std::sqrt(square_error / square_sum) : 0);
+	return rv.str();
+}
+
+int Tensor::nonzero_count(void) const
+{
+	int count = 0;
+	for( int e=0; e<data_num_elem(); e++ )
+		if( element_is_zero(e) == false )
+			count++;
+	return count;
+}
+
+void Tensor::sparse_layout(std::vector<int> &starts, std::vector<int> &indices) const
+{
+	int channels = data_dim[sparse_axis];
+	int inner = 1;
+	for( unsigned d=sparse_axis+1; d<rank(); d++ )
+		inner *= data_dim[d];
+	int outer = data_num_elem() / channels / inner;
+	starts.clear();
+	indices.clear();
+	for( int ch=0; ch<channels; ch++ ) {
+		starts.push_back(indices.size());
+		for( int o=0; o<outer; o++ )
+			for( int i=0; i<inner; i++ )
+				if( element_is_zero((o*channels + ch)*inner + i) == false )
+					indices.push_back(o*inner + i);
+	}
+	starts.push_back(indices.size());
+}
+
+/* The nonzero elements, in the order of sparse_layout() */
+void Tensor::print_sparse_initializer(std::ostream &dst) const
+{
+	std::vector<int> starts, indices;
+	sparse_layout(starts, indices);
+	int channels = data_dim[sparse_axis];
+	int inner = 1;
+	for( unsigned d=sparse_axis+1; d<rank(); d++ )
+		inner *= data_dim[d];
+
+	dst << "{";
+	for( int ch=0; ch<channels; ch++ )
+		for( int j=starts[ch]; j<starts[ch+1]; j++ ) {
+			int o = indices[j] / inner;
+			int i = indices[j] % inner;
+			if( j % 8 == 0 )
+				dst << std::endl << "  ";
+			print_element(dst, (o*channels + ch)*inner + i);
+			if( j < starts[channels]-1 )
+				dst << ", ";
+		}
+	if( indices.size() == 0 )
+		dst << " 0";
+	dst << std::endl << "}";
+}
+
+/* Elements as packed bytes, columns one after the other with pack_columns.
+ * 16 bit floats are two bytes each, low byte first. */
+void Tensor::print_packed_initializer(std::ostream &dst) const
+{
+	std::vector<uint8_t> bytes(packed_size(), 0);
+	int rows = pack_columns ? data_dim[0] : data_num_elem();
+	int cols = pack_columns ? data_dim[1] : 1;
+	int column_bits = 8 * (pack_columns ? bytes.size() / cols : bytes.size());
+	for( int e=0; pack_bits == 16 && e<data_num_elem(); e++ ) {
+		uint16_t h = float_to_16bit(get_data_element_float(e), pack_bfloat16);
+		bytes[2*e] = h & 0xff;
+		bytes[2*e+1] = h >> 8;
+	}
+	for( int c=0; pack_bits != 16 && c<cols; c++ )
+		for( int r=0; r<rows; r++ ) {
+			int e = r*cols + c;
+			int value = data_type == onnx::TensorProto_DataType_FLOAT ? get_data_element_float(e) : get_data_element(e);
+			int bit = c*column_bits + r*pack_bits;
+			if( pack_bits == 4 )
+				bytes[bit/8] |= (value & 0xf) << (bit%8);
+			else if( value > 0 )
+				bytes[bit/8] |= 1 << (bit%8);
+		}
+
+	dst << "{";
+	for( unsigned i=0; i<bytes.size(); i++ ) {
+		if( i % 16 == 0 )
+			dst << std::endl << "  ";
+		dst << static_cast<int>(bytes[i]);
+		if( i < bytes.size()-1 )
+			dst << ", ";
+	}
+	dst << std::endl << "}";
+}
+
 int Tensor::data_num_elem(void) const
 {
 	int dim=1;
@@ -393,6 +570,24 @@ unsigned Tensor::rank(void) const
 	return data_dim.size();
 }
 
+std::string Tensor::str_dim(unsigned i) const
+{
+	if( i == 0 && runtime_dim != "" )
+		return runtime_dim_cname(runtime_dim);
+	return std::to_string(data_dim[i]);
+}
+
+std::string Tensor::str_num_elem(void) const
+{
+	if( runtime_dim == "" )
+		return std::to_string(data_num_elem());
+
+	int inner=1;
+	for( unsigned i=1; i<rank(); i++ )
+		inner *= data_dim[i];
+	return runtime_dim_cname(runtime_dim) + "*" + std::to_string(inner);
+}
+
 std::string Tensor::str_dimensions(void) const
 {
 	std::string rv = "";
@@ -422,6 +617,7 @@ Tensor* Tensor::make_quantized_copy(void)
 	t->isRecursive = isRecursive;
 	// TODO: alias?
 	t->isQuantized = true;
+	t->quantizedFrom = this;
 	quantizedCopy = t;
 
 	t->data_dim = data_dim;
@@ -469,6 +665,7 @@ Tensor* Tensor::make_quantized_copy(void)
 			maxval = -minval;
 
 
+		t->quant_scales = { maxval > 0 ? maxval/127 : 1 };
 		for( int i=0; i<data_num_elem(); i++) {
 			float fv = (odata[i] / maxval) * 127;
 			assert( fv <= 127 );
@@ -509,6 +706,14 @@ int64_t Tensor::get_data_element(uint64_t i) const
 {
 	switch( data_type )
 	{
+		case onnx::TensorProto_DataType_INT8:
+			return ((int8_t*)data_buffer)[i];
+		case onnx::TensorProto_DataType_UINT8:
+			return ((uint8_t*)data_buffer)[i];
+		case onnx::TensorProto_DataType_INT16:
+			return ((int16_t*)data_buffer)[i];
+		case onnx::TensorProto_DataType_UINT16:
+			return ((uint16_t*)data_buffer)[i];
 		case onnx::TensorProto_DataType_INT32:
 			return ((int32_t*)data_buffer)[i];
 		case onnx::TensorProto_DataType_INT64:
@@ -519,12 +724,22 @@ int64_t Tensor::get_data_element(uint64_t i) const
 
 	return INT64_MIN;
 }
+bool Tensor::element_is_zero(uint64_t i) const
+{
+	if( isFloat(data_type) )
+		return get_data_element_float(i) == 0;
+	return get_data_element(i) == 0;
+}
+
 float Tensor::get_data_element_float(uint64_t i) const
 {
 	switch( data_type )
 	{
 		case onnx::TensorProto_DataType_FLOAT:
 			return ((float*)data_buffer)[i];
+		case onnx::TensorProto_DataType_FLOAT16:
+		case onnx::TensorProto_DataType_BFLOAT16:
+			return float_from_16bit(((uint16_t*)data_buffer)[i], data_type == onnx::TensorProto_DataType_BFLOAT16);
 		default:
 			ERROR("Unhandled data type");
 	}
@@ -543,9 +758,70 @@ std::string Tensor::print_trace_dump(void) const
 		   << "  const " << isConst
 		   << "  recurs " << isRecursive
 		   << "  dims { " << str_dimensions() << "}"
+		   << "  runtime_dim " << runtime_dim
 		   << "  buffer " << data_buffer
 		;
 
 	return rv.str();
 }
 
+float Tensor::quant_scale(unsigned channel) const
+{
+	if( quant_scales.size() == 0 )
+		ERROR("Tensor " << name << " has no quantization scale");
+	if( quant_axis < 0 )
+		return quant_scales[0];
+	return quant_scales[channel];
+}
+
+/* Index of dimension 'axis' of the i:th element */
+static unsigned channel_of(const std::vector<int> &dims, int axis, int i)
+{
+	if( axis < 0 )
+		return 0;
+	int inner = 1;
+	for( unsigned d=axis+1; d<dims.size(); d++ )
+		inner *= dims[d];
+	return (i / inner) % dims[axis];
+}
+
+void Tensor::quantize_per_channel(int axis)
+{
+	if( quantizedFrom == NULL || quantizedFrom->data_buffer == NULL )
+		ERROR("Tensor " << name << " is not a quantized copy of a constant");
+	unsigned channels = axis < 0 ? 1 : data_dim[axis];
+	std::vector<float> absmax(channels, 0);
+	for( int i=0; i<data_num_elem(); i++) {
+		unsigned c = channel_of(data_dim, axis, i);
+		absmax[c] = std::max(absmax[c], std::fabs(quantizedFrom->get_data_element_float(i)));
+	}
+
+	std::vector<float> scales;
+	for( float m : absmax )
+		scales.push_back( m > 0 ? m/127 : 1 );
+	quantize_with_scales(axis, scales, onnx::TensorProto_DataType_INT8);
+}
+
+void Tensor::quantize_with_scales(int axis, const std::vector<float> &scales, onnx::TensorProto_DataType type)
+{
+	if( quantizedFrom == NULL || quantizedFrom->data_buffer == NULL )
+		ERROR("Tensor " << name << " is not a quantized copy of a constant");
+	if( type != onnx::TensorProto_DataType_INT8 && type != onnx::TensorProto_DataType_INT32 )
+		ERROR("Unimplemented: quantization to " << type);
+
+	quant_axis = axis;
+	quant_scales = scales;
+	data_type = type;
+	free(data_buffer);
+	data_buffer = calloc(data_num_elem(), data_elem_size());
+
+	double limit = type == onnx::TensorProto_DataType_INT8 ? 127 : INT32_MAX;
+	for( int i=0; i<data_num_elem(); i++) {
+		double q = std::round(quantizedFrom->get_data_element_float(i) / quant_scale(channel_of(data_dim, axis, i)));
+		q = std::min(std::max(q, -limit), limit);
+		if( type == onnx::TensorProto_DataType_INT8 )
+			((int8_t*)data_buffer)[i] = q;
+		else
+			((int32_t*)data_buffer)[i] = q;
+	}
+}
@@ -5,6 +5,9 @@
 
 namespace toC {
 
+// Alignment of the graph internal tensors with the 'align' optimization pass
+const unsigned TENSOR_ALIGNMENT = 64;
+
 class Node;
 // A entity that implements ONNX graph edges,
 // i.e. the data buffers a ONNX node produces or consumes
@@ -19,7 +22,39 @@ class Tensor {
 	                 // may additionally be used as input for other nodes
 	Tensor *quantizedCopy; // non-NULL if there is a quantized version of this
 	bool isQuantized;  // is this a quantized copy
+	const Tensor *quantizedFrom; // the original of a quantized copy
+	// Calibrated quantization (see options.quant_ranges): the real value of an
+	// element is the quantized value times a scale. Weights can have a separate
+	// scale for each index of dimension quant_axis. Other tensors have one scale.
+	std::vector<float> quant_scales;
+	int quant_axis;
 	std::vector<int> data_dim;
+	// Low-bit storage of constant weights ('--pack-weights'). 0 for not packed,
+	// 4 for two's complement nibbles, 1 for -1/+1 as bits 0/1. Low bits first.
+	// With pack_columns, a 2D tensor is packed column by column, each column
+	// padded to whole bytes. Otherwise the elements are packed in C order.
+	// Float weights can be stored as 16 bits ('--weights'): IEEE half, or
+	// bfloat16 with pack_bfloat16. Each is two bytes, low byte first.
+	// data_buffer keeps the unpacked values.
+	int pack_bits;
+	bool pack_columns;
+	bool pack_bfloat16;
+	// Sparse storage of constant weights ('--sparse'). The dimension that
+	// indexes the output channels, -1 for dense. Only the nonzero elements
+	// are stored, one output channel after the other, each in C order.
+	// The nodes print the index tables (see sparse_layout()).
+	int sparse_axis;
+	// Constant values written into the code of the nodes using the tensor
+	// ('--inline-weights'). The tensor is then not printed, nor passed to the nodes.
+	bool inlined;
+	bool bipolar;   // Values are known to be -1 or +1 at run time
+	// A constant variance that BatchNormalization has replaced with
+	// sqrt(variance + epsilon), with this epsilon. Negative if not.
+	float sqrt_var_epsilon;
+	// Name of the graph input dimension (ONNX dim_param) if the outermost
+	// dimension of this tensor is variable at run time. Empty for fixed size.
+	// data_dim[0] then holds the maximum size, which is used for allocation.
+	std::string runtime_dim;
 	onnx::TensorProto_DataType data_type;
 	void *data_buffer;// if initialized, contains the initialization data
 	std::string name; // NB: ONNX name. Might not be valid for C
@@ -36,6 +71,15 @@ class Tensor {
 		isRecursive(false),
 		quantizedCopy(NULL),
 		isQuantized(false),
+		quantizedFrom(NULL),
+		quant_axis(-1),
+		pack_bits(0),
+		pack_columns(false),
+		pack_bfloat16(false),
+		sparse_axis(-1),
+		inlined(false),
+		bipolar(false),
+		sqrt_var_epsilon(-1),
 		data_buffer(NULL),
 		union_no(-1)
 	{}
@@ -55,8 +99,18 @@ class Tensor {
 	/* Number of data dimensions */
 	unsigned rank(void) const;
 
+	/* Size of dimension i as a C expression. This is the plain number,
+	 * or the name of the run time variable for a variable dimension. */
+	std::string str_dim(unsigned i) const;
+	/* Same as data_num_elem(), but as a C expression that takes
+	 * a run time variable dimension into account */
+	std::string str_num_elem(void) const;
+
 	/* A string with the the C type for this tensor's data element. E.g. "float" */
 	std::string data_type_str(void) const;
+	/* The C type to sum this tensor's elements in. Float for the 16 bit floats,
+	 * that are for storage. Otherwise the data type. */
+	std::string accumulator_type_str(void) const;
 
 	/* Fill this Tensor from the ONNX TensorProto */
 	/* TODO: would this not be nicer as a constructor? :) */
@@ -89,12 +143,34 @@ class Tensor {
 	{
 		return print_tensor( alternate_name, false, true );
 	}
+	/* Print as a function parameter in pointer-to-array form, which
+	 * unlike the array form can be qualified in both C and C++.
+	 * E.g. "const float (* RESTRICT name)[2][3]" */
+	std::string print_tensor_as_pointer(std::string name, bool as_const, const std::string &qualifier) const;
 
 
 	/* Print a tensor's initialization to output stream.
 	 * i.e. everything after the "=" in "float foo[43] = { 42, 42, ... };"
 	 * Do not override dim and offs - used only by the function when it recurses into itself. */
 	void print_tensor_initializer(std::ostream &destination, int dim=0, int offs=0) const;
+	void print_packed_initializer(std::ostream &destination) const;
+
+	/* Description of the error from storing the values as 16 bit floats */
+	std::string rounding_error(void) const;
+	/* Number of bytes of a packed tensor */
+	int packed_size(void) const;
+	/* C expression unpacking element 'index' (in C order) of a
+	 * packed tensor that is named 'name' in the generated code */
+	std::string packed_element(const std::string &name, const std::string &index) const;
+
+	/* Number of nonzero elements */
+	int nonzero_count(void) const;
+	/* Layout of a sparse tensor: 'starts' has the index of the first stored
+	 * element of each output channel, and the number of stored elements last.
+	 * 'indices' has the position of each stored element within its channel,
+	 * as a C order index to the tensor without the sparse_axis dimension. */
+	void sparse_layout(std::vector<int> &starts, std::vector<int> &indices) const;
+	void print_sparse_initializer(std::ostream &destination) const;
 
 	/* Print the i:th element in data_buffer */
 	void print_element(std::ostream &dst, uint64_t i) const;
@@ -104,6 +180,16 @@ class Tensor {
 
 	Tensor* make_quantized_copy(void);
 
+	/* Scale of the quantized elements at index 'channel' of dimension quant_axis */
+	float quant_scale(unsigned channel=0) const;
+	/* Redo the data of a quantized copy of a constant tensor from the original.
+	 * quantize_per_channel() quantizes to int8 with symmetric scales for each index of
+	 * dimension 'axis', or with one scale when 'axis' is negative.
+	 * quantize_with_scales() uses the given scales, and can quantize to wider types,
+	 * e.g. an int32 bias with the scale of the accumulator it is added to. */
+	void quantize_per_channel(int axis);
+	void quantize_with_scales(int axis, const std::vector<float> &scales, onnx::TensorProto_DataType type);
+
 	/* Node definitions include the concept of optional inputs/outputs.
 	 * This function tells wether a given tensor must be included or if it can be left out.
 	 * This will return valid data only after all nodes have been resolved! (I.e. use it during printout phase)
@@ -113,6 +199,8 @@ class Tensor {
 	/* Get the data element at index i. Flattening multidimensional arrays down to the index is left for the caller. */
 	int64_t get_data_element(uint64_t i) const;
 	float get_data_element_float(uint64_t i) const;
+	/* Is the data element at index i zero, in any integer or float type */
+	bool element_is_zero(uint64_t i) const;
 
 
 	void assign_union(uint32_t u) {
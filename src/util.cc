@@ -1,6 +1,8 @@
 /* This file is part of onnx2c
  */
 
+#include <cmath>
+#include <cstring>
 #include "error.h"
 #include "options.h"
 #include "tensor.h"
@@ -21,6 +23,11 @@ std::string cify_name(const std::string &in)
 	return rv;
 }
 
+std::string runtime_dim_cname(const std::string &dim_param)
+{
+	return "dim_" + cify_name(dim_param);
+}
+
 
 int parse_attribute_int(const onnx::AttributeProto &a)
 {
@@ -98,6 +105,32 @@ toC::Tensor* parse_attribute_tensor(const onnx::AttributeProto &a)
 	return t;
 }
 
+int node_attribute_int(const onnx::NodeProto &n, const std::string &name, int default_value)
+{
+	for( auto &a : n.attribute() )
+		if( a.name() == name )
+			return parse_attribute_int(a);
+	return default_value;
+}
+
+int listed_rank(const onnx::GraphProto &g, const std::string &name)
+{
+	for( auto list : { &g.input(), &g.value_info(), &g.output() } )
+		for( auto &vi : *list )
+			if( vi.name() == name && vi.type().tensor_type().has_shape() )
+				return vi.type().tensor_type().shape().dim_size();
+	return -1;
+}
+
+int64_t model_opset(const onnx::ModelProto &m)
+{
+	int64_t opset = 1;
+	for( auto &o : m.opset_import() )
+		if( o.domain() == "" || o.domain() == "ai.onnx" )
+			opset = o.version();
+	return opset;
+}
+
 std::string constant_acces_code(const std::string plain)
 {
 	if( !options.target_avr )
@@ -141,7 +174,9 @@ std::string cast_to_ndim_arrayptr(const toC::Tensor *t, std::string shortname)
 bool isFloat(onnx::TensorProto_DataType data_type)
 {
 	return data_type == onnx::TensorProto_DataType_FLOAT
-	     ||data_type == onnx::TensorProto_DataType_DOUBLE;
+	     ||data_type == onnx::TensorProto_DataType_DOUBLE
+	     ||data_type == onnx::TensorProto_DataType_FLOAT16
+	     ||data_type == onnx::TensorProto_DataType_BFLOAT16;
 }
 bool isInt(onnx::TensorProto_DataType data_type)
 {
@@ -155,3 +190,49 @@ bool isInt(onnx::TensorProto_DataType data_type)
 	     ||data_type == onnx::TensorProto_DataType_INT64;
 }
 
+
+uint16_t float_to_16bit(float f, bool bfloat16)
+{
+	uint32_t x;
+	memcpy(&x, &f, 4);
+	if( bfloat16 ) {
+		if( std::isnan(f) )
+			return (x >> 16) | 0x40;
+		x += 0x7fff + ((x >> 16) & 1);
+		return x >> 16;
+	}
+
+	uint16_t sign = (x >> 16) & 0x8000;
+	uint32_t absx = x & 0x7fffffff;
+	if( absx > 0x7f800000 )
+		return sign | 0x7e00;
+	// Rounds to infinity
+	if( absx >= 0x477ff000 )
+		return sign | 0x7c00;
+	// Subnormal, in units of 2^-24
+	if( absx < 0x38800000 )
+		return sign | (uint16_t)std::nearbyint(std::fabs(f) * 16777216.0f);
+	// Rebias the exponent from 127 to 15
+	absx += 0xfff + ((absx >> 13) & 1);
+	return sign | ((absx - (112 << 23)) >> 13);
+}
+
+float float_from_16bit(uint16_t h, bool bfloat16)
+{
+	if( bfloat16 ) {
+		uint32_t x = (uint32_t)h << 16;
+		float f;
+		memcpy(&f, &x, 4);
+		return f;
+	}
+	int e = (h >> 10) & 0x1f;
+	int m = h & 0x3ff;
+	float f;
+	if( e == 0 )
+		f = std::ldexp((float)m, -24);
+	else if( e == 31 )
+		f = m ? NAN : INFINITY;
+	else
+		f = std::ldexp((float)(m + 1024), e - 25);
+	return h & 0x8000 ? -f : f;
+}
@@ -7,6 +7,9 @@
 /* ONNX names are not valid C - make name acceptable to the C compiler*/
 std::string cify_name(const std::string &in);
 
+/* C name of the variable holding a run time variable graph dimension */
+std::string runtime_dim_cname(const std::string &dim_param);
+
 /* Helper functions to parse attributes in a onnx NodeProto */
 int parse_attribute_int(const onnx::AttributeProto &a);
 std::vector<int64_t> parse_attribute_ints(const onnx::AttributeProto &a);
@@ -16,6 +19,15 @@ std::string parse_attribute_string(const onnx::AttributeProto &a);
 std::vector<std::string> parse_attribute_strings(const onnx::AttributeProto &a);
 toC::Tensor* parse_attribute_tensor(const onnx::AttributeProto &a);
 
+/* Helpers for the optimization passes that run on the ONNX model, before
+ * the nodes are resolved. The integer attribute 'name' of node 'n', or
+ * 'default_value' if it is not given. */
+int node_attribute_int(const onnx::NodeProto &n, const std::string &name, int default_value);
+/* Rank of the tensor 'name', if the graph lists its shape. -1 if not. */
+int listed_rank(const onnx::GraphProto &g, const std::string &name);
+/* Version of the default (ai.onnx) operator set the model uses */
+int64_t model_opset(const onnx::ModelProto &m);
+
 /* Wrap all constant accesses into with this function.
  * If targetting AVR, the constants are stored in another memory space than data,
  * this wrapper takes care of that.
@@ -41,3 +53,8 @@ std::string cast_to_ndim_arrayptr(const toC::Tensor *t, const std::string shortn
 bool isFloat(onnx::TensorProto_DataType data_type);
 // is data_type any sort of integer type
 bool isInt(onnx::TensorProto_DataType data_type);
+
+/* Conversion of float to the 16 bit IEEE half or bfloat16 format,
+ * rounding to nearest even, and back */
+uint16_t float_to_16bit(float f, bool bfloat16);
+float float_from_16bit(uint16_t h, bool bfloat16);
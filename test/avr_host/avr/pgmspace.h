@@ -0,0 +1,7 @@
+/* The part of avr-libc's <avr/pgmspace.h> that onnx2c '--avr' code
+ * uses, for running it on the host. The reads are as wide as on the
+ * AVR: pgm_read_byte() of a 16 bit value gives only its low byte. */
+#include <stdint.h>
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
@@ -0,0 +1,59 @@
+# Generate the local tests of scaled dot-product attention,
+# MatMul -> Div/Mul -> Softmax -> MatMul (optimization pass 'attention').
+
+import numpy as np
+import onnxruntime as ort
+from onnx import helper, numpy_helper, TensorProto
+from pathlib import Path
+
+np.random.seed(11)
+
+def save_tensor(t, fn):
+	with open(fn, 'wb') as f:
+		f.write(numpy_helper.from_array(t).SerializeToString())
+
+def save_test(test_name, nodes, inputs, initializers):
+	g = helper.make_graph(nodes, test_name,
+		[helper.make_tensor_value_info(n, TensorProto.FLOAT, s) for n, s in inputs],
+		[helper.make_tensor_value_info('Y', TensorProto.FLOAT, None)],
+		initializers)
+	m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+	m.ir_version = 8
+
+	Path(test_name).mkdir(parents=True, exist_ok=True)
+	with open(test_name + "/model.onnx", 'wb') as f:
+		f.write(m.SerializeToString())
+	sess = ort.InferenceSession(m.SerializeToString())
+	d = test_name + "/test_data_set_0"
+	Path(d).mkdir(parents=True, exist_ok=True)
+	feed = {}
+	for i, (n, s) in enumerate(inputs):
+		feed[n] = np.random.randn(*s).astype(np.float32)
+		save_tensor(feed[n], d + "/input_" + str(i) + ".pb")
+	save_tensor(sess.run(None, feed)[0], d + "/output_0.pb")
+
+# K in [T, D] layout, transposed in the graph, and a sequence
+# longer than one tile of scores
+S, D, T = 20, 8, 40
+save_test("test_attention_transposed_k", [
+		helper.make_node('Transpose', ['K'], ['Kt'], perm=[1,0]),
+		helper.make_node('MatMul', ['Q', 'Kt'], ['scores']),
+		helper.make_node('Div', ['scores', 'sqrt_d'], ['scaled']),
+		helper.make_node('Softmax', ['scaled'], ['probs'], axis=-1),
+		helper.make_node('MatMul', ['probs', 'V'], ['Y']),
+	],
+	[('Q', [S,D]), ('K', [T,D]), ('V', [T,D])],
+	[numpy_helper.from_array(np.array(np.sqrt(D), dtype=np.float32), 'sqrt_d')])
+
+# Two heads, K shared by the heads, scale from a Constant node
+S, D, T, Dv = 6, 4, 9, 5
+save_test("test_attention_batched", [
+		helper.make_node('MatMul', ['Q', 'K'], ['scores']),
+		helper.make_node('Constant', [], ['scale'],
+			value=numpy_helper.from_array(np.array(0.5, dtype=np.float32))),
+		helper.make_node('Mul', ['scores', 'scale'], ['scaled']),
+		helper.make_node('Softmax', ['scaled'], ['probs'], axis=3),
+		helper.make_node('MatMul', ['probs', 'V'], ['Y']),
+	],
+	[('Q', [1,2,S,D]), ('K', [1,1,D,T]), ('V', [1,2,T,Dv])],
+	[])
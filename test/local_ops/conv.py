@@ -0,0 +1,41 @@
+# Generate the local Conv regression tests
+
+import numpy as np
+import onnxruntime as ort
+from onnx import helper, numpy_helper, TensorProto
+from pathlib import Path
+
+def save_tensor(t, fn):
+	with open(fn, 'wb') as f:
+		npt = numpy_helper.from_array(t)
+		f.write(npt.SerializeToString())
+
+def save_test(test_name, x_shape, w_shape, **attributes):
+	X = np.random.rand(*x_shape).astype(np.float32)
+	W = np.random.rand(*w_shape).astype(np.float32)
+	B = np.random.rand(w_shape[0]).astype(np.float32)
+
+	n1 = helper.make_node('Conv', inputs=['X','W','B'], outputs=['Y'], **attributes)
+	g = helper.make_graph([n1], test_name,
+	                      [helper.make_tensor_value_info('X', TensorProto.FLOAT, X.shape)],
+	                      [helper.make_tensor_value_info('Y', TensorProto.FLOAT, None)],
+	                      [numpy_helper.from_array(W, 'W'), numpy_helper.from_array(B, 'B')])
+	m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+	m.ir_version = 8
+
+	Path(test_name + "/test_data_set_0").mkdir(parents=True, exist_ok=True)
+	with open(test_name + "/model.onnx", 'wb') as f:
+		f.write(m.SerializeToString())
+	sess = ort.InferenceSession(m.SerializeToString())
+	result = sess.run(["Y"], {"X": X})
+
+	save_tensor(X, test_name + "/test_data_set_0/input_0.pb")
+	save_tensor(result[0], test_name + "/test_data_set_0/output_0.pb")
+
+group=2
+save_test("test_conv_groups_dilations_pads", (1, 4, 9, 8), (6, 4//group, 3, 3),
+          group=group, dilations=[2,1], pads=[1,2,2,1], strides=[2,1])
+# One input channel per group, and one channel in a batch of two:
+# dimensions of size 1 the flat pointers ('--flat-pointers') must still step over
+save_test("test_conv_depthwise", (1, 3, 7, 6), (3, 1, 3, 3), group=3, pads=[1,1,1,1])
+save_test("test_conv_batch_one_channel", (2, 1, 7, 6), (4, 1, 3, 3), pads=[1,0,1,0])
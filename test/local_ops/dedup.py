@@ -0,0 +1,45 @@
+# Generate the local test for sharing identical initializers (onnx2c
+# optimization pass 'dedup'). The two Gemms have the same weights, as in
+# a tied layer, and all biases are the same.
+
+import numpy as np
+import onnxruntime as ort
+from onnx import helper, numpy_helper, TensorProto
+from pathlib import Path
+
+np.random.seed(42)
+
+def save_tensor(t, fn):
+	with open(fn, 'wb') as f:
+		npt = numpy_helper.from_array(t)
+		f.write(npt.SerializeToString())
+
+def save_test(test_name, m, inputs, result):
+	Path(test_name).mkdir(parents=True, exist_ok=True)
+	with open(test_name + "/model.onnx", 'wb') as f:
+		f.write(m.SerializeToString())
+	d = test_name + "/test_data_set_0"
+	Path(d).mkdir(parents=True, exist_ok=True)
+	for i, name in enumerate(inputs):
+		save_tensor(inputs[name], d + "/input_" + str(i) + ".pb")
+	for o, r in enumerate(result):
+		save_tensor(r, d + "/output_" + str(o) + ".pb")
+
+test_name = "test_dedup_initializers"
+nodes = [
+	helper.make_node('Gemm', ['X', 'W1', 'B1'], ['G1'], name='gemm1'),
+	helper.make_node('Relu', ['G1'], ['R'], name='relu'),
+	helper.make_node('Gemm', ['R', 'W2', 'B2'], ['G2'], name='gemm2'),
+	helper.make_node('Add', ['G2', 'B3'], ['Y'], name='add'),
+]
+W = np.random.rand(8,8).astype(np.float32) - 0.5
+B = np.random.rand(8).astype(np.float32)
+w = {'W1': W, 'B1': B, 'W2': W.copy(), 'B2': B.copy(), 'B3': B.copy()}
+g = helper.make_graph(nodes, test_name,
+	[helper.make_tensor_value_info('X', TensorProto.FLOAT, [1,8])],
+	[helper.make_tensor_value_info('Y', TensorProto.FLOAT, [1,8])],
+	[numpy_helper.from_array(v, k) for k, v in w.items()])
+m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+m.ir_version = 8
+inputs = {"X": np.random.rand(1,8).astype(np.float32)}
+save_test(test_name, m, inputs, ort.InferenceSession(m.SerializeToString()).run(None, inputs))
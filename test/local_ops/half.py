@@ -0,0 +1,76 @@
+# Generate the local tests for float16 and bfloat16 models: a small
+# convnet that is 16 bit floats end to end. onnx2c sums in float, so the
+# reference is calculated in float, with the values rounded to 16 bits
+# where the model stores them (inputs, weights, and between the nodes).
+
+import numpy as np
+import onnxruntime as ort
+from onnx import helper, numpy_helper, TensorProto
+from pathlib import Path
+
+np.random.seed(42)
+
+def save_tensor(t, fn):
+	with open(fn, 'wb') as f:
+		f.write(t.SerializeToString())
+
+def save_test(test_name, m, inputs, result):
+	Path(test_name).mkdir(parents=True, exist_ok=True)
+	with open(test_name + "/model.onnx", 'wb') as f:
+		f.write(m.SerializeToString())
+	d = test_name + "/test_data_set_0"
+	Path(d).mkdir(parents=True, exist_ok=True)
+	for i, t in enumerate(inputs):
+		save_tensor(t, d + "/input_" + str(i) + ".pb")
+	for o, r in enumerate(result):
+		save_tensor(r, d + "/output_" + str(o) + ".pb")
+
+def fp16(a):
+	return a.astype(np.float16).astype(np.float32)
+
+def bf16(a):
+	bits = a.astype(np.float32).view(np.uint32).astype(np.uint64)
+	bits = (bits + 0x7fff + ((bits >> 16) & 1)) & 0xffff0000
+	return bits.astype(np.uint32).view(np.float32)
+
+# TensorProto of 16 bit float type, from float values that are already rounded
+def tensor16(name, a, elem_type):
+	bits = a.astype(np.float16).view(np.uint16) if elem_type == TensorProto.FLOAT16 else (a.view(np.uint32) >> 16).astype(np.uint16)
+	return helper.make_tensor(name, elem_type, a.shape, bits.tobytes(), raw=True)
+
+nodes = [
+	helper.make_node('Conv', ['X', 'W', 'B'], ['C'], pads=[1,1,1,1], name='conv'),
+	helper.make_node('Relu', ['C'], ['R'], name='relu'),
+	helper.make_node('MaxPool', ['R'], ['P'], kernel_shape=[2,2], strides=[2,2], name='maxpool'),
+	helper.make_node('Flatten', ['P'], ['F'], name='flatten'),
+	helper.make_node('Gemm', ['F', 'Wg', 'Bg'], ['G'], transB=1, name='gemm'),
+	helper.make_node('Softmax', ['G'], ['Y'], axis=1, name='softmax'),
+]
+
+for name, elem_type, rounding in [("float16", TensorProto.FLOAT16, fp16), ("bfloat16", TensorProto.BFLOAT16, bf16)]:
+	test_name = "test_" + name + "_convnet"
+	w = {'W': rounding(np.random.randn(4,2,3,3).astype(np.float32) * 0.3),
+	     'B': rounding(np.random.randn(4).astype(np.float32) * 0.1),
+	     'Wg': rounding(np.random.randn(5,36).astype(np.float32) * 0.3),
+	     'Bg': rounding(np.random.randn(5).astype(np.float32) * 0.1)}
+	X = rounding(np.random.rand(1,2,6,6).astype(np.float32))
+
+	g = helper.make_graph(nodes, test_name,
+		[helper.make_tensor_value_info('X', elem_type, [1,2,6,6])],
+		[helper.make_tensor_value_info('Y', elem_type, [1,5])],
+		[tensor16(k, v, elem_type) for k, v in w.items()])
+	m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+	m.ir_version = 8
+
+	# Reference: the float model, run node by node to round the intermediate tensors
+	ref = {'X': X}
+	ref.update(w)
+	for n in nodes:
+		g32 = helper.make_graph([n], "node",
+			[helper.make_tensor_value_info(i, TensorProto.FLOAT, ref[i].shape) for i in n.input],
+			[helper.make_tensor_value_info(n.output[0], TensorProto.FLOAT, None)])
+		m32 = helper.make_model(g32, opset_imports=[helper.make_opsetid("", 13)])
+		m32.ir_version = 8
+		feeds = {i: ref[i] for i in n.input}
+		ref[n.output[0]] = rounding(ort.InferenceSession(m32.SerializeToString()).run(None, feeds)[0])
+	save_test(test_name, m, [tensor16('X', X, elem_type)], [tensor16('Y', ref['Y'], elem_type)])
@@ -0,0 +1,48 @@
+# Generate the local test for constant weights written into the code
+# with onnx2c '--inline-weights'. The weights are zeros, ones and
+# minus ones, with some other values mixed in.
+
+import numpy as np
+import onnxruntime as ort
+from onnx import helper, numpy_helper, TensorProto
+from pathlib import Path
+
+np.random.seed(42)
+
+def save_tensor(t, fn):
+	with open(fn, 'wb') as f:
+		npt = numpy_helper.from_array(t)
+		f.write(npt.SerializeToString())
+
+def save_test(test_name, m, inputs, result):
+	Path(test_name).mkdir(parents=True, exist_ok=True)
+	with open(test_name + "/model.onnx", 'wb') as f:
+		f.write(m.SerializeToString())
+	d = test_name + "/test_data_set_0"
+	Path(d).mkdir(parents=True, exist_ok=True)
+	for i, name in enumerate(inputs):
+		save_tensor(inputs[name], d + "/input_" + str(i) + ".pb")
+	for o, r in enumerate(result):
+		save_tensor(r, d + "/output_" + str(o) + ".pb")
+
+def weights(shape):
+	values = np.array([-1, 0, 0, 1, 0.5, -2, 0.3], dtype=np.float32)
+	return np.random.choice(values, shape)
+
+test_name = "test_inline_convnet"
+nodes = [
+	helper.make_node('Conv', ['X', 'Wc', 'Bc'], ['C'], pads=[1,0,1,0], strides=[2,1], name='conv'),
+	helper.make_node('Relu', ['C'], ['R'], name='relu'),
+	helper.make_node('Flatten', ['R'], ['F'], name='flatten'),
+	helper.make_node('Gemm', ['F', 'Wg', 'Bg'], ['Y'], alpha=0.5, name='gemm'),
+]
+w = {'Wc': weights((4,3,3,3)), 'Bc': np.random.rand(4).astype(np.float32),
+     'Wg': weights((80,5)), 'Bg': np.random.rand(5).astype(np.float32)}
+g = helper.make_graph(nodes, test_name,
+	[helper.make_tensor_value_info('X', TensorProto.FLOAT, [1,3,7,7])],
+	[helper.make_tensor_value_info('Y', TensorProto.FLOAT, [1,5])],
+	[numpy_helper.from_array(v, k) for k, v in w.items()])
+m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+m.ir_version = 8
+inputs = {"X": np.random.rand(1,3,7,7).astype(np.float32)}
+save_test(test_name, m, inputs, ort.InferenceSession(m.SerializeToString()).run(None, inputs))
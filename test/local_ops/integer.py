@@ -0,0 +1,78 @@
+# Generate the local tests for ConvInteger and MatMulInteger with
+# zero points that the ONNX backend tests don't cover: groups and
+# dilations, weight zero points, and per row/column zero points.
+
+import numpy as np
+import onnxruntime as ort
+from onnx import helper, numpy_helper, TensorProto
+from pathlib import Path
+
+np.random.seed(42)
+
+def save_tensor(t, fn):
+	with open(fn, 'wb') as f:
+		npt = numpy_helper.from_array(t)
+		f.write(npt.SerializeToString())
+
+def save_test(test_name, m, inputs, reference=None):
+	Path(test_name).mkdir(parents=True, exist_ok=True)
+	with open(test_name + "/model.onnx", 'wb') as f:
+		f.write(m.SerializeToString())
+	d = test_name + "/test_data_set_0"
+	Path(d).mkdir(parents=True, exist_ok=True)
+	if reference is None:
+		sess = ort.InferenceSession(m.SerializeToString())
+		result = sess.run(None, inputs)
+	else:
+		result = reference(inputs)
+	for i, name in enumerate(inputs):
+		save_tensor(inputs[name], d + "/input_" + str(i) + ".pb")
+	for o, r in enumerate(result):
+		save_tensor(r, d + "/output_" + str(o) + ".pb")
+
+def c(name, value, dtype):
+	return numpy_helper.from_array(np.array(value, dtype=dtype), name)
+
+
+# ConvInteger: groups, dilations and strides, with input and per channel weight zero points
+test_name = "test_convinteger_groups_zero_points"
+W = np.random.randint(0, 256, (4, 2, 3, 3)).astype(np.uint8)
+n = helper.make_node('ConvInteger',
+	inputs=['X', 'W', 'x_zero_point', 'w_zero_point'],
+	outputs=['Y'], group=2, dilations=[2,1], strides=[1,2])
+g = helper.make_graph([n], test_name,
+	[helper.make_tensor_value_info('X', TensorProto.UINT8, [1,4,8,7])],
+	[helper.make_tensor_value_info('Y', TensorProto.INT32, [1,4,4,3])],
+	[numpy_helper.from_array(W, 'W'), c('x_zero_point', 120, np.uint8), c('w_zero_point', [130, 120, 140, 128], np.uint8)])
+m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+m.ir_version = 8
+# onnxruntime has only per tensor weight zero points: the reference is a float
+# Conv on the inputs with zero points subtracted, which is exact at these sizes
+def convinteger(inputs):
+	Wf = W.astype(np.float32) - np.array([130, 120, 140, 128], np.float32)[:, None, None, None]
+	n = helper.make_node('Conv', inputs=['X', 'W'], outputs=['Y'], group=2, dilations=[2,1], strides=[1,2])
+	g = helper.make_graph([n], test_name,
+		[helper.make_tensor_value_info('X', TensorProto.FLOAT, [1,4,8,7])],
+		[helper.make_tensor_value_info('Y', TensorProto.FLOAT, [1,4,4,3])],
+		[numpy_helper.from_array(Wf, 'W')])
+	sess = ort.InferenceSession(helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)], ir_version=8).SerializeToString())
+	return [r.astype(np.int32) for r in sess.run(None, {"X": inputs["X"].astype(np.float32) - 120})]
+save_test(test_name, m, {"X": np.random.randint(0, 256, (1,4,8,7)).astype(np.uint8)}, convinteger)
+
+
+# MatMulInteger: a zero point per row of A, b zero point per column of B
+test_name = "test_matmulinteger_zero_points"
+B = np.random.randint(-128, 128, (6, 5)).astype(np.int8)
+a_zero = np.random.randint(0, 256, (3,)).astype(np.uint8)
+b_zero = np.random.randint(-128, 128, (5,)).astype(np.int8)
+n = helper.make_node('MatMulInteger', inputs=['A', 'B', 'a_zero_point', 'b_zero_point'], outputs=['Y'])
+g = helper.make_graph([n], test_name,
+	[helper.make_tensor_value_info('A', TensorProto.UINT8, [3,6])],
+	[helper.make_tensor_value_info('Y', TensorProto.INT32, [3,5])],
+	[numpy_helper.from_array(B, 'B'), numpy_helper.from_array(a_zero, 'a_zero_point'), numpy_helper.from_array(b_zero, 'b_zero_point')])
+m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+m.ir_version = 8
+def matmulinteger(inputs):
+	A = inputs["A"].astype(np.int32) - a_zero.astype(np.int32)[:, None]
+	return [A @ (B.astype(np.int32) - b_zero.astype(np.int32))]
+save_test(test_name, m, {"A": np.random.randint(0, 256, (3,6)).astype(np.uint8)}, matmulinteger)
@@ -0,0 +1,65 @@
+# Generate the local tests for LSTMs over several time steps: one with
+# constant weights, that onnx2c lays out for its kernel, and one with the
+# weights as inputs. Both run a backward lane. The third has sequences
+# of different lengths in the batch.
+
+import numpy as np
+import onnxruntime as ort
+from onnx import helper, numpy_helper, TensorProto
+from pathlib import Path
+
+np.random.seed(42)
+
+def save_tensor(t, fn):
+	with open(fn, 'wb') as f:
+		npt = numpy_helper.from_array(t)
+		f.write(npt.SerializeToString())
+
+def save_test(test_name, m, inputs, result):
+	Path(test_name).mkdir(parents=True, exist_ok=True)
+	with open(test_name + "/model.onnx", 'wb') as f:
+		f.write(m.SerializeToString())
+	d = test_name + "/test_data_set_0"
+	Path(d).mkdir(parents=True, exist_ok=True)
+	for i, name in enumerate(inputs):
+		save_tensor(inputs[name], d + "/input_" + str(i) + ".pb")
+	for o, r in enumerate(result):
+		save_tensor(r, d + "/output_" + str(o) + ".pb")
+
+def rand(*shape):
+	return (np.random.rand(*shape).astype(np.float32) - 0.5)
+
+def lstm_test(test_name, direction, constant_weights, sequence_lens=None):
+	dirs = 2 if direction == "bidirectional" else 1
+	seq, bs, ds, hs = 5, 2, 3, 4
+	if sequence_lens is not None:
+		bs = len(sequence_lens)
+	weights = {'W': rand(dirs, 4*hs, ds), 'R': rand(dirs, 4*hs, hs),
+	           'B': rand(dirs, 8*hs),
+	           'initial_h': rand(dirs, bs, hs), 'initial_c': rand(dirs, bs, hs),
+	           'P': rand(dirs, 3*hs)}
+	node = helper.make_node('LSTM', ['X', 'W', 'R', 'B', '' if sequence_lens is None else 'sequence_lens', 'initial_h', 'initial_c', 'P'],
+		['Y', 'Y_h', 'Y_c'], hidden_size=hs, direction=direction, name='lstm')
+	inputs = {'X': rand(seq, bs, ds)}
+	graph_inputs = [helper.make_tensor_value_info('X', TensorProto.FLOAT, [seq, bs, ds])]
+	if sequence_lens is not None:
+		inputs['sequence_lens'] = np.array(sequence_lens, dtype=np.int32)
+		graph_inputs.append(helper.make_tensor_value_info('sequence_lens', TensorProto.INT32, [bs]))
+	if constant_weights:
+		initializers = [numpy_helper.from_array(v, k) for k, v in weights.items()]
+	else:
+		initializers = []
+		inputs.update(weights)
+		graph_inputs += [helper.make_tensor_value_info(k, TensorProto.FLOAT, v.shape) for k, v in weights.items()]
+	g = helper.make_graph([node], test_name, graph_inputs,
+		[helper.make_tensor_value_info('Y', TensorProto.FLOAT, [seq, dirs, bs, hs]),
+		 helper.make_tensor_value_info('Y_h', TensorProto.FLOAT, [dirs, bs, hs]),
+		 helper.make_tensor_value_info('Y_c', TensorProto.FLOAT, [dirs, bs, hs])],
+		initializers)
+	m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 14)])
+	m.ir_version = 8
+	save_test(test_name, m, inputs, ort.InferenceSession(m.SerializeToString()).run(None, inputs))
+
+lstm_test("test_lstm_constant_weights", "bidirectional", True)
+lstm_test("test_lstm_reverse_sequence", "reverse", False)
+lstm_test("test_lstm_sequence_lens", "bidirectional", True, [5, 2, 0, 4])
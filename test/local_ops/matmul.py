@@ -0,0 +1,46 @@
+# Generate the local tests of batched MatMul: broadcast batch dimensions,
+# 1D operands, and weights shared by the whole batch (which can also be
+# stored sparse).
+
+import numpy as np
+import onnxruntime as ort
+from onnx import helper, numpy_helper, TensorProto
+from pathlib import Path
+
+np.random.seed(3)
+
+def save_tensor(t, fn):
+	with open(fn, 'wb') as f:
+		f.write(numpy_helper.from_array(t).SerializeToString())
+
+def save_test(test_name, inputs, initializers={}):
+	nodes = [helper.make_node('MatMul', ['A', 'B'], ['Y'])]
+	g = helper.make_graph(nodes, test_name,
+		[helper.make_tensor_value_info(n, TensorProto.FLOAT, s) for n, s in inputs],
+		[helper.make_tensor_value_info('Y', TensorProto.FLOAT, None)],
+		[numpy_helper.from_array(v, k) for k, v in initializers.items()])
+	m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+	m.ir_version = 8
+
+	Path(test_name).mkdir(parents=True, exist_ok=True)
+	with open(test_name + "/model.onnx", 'wb') as f:
+		f.write(m.SerializeToString())
+	sess = ort.InferenceSession(m.SerializeToString())
+	d = test_name + "/test_data_set_0"
+	Path(d).mkdir(parents=True, exist_ok=True)
+	feed = {}
+	for i, (n, s) in enumerate(inputs):
+		feed[n] = np.random.randn(*s).astype(np.float32)
+		save_tensor(feed[n], d + "/input_" + str(i) + ".pb")
+	save_tensor(sess.run(None, feed)[0], d + "/output_0.pb")
+
+# Both batch dimensions broadcast, from different operands
+save_test("test_matmul_broadcast", [('A', [2,1,3,4]), ('B', [3,4,5])])
+# A 1D A is a row vector
+save_test("test_matmul_1d_batched", [('A', [4]), ('B', [2,3,4,5])])
+# A 1D B is a column vector
+save_test("test_matmul_batched_1d", [('A', [2,3,5,4]), ('B', [4])])
+# Constant weights shared by the batch, mostly zero
+w = np.random.uniform(-1, 1, (6,4)).astype(np.float32)
+w[np.random.rand(6,4) < 0.7] = 0
+save_test("test_matmul_shared_weights", [('A', [2,3,6])], {'B': w})
@@ -0,0 +1,81 @@
+# Generate the local tests for low-bit weights, that onnx2c can store
+# packed with '--pack-weights': integer weights in [-8, 7] in Conv,
+# Gemm and MatMul, and a binarized MLP (bipolar weights and activations)
+# in the style of FINN.
+
+import numpy as np
+import onnxruntime as ort
+from onnx import helper, numpy_helper, TensorProto
+from pathlib import Path
+
+np.random.seed(42)
+
+def save_tensor(t, fn):
+	with open(fn, 'wb') as f:
+		npt = numpy_helper.from_array(t)
+		f.write(npt.SerializeToString())
+
+def save_test(test_name, m, inputs, result):
+	Path(test_name).mkdir(parents=True, exist_ok=True)
+	with open(test_name + "/model.onnx", 'wb') as f:
+		f.write(m.SerializeToString())
+	d = test_name + "/test_data_set_0"
+	Path(d).mkdir(parents=True, exist_ok=True)
+	for i, name in enumerate(inputs):
+		save_tensor(inputs[name], d + "/input_" + str(i) + ".pb")
+	for o, r in enumerate(result):
+		save_tensor(r, d + "/output_" + str(o) + ".pb")
+
+def int4(shape):
+	return np.random.randint(-8, 8, shape).astype(np.float32)
+
+def bipolar(shape):
+	return (2*np.random.randint(0, 2, shape) - 1).astype(np.float32)
+
+
+# 4 bit weights: Conv -> Relu -> Flatten -> Gemm (transB) -> Relu -> MatMul
+test_name = "test_packed_int4"
+nodes = [
+	helper.make_node('Conv', ['X', 'Wc', 'Bc'], ['C'], pads=[1,1,1,1], name='conv'),
+	helper.make_node('Relu', ['C'], ['R1'], name='relu1'),
+	helper.make_node('Flatten', ['R1'], ['F'], name='flatten'),
+	helper.make_node('Gemm', ['F', 'Wg', 'Bg'], ['G'], transB=1, alpha=0.01, name='gemm'),
+	helper.make_node('Relu', ['G'], ['R2'], name='relu2'),
+	helper.make_node('MatMul', ['R2', 'Wm'], ['Y'], name='matmul'),
+]
+g = helper.make_graph(nodes, test_name,
+	[helper.make_tensor_value_info('X', TensorProto.FLOAT, [1,2,5,5])],
+	[helper.make_tensor_value_info('Y', TensorProto.FLOAT, [1,3])],
+	[numpy_helper.from_array(int4((3,2,3,3)), 'Wc'),
+	 numpy_helper.from_array(np.random.rand(3).astype(np.float32), 'Bc'),
+	 numpy_helper.from_array(int4((5,75)), 'Wg'),
+	 numpy_helper.from_array(np.random.rand(5).astype(np.float32), 'Bg'),
+	 numpy_helper.from_array(int4((5,3)), 'Wm')])
+m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+m.ir_version = 8
+inputs = {"X": np.random.rand(1,2,5,5).astype(np.float32)}
+save_test(test_name, m, inputs, ort.InferenceSession(m.SerializeToString()).run(None, inputs))
+
+
+# Binarized MLP: MatMul -> MultiThreshold (to -1/+1) -> MatMul, with
+# bipolar weights. The second MatMul can be run on bits.
+# Inputs are integers and thresholds halfway between, so the reference is exact.
+test_name = "test_packed_bipolar_mlp"
+W1 = bipolar((20,12))
+T = (np.random.randint(-4, 4, (12,1)) + 0.5).astype(np.float32)
+W2 = bipolar((12,5))
+nodes = [
+	helper.make_node('MatMul', ['X', 'W1'], ['H'], name='matmul1'),
+	helper.make_node('MultiThreshold', ['H', 'T'], ['A'], domain='qonnx.custom_op.general',
+		out_scale=2.0, out_bias=-1.0, out_dtype="BIPOLAR", name='threshold'),
+	helper.make_node('MatMul', ['A', 'W2'], ['Y'], name='matmul2'),
+]
+g = helper.make_graph(nodes, test_name,
+	[helper.make_tensor_value_info('X', TensorProto.FLOAT, [1,20])],
+	[helper.make_tensor_value_info('Y', TensorProto.FLOAT, [1,5])],
+	[numpy_helper.from_array(W1, 'W1'), numpy_helper.from_array(T, 'T'), numpy_helper.from_array(W2, 'W2')])
+m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13), helper.make_opsetid("qonnx.custom_op.general", 1)])
+m.ir_version = 8
+X = np.random.randint(-3, 4, (1,20)).astype(np.float32)
+A = np.where(X @ W1 >= T[:,0], 1.0, -1.0).astype(np.float32)
+save_test(test_name, m, {"X": X}, [A @ W2])
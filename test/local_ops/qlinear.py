@@ -0,0 +1,165 @@
+# Generate the local tests for quantized models: QLinearConv with
+# padding, bias and weight zero points, and a network in the QDQ
+# format that onnx2c runs as integer nodes (optimization pass 'qdq').
+
+import numpy as np
+import onnxruntime as ort
+from onnx import helper, numpy_helper, TensorProto
+from pathlib import Path
+
+np.random.seed(42)
+
+def save_tensor(t, fn):
+	with open(fn, 'wb') as f:
+		npt = numpy_helper.from_array(t)
+		f.write(npt.SerializeToString())
+
+def save_test(test_name, m, inputs, num_sets=1):
+	Path(test_name).mkdir(parents=True, exist_ok=True)
+	with open(test_name + "/model.onnx", 'wb') as f:
+		f.write(m.SerializeToString())
+	opts = ort.SessionOptions()
+	opts.graph_optimization_level = ort.GraphOptimizationLevel.ORT_DISABLE_ALL
+	sess = ort.InferenceSession(m.SerializeToString(), opts)
+	for s in range(num_sets):
+		d = test_name + "/test_data_set_" + str(s)
+		Path(d).mkdir(parents=True, exist_ok=True)
+		data = inputs()
+		result = sess.run(None, data)
+		for i, name in enumerate(data):
+			save_tensor(data[name], d + "/input_" + str(i) + ".pb")
+		for o, r in enumerate(result):
+			save_tensor(r, d + "/output_" + str(o) + ".pb")
+
+def c(name, value, dtype):
+	return numpy_helper.from_array(np.array(value, dtype=dtype), name)
+
+
+# QLinearConv: padding, strides, bias and a weight zero point
+test_name = "test_qlinearconv_pads_bias"
+W = np.random.randint(0, 256, (4, 3, 3, 3)).astype(np.uint8)
+B = np.random.randint(-2000, 2000, (4,)).astype(np.int32)
+n = helper.make_node('QLinearConv',
+	inputs=['X', 'x_scale', 'x_zero_point', 'W', 'w_scale', 'w_zero_point', 'y_scale', 'y_zero_point', 'B'],
+	outputs=['Y'], pads=[1,1,1,1], strides=[2,1])
+g = helper.make_graph([n], test_name,
+	[helper.make_tensor_value_info('X', TensorProto.UINT8, [1,3,7,6])],
+	[helper.make_tensor_value_info('Y', TensorProto.UINT8, [1,4,4,6])],
+	[c('x_scale', 0.02, np.float32), c('x_zero_point', 120, np.uint8),
+	 numpy_helper.from_array(W, 'W'), c('w_scale', 0.01, np.float32), c('w_zero_point', 130, np.uint8),
+	 c('y_scale', 0.05, np.float32), c('y_zero_point', 100, np.uint8),
+	 numpy_helper.from_array(B, 'B')])
+m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+m.ir_version = 8
+save_test(test_name, m, lambda: {"X": np.random.randint(0, 256, (1,3,7,6)).astype(np.uint8)})
+
+
+# A network in the QDQ format:
+# Conv(+bias) -> Relu -> MaxPool -> Flatten -> MatMul, with per channel int8 weights.
+# Relu is folded into the quantization range of the Conv output, as quantizers do.
+test_name = "test_qdq_convnet"
+Wc = np.random.uniform(-0.5, 0.5, (4, 2, 3, 3)).astype(np.float32)
+wc_scale = (np.abs(Wc).reshape(4, -1).max(axis=1) / 127).astype(np.float32)
+Wc_q = np.round(Wc / wc_scale[:, None, None, None]).astype(np.int8)
+x_scale, c_scale, m_scale = 1/255, 0.02, 0.03
+Bc_q = np.round(np.random.uniform(-0.2, 0.2, 4) / (x_scale * wc_scale)).astype(np.int32)
+Wm = np.random.uniform(-0.5, 0.5, (36, 5)).astype(np.float32)
+wm_scale = (np.abs(Wm).max(axis=0) / 127).astype(np.float32)
+Wm_q = np.round(Wm / wm_scale).astype(np.int8)
+
+nodes = [
+	helper.make_node('QuantizeLinear', ['X', 'x_scale', 'x_zero'], ['Xq']),
+	helper.make_node('DequantizeLinear', ['Xq', 'x_scale', 'x_zero'], ['Xd']),
+	helper.make_node('DequantizeLinear', ['Wc_q', 'wc_scale', 'wc_zero'], ['Wc'], axis=0),
+	helper.make_node('DequantizeLinear', ['Bc_q', 'bc_scale', 'bc_zero'], ['Bc'], axis=0),
+	helper.make_node('Conv', ['Xd', 'Wc', 'Bc'], ['C'], pads=[1,1,1,1], name='conv'),
+	helper.make_node('QuantizeLinear', ['C', 'c_scale', 'c_zero'], ['Cq']),
+	helper.make_node('DequantizeLinear', ['Cq', 'c_scale', 'c_zero'], ['Cd']),
+	helper.make_node('MaxPool', ['Cd'], ['P'], kernel_shape=[2,2], strides=[2,2], name='pool'),
+	helper.make_node('QuantizeLinear', ['P', 'c_scale', 'c_zero'], ['Pq']),
+	helper.make_node('DequantizeLinear', ['Pq', 'c_scale', 'c_zero'], ['Pd']),
+	helper.make_node('Flatten', ['Pd'], ['F'], name='flatten'),
+	helper.make_node('QuantizeLinear', ['F', 'c_scale', 'c_zero'], ['Fq']),
+	helper.make_node('DequantizeLinear', ['Fq', 'c_scale', 'c_zero'], ['Fd']),
+	helper.make_node('DequantizeLinear', ['Wm_q', 'wm_scale', 'wm_zero'], ['Wm'], axis=1),
+	helper.make_node('MatMul', ['Fd', 'Wm'], ['M'], name='matmul'),
+	helper.make_node('QuantizeLinear', ['M', 'm_scale', 'm_zero'], ['Mq']),
+	helper.make_node('DequantizeLinear', ['Mq', 'm_scale', 'm_zero'], ['Y']),
+]
+g = helper.make_graph(nodes, test_name,
+	[helper.make_tensor_value_info('X', TensorProto.FLOAT, [1,2,6,6])],
+	[helper.make_tensor_value_info('Y', TensorProto.FLOAT, [1,5])],
+	[c('x_scale', x_scale, np.float32), c('x_zero', 0, np.uint8),
+	 numpy_helper.from_array(Wc_q, 'Wc_q'), numpy_helper.from_array(wc_scale, 'wc_scale'), c('wc_zero', [0]*4, np.int8),
+	 numpy_helper.from_array(Bc_q, 'Bc_q'), numpy_helper.from_array((x_scale*wc_scale).astype(np.float32), 'bc_scale'), c('bc_zero', [0]*4, np.int32),
+	 c('c_scale', c_scale, np.float32), c('c_zero', 0, np.uint8),
+	 numpy_helper.from_array(Wm_q, 'Wm_q'), numpy_helper.from_array(wm_scale, 'wm_scale'), c('wm_zero', [0]*5, np.int8),
+	 c('m_scale', m_scale, np.float32), c('m_zero', 128, np.uint8)])
+m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+m.ir_version = 8
+save_test(test_name, m, lambda: {"X": np.random.rand(1,2,6,6).astype(np.float32)})
+
+
+# Elementwise nonlinearities in the QDQ format, which onnx2c runs as
+# lookup tables: int8 and uint8 with zero points, and int16.
+test_name = "test_qdq_activations"
+nodes = [
+	helper.make_node('QuantizeLinear', ['X', 'x_scale', 'x_zero'], ['Xq']),
+	helper.make_node('DequantizeLinear', ['Xq', 'x_scale', 'x_zero'], ['Xd']),
+	helper.make_node('Tanh', ['Xd'], ['T'], name='tanh'),
+	helper.make_node('QuantizeLinear', ['T', 't_scale', 't_zero'], ['Tq']),
+	helper.make_node('DequantizeLinear', ['Tq', 't_scale', 't_zero'], ['Td']),
+	helper.make_node('HardSwish', ['Td'], ['H'], name='hardswish'),
+	helper.make_node('QuantizeLinear', ['H', 'h_scale', 'h_zero'], ['Hq']),
+	helper.make_node('DequantizeLinear', ['Hq', 'h_scale', 'h_zero'], ['Hd']),
+	helper.make_node('Sigmoid', ['Hd'], ['S'], name='sigmoid'),
+	helper.make_node('QuantizeLinear', ['S', 's_scale', 's_zero'], ['Sq']),
+	helper.make_node('DequantizeLinear', ['Sq', 's_scale', 's_zero'], ['Y']),
+	helper.make_node('QuantizeLinear', ['X', 'x16_scale', 'x16_zero'], ['X16q']),
+	helper.make_node('DequantizeLinear', ['X16q', 'x16_scale', 'x16_zero'], ['X16d']),
+	helper.make_node('Elu', ['X16d'], ['E'], name='elu', alpha=0.5),
+	helper.make_node('QuantizeLinear', ['E', 'e_scale', 'e_zero'], ['Eq']),
+	helper.make_node('DequantizeLinear', ['Eq', 'e_scale', 'e_zero'], ['Z']),
+]
+g = helper.make_graph(nodes, test_name,
+	[helper.make_tensor_value_info('X', TensorProto.FLOAT, [1,3,4,5])],
+	[helper.make_tensor_value_info('Y', TensorProto.FLOAT, [1,3,4,5]),
+	 helper.make_tensor_value_info('Z', TensorProto.FLOAT, [1,3,4,5])],
+	[c('x_scale', 0.03, np.float32), c('x_zero', 0, np.int8),
+	 c('t_scale', 1/127, np.float32), c('t_zero', 0, np.int8),
+	 c('h_scale', 0.006, np.float32), c('h_zero', 60, np.uint8),
+	 c('s_scale', 1/255, np.float32), c('s_zero', 0, np.uint8),
+	 c('x16_scale', 0.0002, np.float32), c('x16_zero', 0, np.int16),
+	 c('e_scale', 0.0001, np.float32), c('e_zero', -10000, np.int16)])
+m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 21)])
+m.ir_version = 10
+save_test(test_name, m, lambda: {"X": np.random.uniform(-4, 4, (1,3,4,5)).astype(np.float32)})
+
+
+# Lookup tables with entries of another width than the input: int8 -> int16
+# has 256 entries of two bytes, int16 -> int8 65536 entries of one byte.
+# Also run with '--avr', where the tables are read from program memory.
+test_name = "test_qdq_mixed_width"
+nodes = [
+	helper.make_node('QuantizeLinear', ['X', 'x8_scale', 'x8_zero'], ['X8q']),
+	helper.make_node('DequantizeLinear', ['X8q', 'x8_scale', 'x8_zero'], ['X8d']),
+	helper.make_node('Tanh', ['X8d'], ['T'], name='tanh'),
+	helper.make_node('QuantizeLinear', ['T', 't_scale', 't_zero'], ['Tq']),
+	helper.make_node('DequantizeLinear', ['Tq', 't_scale', 't_zero'], ['Y']),
+	helper.make_node('QuantizeLinear', ['X', 'x16_scale', 'x16_zero'], ['X16q']),
+	helper.make_node('DequantizeLinear', ['X16q', 'x16_scale', 'x16_zero'], ['X16d']),
+	helper.make_node('Sigmoid', ['X16d'], ['S'], name='sigmoid'),
+	helper.make_node('QuantizeLinear', ['S', 's_scale', 's_zero'], ['Sq']),
+	helper.make_node('DequantizeLinear', ['Sq', 's_scale', 's_zero'], ['Z']),
+]
+g = helper.make_graph(nodes, test_name,
+	[helper.make_tensor_value_info('X', TensorProto.FLOAT, [2,3,5])],
+	[helper.make_tensor_value_info('Y', TensorProto.FLOAT, [2,3,5]),
+	 helper.make_tensor_value_info('Z', TensorProto.FLOAT, [2,3,5])],
+	[c('x8_scale', 0.03, np.float32), c('x8_zero', 0, np.int8),
+	 c('t_scale', 1/30000, np.float32), c('t_zero', -100, np.int16),
+	 c('x16_scale', 0.0002, np.float32), c('x16_zero', 0, np.int16),
+	 c('s_scale', 1/127, np.float32), c('s_zero', -60, np.int8)])
+m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 21)])
+m.ir_version = 10
+save_test(test_name, m, lambda: {"X": np.random.uniform(-4, 4, (2,3,5)).astype(np.float32)})
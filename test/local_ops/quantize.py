@@ -0,0 +1,99 @@
+# Generate the local calibrated quantization tests.
+# Data sets 0..7 are both the calibration data (onnx2c --calibrate) and
+# the test data. The tensors are named, as the calibrated tensors are
+# identified by name.
+
+import numpy as np
+import onnxruntime as ort
+from onnx import helper, numpy_helper, TensorProto
+from pathlib import Path
+
+test_name="test_quantize_convnet"
+num_sets=8
+np.random.seed(1)
+
+def init(name, shape, scale=1.0):
+	return numpy_helper.from_array((np.random.randn(*shape)*scale).astype(np.float32), name)
+
+nodes = [
+	helper.make_node('Conv', ['X','W','Wb'], ['conv'], pads=[1,1,1,1]),
+	helper.make_node('Relu', ['conv'], ['relu']),
+	helper.make_node('MaxPool', ['relu'], ['pool'], kernel_shape=[2,2], strides=[2,2]),
+	helper.make_node('Flatten', ['pool'], ['flat']),
+	helper.make_node('Gemm', ['flat','G','Gc'], ['gemm'], transB=1),
+	helper.make_node('MatMul', ['flat','M'], ['matmul']),
+	helper.make_node('Add', ['gemm','matmul'], ['sum']),
+	helper.make_node('Mul', ['sum','S'], ['Y']),
+]
+initializers = [
+	init('W', (4,2,3,3), 0.5),
+	init('Wb', (4,), 0.1),
+	init('G', (10,64), 0.2),
+	init('Gc', (10,), 0.1),
+	init('M', (64,10), 0.1),
+	init('S', (10,), 1.0),
+]
+def save_tensor(t, name, fn):
+	with open(fn, 'wb') as f:
+		f.write(numpy_helper.from_array(t, name).SerializeToString())
+
+def save_test(test_name, nodes, initializers, opset=13):
+	g = helper.make_graph(nodes, test_name,
+	                      [helper.make_tensor_value_info('X', TensorProto.FLOAT, [1,2,8,8])],
+	                      [helper.make_tensor_value_info('Y', TensorProto.FLOAT, [1,10])],
+	                      initializers)
+	m = helper.make_model(g, opset_imports=[helper.make_opsetid("", opset)])
+	m.ir_version = 8
+	Path(test_name).mkdir(parents=True, exist_ok=True)
+	with open(test_name + "/model.onnx", 'wb') as f:
+		f.write(m.SerializeToString())
+
+	sess = ort.InferenceSession(m.SerializeToString())
+	for s in range(num_sets):
+		d = test_name + "/test_data_set_" + str(s)
+		Path(d).mkdir(parents=True, exist_ok=True)
+		X = np.random.rand(1,2,8,8).astype(np.float32)
+		Y = sess.run(["Y"], {"X": X})[0]
+		save_tensor(X, "X", d + "/input_0.pb")
+		save_tensor(Y, "Y", d + "/output_0.pb")
+
+save_test(test_name, nodes, initializers)
+
+
+# Nonlinearities on int8 data, calculated with lookup tables
+test_name="test_quantize_activations"
+nodes = [
+	helper.make_node('Conv', ['X','W','Wb'], ['conv'], pads=[1,1,1,1]),
+	helper.make_node('Tanh', ['conv'], ['tanh']),
+	helper.make_node('Flatten', ['tanh'], ['flat']),
+	helper.make_node('Gemm', ['flat','G','Gc'], ['gemm'], transB=1),
+	helper.make_node('HardSwish', ['gemm'], ['hardswish']),
+	helper.make_node('Sigmoid', ['hardswish'], ['Y']),
+]
+initializers = [
+	init('W', (4,2,3,3), 0.5),
+	init('Wb', (4,), 0.1),
+	init('G', (10,256), 0.2),
+	init('Gc', (10,), 0.1),
+]
+save_test(test_name, nodes, initializers, 14)
+
+
+# Two Gemms with the same bias values, but inputs of different ranges.
+# The bias is quantized at the scale of each Gemm's accumulator, so the
+# 'dedup' pass must not share it.
+test_name="test_quantize_shared_bias"
+nodes = [
+	helper.make_node('Flatten', ['X'], ['flat']),
+	helper.make_node('Gemm', ['flat','G1','C1'], ['gemm1'], transB=1),
+	helper.make_node('Gemm', ['gemm1','G2','C2'], ['gemm2'], transB=1),
+	helper.make_node('Add', ['gemm1','gemm2'], ['Y']),
+]
+C = np.random.randn(10).astype(np.float32)*0.5
+initializers = [
+	init('G1', (10,128), 0.3),
+	numpy_helper.from_array(C, 'C1'),
+	init('G2', (10,10), 0.3),
+	numpy_helper.from_array(C.copy(), 'C2'),
+]
+save_test(test_name, nodes, initializers)
@@ -0,0 +1,72 @@
+# Generate the local test of a graph input dimension that is variable
+# at run time ('-r'). The batch dimension N is symbolic in the model.
+# The test data has fewer rows than the maximum the test generates for.
+
+import numpy as np
+import onnxruntime as ort
+from onnx import helper, numpy_helper, TensorProto
+from pathlib import Path
+
+np.random.seed(14)
+
+def save_tensor(t, fn):
+	with open(fn, 'wb') as f:
+		f.write(numpy_helper.from_array(t).SerializeToString())
+
+def weights(name, shape):
+	return numpy_helper.from_array((0.3*np.random.randn(*shape)).astype(np.float32), name)
+
+# Conv, Relu, Flatten, MatMul, Add, Sigmoid, Gemm and Softmax,
+# which all loop over the run time rows
+test_name = "test_runtime_batch"
+nodes = [
+	helper.make_node('Conv', ['X', 'W'], ['c'], kernel_shape=[3,3]),
+	helper.make_node('Relu', ['c'], ['r']),
+	helper.make_node('Flatten', ['r'], ['f'], axis=1),
+	helper.make_node('MatMul', ['f', 'M'], ['m']),
+	helper.make_node('Add', ['m', 'bias'], ['a']),
+	helper.make_node('Sigmoid', ['a'], ['s']),
+	helper.make_node('Gemm', ['s', 'G', 'C'], ['g'], transB=1),
+	helper.make_node('Softmax', ['g'], ['Y'], axis=1),
+]
+initializers = [weights('W', [3,2,3,3]), weights('M', [48,10]), weights('bias', [10]),
+	weights('G', [5,10]), weights('C', [5])]
+
+g = helper.make_graph(nodes, test_name,
+	[helper.make_tensor_value_info('X', TensorProto.FLOAT, ['N',2,6,6])],
+	[helper.make_tensor_value_info('Y', TensorProto.FLOAT, ['N',5])],
+	initializers)
+m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+m.ir_version = 8
+
+Path(test_name).mkdir(parents=True, exist_ok=True)
+with open(test_name + "/model.onnx", 'wb') as f:
+	f.write(m.SerializeToString())
+sess = ort.InferenceSession(m.SerializeToString())
+d = test_name + "/test_data_set_0"
+Path(d).mkdir(parents=True, exist_ok=True)
+x = np.random.randn(3,2,6,6).astype(np.float32)
+save_tensor(x, d + "/input_0.pb")
+save_tensor(sess.run(None, {'X': x})[0], d + "/output_0.pb")
+
+# A matrix with run time rows times a vector
+test_name = "test_runtime_matvec"
+nodes = [
+	helper.make_node('MatMul', ['X', 'v'], ['Y']),
+]
+g = helper.make_graph(nodes, test_name,
+	[helper.make_tensor_value_info('X', TensorProto.FLOAT, ['N',6])],
+	[helper.make_tensor_value_info('Y', TensorProto.FLOAT, ['N'])],
+	[weights('v', [6])])
+m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+m.ir_version = 8
+
+Path(test_name).mkdir(parents=True, exist_ok=True)
+with open(test_name + "/model.onnx", 'wb') as f:
+	f.write(m.SerializeToString())
+sess = ort.InferenceSession(m.SerializeToString())
+d = test_name + "/test_data_set_0"
+Path(d).mkdir(parents=True, exist_ok=True)
+x = np.random.randn(3,6).astype(np.float32)
+save_tensor(x, d + "/input_0.pb")
+save_tensor(sess.run(None, {'X': x})[0], d + "/output_0.pb")
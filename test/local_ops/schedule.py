@@ -0,0 +1,47 @@
+# Generate the local test of ordering the nodes for the least
+# memory alive at a time (optimization pass 'schedule').
+
+import numpy as np
+import onnxruntime as ort
+from onnx import helper, numpy_helper, TensorProto
+from pathlib import Path
+
+np.random.seed(13)
+
+def save_tensor(t, fn):
+	with open(fn, 'wb') as f:
+		f.write(numpy_helper.from_array(t).SerializeToString())
+
+def weights(name, shape):
+	return numpy_helper.from_array((0.2*np.random.randn(*shape)).astype(np.float32), name)
+
+# Three branches that widen and narrow again. In the file order all the
+# wide tensors are alive at the same time, branch by branch only one.
+test_name = "test_schedule_branches"
+nodes = []
+initializers = []
+for b in range(3):
+	nodes.append(helper.make_node('MatMul', ['X', 'Wwide'+str(b)], ['wide'+str(b)]))
+	initializers.append(weights('Wwide'+str(b), [8,200]))
+for b in range(3):
+	nodes.append(helper.make_node('Relu', ['wide'+str(b)], ['relu'+str(b)]))
+	nodes.append(helper.make_node('MatMul', ['relu'+str(b), 'Wnarrow'+str(b)], ['narrow'+str(b)]))
+	initializers.append(weights('Wnarrow'+str(b), [200,4]))
+nodes.append(helper.make_node('Sum', ['narrow0', 'narrow1', 'narrow2'], ['Y']))
+
+g = helper.make_graph(nodes, test_name,
+	[helper.make_tensor_value_info('X', TensorProto.FLOAT, [2,8])],
+	[helper.make_tensor_value_info('Y', TensorProto.FLOAT, None)],
+	initializers)
+m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+m.ir_version = 8
+
+Path(test_name).mkdir(parents=True, exist_ok=True)
+with open(test_name + "/model.onnx", 'wb') as f:
+	f.write(m.SerializeToString())
+sess = ort.InferenceSession(m.SerializeToString())
+d = test_name + "/test_data_set_0"
+Path(d).mkdir(parents=True, exist_ok=True)
+x = np.random.randn(2,8).astype(np.float32)
+save_tensor(x, d + "/input_0.pb")
+save_tensor(sess.run(None, {'X': x})[0], d + "/output_0.pb")
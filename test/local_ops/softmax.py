@@ -0,0 +1,38 @@
+# Generate the local tests of a classifier that ends with Softmax and TopK
+# with k=1, of which only the index is used (optimization pass 'argmax').
+
+import numpy as np
+import onnxruntime as ort
+from onnx import helper, numpy_helper, TensorProto
+from pathlib import Path
+
+np.random.seed(7)
+
+def save_tensor(t, fn):
+	with open(fn, 'wb') as f:
+		f.write(numpy_helper.from_array(t).SerializeToString())
+
+test_name = "test_softmax_topk_index"
+nodes = [
+	helper.make_node('Gemm', ['X', 'W', 'B'], ['logits']),
+	helper.make_node('Softmax', ['logits'], ['probs']),
+	helper.make_node('TopK', ['probs', 'K'], ['values', 'Y']),
+]
+g = helper.make_graph(nodes, test_name,
+	[helper.make_tensor_value_info('X', TensorProto.FLOAT, [1,16])],
+	[helper.make_tensor_value_info('Y', TensorProto.INT64, [1,1])],
+	[numpy_helper.from_array(np.random.randn(16,10).astype(np.float32), 'W'),
+	 numpy_helper.from_array(np.random.randn(10).astype(np.float32), 'B'),
+	 numpy_helper.from_array(np.array([1], dtype=np.int64), 'K')])
+m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+m.ir_version = 8
+
+Path(test_name).mkdir(parents=True, exist_ok=True)
+with open(test_name + "/model.onnx", 'wb') as f:
+	f.write(m.SerializeToString())
+sess = ort.InferenceSession(m.SerializeToString())
+d = test_name + "/test_data_set_0"
+Path(d).mkdir(parents=True, exist_ok=True)
+X = np.random.randn(1,16).astype(np.float32)
+save_tensor(X, d + "/input_0.pb")
+save_tensor(sess.run(None, {"X": X})[0], d + "/output_0.pb")
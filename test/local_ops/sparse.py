@@ -0,0 +1,55 @@
+# Generate the local test for pruned weights, stored sparse
+# with onnx2c '--sparse'. Most weights are zero, and some output
+# channels have no nonzero weights at all.
+
+import numpy as np
+import onnxruntime as ort
+from onnx import helper, numpy_helper, TensorProto
+from pathlib import Path
+
+np.random.seed(42)
+
+def save_tensor(t, fn):
+	with open(fn, 'wb') as f:
+		npt = numpy_helper.from_array(t)
+		f.write(npt.SerializeToString())
+
+def save_test(test_name, m, inputs, result):
+	Path(test_name).mkdir(parents=True, exist_ok=True)
+	with open(test_name + "/model.onnx", 'wb') as f:
+		f.write(m.SerializeToString())
+	d = test_name + "/test_data_set_0"
+	Path(d).mkdir(parents=True, exist_ok=True)
+	for i, name in enumerate(inputs):
+		save_tensor(inputs[name], d + "/input_" + str(i) + ".pb")
+	for o, r in enumerate(result):
+		save_tensor(r, d + "/output_" + str(o) + ".pb")
+
+# Mostly zeros, and output channel 1 (on 'axis') all zeros
+def pruned(shape, axis, zeros=0.8):
+	w = np.random.uniform(-1, 1, shape).astype(np.float32)
+	w[np.random.rand(*shape) < zeros] = 0
+	np.moveaxis(w, axis, 0)[1] = 0
+	return w
+
+test_name = "test_sparse_convnet"
+nodes = [
+	helper.make_node('Conv', ['X', 'Wc', 'Bc'], ['C'], group=2, pads=[2,2,2,2], dilations=[2,2], name='conv'),
+	helper.make_node('Relu', ['C'], ['R'], name='relu'),
+	helper.make_node('Flatten', ['R'], ['F'], name='flatten'),
+	helper.make_node('Gemm', ['F', 'Wg', 'Bg'], ['G'], transB=1, name='gemm'),
+	helper.make_node('Gemm', ['G', 'Wh', 'Bh'], ['H'], name='gemm_h'),
+	helper.make_node('MatMul', ['H', 'Wm'], ['Y'], name='matmul'),
+]
+w = {'Wc': pruned((4,2,3,3), 0), 'Bc': np.random.rand(4).astype(np.float32),
+     'Wg': pruned((10,144), 0), 'Bg': np.random.rand(10).astype(np.float32),
+     'Wh': pruned((10,8), 1, 0.5), 'Bh': np.random.rand(8).astype(np.float32),
+     'Wm': pruned((8,3), 1, 0.3)}
+g = helper.make_graph(nodes, test_name,
+	[helper.make_tensor_value_info('X', TensorProto.FLOAT, [1,4,6,6])],
+	[helper.make_tensor_value_info('Y', TensorProto.FLOAT, [1,3])],
+	[numpy_helper.from_array(v, k) for k, v in w.items()])
+m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+m.ir_version = 8
+inputs = {"X": np.random.rand(1,4,6,6).astype(np.float32)}
+save_test(test_name, m, inputs, ort.InferenceSession(m.SerializeToString()).run(None, inputs))
@@ -0,0 +1 @@
+	J􁺿x%?!3"K(?>Pd>}=/]?;?]ڈU)/CJ>:r).T?w>h?濡?Y|=>u>`޿+R_>k4?T}{2?#`k
\ No newline at end of file
@@ -0,0 +1,2 @@
+	Jľfʹ>ڀ?#Ҥr"^<hhUuXKҾzd?]=>qaJh?	>p4r￼@f>@Կf=W&?̪=?t?h^+?/c?e=?>C?k?'??3Zf?vȾ4?v3>m>k?E
+01!?)4?>|?zl\QU>౾@<s,ڽQr8?I">X>^=y?ĕ+gq=#?ǻj_O?gr>e?w?n>WVGS?t?e>gf kJg=..U?ߊ9>
\ No newline at end of file
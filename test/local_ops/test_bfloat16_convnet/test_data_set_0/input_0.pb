@@ -0,0 +1,2 @@
+BXJ>K??	?e?J?>>~>>?	=?C?`?>R?=Y?>>L?>k>9?8?$?2??>>:>i??>>s?>???<_?o??2?l?5?>??>=?o?m?>=|?W?=l?_???>`=>N?;>>
+?k?
\ No newline at end of file
@@ -0,0 +1,2 @@
+BYJ
+?Q>=<=
\ No newline at end of file
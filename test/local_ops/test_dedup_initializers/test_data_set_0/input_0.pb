@@ -0,0 +1 @@
+J ;P?4?7:?qE?=҈>L=
\ No newline at end of file
@@ -0,0 +1 @@
+J 4>?#'ǳ@#Y?;? ?<j7
\ No newline at end of file
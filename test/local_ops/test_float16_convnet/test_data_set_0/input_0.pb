@@ -0,0 +1,2 @@
+
+BXJ7716`689)598:E971,$9&8;866%9U7]8;-6;>;D2p,s.$.w9,5:%:4/99;9n:41:t:;656:t5r;:6:	:.8;8:5*;:6!>;-5;
\ No newline at end of file
@@ -0,0 +1,3 @@
+
+BYJ
+u1w(k5}24
\ No newline at end of file
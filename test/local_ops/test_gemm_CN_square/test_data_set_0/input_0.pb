@@ -0,0 +1 @@
+J$kd>??:=s>Uod>\P0?6'>|=
\ No newline at end of file
@@ -0,0 +1 @@
+J$p?lM?s=8?IA">$>C>U2?>
\ No newline at end of file
@@ -0,0 +1 @@
+J@9\>i>G=
\ No newline at end of file
@@ -0,0 +1 @@
+J$k?7l@9tJ?GT??~?2ռ?M??
\ No newline at end of file
@@ -0,0 +1 @@
+JE$:I:@!*
\ No newline at end of file
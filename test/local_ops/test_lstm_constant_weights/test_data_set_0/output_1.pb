@@ -0,0 +1 @@
+J@wZ>۲]YKH"Z>dA̾\?=>='k>>L;">R޹=
\ No newline at end of file
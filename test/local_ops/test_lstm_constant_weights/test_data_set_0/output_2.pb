@@ -0,0 +1 @@
+J@>UVʥj>xt8=]>I>!>s)Γ>?7>
\ No newline at end of file
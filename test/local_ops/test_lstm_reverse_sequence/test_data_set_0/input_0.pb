@@ -0,0 +1 @@
+Jxž/>`\<Pm>-<"Q>@T= y=>ȪŽ[bfCZ>d=HP>\-&=(ܽ$>b@4e<:>`ӽ=>'>
\ No newline at end of file
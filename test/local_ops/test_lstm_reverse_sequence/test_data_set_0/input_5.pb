@@ -0,0 +1 @@
+J sh"伺>4>>.G>`c=
\ No newline at end of file
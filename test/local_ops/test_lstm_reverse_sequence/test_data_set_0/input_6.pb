@@ -0,0 +1 @@
+J0>V>>[8J޽`y>r=TL/>8==
\ No newline at end of file
@@ -0,0 +1 @@
+JD=9{=FM>Sмy}V>4>oj=];rU=Hi>鲽AɇU>=1<}$=!я\>>[=ty"2N>#wX==z>O>٭7սٽG>=G>B>^,>
\ No newline at end of file
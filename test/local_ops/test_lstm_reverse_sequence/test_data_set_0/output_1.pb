@@ -0,0 +1 @@
+J D=9{=FM>Sмy}V>4>
\ No newline at end of file
@@ -0,0 +1 @@
+J Q	>&=:#U>X>91&G֛>券>
\ No newline at end of file
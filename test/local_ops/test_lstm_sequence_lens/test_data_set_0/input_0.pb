@@ -0,0 +1,2 @@
+J5->[U@<ܪs>jվhA=a⽬`XM`>TO(=1ļh'>&>`'n>Vqs8=往$nU=)>kɾپPi>@>@yׁba>
+M>^G>Riʸ=\(Ѿ >򹾂>)]B6P+=>\m>>">$D>ɲ>+B->
\ No newline at end of file
@@ -0,0 +1 @@
+Jt>+}?vżc
\ No newline at end of file
@@ -0,0 +1,4 @@
+Js:xP3Ou,> )ལ-?Z
+@0_?8O?a?>;;"%?sI>
+CAվ*9?C0Q>%Y?>U(?Y-U>@?߿+g>F>^X>B%<,/c?P?.?6	[?w2{ֿ	h={>J?wM7WA;?P>U?>@\,?FP/t=<. ;i>9 /A?K=Pd&mE+@HۑJM?>\?%ܾ'O
+6wϬϿW)R*b?!?]?i1?ZS\u"9>,%?tſ~>g=>_HԆ??ý>'>D??ْ?ӿ
\ No newline at end of file
@@ -0,0 +1 @@
+JxhD?Jrr @fP~@>hF?>:bq?	PB#Y#?!?6> ?PB3z?"uũ%H؉2<l,7?߼?
\ No newline at end of file
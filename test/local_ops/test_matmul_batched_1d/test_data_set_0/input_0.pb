@@ -0,0 +1,2 @@
+J>5ƾT?p?ĴJr>q?<G>-wwt)S&(?/+m?+5<?o?#?c>3@>_X>Fs>KI@?%4$?NM?Y?d?F@'?*>?`C=>~i͇#'3-@! ?k\fW?sb?">3?XLD?^=#%_?T_5C?Z?=2?Ƥ=.g?
+= ڸ>'A?oVTi?7@@HURu:>͡??Ww􇿝ovѿa>O[j?h?̓݃:2?Y,pJ,>B(I?M:v>>1["xF slG>=)A@>\?Dk?؈xe?
\ No newline at end of file
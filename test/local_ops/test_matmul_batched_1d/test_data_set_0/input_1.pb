@@ -0,0 +1 @@
+JMp=I?'o?
\ No newline at end of file
@@ -0,0 +1 @@
+Jx|jPGQ?X?M2?߽6$@'?.?t@P?\┿%r?v?Z5{?C%?n@J?+S5dNB?mH@:J?p@c
\ No newline at end of file
@@ -0,0 +1 @@
+J`?8~>w=^t z3U,vb?a?J?L=1Ͼſo|{?R:?er>
\ No newline at end of file
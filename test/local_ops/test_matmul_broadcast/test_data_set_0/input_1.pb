@@ -0,0 +1 @@
+Jd6 ?]$vD,k>?3?o?\ MB}l\ޏ?Ͽ%?i?߿_cj<u?PZ?ٍ?1H?g?z$X?1Vk)?췪?'J'?,O;>̝>7:>r0?0;f?7&?>-?Y$?>a"?rIt>(4?kV
\ No newline at end of file
@@ -0,0 +1 @@
+J?/?	?\?a?BK???^?P??+!@)*f&9?<?B:dw1XV-_Y*?I??N:`A@8>E>@d紿I	?sc޽")Ͽ񈿿2>jj>$h2?g@Z:|>Hk?+@==iRM~wz@	ʶ;?B>(?2PO@_UlUGCA!@l@[D<?@;?k@lIk@r@>'$[΀?8y6?g%?z?I
\ No newline at end of file
@@ -0,0 +1,2 @@
+J>h͵?RK׎?>4?wL?zݾRl>׭?͑E8?>߃=*ze>\ -d+ L+&6ܾ=
+?@*?=va=eG?
\ No newline at end of file
@@ -0,0 +1 @@
+J`i>Us5fx'?M=}>b?A><la?'?}z\A)?eS?uC=$?*F@ǻt=١c->s>
\ No newline at end of file
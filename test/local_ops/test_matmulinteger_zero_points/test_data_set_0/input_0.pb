@@ -0,0 +1 @@
+JE\Y_3
\ No newline at end of file
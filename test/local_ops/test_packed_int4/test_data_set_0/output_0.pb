@@ -0,0 +1 @@
+J͑AƸf
\ No newline at end of file
@@ -0,0 +1 @@
+Jɺ@k}e?U3@K9>~1P@ Gq/z]8,cL*CCʘ?0?>*?l@!Jnۿ<@ل+m@yp@iCH@pb>e|@V7ZO>lHp@7=>?Xr?&3?,?dM@Ah0KVf@G@Dv?0㿕*S+?*3Xr@x@?ٓ>1ÿ @+*?y,eR@
\ No newline at end of file
@@ -0,0 +1,2 @@
+J'?>>'??>(?>>>>>>>!?'??(?>>(?>(?>(?>(??(?>?(???$?>??(?>>(?(?>?>>>>?>(?(?%?
+?>(?$?>(?
\ No newline at end of file
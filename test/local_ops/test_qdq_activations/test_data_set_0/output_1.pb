@@ -0,0 +1 @@
+J^@ޠ@4>ThP@JG㽐ǘ??*?3l@䡾Ѿ#<@A+m@,tp@+eDH@b>8g|@Oё>Hp@6<=>o?r?w?,?cM@=ӾԚf@ G@v?Ծ%)˰P+?>r@4x@?ݓ>B>Ⱦd @(?dR@
\ No newline at end of file
@@ -0,0 +1 @@
+Jx}??|ar?p_7?|?/~?@HAX|??L~"?C>?!}?-}?&qX|arƒ'{~?X|???G>Fy?%?L~?
\ No newline at end of file
@@ -0,0 +1 @@
+Jxm?y?o[?j5?Z>w?s?<<$>k?y?a=Z-?4>y?o?o?>Z>D">=q?k?{?{?m6?e?w?q?
\ No newline at end of file
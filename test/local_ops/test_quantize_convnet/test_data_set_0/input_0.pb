@@ -0,0 +1,3 @@
+BXJz>yQ?=ч+=SJ=>ak>pt?=%?4?0ܴ>J>ja>/~3=6?b'?5>k8?;=Op?X?(?)><H>>no?n]?o>?x`?s?#???.>k?b5V?S?^?4Y?N?W>w7	?f?<UE?g>_Vz?We>Ϊ>|Ft?O?|f?C=<|p>,q>̈́>F<?]9?p>A>Y????i>XE?>'?u?h;0.9?8=5?} ?"x>i?O?`Am>b'E?=?#?Tx=_?>uC&?o@7?1?SS(?4P? N?{?>>v_?V3?_=>?h?zN>sX?Q?>=
+>2l?4=)>by?I>({?>j(
+?5?l>>xe>QD?9`"?b>*?!>	?(?H9>I?bU?z?kc>
\ No newline at end of file
@@ -0,0 +1,3 @@
+
+BYJ(/h?FLù@]=8:>E=
+9{m+'>?
\ No newline at end of file
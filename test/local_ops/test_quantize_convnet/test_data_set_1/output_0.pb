@@ -0,0 +1,2 @@
+
+BYJ(ߨ<?$p"@b>O>8)'^?z?
\ No newline at end of file
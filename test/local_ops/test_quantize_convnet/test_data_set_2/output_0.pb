@@ -0,0 +1,2 @@
+
+BYJ(f<g?g@3=M>(Sar=k
\ No newline at end of file
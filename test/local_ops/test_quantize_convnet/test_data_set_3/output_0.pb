@@ -0,0 +1,2 @@
+
+BYJ(4׻-?|>+@ITRB>D?Zf~?
\ No newline at end of file
@@ -0,0 +1,3 @@
+BXJw?Z6?R>,M<Y>K?n? ?>"A?E?@?[?r?Ə'?Z?@>?N#:?[?Il?tf?ǟ>Y=^T?k	?
+?>S?=`?b=3u1?be?I$?p>\	>h?Nb?Ӷ? )?u>x?>?ȵ>M'?
+?Qb?ӌ>|R=C>*>Z?/>Y ??>5,N=o>?Vi>>%>)?ϰ=?Ы|<q{?2?>E>f2?g?&ߢ>8D?2>u?3? ?Dn?쿉>rl?ؖ-?xE?V?zU?2? >A?>wj?hJ>oI>1C=)>??g?=>q">Y??l'?>ו>?r>J=D=u><:O ?e=~>I]>6=ʅ>G<+|??>Q<>ĵ>:Vn?>Yb?yH*?l>>y?XI?
\ No newline at end of file
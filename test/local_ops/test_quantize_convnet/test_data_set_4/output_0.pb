@@ -0,0 +1,2 @@
+
+BYJ(H;[?T>@@P ^x>V>sЦ?W˜?
\ No newline at end of file
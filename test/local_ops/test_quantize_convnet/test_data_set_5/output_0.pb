@@ -0,0 +1,2 @@
+
+BYJ(I6R?@,Qw>N8?5'"E??il?
\ No newline at end of file
@@ -0,0 +1,2 @@
+
+BYJ(v`?Qt>pͫ@acVL>gӭѿ	@
\ No newline at end of file
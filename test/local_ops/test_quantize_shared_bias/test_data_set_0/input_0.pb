@@ -0,0 +1,4 @@
+BXJ>1?L=B`>i<\C?>)h>?&>O?.>#?x?;}?
+O>&>G>d>'>jV?Kv?W>Hd?>&?!V>p?lI?XfE>3s?x?,>>P>M#?֏d?>=>p ?^<?E?2=p?A>G?K&h?/y?[?v0>V2h?ί>=?>A?E>;鉒>;>!>v>s7>qE?<
+i>{?(t=s?d?1?>W=U=Q(e?P^?|?p>&?>0??(I?>=>J?lfV>h>ɨ
+?R?r?9v>.me?[9i?Y>?8>*@?>E?j[?~^?9k?Ly?v>?in>&=T? 9?٫=?Qm?.?Ѻ=u?wzm?v??>Lw;?!s?>J>>l">?')>+.c?[>
\ No newline at end of file
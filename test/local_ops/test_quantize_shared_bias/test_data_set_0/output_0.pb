@@ -0,0 +1,3 @@
+
+BYJ(Gտn\?(@\+~?ҙ@?H
+~٤>
\ No newline at end of file
@@ -0,0 +1,2 @@
+
+BYJ(SЬ>U>&?$N@̇>
\ No newline at end of file
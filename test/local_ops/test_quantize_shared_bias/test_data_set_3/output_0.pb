@@ -0,0 +1,2 @@
+
+BYJ(=^0Δ?ug/@N?>W		@
\ No newline at end of file
@@ -0,0 +1,2 @@
+
+BYJ(|y>US%?:a(@̃?\T'?ۿx@
\ No newline at end of file
@@ -0,0 +1,2 @@
+
+BYJ(?TS0?@?%?YWgv@
\ No newline at end of file
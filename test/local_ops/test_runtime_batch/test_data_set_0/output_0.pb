@@ -0,0 +1 @@
+J<>B>=*P>/>2>Ӽ?G==/> >Mj>W=kq=,&?>
\ No newline at end of file
@@ -0,0 +1 @@
+JH_?W>c?RmʽJ?="S?=.u?d>#|O;>crJ;o?
\ No newline at end of file
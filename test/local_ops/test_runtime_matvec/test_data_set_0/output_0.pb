@@ -0,0 +1 @@
+J]?E?S
\ No newline at end of file
@@ -0,0 +1 @@
+J@?`?p@>SͿ$W?Eڿ~T>%Y?/?-??TyR>,S
\ No newline at end of file
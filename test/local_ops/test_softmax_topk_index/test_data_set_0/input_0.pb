@@ -0,0 +1 @@
+J@,,QOD>cT@t?"p m	v??ٍJ*?0bQ>>?=I
\ No newline at end of file
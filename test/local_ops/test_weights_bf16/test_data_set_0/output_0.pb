@@ -0,0 +1 @@
+Jϧ@I7=B
\ No newline at end of file
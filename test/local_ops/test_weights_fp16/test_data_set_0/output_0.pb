@@ -0,0 +1 @@
+Jc@Zf=DB
\ No newline at end of file
@@ -0,0 +1,78 @@
+# Generate the local tests for the QONNX MultiThreshold node: 4D inputs
+# in both data layouts, and a FINN style MLP of MatMuls followed by
+# MultiThresholds, that onnx2c fuses and runs on integers.
+
+import numpy as np
+from onnx import helper, numpy_helper, TensorProto
+from pathlib import Path
+
+np.random.seed(42)
+qonnx = "qonnx.custom_op.general"
+
+def save_tensor(t, fn):
+	with open(fn, 'wb') as f:
+		npt = numpy_helper.from_array(t)
+		f.write(npt.SerializeToString())
+
+def save_test(test_name, m, inputs, result):
+	Path(test_name).mkdir(parents=True, exist_ok=True)
+	with open(test_name + "/model.onnx", 'wb') as f:
+		f.write(m.SerializeToString())
+	d = test_name + "/test_data_set_0"
+	Path(d).mkdir(parents=True, exist_ok=True)
+	for i, name in enumerate(inputs):
+		save_tensor(inputs[name], d + "/input_" + str(i) + ".pb")
+	for o, r in enumerate(result):
+		save_tensor(r, d + "/output_" + str(o) + ".pb")
+
+def make_model(test_name, nodes, X, Y, initializers):
+	g = helper.make_graph(nodes, test_name,
+		[helper.make_tensor_value_info('X', TensorProto.FLOAT, X.shape)],
+		[helper.make_tensor_value_info('Y', TensorProto.FLOAT, Y.shape)],
+		[numpy_helper.from_array(v, k) for k, v in initializers.items()])
+	m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13), helper.make_opsetid(qonnx, 1)])
+	m.ir_version = 8
+	return m
+
+# Number of thresholds of each channel that x is at or above.
+# 'channel' is the axis of the channels in x.
+def multithreshold(x, T, channel, scale=1.0, bias=0.0):
+	xc = np.moveaxis(x, channel, -1)
+	count = (xc[..., None] >= T[None, :, :] if T.shape[0] > 1 else xc[..., None] >= T[0]).sum(axis=-1)
+	return np.moveaxis(scale*count + bias, -1, channel).astype(np.float32)
+
+def sorted_thresholds(channels, thresholds, lo, hi):
+	return np.sort(np.random.uniform(lo, hi, (channels, thresholds)), axis=1).astype(np.float32)
+
+
+# 4D, channels first and last
+for layout, shape, channel in [("NCHW", (2,3,4,5), 1), ("NHWC", (2,4,5,3), 3)]:
+	test_name = "test_multithreshold_" + layout.lower()
+	X = np.random.randint(-10, 10, shape).astype(np.float32)
+	T = sorted_thresholds(3, 6, -10, 10)
+	Y = multithreshold(X, T, channel, 0.5, -1.5)
+	nodes = [helper.make_node('MultiThreshold', ['X', 'T'], ['Y'], domain=qonnx,
+		out_scale=0.5, out_bias=-1.5, data_layout=layout, name='threshold')]
+	save_test(test_name, make_model(test_name, nodes, X, Y, {'T': T}), {"X": X}, [Y])
+
+
+# MLP: MatMul -> MultiThreshold -> MatMul -> MultiThreshold.
+# The second MatMul has integer inputs and weights, and thresholds
+# shared by all channels.
+test_name = "test_multithreshold_mlp"
+W1 = np.random.randint(-3, 4, (8,6)).astype(np.float32)
+T1 = sorted_thresholds(6, 7, -12, 12)
+W2 = np.random.randint(-8, 8, (6,4)).astype(np.float32)
+T2 = np.array([[-5.5, 0.0, 4.25]], dtype=np.float32)
+nodes = [
+	helper.make_node('MatMul', ['X', 'W1'], ['H1'], name='matmul1'),
+	helper.make_node('MultiThreshold', ['H1', 'T1'], ['A1'], domain=qonnx,
+		out_bias=-3.0, out_dtype="INT4", name='threshold1'),
+	helper.make_node('MatMul', ['A1', 'W2'], ['H2'], name='matmul2'),
+	helper.make_node('MultiThreshold', ['H2', 'T2'], ['Y'], domain=qonnx,
+		out_scale=2.0, out_bias=-1.0, name='threshold2'),
+]
+X = np.random.randint(-4, 5, (2,8)).astype(np.float32)
+A1 = multithreshold(X @ W1, T1, 1, 1.0, -3.0)
+Y = multithreshold(A1 @ W2, T2, 1, 2.0, -1.0)
+save_test(test_name, make_model(test_name, nodes, X, Y, {'W1': W1, 'T1': T1, 'W2': W2, 'T2': T2}), {"X": X}, [Y])
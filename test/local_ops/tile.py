@@ -0,0 +1,87 @@
+# Generate the local tests of depth first execution of the first
+# layers of a CNN over bands of rows (the '--tile' option).
+
+import numpy as np
+import onnxruntime as ort
+from onnx import helper, numpy_helper, TensorProto
+from pathlib import Path
+
+np.random.seed(12)
+
+def save_tensor(t, fn):
+	with open(fn, 'wb') as f:
+		f.write(numpy_helper.from_array(t).SerializeToString())
+
+def weights(name, shape):
+	return numpy_helper.from_array((0.2*np.random.randn(*shape)).astype(np.float32), name)
+
+def save_test(test_name, nodes, input_shape, initializers):
+	g = helper.make_graph(nodes, test_name,
+		[helper.make_tensor_value_info('X', TensorProto.FLOAT, input_shape)],
+		[helper.make_tensor_value_info('Y', TensorProto.FLOAT, None)],
+		initializers)
+	m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+	m.ir_version = 8
+
+	Path(test_name).mkdir(parents=True, exist_ok=True)
+	with open(test_name + "/model.onnx", 'wb') as f:
+		f.write(m.SerializeToString())
+	sess = ort.InferenceSession(m.SerializeToString())
+	d = test_name + "/test_data_set_0"
+	Path(d).mkdir(parents=True, exist_ok=True)
+	x = np.random.randn(*input_shape).astype(np.float32)
+	save_tensor(x, d + "/input_0.pb")
+	save_tensor(sess.run(None, {'X': x})[0], d + "/output_0.pb")
+
+# Padded Conv, Relu, strided MaxPool and a strided, dilated Conv.
+# The height of the output is not a multiple of the band height.
+save_test("test_tiled_convnet", [
+		helper.make_node('Conv', ['X', 'W1', 'B1'], ['c1'], kernel_shape=[3,3], pads=[1,1,1,1]),
+		helper.make_node('Relu', ['c1'], ['r1']),
+		helper.make_node('MaxPool', ['r1'], ['p1'], kernel_shape=[2,2], strides=[2,2]),
+		helper.make_node('Conv', ['p1', 'W2'], ['Y'], kernel_shape=[3,3], strides=[2,1], dilations=[2,1], pads=[2,1,1,0]),
+	],
+	[1,2,30,12],
+	[weights('W1', [4,2,3,3]), weights('B1', [4]), weights('W2', [3,4,3,3])])
+
+# Asymmetric padding at the top and bottom of the image, BatchNormalization
+# and a padded MaxPool, which pads with the smallest float.
+# The chain ends at the Add, which can not be tiled.
+save_test("test_tiled_batchnorm", [
+		helper.make_node('Conv', ['X', 'W1'], ['c1'], kernel_shape=[5,3], pads=[1,1,3,1]),
+		helper.make_node('BatchNormalization', ['c1', 'scale', 'bias', 'mean', 'var'], ['n1']),
+		helper.make_node('LeakyRelu', ['n1'], ['r1'], alpha=0.2),
+		helper.make_node('MaxPool', ['r1'], ['p1'], kernel_shape=[3,3], strides=[2,2], pads=[1,1,1,1]),
+		helper.make_node('Add', ['p1', 'offset'], ['Y']),
+	],
+	[1,3,17,9],
+	[weights('W1', [4,3,5,3]), weights('scale', [4]), weights('bias', [4]), weights('mean', [4]),
+	 numpy_helper.from_array(np.random.rand(4).astype(np.float32)+0.5, 'var'),
+	 weights('offset', [4,1,1])])
+
+# Two BatchNormalizations of the same variance (and epsilon). Its square
+# root is taken once, also when the stages of the bands resolve again.
+# With different epsilons, onnx2c stops with an error.
+def shared_var_nodes(epsilon2):
+	return [
+		helper.make_node('Conv', ['X', 'W1'], ['c1'], kernel_shape=[3,3], pads=[1,1,1,1]),
+		helper.make_node('BatchNormalization', ['c1', 'scale1', 'bias1', 'mean', 'var'], ['n1'], epsilon=0.01),
+		helper.make_node('Relu', ['n1'], ['r1']),
+		helper.make_node('BatchNormalization', ['r1', 'scale2', 'bias2', 'mean', 'var'], ['n2'], epsilon=epsilon2),
+		helper.make_node('Add', ['n2', 'offset'], ['Y']),
+	]
+shared_var_weights = [weights('W1', [4,2,3,3]), weights('scale1', [4]), weights('bias1', [4]),
+	weights('scale2', [4]), weights('bias2', [4]), weights('mean', [4]),
+	numpy_helper.from_array(np.random.rand(4).astype(np.float32)+0.5, 'var'),
+	weights('offset', [4,1,1])]
+save_test("test_tiled_batchnorm_shared", shared_var_nodes(0.01), [1,2,11,7], shared_var_weights)
+save_test("test_tiled_batchnorm_epsilons", shared_var_nodes(0.001), [1,2,11,7], shared_var_weights)
+
+# A depthwise Conv, one input channel per group. Also with flat pointers.
+save_test("test_tiled_depthwise", [
+		helper.make_node('Conv', ['X', 'W1', 'B1'], ['c1'], kernel_shape=[3,3], pads=[1,1,1,1], group=3),
+		helper.make_node('MaxPool', ['c1'], ['p1'], kernel_shape=[2,2], strides=[2,2]),
+		helper.make_node('LeakyRelu', ['p1'], ['Y'], alpha=0.1),
+	],
+	[1,3,12,8],
+	[weights('W1', [3,1,3,3]), weights('B1', [3])])
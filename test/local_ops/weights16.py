@@ -0,0 +1,66 @@
+# Generate the local tests for float weights stored as 16 bit floats
+# with onnx2c '--weights fp16' or '--weights bf16'. The reference is
+# calculated in float, with the weights rounded like onnx2c rounds them,
+# so the test checks the rounding too.
+
+import numpy as np
+import onnxruntime as ort
+from onnx import helper, numpy_helper, TensorProto
+from pathlib import Path
+
+np.random.seed(42)
+
+def save_tensor(t, fn):
+	with open(fn, 'wb') as f:
+		npt = numpy_helper.from_array(t)
+		f.write(npt.SerializeToString())
+
+def save_test(test_name, m, inputs, result):
+	Path(test_name).mkdir(parents=True, exist_ok=True)
+	with open(test_name + "/model.onnx", 'wb') as f:
+		f.write(m.SerializeToString())
+	d = test_name + "/test_data_set_0"
+	Path(d).mkdir(parents=True, exist_ok=True)
+	for i, name in enumerate(inputs):
+		save_tensor(inputs[name], d + "/input_" + str(i) + ".pb")
+	for o, r in enumerate(result):
+		save_tensor(r, d + "/output_" + str(o) + ".pb")
+
+def fp16(w):
+	return w.astype(np.float16).astype(np.float32)
+
+def bf16(w):
+	bits = w.view(np.uint32).astype(np.uint64)
+	bits = (bits + 0x7fff + ((bits >> 16) & 1)) & 0xffff0000
+	return bits.astype(np.uint32).view(np.float32)
+
+# Weights of all magnitudes, down to float16 subnormals
+def weights(shape):
+	return (np.random.uniform(-1, 1, shape) * 10.0**np.random.randint(-6, 2, shape)).astype(np.float32)
+
+def model(test_name, w):
+	nodes = [
+		helper.make_node('Conv', ['X', 'Wc', 'Bc'], ['C'], pads=[1,1,1,1], name='conv'),
+		helper.make_node('Relu', ['C'], ['R'], name='relu'),
+		helper.make_node('Flatten', ['R'], ['F'], name='flatten'),
+		helper.make_node('Gemm', ['F', 'Wg', 'Bg'], ['G'], transB=1, name='gemm'),
+		helper.make_node('MatMul', ['G', 'Wm'], ['Y'], name='matmul'),
+	]
+	g = helper.make_graph(nodes, test_name,
+		[helper.make_tensor_value_info('X', TensorProto.FLOAT, [1,2,5,5])],
+		[helper.make_tensor_value_info('Y', TensorProto.FLOAT, [1,3])],
+		[numpy_helper.from_array(v, k) for k, v in w.items()])
+	m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+	m.ir_version = 8
+	return m
+
+w = {'Wc': weights((3,2,3,3)), 'Bc': np.random.rand(3).astype(np.float32),
+     'Wg': weights((5,75)), 'Bg': np.random.rand(5).astype(np.float32),
+     'Wm': weights((5,3))}
+inputs = {"X": np.random.rand(1,2,5,5).astype(np.float32)}
+for name, rounding in [("fp16", fp16), ("bf16", bf16)]:
+	test_name = "test_weights_" + name
+	# Biases are kept in float
+	rounded = {k: rounding(v) if k[0] == 'W' else v for k, v in w.items()}
+	reference = ort.InferenceSession(model(test_name, rounded).SerializeToString()).run(None, inputs)
+	save_test(test_name, model(test_name, w), inputs, reference)
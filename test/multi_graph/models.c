@@ -0,0 +1,33 @@
+/* Several models in one source file ('onnx2c model_a.onnx model_b.onnx'):
+ * each has its own entry_<file name>(), and they share the W they both have. */
+#include <math.h>
+#include <stdint.h>
+#include "reference.h"
+
+void entry_model_a(const float tensor_model_a_X[2][4], float tensor_model_a_Y[2][3]);
+void entry_model_b(const float tensor_model_b_X[2][4], float tensor_model_b_Y[2][3]);
+
+static int check(const float *result, const float *reference, int size)
+{
+	for( int i=0; i<size; i++ ) {
+		if( isnan(result[i]) )
+			return 1;
+		if( fabs(result[i] - reference[i]) > 1e-5 )
+			return 1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	float y[2][3];
+
+	entry_model_a((const float(*)[4])models_x, y);
+	if( check(&y[0][0], model_a_y, 2*3) )
+		return 1;
+
+	entry_model_b((const float(*)[4])models_x, y);
+	if( check(&y[0][0], model_b_y, 2*3) )
+		return 1;
+	return 0;
+}
@@ -0,0 +1,63 @@
+# Generate the models of the tests that print several graphs into
+# one source file, and reference.h with their test data.
+# Run in this directory.
+
+import numpy as np
+import onnxruntime as ort
+from onnx import helper, numpy_helper, TensorProto
+
+np.random.seed(15)
+header = open("reference.h", "w")
+header.write("/* Generated with models.py */\n")
+
+def weights(name, shape):
+	return numpy_helper.from_array(np.random.randn(*shape).astype(np.float32), name)
+
+def save_model(filename, nodes, inputs, outputs, initializers):
+	g = helper.make_graph(nodes, filename,
+		[helper.make_tensor_value_info(n, TensorProto.FLOAT, s) for n, s in inputs],
+		[helper.make_tensor_value_info(n, TensorProto.FLOAT, s) for n, s in outputs],
+		initializers)
+	m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+	m.ir_version = 8
+	with open(filename, 'wb') as f:
+		f.write(m.SerializeToString())
+	return ort.InferenceSession(m.SerializeToString())
+
+def write_array(name, a):
+	values = ", ".join("%.9gf" % v for v in a.flatten())
+	header.write("static const float %s[%d] = { %s };\n" % (name, a.size, values))
+
+# Shape variants ('-V'): the batch N is 2 or 4
+sess = save_model("variants.onnx", [
+		helper.make_node('MatMul', ['X', 'W'], ['m']),
+		helper.make_node('Tanh', ['m'], ['Y']),
+	],
+	[('X', ['N', 4])], [('Y', ['N', 3])],
+	[weights('W', [4,3])])
+for n in [2, 4]:
+	x = np.random.randn(n, 4).astype(np.float32)
+	write_array("variants_x%d" % n, x)
+	write_array("variants_y%d" % n, sess.run(None, {'X': x})[0])
+
+# Several models ('onnx2c model_a.onnx model_b.onnx'): the same W is in
+# both, and is printed once. Each model has also a weight of its own.
+W = weights('W', [4,3])
+sess_a = save_model("model_a.onnx", [
+		helper.make_node('MatMul', ['X', 'W'], ['m']),
+		helper.make_node('Add', ['m', 'B'], ['Y']),
+	],
+	[('X', [2, 4])], [('Y', [2, 3])],
+	[W, weights('B', [3])])
+sess_b = save_model("model_b.onnx", [
+		helper.make_node('MatMul', ['X', 'W'], ['m']),
+		helper.make_node('Mul', ['m', 'S'], ['Y']),
+	],
+	[('X', [2, 4])], [('Y', [2, 3])],
+	[W, weights('S', [3])])
+x = np.random.randn(2, 4).astype(np.float32)
+write_array("models_x", x)
+write_array("model_a_y", sess_a.run(None, {'X': x})[0])
+write_array("model_b_y", sess_b.run(None, {'X': x})[0])
+
+header.close()
@@ -0,0 +1,8 @@
+/* Generated with models.py */
+static const float variants_x2[8] = { 0.689517736f, 0.410589665f, -0.564978421f, 0.599390686f, -0.1629363f, 1.60021448f, 0.681627214f, 0.0148801012f };
+static const float variants_y2[6] = { -0.0859947428f, 0.677779198f, -0.418855906f, -0.906244457f, -0.39925015f, -0.995049536f };
+static const float variants_x4[16] = { -0.0877796337f, -0.982117832f, 0.121690482f, -1.13743734f, 0.34900257f, -1.85851312f, -1.16718185f, 1.42489684f, 1.49656534f, 1.28993201f, -1.81174529f, -1.49830723f, -1.45014322f, -1.6939069f, 0.227264032f, -0.489734709f };
+static const float variants_y4[12] = { 0.728599608f, -0.16385521f, 0.862903476f, 0.89117521f, 0.581282318f, 0.99943471f, 0.918687463f, 0.995808959f, -0.986279547f, 0.858040333f, -0.77789408f, 0.994751513f };
+static const float models_x[8] = { -0.191305384f, 1.28725755f, -0.246883944f, 0.342551082f, 0.222717047f, 0.681593716f, 0.2514489f, -1.48184896f };
+static const float model_a_y[6] = { 2.51459026f, 2.4966464f, 0.826604128f, -0.705840588f, 3.02348995f, 1.42365897f };
+static const float model_b_y[6] = { 0.620158374f, 1.45324814f, 1.57559657f, -0.0873317346f, 2.4515214f, 0.758766234f };
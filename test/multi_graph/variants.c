@@ -0,0 +1,37 @@
+/* Shape variants ('-V'): entry() runs the variant of the given
+ * batch size, and returns -1 for a size there is no variant of. */
+#include <math.h>
+#include <stdint.h>
+#include "reference.h"
+
+int entry(uint32_t N, const float *tensor_X, float *tensor_Y);
+
+static int check(const float *result, const float *reference, int size)
+{
+	for( int i=0; i<size; i++ ) {
+		if( isnan(result[i]) )
+			return 1;
+		if( fabs(result[i] - reference[i]) > 1e-5 )
+			return 1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	float y[4*3];
+
+	if( entry(2, variants_x2, y) != 0 )
+		return 1;
+	if( check(y, variants_y2, 2*3) )
+		return 1;
+
+	if( entry(4, variants_x4, y) != 0 )
+		return 1;
+	if( check(y, variants_y4, 4*3) )
+		return 1;
+
+	if( entry(3, variants_x4, y) != -1 )
+		return 1;
+	return 0;
+}
@@ -10,10 +10,12 @@
 
 #include <iostream>
 #include <fstream>
+#include <map>
 
 #include "graph.h"
 #include "onnx.pb.h"
 #include "options.h"
+#include "quantization.h"
 #include "tensor.h"
 
 #include <google/protobuf/io/coded_stream.h>
@@ -64,14 +66,95 @@ int main(int argc, char *argv[])
 {
 	if( argc < 4 ) {
 		std::cerr << "Usage:" << std::endl;
-		std::cerr << "./onnx_backend_tests_runner <directory> <accuracy> <test_data_set>" << std::endl;
+		std::cerr << "./onnx_backend_tests_runner <directory> <accuracy> <test_data_set> [option=value]..." << std::endl;
 		std::cerr << std::endl;
 		std::cerr << " <directory> is the directory that contains the test - i.e. 'model.onnx' and test_data_set_0" << std::endl;
 		std::cerr << " <accuracy> floating point value: the maximum allowed difference between result and refrence. Use decimal dot, not comma!"<< std::endl;
 		std::cerr << " <test_data_set> integer value: select the test dataset to run this test against. (Most tests have only 0)" << std::endl;
+		std::cerr << " [option=value]... onnx2c options to generate the graph with. Available:" << std::endl;
+		std::cerr << "    simd=<isa>  (see onnx2c '--simd')" << std::endl;
+		std::cerr << "    align=1     (see onnx2c optimization pass 'align')" << std::endl;
+		std::cerr << "    flat=1      (see onnx2c '--flat-pointers')" << std::endl;
+		std::cerr << "    avr=1       (see onnx2c '--avr'. Compile with an <avr/pgmspace.h> for the host)" << std::endl;
+		std::cerr << "    qdq=0       (disable onnx2c optimization pass 'qdq')" << std::endl;
+		std::cerr << "    thresholds=0 (disable onnx2c optimization pass 'thresholds')" << std::endl;
+		std::cerr << "    dedup=0     (disable onnx2c optimization pass 'dedup')" << std::endl;
+		std::cerr << "    argmax=0    (disable onnx2c optimization pass 'argmax')" << std::endl;
+		std::cerr << "    attention=0 (disable onnx2c optimization pass 'attention')" << std::endl;
+		std::cerr << "    schedule=0 (disable onnx2c optimization pass 'schedule')" << std::endl;
+		std::cerr << "    lstm=0      (disable onnx2c optimization pass 'lstm')" << std::endl;
+		std::cerr << "    pack=1      (see onnx2c '--pack-weights')" << std::endl;
+		std::cerr << "    weights=<type> (see onnx2c '--weights')" << std::endl;
+		std::cerr << "    sparse=<fraction> (see onnx2c '--sparse')" << std::endl;
+		std::cerr << "    inline=<count> (see onnx2c '--inline-weights')" << std::endl;
+		std::cerr << "    stream=1    (see onnx2c '--stream')" << std::endl;
+		std::cerr << "    fastmath=1  (see onnx2c '--fastmath')" << std::endl;
+		std::cerr << "    tile=<layers>[:<rows>] (see onnx2c '--tile')" << std::endl;
+		std::cerr << "    runtime=<dim>:<max> (see onnx2c '-r'. The run time size is that of the test data)" << std::endl;
+		std::cerr << "    ranges=<file> (see onnx2c '-q --quant-ranges'. Inputs are quantized and outputs dequantized for the test)" << std::endl;
 		exit(1);
 	}
 
+	for( int a=4; a<argc; a++ ) {
+		std::string opt(argv[a]);
+		if( opt.substr(0, 5) == "simd=" )
+			options.simd = opt.substr(5);
+		else if( opt == "align=1" )
+			options.opt_align = true;
+		else if( opt == "flat=1" )
+			options.flat_pointers = true;
+		else if( opt == "avr=1" )
+			options.target_avr = true;
+		else if( opt == "qdq=0" )
+			options.opt_qdq = false;
+		else if( opt == "thresholds=0" )
+			options.opt_thresholds = false;
+		else if( opt == "dedup=0" )
+			options.opt_dedup = false;
+		else if( opt == "argmax=0" )
+			options.opt_argmax = false;
+		else if( opt == "attention=0" )
+			options.opt_attention = false;
+		else if( opt == "schedule=0" )
+			options.opt_schedule = false;
+		else if( opt == "lstm=0" )
+			options.opt_lstm = false;
+		else if( opt == "pack=1" )
+			options.pack_weights = true;
+		else if( opt.substr(0, 8) == "weights=" )
+			options.weight_type = opt.substr(8);
+		else if( opt.substr(0, 7) == "sparse=" )
+			options.sparse_weights = std::stof(opt.substr(7));
+		else if( opt.substr(0, 7) == "inline=" )
+			options.inline_weights = std::stoi(opt.substr(7));
+		else if( opt == "stream=1" )
+			options.stream = true;
+		else if( opt == "fastmath=1" )
+			options.fastmath = true;
+		else if( opt.substr(0, 5) == "tile=" ) {
+			size_t delim_pos = opt.find(':');
+			options.tile_layers = std::stoi(opt.substr(5, delim_pos-5));
+			if( delim_pos != std::string::npos )
+				options.tile_rows = std::stoi(opt.substr(delim_pos+1));
+		}
+		else if( opt.substr(0, 8) == "runtime=" ) {
+			size_t delim_pos = opt.find(':');
+			if( delim_pos == std::string::npos ) {
+				std::cerr << "Bad option " << opt << std::endl;
+				exit(1);
+			}
+			options.runtime_dims[opt.substr(8, delim_pos-8)] = std::stoul(opt.substr(delim_pos+1));
+		}
+		else if( opt.substr(0, 7) == "ranges=" ) {
+			options.quantize = true;
+			load_quant_ranges(opt.substr(7));
+		}
+		else {
+			std::cerr << "Unknown option " << opt << std::endl;
+			exit(1);
+		}
+	}
+
 	options.logging_level = 1;
 	AixLog::Log::init<AixLog::SinkCerr>(AixLog::Severity::error);
 
@@ -143,13 +226,44 @@ int main(int argc, char *argv[])
 	// can mark IO tensors as 'initialized'.
 	// This helps with unittests where the node expects input to be
 	// a compile time constant (e.g. Unsqueeze)
+	// Quantized graphs take their inputs at the calibrated scale, so don't.
+	// Nor do graphs with run time dimensions: their inputs are smaller than the maximum.
 	std::vector <Tensor *> tensors_to_parser;
-	for( auto i : inputs) tensors_to_parser.push_back(i);
+	if( quantization_calibrated() == false && options.runtime_dims.size() == 0 )
+		for( auto i : inputs) tensors_to_parser.push_back(i);
 
 	onnx_model.ParseFromIstream(&model_ifs);
+	if( options.opt_qdq )
+		Graph::fuse_qdq(onnx_model);
+	if( options.opt_thresholds )
+		Graph::fuse_thresholds(onnx_model);
+	if( options.opt_attention )
+		Graph::fuse_attention(onnx_model);
+	if( options.opt_argmax )
+		Graph::skip_softmax(onnx_model);
+	if( options.opt_dedup )
+		Graph::dedup_initializers({&onnx_model});
 	Graph toCgraph(onnx_model, tensors_to_parser);
+	if( options.opt_lstm )
+		toCgraph.prepack_lstm();
+	if( options.opt_thresholds )
+		toCgraph.integer_thresholds();
 	std::cout.precision(20);
+	if( options.inline_weights > 0 )
+		toCgraph.inline_weights();
+	if( options.sparse_weights > 0 )
+		toCgraph.sparse_weights();
+	if( options.pack_weights )
+		toCgraph.pack_weights();
+	if( options.weight_type != "" )
+		toCgraph.store_weights_16bit();
+	if( options.tile_layers > 0 )
+		toCgraph.tile_layers();
+	if( options.opt_schedule )
+		toCgraph.schedule_nodes();
 	toCgraph.unionize_tensors();
+	if( options.opt_restrict )
+		toCgraph.mark_restrict_params();
 	toCgraph.print_source(std::cout);
 
 
@@ -160,14 +274,56 @@ int main(int argc, char *argv[])
 	std::cout << "/////////////////////////////////////"<<std::endl;
 	std::cout << std::endl << std::endl;
 
-	for( auto i : inputs) {
+	// The run time sizes of the run time dimensions, from the test data of the
+	// graph inputs that have them outermost. These inputs and the outputs are
+	// allocated for the maximum, to check that the rows past the run time size
+	// are not written.
+	std::vector<std::string> runtime_sizes;
+	// maximum size of the inputs that have a run time dimension, by input number
+	std::map<unsigned, int> runtime_inputs;
+	for( auto d : toCgraph.runtime_dims() ) {
+		std::string size;
+		unsigned i=0;
+		for( auto &vi : onnx_model.graph().input() ) {
+			if( i >= inputs.size() )
+				break;
+			if( vi.type().tensor_type().shape().dim_size() && vi.type().tensor_type().shape().dim(0).dim_param() == d ) {
+				size = std::to_string(inputs[i]->data_dim[0]);
+				runtime_inputs[i] = options.runtime_dims[d];
+			}
+			i++;
+		}
+		if( size == "" )
+			ERROR("No test input has the run time dimension " << d);
+		runtime_sizes.push_back(size);
+	}
+	for( unsigned n=0; n<inputs.size(); n++ ) {
+		Tensor *i = inputs[n];
+		const Tensor *data = i;
+		if( quantization_calibrated() ) {
+			Tensor *q = i->make_quantized_copy();
+			q->quantize_with_scales(-1, { quant_scale_from_range(i->name) }, onnx::TensorProto_DataType_INT8);
+			data = q;
+		}
 		std::cout << "static ";
-		i->print_tensor(std::cout, false, i->cname());
+		if( runtime_inputs.count(n) ) {
+			// The rows past the test data are zero
+			int rows = i->data_dim[0];
+			i->data_dim[0] = runtime_inputs[n];
+			i->print_tensor(std::cout, false, i->cname());
+			i->data_dim[0] = rows;
+		}
+		else
+			data->print_tensor(std::cout, false, i->cname());
 		std::cout << " = ";
-		i->print_tensor_initializer(std::cout);
+		data->print_tensor_initializer(std::cout);
 		std::cout << ";" << std::endl;
 	}
 	for( auto o : outputs) {
+		if( quantization_calibrated() )
+			o->data_type = onnx::TensorProto_DataType_INT8;
+		if( runtime_sizes.size() )
+			o->data_dim[0] = options.runtime_dims.begin()->second;
 		std::cout << "static ";
 		o->print_tensor(std::cout, false, o->cname());
 		std::cout << ";" << std::endl;
@@ -185,9 +341,18 @@ int main(int argc, char *argv[])
 
 	std::cout <<         "int main(void) {" << std::endl;
 
+	for( auto o : outputs )
+		if( runtime_sizes.size() )
+			std::cout << "\t" << "memset(" << o->cname() << ", 0xff, sizeof(" << o->cname() << "));" << std::endl;
+
 	// run inference on the network
 	std::cout << "\t"<<  "entry(";
 	bool isfirst = true;
+	for( auto s : runtime_sizes ) {
+		if( isfirst ) isfirst=false;
+		else          std::cout << ", ";
+		std::cout << s;
+	}
 	for( auto i : inputs) {
 //		if( i-> isAliasOf )
 //			continue;
@@ -216,16 +381,29 @@ int main(int argc, char *argv[])
 		std::string refname = "reference_" + r->cname();
 		std::string type = r->data_type_str();
 
-		std::cout << "\t\t" << type << " *result = (" << type << "*)" << outname << ";" << std::endl;
 		std::cout << "\t\t" << type << " *reference = (" << type << "*)" << refname << ";" << std::endl;
 
+		if( quantization_calibrated() ) {
+			// Compare the dequantized result
+			std::cout << "\t\t" << "int8_t *result = (int8_t*)" << outname << ";" << std::endl;
+			std::cout << "\t\t" << "for(uint64_t i = 0; i< (sizeof(" << refname << ") / sizeof("<<type<<")); i++) {" << std::endl;
+			std::cout << "\t\t\t" << "if( fabs(result[i]*" << quant_scale_from_range(o->name) << "-reference[i]) > " << test_accuracy << " )" <<std::endl;
+			std::cout << "\t\t\t\t" << "return 1;" << std::endl;
+			std::cout << "\t\t}" << std::endl;
+			std::cout << "\t}" << std::endl;
+			continue;
+		}
+		std::cout << "\t\t" << type << " *result = (" << type << "*)" << outname << ";" << std::endl;
+
 		// Check result and reference, elementvise
 		std::cout << "\t\t" << "for(uint64_t i = 0; i< (sizeof(" << refname << ") / sizeof("<<type<<")); i++) {" << std::endl;
-		if( type == "float" || type == "double" ) {
-			std::cout << "\t\t\t" << "if( fabs(result[i]-reference[i]) > " << test_accuracy << " )" <<std::endl;
+		if( isFloat(r->data_type) ) {
+			// 16 bit floats are compared as float
+			std::string cast = type == "float" || type == "double" ? "" : "(float)";
+			std::cout << "\t\t\t" << "if( fabs(" << cast << "result[i]-" << cast << "reference[i]) > " << test_accuracy << " )" <<std::endl;
 			std::cout << "\t\t\t\t" << "return 1;" << std::endl;
 			// fabs(nan) > 0.1 always false - and out-of-bounds indexing is a likely bug and source of nans
-			std::cout << "\t\t\t" << "if(isnan(result[i]) || isnan(reference[i]))" << std::endl;
+			std::cout << "\t\t\t" << "if(isnan(" << cast << "result[i]) || isnan(" << cast << "reference[i]))" << std::endl;
 			std::cout << "\t\t\t\t" << "return 1;" << std::endl;
 		}
 		else if(   type == "int8_t"
@@ -244,6 +422,12 @@ int main(int argc, char *argv[])
 		else
 			ERROR("unimplemented type");
 		std::cout << "\t}" << std::endl;
+		if( runtime_sizes.size() ) {
+			// Past the run time size, the output is as it was before entry()
+			std::cout << "\t\t" << "for(uint64_t i = sizeof(" << refname << "); i< sizeof(" << outname << "); i++)" << std::endl;
+			std::cout << "\t\t\t" << "if( ((uint8_t*)" << outname << ")[i] != 0xff )" << std::endl;
+			std::cout << "\t\t\t\t" << "return 1;" << std::endl;
+		}
 	std::cout << "\t}" << std::endl;
 	}
 
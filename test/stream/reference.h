@@ -0,0 +1,6 @@
+/* Generated with stream.py */
+#define FRAMES 6
+#define INPUT_SIZE 3
+#define HIDDEN_SIZE 4
+static const float stream_x[18] = { -0.680024743f, 0.2322537f, 0.293072462f, -0.714351416f, 1.86577451f, 0.473832935f, -1.19130349f, 0.656553626f, -0.974681675f, 0.787084579f, 1.15859556f, -0.820682347f, 0.963376105f, 0.412780941f, 0.822060168f, 1.89679301f, -0.24538812f, -0.753736138f };
+static const float stream_y[24] = { 0.035582561f, 0.123322301f, -0.0204569828f, 0.364474565f, -0.024230117f, 0.18421866f, -0.14356406f, 0.0760174692f, -0.06298998f, 0.220460936f, -0.187534302f, -0.0693372339f, -0.0369865671f, 0.144863337f, -0.148857415f, -0.389052272f, -0.0419201367f, 0.20188655f, -0.409467459f, -0.0722756982f, 0.221156269f, 0.22089909f, -0.311579227f, -0.400943488f };
@@ -0,0 +1,63 @@
+/* Streaming ('--stream'): an LSTM run one frame per call gives the
+ * same outputs as over the whole sequence at once. get_state() and
+ * set_state() go back to an earlier point of the stream, and
+ * reset_state() to its start. */
+#include <math.h>
+#include <string.h>
+#include "reference.h"
+
+void entry(const float tensor_X[1][1][INPUT_SIZE], float tensor_Y_h[1][1][HIDDEN_SIZE]);
+void reset_state(void);
+void get_state(void *state);
+void set_state(const void *state);
+
+/* The hidden and the cell state */
+#define STATE_SIZE (2*HIDDEN_SIZE*sizeof(float))
+
+/* Run frames first..last-1, and check the outputs */
+static int run_frames(int first, int last)
+{
+	for( int t=first; t<last; t++ ) {
+		float y[1][1][HIDDEN_SIZE];
+		entry((const float (*)[1][INPUT_SIZE])&stream_x[t*INPUT_SIZE], y);
+		for( int h=0; h<HIDDEN_SIZE; h++ ) {
+			if( isnan(y[0][0][h]) )
+				return 1;
+			if( fabs(y[0][0][h] - stream_y[t*HIDDEN_SIZE+h]) > 1e-5 )
+				return 1;
+		}
+	}
+	return 0;
+}
+
+int main(void)
+{
+	unsigned char start[STATE_SIZE], middle[STATE_SIZE], end[STATE_SIZE];
+
+	get_state(start);
+	if( run_frames(0, FRAMES/2) )
+		return 1;
+	get_state(middle);
+	if( run_frames(FRAMES/2, FRAMES) )
+		return 1;
+	get_state(end);
+
+	// Back to the middle of the stream
+	set_state(middle);
+	if( run_frames(FRAMES/2, FRAMES) )
+		return 2;
+	// get_state() after set_state() gives the state that was set
+	set_state(middle);
+	get_state(end);
+	if( memcmp(middle, end, STATE_SIZE) )
+		return 2;
+
+	// Back to the start
+	reset_state();
+	get_state(end);
+	if( memcmp(start, end, STATE_SIZE) )
+		return 3;
+	if( run_frames(0, FRAMES) )
+		return 3;
+	return 0;
+}
@@ -0,0 +1,63 @@
+# Generate the model of the streaming test, and reference.h with
+# its test data. Run in this directory.
+#
+# stream.onnx is an LSTM that takes one frame per call. The reference
+# is the output of the same LSTM over the whole sequence at once.
+
+import numpy as np
+import onnxruntime as ort
+from onnx import helper, numpy_helper, TensorProto
+
+np.random.seed(42)
+input_size = 3
+hidden_size = 4
+frames = 6
+
+def weights(name, shape):
+	return numpy_helper.from_array(np.random.randn(*shape).astype(np.float32) * 0.5, name)
+
+def lstm_model(seq_length):
+	g = helper.make_graph([
+			helper.make_node('LSTM', ['X', 'W', 'R', 'B', '', 'initial_h', 'initial_c'], ['Y', 'Y_h'],
+				hidden_size=hidden_size),
+		],
+		"stream",
+		[helper.make_tensor_value_info('X', TensorProto.FLOAT, [seq_length, 1, input_size])],
+		[helper.make_tensor_value_info('Y', TensorProto.FLOAT, [seq_length, 1, 1, hidden_size]),
+		 helper.make_tensor_value_info('Y_h', TensorProto.FLOAT, [1, 1, hidden_size])],
+		initializers)
+	m = helper.make_model(g, opset_imports=[helper.make_opsetid("", 13)])
+	m.ir_version = 8
+	return m
+
+# A non-zero initial state, that reset_state() must return to
+initializers = [
+	weights('W', [1, 4*hidden_size, input_size]),
+	weights('R', [1, 4*hidden_size, hidden_size]),
+	weights('B', [1, 8*hidden_size]),
+	weights('initial_h', [1, 1, hidden_size]),
+	weights('initial_c', [1, 1, hidden_size]),
+]
+
+frame_model = lstm_model(1)
+# onnx2c prints only the outputs the graph has
+del frame_model.graph.output[0]
+with open("stream.onnx", 'wb') as f:
+	f.write(frame_model.SerializeToString())
+
+x = np.random.randn(frames, 1, input_size).astype(np.float32)
+sess = ort.InferenceSession(lstm_model(frames).SerializeToString())
+y = sess.run(None, {'X': x})[0]
+
+def write_array(name, a):
+	values = ", ".join("%.9gf" % v for v in a.flatten())
+	header.write("static const float %s[%d] = { %s };\n" % (name, a.size, values))
+
+header = open("reference.h", "w")
+header.write("/* Generated with stream.py */\n")
+header.write("#define FRAMES %d\n" % frames)
+header.write("#define INPUT_SIZE %d\n" % input_size)
+header.write("#define HIDDEN_SIZE %d\n" % hidden_size)
+write_array("stream_x", x)
+write_array("stream_y", y)
+header.close()